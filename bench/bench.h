@@ -0,0 +1,26 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+/* Results go to stdout as one JSON object per line, see bench_report() */
+extern uint64 bench_now_ns();
+extern void bench_report(const char *p_suite, const char *p_name, const uint32 iterations_u32, const uint64 elapsed_ns_u64);
+
+extern volatile uint32 bench_sink_u32; /* keeps the compiler from optimizing benchmarked work away */
+
+/*****************************************************************************/
+
+extern void bench_core();
+extern void bench_events();
+extern void bench_scheduler();
+extern void bench_deskcontrol();
+extern void bench_log();
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,69 @@
+#include "bench.h"
+
+/*****************************************************************************/
+
+#define BENCH_CORE_TIMES 1024U /* power of two, cycled through so the inputs are not constant */
+
+/*****************************************************************************/
+
+const uint32 BENCH_CORE_ITERATIONS_U32 = 1000000U;
+
+/*****************************************************************************/
+
+TIME bench_core_times[BENCH_CORE_TIMES];
+uint32 bench_core_seconds_vu32[BENCH_CORE_TIMES];
+
+/*****************************************************************************/
+
+void bench_core_prepare()
+{
+    uint32 random_u32 = 0x12345678U;
+
+    for (uint16 i = 0U; i < BENCH_CORE_TIMES; ++i)
+    {
+        /* Numerical Recipes LCG, reproducible across runs */
+        random_u32 = (random_u32 * 1664525U) + 1013904223U;
+        bench_core_times[i].hour_u8 = (uint8)((random_u32 >> 8) % 24U);
+        bench_core_times[i].minute_u8 = (uint8)((random_u32 >> 16) % 60U);
+        bench_core_times[i].second_u8 = (uint8)((random_u32 >> 24) % 60U);
+        bench_core_seconds_vu32[i] = random_u32 % 86400U;
+    }
+}
+
+/*****************************************************************************/
+
+void bench_core()
+{
+    TIME time_out;
+    uint32 sum_u32 = 0U;
+    uint64 start_ns_u64;
+
+    bench_core_prepare();
+
+    start_ns_u64 = bench_now_ns();
+    for (uint32 i = 0U; i < BENCH_CORE_ITERATIONS_U32; ++i)
+    {
+        sum_u32 += (uint32)time_to_seconds(&bench_core_times[i & (BENCH_CORE_TIMES - 1U)]);
+    }
+    bench_report("core", "time_to_seconds", BENCH_CORE_ITERATIONS_U32, bench_now_ns() - start_ns_u64);
+
+    start_ns_u64 = bench_now_ns();
+    for (uint32 i = 0U; i < BENCH_CORE_ITERATIONS_U32; ++i)
+    {
+        sum_u32 += (uint32)time_diff(&bench_core_times[i & (BENCH_CORE_TIMES - 1U)], &bench_core_times[(i + 1U) & (BENCH_CORE_TIMES - 1U)]);
+    }
+    bench_report("core", "time_diff", BENCH_CORE_ITERATIONS_U32, bench_now_ns() - start_ns_u64);
+
+    /* Up to a day ahead, so about half of them carry over into the next day */
+    start_ns_u64 = bench_now_ns();
+    for (uint32 i = 0U; i < BENCH_CORE_ITERATIONS_U32; ++i)
+    {
+        sum_u32 += time_add(&bench_core_times[i & (BENCH_CORE_TIMES - 1U)], &time_out, bench_core_seconds_vu32[(i + 1U) & (BENCH_CORE_TIMES - 1U)]);
+        sum_u32 += time_out.second_u8;
+    }
+    bench_report("core", "time_add", BENCH_CORE_ITERATIONS_U32, bench_now_ns() - start_ns_u64);
+
+    bench_sink_u32 += sum_u32;
+}
+
+/*****************************************************************************/
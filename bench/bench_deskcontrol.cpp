@@ -0,0 +1,121 @@
+#include "bench.h"
+
+#include <SoftwareSerial.h>
+
+#include "deskcontrol.h"
+#include "events.h"
+#include "log.h"
+
+/*****************************************************************************/
+
+#define BENCH_DESK_FRAME_SIZE 9U
+#define BENCH_DESK_FRAMES 4096U
+
+/*****************************************************************************/
+
+/* Internal to deskcontrol, the I/O hook that reads the serial port */
+extern void dc_handle_serial();
+
+/*****************************************************************************/
+
+const uint32 BENCH_DESK_ROUNDS_U32 = 50U;
+
+/*****************************************************************************/
+
+uint8 bench_desk_stream_vu8[BENCH_DESK_FRAMES * BENCH_DESK_FRAME_SIZE];
+
+/*****************************************************************************/
+
+/* Same encoding as the controller's display, see host/arduino/SoftwareSerial.cpp */
+void bench_desk_frame(uint8 *p_frame, const uint16 height_mm_u16)
+{
+    const uint8 SEGMENTS_VU8[10] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+    const uint8 FRAME_VU8[BENCH_DESK_FRAME_SIZE] = {0x9b, 0x07, 0x12, 0x00, 0x00, 0x00, 0x55, 0xaa, 0x9d};
+
+    (void)memcpy(p_frame, FRAME_VU8, sizeof(FRAME_VU8));
+    if (height_mm_u16 >= 1000U)
+    {
+        p_frame[3U] = SEGMENTS_VU8[(height_mm_u16 / 1000U) % 10U];
+        p_frame[4U] = SEGMENTS_VU8[(height_mm_u16 / 100U) % 10U];
+        p_frame[5U] = SEGMENTS_VU8[(height_mm_u16 / 10U) % 10U];
+    }
+    else if (height_mm_u16 > 0U)
+    {
+        p_frame[3U] = SEGMENTS_VU8[(height_mm_u16 / 100U) % 10U];
+        p_frame[4U] = SEGMENTS_VU8[(height_mm_u16 / 10U) % 10U] | 0x80U;
+        p_frame[5U] = SEGMENTS_VU8[height_mm_u16 % 10U];
+    }
+    else
+    {
+        /* Blank display, the sign-off */
+    }
+}
+
+void bench_desk_run(const char *p_name, const uint32 units_u32, const uint32 frames_u32)
+{
+    const uint32 frames_before_u32 = dc_get_stats()->frames_u32;
+    uint64 start_ns_u64;
+    uint64 elapsed_ns_u64 = 0U;
+
+    for (uint32 i = 0U; i < BENCH_DESK_ROUNDS_U32; ++i)
+    {
+        host_serial_replay(bench_desk_stream_vu8, sizeof(bench_desk_stream_vu8));
+        start_ns_u64 = bench_now_ns();
+        dc_handle_serial();
+        elapsed_ns_u64 += bench_now_ns() - start_ns_u64;
+    }
+
+    bench_report("deskcontrol", p_name, BENCH_DESK_ROUNDS_U32 * units_u32, elapsed_ns_u64);
+    if ((dc_get_stats()->frames_u32 - frames_before_u32) != (BENCH_DESK_ROUNDS_U32 * frames_u32))
+    {
+        fprintf(stderr, "deskcontrol: %s parsed %u frames instead of %u\n", p_name,
+                (unsigned)(dc_get_stats()->frames_u32 - frames_before_u32), (unsigned)(BENCH_DESK_ROUNDS_U32 * frames_u32));
+    }
+    bench_sink_u32 += dc_get_current_height();
+}
+
+/*****************************************************************************/
+
+void bench_deskcontrol()
+{
+    uint32 random_u32 = 0x9e3779b9U;
+
+    /* Heights are parsed and published, the log line about it is filtered at runtime */
+    ev_init();
+    log_set_global_level(LOG_LEVEL_WARNING);
+    dc_set_params(1150U, 750U, 20U);
+
+    /* The desk standing still, one report after the other with the same height */
+    for (uint16 i = 0U; i < BENCH_DESK_FRAMES; ++i)
+    {
+        bench_desk_frame(&bench_desk_stream_vu8[i * BENCH_DESK_FRAME_SIZE], 1150U);
+    }
+    bench_desk_run("frames_idle", BENCH_DESK_FRAMES, BENCH_DESK_FRAMES);
+
+    /* Moving between sitting and standing, every frame is a new height and some a new state */
+    for (uint16 i = 0U; i < BENCH_DESK_FRAMES; ++i)
+    {
+        const uint16 step_u16 = i % 1000U;
+
+        bench_desk_frame(&bench_desk_stream_vu8[i * BENCH_DESK_FRAME_SIZE], (uint16)(650U + ((step_u16 < 500U) ? step_u16 : (1000U - step_u16))));
+    }
+    bench_desk_run("frames_moving", BENCH_DESK_FRAMES, BENCH_DESK_FRAMES);
+
+    /* The desk going to sleep over and over */
+    for (uint16 i = 0U; i < BENCH_DESK_FRAMES; ++i)
+    {
+        bench_desk_frame(&bench_desk_stream_vu8[i * BENCH_DESK_FRAME_SIZE], 0U);
+    }
+    bench_desk_run("frames_sign_off", BENCH_DESK_FRAMES, BENCH_DESK_FRAMES);
+
+    /* Line noise without start bytes, every byte goes into the buffer and nothing is parsed */
+    for (uint32 i = 0U; i < sizeof(bench_desk_stream_vu8); ++i)
+    {
+        random_u32 = (random_u32 * 1664525U) + 1013904223U;
+        bench_desk_stream_vu8[i] = (uint8)(random_u32 >> 24);
+        bench_desk_stream_vu8[i] = ((bench_desk_stream_vu8[i] == 0x9bU) || (bench_desk_stream_vu8[i] == 0x9dU)) ? 0x55U : bench_desk_stream_vu8[i];
+    }
+    bench_desk_run("noise_bytes", sizeof(bench_desk_stream_vu8), 0U);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,59 @@
+#include "bench.h"
+
+#include "events.h"
+
+/*****************************************************************************/
+
+const uint32 BENCH_EVENTS_ITERATIONS_U32 = 100000U;
+
+/*****************************************************************************/
+
+void bench_events_receiver(const EVENT *p_event)
+{
+    bench_sink_u32 += p_event->data.height_u16;
+}
+
+/*****************************************************************************/
+
+void bench_events()
+{
+    const uint16 FANOUTS_VU16[] = {0U, 1U, 8U, 64U, EV_MAX_SUBSCRIBERS};
+    char name_str[48];
+    EVENT event;
+    uint64 start_ns_u64;
+    uint64 elapsed_ns_u64;
+
+    for (uint8 i = 0U; i < (sizeof(FANOUTS_VU16) / sizeof(FANOUTS_VU16[0U])); ++i)
+    {
+        if (FANOUTS_VU16[i] > EV_MAX_SUBSCRIBERS)
+        {
+            continue;
+        }
+
+        ev_init();
+        for (uint16 j = 0U; j < FANOUTS_VU16[i]; ++j)
+        {
+            (void)ev_subscribe(EV_HEIGHT_CHANGED, bench_events_receiver);
+        }
+
+        event.type_e = EV_HEIGHT_CHANGED;
+        start_ns_u64 = bench_now_ns();
+        for (uint32 k = 0U; k < BENCH_EVENTS_ITERATIONS_U32; ++k)
+        {
+            event.data.height_u16 = (uint16)k;
+            ev_publish(&event);
+        }
+        elapsed_ns_u64 = bench_now_ns() - start_ns_u64;
+
+        /* Cost per publish call and per delivered event */
+        snprintf(name_str, sizeof(name_str), "publish_fanout_%u", (unsigned)FANOUTS_VU16[i]);
+        bench_report("events", name_str, BENCH_EVENTS_ITERATIONS_U32, elapsed_ns_u64);
+        if (FANOUTS_VU16[i] > 0U)
+        {
+            snprintf(name_str, sizeof(name_str), "delivery_fanout_%u", (unsigned)FANOUTS_VU16[i]);
+            bench_report("events", name_str, BENCH_EVENTS_ITERATIONS_U32 * FANOUTS_VU16[i], elapsed_ns_u64);
+        }
+    }
+}
+
+/*****************************************************************************/
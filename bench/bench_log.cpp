@@ -0,0 +1,116 @@
+#include "bench.h"
+
+#include "log.h"
+
+/*****************************************************************************/
+
+/* Internal to the log, formats the next recorded message like the drain task does */
+extern bool log_next_line();
+
+/*****************************************************************************/
+
+typedef void (*fn_bench_log_call)(const uint32 i_u32);
+
+/*****************************************************************************/
+
+const uint32 BENCH_LOG_BATCHES_U32 = 20000U;
+const uint32 BENCH_LOG_BATCH_SIZE_U32 = 16U; /* always fits into the ring */
+const char bench_log_module_str[] PROGMEM = "Bench";
+
+/*****************************************************************************/
+
+void bench_log_sink(const LOG_LEVEL level_e, const char *p_line, const uint16 size_u16)
+{
+    bench_sink_u32 += size_u16;
+}
+
+void bench_log_plain(const uint32 i_u32)
+{
+    log_msg(LOG_LEVEL_INFO, bench_log_module_str, "Received sign-off, screen is inactive again.");
+}
+
+void bench_log_int(const uint32 i_u32)
+{
+    log_msg(LOG_LEVEL_INFO, bench_log_module_str, "Got height: %i cm.", (int)(700U + (i_u32 % 500U)));
+}
+
+void bench_log_three_ints(const uint32 i_u32)
+{
+    log_msg(LOG_LEVEL_INFO, bench_log_module_str, "Time %u:%u:%u", (unsigned)(i_u32 % 24U), (unsigned)(i_u32 % 60U), 30U);
+}
+
+void bench_log_string(const uint32 i_u32)
+{
+    log_msg(LOG_LEVEL_INFO, bench_log_module_str, "Connecting to %s:%u", "192.168.178.10", (unsigned)i_u32);
+}
+
+void bench_log_buffer(const uint32 i_u32)
+{
+    const uint8 FRAME_VU8[7] = {0x07, 0x12, 0x06, 0xcf, 0x6d, 0x55, 0xaa};
+
+    log_buffer(LOG_LEVEL_WARNING, bench_log_module_str, "Unknown message", FRAME_VU8, sizeof(FRAME_VU8));
+}
+
+/* Recording is timed in batches, then each batch is formatted like the drain task does it and timed on its own */
+void bench_log_run(const char *p_name, fn_bench_log_call call)
+{
+    char name_str[48];
+    uint64 write_ns_u64 = 0U;
+    uint64 format_ns_u64 = 0U;
+    uint64 start_ns_u64;
+
+    for (uint32 batch_u32 = 0U; batch_u32 < BENCH_LOG_BATCHES_U32; ++batch_u32)
+    {
+        start_ns_u64 = bench_now_ns();
+        for (uint32 i = 0U; i < BENCH_LOG_BATCH_SIZE_U32; ++i)
+        {
+            call((batch_u32 * BENCH_LOG_BATCH_SIZE_U32) + i);
+        }
+        write_ns_u64 += bench_now_ns() - start_ns_u64;
+
+        start_ns_u64 = bench_now_ns();
+        while (log_next_line())
+        {
+        }
+        format_ns_u64 += bench_now_ns() - start_ns_u64;
+    }
+
+    snprintf(name_str, sizeof(name_str), "write_%s", p_name);
+    bench_report("log", name_str, BENCH_LOG_BATCHES_U32 * BENCH_LOG_BATCH_SIZE_U32, write_ns_u64);
+    snprintf(name_str, sizeof(name_str), "format_%s", p_name);
+    bench_report("log", name_str, BENCH_LOG_BATCHES_U32 * BENCH_LOG_BATCH_SIZE_U32, format_ns_u64);
+}
+
+/*****************************************************************************/
+
+void bench_log()
+{
+    uint64 start_ns_u64;
+
+    log_set_sink(bench_log_sink);
+
+    /* Below the runtime level, only the check is left */
+    log_set_global_level(LOG_LEVEL_INFO);
+    start_ns_u64 = bench_now_ns();
+    for (uint32 i = 0U; i < (BENCH_LOG_BATCHES_U32 * BENCH_LOG_BATCH_SIZE_U32); ++i)
+    {
+        log_msg(LOG_LEVEL_DEBUG, bench_log_module_str, "Filtered %u", i);
+    }
+    bench_report("log", "filtered", BENCH_LOG_BATCHES_U32 * BENCH_LOG_BATCH_SIZE_U32, bench_now_ns() - start_ns_u64);
+
+    log_set_global_level(LOG_LEVEL_DEBUG);
+    bench_log_run("plain", bench_log_plain);
+    bench_log_run("int", bench_log_int);
+    bench_log_run("three_ints", bench_log_three_ints);
+    bench_log_run("string", bench_log_string);
+    bench_log_run("buffer", bench_log_buffer);
+
+    if (log_get_dropped() != 0U)
+    {
+        fprintf(stderr, "log: %u messages dropped, the batches do not fit into the ring\n", (unsigned)log_get_dropped());
+    }
+    log_set_global_level(LOG_LEVEL_SILENT);
+    log_set_sink(NULL);
+}
+
+/*****************************************************************************/
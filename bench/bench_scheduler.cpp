@@ -0,0 +1,61 @@
+#include "bench.h"
+
+#include "log.h"
+#include "scheduler.h"
+
+/*****************************************************************************/
+
+#define BENCH_SCHEDULER_SECONDS_PER_DAY 86400U
+
+/*****************************************************************************/
+
+/* Internal to the scheduler, called for every tick of the clock */
+extern SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_config, const uint16 transition_time_tolerance_u16);
+
+/*****************************************************************************/
+
+const uint32 BENCH_SCHEDULER_DAYS_U32 = 20U;
+const uint16 BENCH_SCHEDULER_TOLERANCE_U16 = 60U;
+
+/*****************************************************************************/
+
+void bench_scheduler_day(const char *p_name, const DAY_CONFIG *p_config)
+{
+    uint32 states_vu32[SC_STATE_STANDING + 1] = {0U};
+    uint64 start_ns_u64;
+    TIME time;
+
+    /* Every second of the day in order, like sc_handle_tick() sees them */
+    start_ns_u64 = bench_now_ns();
+    for (uint32 day_u32 = 0U; day_u32 < BENCH_SCHEDULER_DAYS_U32; ++day_u32)
+    {
+        for (uint32 second_u32 = 0U; second_u32 < BENCH_SCHEDULER_SECONDS_PER_DAY; ++second_u32)
+        {
+            time.hour_u8 = (uint8)(second_u32 / 3600U);
+            time.minute_u8 = (uint8)((second_u32 / 60U) % 60U);
+            time.second_u8 = (uint8)(second_u32 % 60U);
+            states_vu32[sc_determine_state(&time, p_config, BENCH_SCHEDULER_TOLERANCE_U16)] += 1U;
+        }
+    }
+    bench_report("scheduler", p_name, BENCH_SCHEDULER_DAYS_U32 * BENCH_SCHEDULER_SECONDS_PER_DAY, bench_now_ns() - start_ns_u64);
+
+    bench_sink_u32 += states_vu32[SC_STATE_STANDING];
+}
+
+/*****************************************************************************/
+
+void bench_scheduler()
+{
+    const DAY_CONFIG DISABLED = {{8U, 0U, 0U}, {18U, 0U, 0U}, 3600U, 900U, 0};
+    const DAY_CONFIG WORKDAY = {{8U, 0U, 0U}, {18U, 0U, 0U}, 3600U, 900U, 1};
+    const DAY_CONFIG ALL_DAY = {{0U, 0U, 0U}, {23U, 59U, 59U}, 1800U, 600U, 1};
+
+    /* Outside the schedule only the debug message is left, filtered at runtime here */
+    log_set_global_level(LOG_LEVEL_WARNING);
+
+    bench_scheduler_day("determine_state_disabled", &DISABLED);
+    bench_scheduler_day("determine_state_workday", &WORKDAY);
+    bench_scheduler_day("determine_state_all_day", &ALL_DAY);
+}
+
+/*****************************************************************************/
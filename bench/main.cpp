@@ -0,0 +1,77 @@
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+/*****************************************************************************/
+
+typedef struct
+{
+    const char *p_name;
+    void (*run)();
+} BENCH_SUITE;
+
+/*****************************************************************************/
+
+const BENCH_SUITE BENCH_SUITES[] = {
+    {"core", bench_core},
+    {"events", bench_events},
+    {"scheduler", bench_scheduler},
+    {"deskcontrol", bench_deskcontrol},
+    {"log", bench_log}};
+
+/*****************************************************************************/
+
+volatile uint32 bench_sink_u32 = 0U;
+
+/*****************************************************************************/
+
+uint64 bench_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64)ts.tv_sec * 1000000000ULL) + (uint64)ts.tv_nsec;
+}
+
+void bench_report(const char *p_suite, const char *p_name, const uint32 iterations_u32, const uint64 elapsed_ns_u64)
+{
+    const double ns_per_op = (iterations_u32 > 0U) ? ((double)elapsed_ns_u64 / (double)iterations_u32) : 0.0;
+
+    printf("{\"suite\":\"%s\",\"name\":\"%s\",\"iterations\":%u,\"total_ns\":%llu,\"ns_per_op\":%.2f}\n",
+           p_suite, p_name, iterations_u32, (unsigned long long)elapsed_ns_u64, ns_per_op);
+    fflush(stdout);
+}
+
+/*****************************************************************************/
+
+/* Runs the suites given on the command line, all of them without arguments */
+int main(int argc, char **argv)
+{
+    int found_i = 0;
+
+    for (uint8 i = 0U; i < (sizeof(BENCH_SUITES) / sizeof(BENCH_SUITES[0U])); ++i)
+    {
+        bool selected_b = (argc < 2);
+
+        for (int j = 1; j < argc; ++j)
+        {
+            selected_b = selected_b || (strcmp(argv[j], BENCH_SUITES[i].p_name) == 0);
+        }
+
+        if (selected_b)
+        {
+            BENCH_SUITES[i].run();
+            found_i++;
+        }
+    }
+
+    if (found_i == 0)
+    {
+        fprintf(stderr, "No such suite, choose from: core events scheduler deskcontrol log\n");
+        return 1;
+    }
+
+    return 0;
+}
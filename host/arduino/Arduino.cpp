@@ -0,0 +1,260 @@
+#include <Arduino.h>
+#include <flash_hal.h>
+#include <user_interface.h>
+
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+#define HOST_CONT_STACK_SIZE 4096U /* what the ESP8266 core gives loop() */
+#define HOST_CONT_STACKGUARD 0xfeefeffeU
+#define HOST_RTC_USER_SIZE 512U
+
+/*****************************************************************************/
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static uint8_t host_flash_vu8[FS_PHYS_SIZE];
+static bool host_flash_erased_b = false;
+
+/* Painted like the core paints the stack of loop(), NULL if the program has its own main() */
+static volatile uint32_t *host_cont_stack = NULL;
+
+/* Cleared like after a power cycle */
+static uint32_t host_rtc_user_vu32[HOST_RTC_USER_SIZE / 4U];
+static struct rst_info host_reset_info = {REASON_DEFAULT_RST, 0U, 0U, 0U, 0U, 0U, 0U};
+
+/*****************************************************************************/
+
+static uint64_t host_now_us()
+{
+    static uint64_t start_us = 0U;
+    struct timespec ts;
+    uint64_t now_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now_us = ((uint64_t)ts.tv_sec * 1000000U) + ((uint64_t)ts.tv_nsec / 1000U);
+    if (start_us == 0U)
+    {
+        start_us = now_us;
+    }
+
+    return now_us - start_us;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(uint32_t)(host_now_us() / 1000U);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(uint32_t)host_now_us();
+}
+
+void delay(unsigned long ms)
+{
+    usleep(ms * 1000U);
+}
+
+void yield()
+{
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+}
+
+/*****************************************************************************/
+
+/* Weak so that programs with their own main(), like the benchmarks, still link without them */
+extern void setup(void) __attribute__((weak));
+extern void loop(void) __attribute__((weak));
+
+/* Runs the firmware unless the program brings its own main() */
+__attribute__((weak)) int main(int argc, char **argv)
+{
+    volatile uint32_t *p_word;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    /* Everything below our frame is what setup() and loop() get, painted inline as a call would use it */
+    host_cont_stack = (volatile uint32_t *)(((uintptr_t)__builtin_frame_address(0) - 512U - HOST_CONT_STACK_SIZE) & ~(uintptr_t)3U);
+    for (p_word = host_cont_stack; p_word < &host_cont_stack[HOST_CONT_STACK_SIZE / 4U]; ++p_word)
+    {
+        *p_word = HOST_CONT_STACKGUARD;
+    }
+
+    setup();
+    for (;;)
+    {
+        loop();
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+
+uint32_t EspClass::getFreeHeap()
+{
+    /* Roughly what the firmware has available, minus what was allocated since the first call, so leaks show up on the host as well */
+    static const size_t baseline = mallinfo2().uordblks;
+    const size_t heap_size = 48U * 1024U;
+    const size_t in_use = mallinfo2().uordblks - min(baseline, mallinfo2().uordblks);
+
+    return (in_use < heap_size) ? (uint32_t)(heap_size - in_use) : 0U;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    /* Pretend to run at 80 MHz */
+    return (uint32_t)(host_now_us() * 80U);
+}
+
+uint32_t EspClass::getChipId()
+{
+    return (uint32_t)getpid() & 0x00ffffffU;
+}
+
+uint32_t EspClass::getFreeContStack()
+{
+    uint32_t free_words = 0U;
+
+    /* Like the core, untouched words from the bottom up */
+    while ((NULL != host_cont_stack) && (free_words < (HOST_CONT_STACK_SIZE / 4U)) && (host_cont_stack[free_words] == HOST_CONT_STACKGUARD))
+    {
+        free_words++;
+    }
+
+    return free_words * 4U;
+}
+
+struct rst_info *EspClass::getResetInfoPtr()
+{
+    return &host_reset_info;
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *p_data, size_t size)
+{
+    if (((offset * 4U) + size > HOST_RTC_USER_SIZE) || ((size % 4U) != 0U))
+    {
+        return false;
+    }
+
+    memcpy(p_data, &host_rtc_user_vu32[offset], size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *p_data, size_t size)
+{
+    if (((offset * 4U) + size > HOST_RTC_USER_SIZE) || ((size % 4U) != 0U))
+    {
+        return false;
+    }
+
+    memcpy(&host_rtc_user_vu32[offset], p_data, size);
+    return true;
+}
+
+static bool host_flash_range(uint32_t address, size_t size)
+{
+    if (!host_flash_erased_b)
+    {
+        memset(host_flash_vu8, 0xff, sizeof(host_flash_vu8));
+        host_flash_erased_b = true;
+    }
+
+    return (address >= FS_PHYS_ADDR) && ((address + size) <= (FS_PHYS_ADDR + FS_PHYS_SIZE));
+}
+
+bool EspClass::flashEraseSector(uint32_t sector)
+{
+    const uint32_t address = sector * FLASH_SECTOR_SIZE;
+
+    if (!host_flash_range(address, FLASH_SECTOR_SIZE))
+    {
+        return false;
+    }
+
+    memset(&host_flash_vu8[address - FS_PHYS_ADDR], 0xff, FLASH_SECTOR_SIZE);
+    return true;
+}
+
+bool EspClass::flashWrite(uint32_t address, const uint32_t *p_data, size_t size)
+{
+    const uint8_t *p_bytes = (const uint8_t *)p_data;
+
+    if (((address % 4U) != 0U) || ((size % 4U) != 0U) || !host_flash_range(address, size))
+    {
+        return false;
+    }
+
+    for (size_t i = 0U; i < size; ++i)
+    {
+        host_flash_vu8[address - FS_PHYS_ADDR + i] &= p_bytes[i];
+    }
+    return true;
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t *p_data, size_t size)
+{
+    if (((address % 4U) != 0U) || !host_flash_range(address, size))
+    {
+        return false;
+    }
+
+    memcpy(p_data, &host_flash_vu8[address - FS_PHYS_ADDR], size);
+    return true;
+}
+
+/*****************************************************************************/
+
+size_t Print::write(const uint8_t *p_buffer, size_t size)
+{
+    size_t written = 0U;
+
+    while ((written < size) && (write(p_buffer[written]) == 1U))
+    {
+        written++;
+    }
+
+    return written;
+}
+
+size_t Print::printf(const char *p_format, ...)
+{
+    char buffer[512];
+    va_list args;
+    int len;
+
+    va_start(args, p_format);
+    len = vsnprintf(buffer, sizeof(buffer), p_format, args);
+    va_end(args);
+
+    return (len > 0) ? write((const uint8_t *)buffer, min((size_t)len, sizeof(buffer) - 1U)) : 0U;
+}
+
+size_t Print::println(const char *p_str)
+{
+    return print(p_str) + print("\n");
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1U, 1U, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *p_buffer, size_t size)
+{
+    return fwrite(p_buffer, 1U, size, stdout);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,112 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/*****************************************************************************/
+
+/* Thin host shim of the Arduino core, just enough for the modules in lib/ */
+#include <c_types.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+/*****************************************************************************/
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define LED_BUILTIN 2
+
+typedef uint8_t byte;
+
+using std::max;
+using std::min;
+
+/*****************************************************************************/
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *p_buffer, size_t size);
+    size_t write(const char *p_str) { return write((const uint8_t *)p_str, strlen(p_str)); }
+    virtual int availableForWrite() { return 0; }
+
+    size_t printf(const char *p_format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char *p_str) { return write(p_str); }
+    size_t println(const char *p_str = "");
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    void setTimeout(unsigned long timeout_ms) { (void)timeout_ms; } /* nothing on the host blocks long enough to need one */
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *p_buffer, size_t size) override;
+    int availableForWrite() override { return 256; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+/*****************************************************************************/
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define FPSTR(p) (p)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+#define strncpy_P strncpy
+
+/* Flash is emulated in RAM with NOR semantics (writes can only clear bits) */
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize() { return getFreeHeap(); }
+    uint8_t getHeapFragmentation() { return 0U; }
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz() { return 80U; }
+    uint32_t getChipId();
+    uint32_t getFreeContStack();
+    struct rst_info *getResetInfoPtr();
+
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *p_data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *p_data, size_t size);
+
+    bool flashEraseSector(uint32_t sector);
+    bool flashWrite(uint32_t address, const uint32_t *p_data, size_t size);
+    bool flashRead(uint32_t address, uint32_t *p_data, size_t size);
+};
+
+extern EspClass ESP;
+
+/*****************************************************************************/
+
+extern unsigned long millis();
+extern unsigned long micros();
+extern void delay(unsigned long ms);
+extern void yield();
+
+extern void pinMode(uint8_t pin, uint8_t mode);
+extern void digitalWrite(uint8_t pin, uint8_t value);
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,507 @@
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+ESP8266WiFiClass WiFi;
+
+/*****************************************************************************/
+
+static void host_set_nonblocking(int fd)
+{
+    (void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static bool host_resolve(const char *p_host, uint32_t *p_address)
+{
+    struct addrinfo hints;
+    struct addrinfo *p_result = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if ((getaddrinfo(p_host, NULL, &hints, &p_result) != 0) || (p_result == NULL))
+    {
+        return false;
+    }
+
+    *p_address = ((struct sockaddr_in *)p_result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(p_result);
+    return true;
+}
+
+uint16_t host_server_port(uint16_t port)
+{
+    static int offset = -1;
+    const char *p_port = getenv("FLEXIDESK_PORT");
+
+    /* The first server opened is the web server, everything else keeps its distance to it */
+    if (offset < 0)
+    {
+        offset = (p_port != NULL) ? (atoi(p_port) - (int)port) : 0;
+    }
+
+    return (uint16_t)((int)port + offset);
+}
+
+bool IPAddress::fromString(const char *p_str)
+{
+    struct in_addr address;
+
+    if (inet_aton(p_str, &address) == 0)
+    {
+        return false;
+    }
+
+    m_address = address.s_addr;
+    return true;
+}
+
+/*****************************************************************************/
+
+void ESP8266WiFiClass::begin(const char *p_ssid, const char *p_password)
+{
+    WiFiEventStationModeGotIP event;
+
+    m_connected = true;
+    event.ip = localIP();
+    if (m_got_ip_handler)
+    {
+        m_got_ip_handler(event);
+    }
+}
+
+void ESP8266WiFiClass::disconnect()
+{
+    m_connected = false;
+}
+
+void ESP8266WiFiClass::macAddress(uint8_t *p_mac)
+{
+    const uint32_t id = ESP.getChipId();
+
+    p_mac[0] = 0x02;
+    p_mac[1] = 0x00;
+    p_mac[2] = 0x00;
+    p_mac[3] = (uint8_t)(id >> 16);
+    p_mac[4] = (uint8_t)(id >> 8);
+    p_mac[5] = (uint8_t)id;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> handler)
+{
+    m_got_ip_handler = handler;
+    return WiFiEventHandler();
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> handler)
+{
+    m_disconnected_handler = handler;
+    return WiFiEventHandler();
+}
+
+/*****************************************************************************/
+
+WiFiClient::WiFiClient(int fd) : m_fd(new int(fd), [](int *p_fd)
+                                     { if (*p_fd >= 0) { ::close(*p_fd); } delete p_fd; })
+{
+    host_set_nonblocking(fd);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    struct sockaddr_in address;
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+
+    *this = WiFiClient(fd);
+    return 1;
+}
+
+int WiFiClient::connect(const char *p_host, uint16_t port)
+{
+    uint32_t address;
+
+    return host_resolve(p_host, &address) ? connect(IPAddress(address), port) : 0;
+}
+
+uint8_t WiFiClient::connected()
+{
+    uint8_t probe;
+    ssize_t ret;
+
+    if (!m_fd || (*m_fd < 0))
+    {
+        return 0U;
+    }
+
+    /* Still connected as long as there is unread data or the peer did not close */
+    ret = recv(*m_fd, &probe, 1U, MSG_PEEK | MSG_DONTWAIT);
+    if ((ret == 0) || ((ret < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        return 0U;
+    }
+
+    return 1U;
+}
+
+void WiFiClient::stop()
+{
+    if (m_fd && (*m_fd >= 0))
+    {
+        ::close(*m_fd);
+        *m_fd = -1;
+    }
+}
+
+void WiFiClient::setNoDelay(bool nodelay)
+{
+    int flag = nodelay ? 1 : 0;
+
+    if (m_fd && (*m_fd >= 0))
+    {
+        (void)setsockopt(*m_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+}
+
+int WiFiClient::available()
+{
+    int bytes = 0;
+
+    if (!m_fd || (*m_fd < 0) || (ioctl(*m_fd, FIONREAD, &bytes) != 0))
+    {
+        return 0;
+    }
+
+    return bytes;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+
+    return (read(&c, 1U) == 1) ? (int)c : -1;
+}
+
+int WiFiClient::read(uint8_t *p_buffer, size_t size)
+{
+    ssize_t ret;
+
+    if (!m_fd || (*m_fd < 0))
+    {
+        return -1;
+    }
+
+    ret = recv(*m_fd, p_buffer, size, MSG_DONTWAIT);
+    return (ret > 0) ? (int)ret : -1;
+}
+
+size_t WiFiClient::write(const uint8_t *p_buffer, size_t size)
+{
+    ssize_t ret;
+
+    if (!m_fd || (*m_fd < 0))
+    {
+        return 0U;
+    }
+
+    ret = send(*m_fd, p_buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return (ret > 0) ? (size_t)ret : 0U;
+}
+
+int WiFiClient::availableForWrite()
+{
+    struct pollfd pfd;
+
+    if (!m_fd || (*m_fd < 0))
+    {
+        return 0;
+    }
+
+    /* The real thing reports the free TCP send window, a writable socket takes at least this much */
+    pfd.fd = *m_fd;
+    pfd.events = POLLOUT;
+    return ((poll(&pfd, 1, 0) == 1) && ((pfd.revents & POLLOUT) != 0)) ? 2920 : 0;
+}
+
+IPAddress WiFiClient::remoteIP()
+{
+    struct sockaddr_in address;
+    socklen_t size = sizeof(address);
+
+    if (!m_fd || (*m_fd < 0) || (getpeername(*m_fd, (struct sockaddr *)&address, &size) != 0))
+    {
+        return IPAddress();
+    }
+
+    return IPAddress((uint32_t)address.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort()
+{
+    struct sockaddr_in address;
+    socklen_t size = sizeof(address);
+
+    if (!m_fd || (*m_fd < 0) || (getpeername(*m_fd, (struct sockaddr *)&address, &size) != 0))
+    {
+        return 0U;
+    }
+
+    return ntohs(address.sin_port);
+}
+
+/*****************************************************************************/
+
+void WiFiServer::begin()
+{
+    struct sockaddr_in address;
+    int flag = 1;
+
+    close();
+
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    (void)setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(host_server_port(m_port));
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if ((bind(m_fd, (struct sockaddr *)&address, sizeof(address)) != 0) || (listen(m_fd, 128) != 0))
+    {
+        fprintf(stderr, "Cannot listen on port %u: %s\n", host_server_port(m_port), strerror(errno));
+        close();
+        return;
+    }
+
+    host_set_nonblocking(m_fd);
+}
+
+void WiFiServer::begin(uint16_t port)
+{
+    m_port = port;
+    begin();
+}
+
+void WiFiServer::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool WiFiServer::hasClient()
+{
+    struct pollfd pfd;
+
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    return (poll(&pfd, 1, 0) == 1) && ((pfd.revents & POLLIN) != 0);
+}
+
+WiFiClient WiFiServer::accept()
+{
+    const int fd = (m_fd >= 0) ? ::accept(m_fd, NULL, NULL) : -1;
+
+    return (fd >= 0) ? WiFiClient(fd) : WiFiClient();
+}
+
+/*****************************************************************************/
+
+bool WiFiUDP::open()
+{
+    int flag = 1;
+
+    if (m_fd < 0)
+    {
+        m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        (void)setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        (void)setsockopt(m_fd, SOL_SOCKET, SO_BROADCAST, &flag, sizeof(flag));
+        host_set_nonblocking(m_fd);
+    }
+
+    return (m_fd >= 0);
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    stop();
+
+    /* Moved along with the web server, every instance gets its own */
+    return (open() && bind_port(host_server_port(port))) ? 1U : 0U;
+}
+
+bool WiFiUDP::bind_port(uint16_t port)
+{
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(m_fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        stop();
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress interface_ip, IPAddress multicast_ip, uint16_t port)
+{
+    struct ip_mreq request;
+    int flag = 1;
+
+    stop();
+    if (!open())
+    {
+        return 0U;
+    }
+
+    /* Several instances on one host all want the same group and port */
+    (void)setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    (void)setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &flag, sizeof(flag));
+    if (!bind_port(port))
+    {
+        return 0U;
+    }
+
+    request.imr_multiaddr.s_addr = (uint32_t)multicast_ip;
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+    return (setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0) ? 1U : 0U;
+}
+
+void WiFiUDP::stop()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_rx_size = 0U;
+    m_rx_pos = 0U;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    m_tx_ip = (uint32_t)ip;
+    m_tx_port = port;
+    m_tx_size = 0U;
+
+    return open() ? 1 : 0;
+}
+
+int WiFiUDP::beginPacket(const char *p_host, uint16_t port)
+{
+    uint32_t address;
+
+    return host_resolve(p_host, &address) ? beginPacket(IPAddress(address), port) : 0;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress multicast_ip, uint16_t port, IPAddress interface_ip, int ttl)
+{
+    unsigned char ttl_u8 = (unsigned char)ttl;
+
+    if (beginPacket(multicast_ip, port) == 0)
+    {
+        return 0;
+    }
+
+    (void)setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_u8, sizeof(ttl_u8));
+    return 1;
+}
+
+int WiFiUDP::endPacket()
+{
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_tx_port);
+    address.sin_addr.s_addr = m_tx_ip;
+
+    return (sendto(m_fd, m_tx, m_tx_size, MSG_DONTWAIT, (struct sockaddr *)&address, sizeof(address)) == (ssize_t)m_tx_size) ? 1 : 0;
+}
+
+size_t WiFiUDP::write(const uint8_t *p_buffer, size_t size)
+{
+    const size_t free_size = sizeof(m_tx) - m_tx_size;
+
+    size = min(size, free_size);
+    memcpy(&m_tx[m_tx_size], p_buffer, size);
+    m_tx_size += size;
+
+    return size;
+}
+
+int WiFiUDP::parsePacket()
+{
+    struct sockaddr_in address;
+    socklen_t size = sizeof(address);
+    ssize_t ret;
+
+    m_rx_size = 0U;
+    m_rx_pos = 0U;
+    if (m_fd < 0)
+    {
+        return 0;
+    }
+
+    ret = recvfrom(m_fd, m_rx, sizeof(m_rx), MSG_DONTWAIT, (struct sockaddr *)&address, &size);
+    if (ret <= 0)
+    {
+        return 0;
+    }
+
+    m_rx_size = (size_t)ret;
+    m_remote_ip = IPAddress((uint32_t)address.sin_addr.s_addr);
+    m_remote_port = ntohs(address.sin_port);
+
+    return (int)ret;
+}
+
+int WiFiUDP::read()
+{
+    return (m_rx_pos < m_rx_size) ? (int)m_rx[m_rx_pos++] : -1;
+}
+
+int WiFiUDP::read(uint8_t *p_buffer, size_t size)
+{
+    size = min(size, m_rx_size - m_rx_pos);
+    memcpy(p_buffer, &m_rx[m_rx_pos], size);
+    m_rx_pos += size;
+
+    return (int)size;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,119 @@
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+/*****************************************************************************/
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <functional>
+#include <memory>
+
+/*****************************************************************************/
+
+#define WL_IDLE_STATUS 0
+#define WL_DISCONNECTED 6
+#define WL_CONNECTED 3
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+} WiFiMode_t;
+
+typedef struct
+{
+    IPAddress ip;
+} WiFiEventStationModeGotIP;
+
+typedef struct
+{
+    uint8_t reason;
+} WiFiEventStationModeDisconnected;
+
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+/*****************************************************************************/
+
+/* TCP client over a non-blocking POSIX socket, copies share the socket like on the ESP */
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *p_host, uint16_t port);
+    uint8_t connected();
+    void stop();
+    void setNoDelay(bool nodelay);
+
+    int available() override;
+    int read() override;
+    int read(uint8_t *p_buffer, size_t size);
+    size_t write(uint8_t c) override { return write(&c, 1U); }
+    size_t write(const uint8_t *p_buffer, size_t size) override;
+    size_t write_P(PGM_P p_buffer, size_t size) { return write((const uint8_t *)p_buffer, size); }
+    int availableForWrite() override;
+    using Print::write;
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    operator bool() { return connected() != 0U; }
+
+private:
+    std::shared_ptr<int> m_fd;
+};
+
+class WiFiServer
+{
+public:
+    WiFiServer(uint16_t port) : m_port(port), m_fd(-1) {}
+
+    void begin();
+    void begin(uint16_t port);
+    void stop() { close(); }
+    void close();
+    bool hasClient();
+    WiFiClient accept();
+    void setNoDelay(bool nodelay) {}
+
+private:
+    uint16_t m_port;
+    int m_fd;
+};
+
+/*****************************************************************************/
+
+/* The host is always "associated", begin() reports a link right away */
+class ESP8266WiFiClass
+{
+public:
+    void mode(WiFiMode_t mode) {}
+    void persistent(bool persistent) {}
+    void setAutoReconnect(bool auto_reconnect) {}
+    void begin(const char *p_ssid, const char *p_password);
+    void disconnect();
+    int status() { return m_connected ? WL_CONNECTED : WL_DISCONNECTED; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    void macAddress(uint8_t *p_mac);
+
+    WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> handler);
+    WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> handler);
+
+private:
+    bool m_connected = false;
+    std::function<void(const WiFiEventStationModeGotIP &)> m_got_ip_handler;
+    std::function<void(const WiFiEventStationModeDisconnected &)> m_disconnected_handler;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+/*****************************************************************************/
+
+/* Port of the first listening socket, can be moved with FLEXIDESK_PORT so that many instances fit on one host */
+extern uint16_t host_server_port(uint16_t port);
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,285 @@
+#include <ESP8266mDNS.h>
+
+#include <strings.h>
+
+/*****************************************************************************/
+
+#define HOST_MDNS_PORT 5353U
+#define HOST_MDNS_TTL_SERVICE 4500U /* RFC 6762 section 10 */
+#define HOST_MDNS_TTL_HOST 120U
+#define HOST_DNS_TYPE_A 1U
+#define HOST_DNS_TYPE_PTR 12U
+#define HOST_DNS_TYPE_TXT 16U
+#define HOST_DNS_TYPE_SRV 33U
+#define HOST_DNS_TYPE_ANY 255U
+
+/*****************************************************************************/
+
+MDNSResponder MDNS;
+
+static const IPAddress host_mdns_group(224U, 0U, 0U, 251U);
+
+/*****************************************************************************/
+
+static void host_dns_put_u16(std::string *p_packet, uint16_t value)
+{
+    p_packet->push_back((char)(value >> 8));
+    p_packet->push_back((char)(value & 0xffU));
+}
+
+/* Uncompressed, the packets stay far below a datagram anyway */
+static void host_dns_put_name(std::string *p_packet, const std::string &name)
+{
+    size_t start = 0U;
+
+    while (start < name.size())
+    {
+        size_t end = name.find('.', start);
+
+        end = (end == std::string::npos) ? name.size() : end;
+        p_packet->push_back((char)(end - start));
+        p_packet->append(name, start, end - start);
+        start = end + 1U;
+    }
+    p_packet->push_back('\0');
+}
+
+static void host_dns_put_record(std::string *p_packet, const std::string &name, uint16_t type, bool unique, uint32_t ttl, const std::string &data)
+{
+    host_dns_put_name(p_packet, name);
+    host_dns_put_u16(p_packet, type);
+    host_dns_put_u16(p_packet, unique ? 0x8001U : 0x0001U); /* cache flush bit and class IN */
+    host_dns_put_u16(p_packet, (uint16_t)(ttl >> 16));
+    host_dns_put_u16(p_packet, (uint16_t)(ttl & 0xffffU));
+    host_dns_put_u16(p_packet, (uint16_t)data.size());
+    p_packet->append(data);
+}
+
+/* Position after the name, 0 if it is malformed */
+static size_t host_dns_get_name(const uint8_t *p_packet, size_t size, size_t pos, std::string *p_name)
+{
+    size_t end = 0U;
+    int jumps = 0;
+
+    p_name->clear();
+    while (pos < size)
+    {
+        const uint8_t length = p_packet[pos];
+
+        if (length == 0U)
+        {
+            return (end != 0U) ? end : (pos + 1U);
+        }
+        if ((length & 0xc0U) == 0xc0U)
+        {
+            if (((pos + 1U) >= size) || (++jumps > 8))
+            {
+                return 0U;
+            }
+            end = (end != 0U) ? end : (pos + 2U);
+            pos = ((size_t)(length & 0x3fU) << 8) | p_packet[pos + 1U];
+            continue;
+        }
+        if ((pos + 1U + length) > size)
+        {
+            return 0U;
+        }
+
+        if (!p_name->empty())
+        {
+            p_name->push_back('.');
+        }
+        p_name->append((const char *)&p_packet[pos + 1U], length);
+        pos += 1U + length;
+    }
+
+    return 0U;
+}
+
+/*****************************************************************************/
+
+bool MDNSResponder::begin(const char *p_hostname)
+{
+    /* Every instance on the host joins the group on the same port */
+    m_hostname = p_hostname;
+    m_running = (m_udp.beginMulticast(IPAddress(), host_mdns_group, HOST_MDNS_PORT) != 0U);
+
+    return m_running;
+}
+
+bool MDNSResponder::close()
+{
+    m_udp.stop();
+    m_running = false;
+    m_announce_pending = false;
+    m_instance.clear();
+    m_txt_callback = NULL;
+
+    return true;
+}
+
+MDNSResponder::hMDNSService MDNSResponder::addService(const char *p_name, const char *p_service, const char *p_protocol, uint16_t port)
+{
+    if (!m_running)
+    {
+        return NULL;
+    }
+
+    /* Only the first server's port is configured, the others move with it like their sockets */
+    m_type = std::string("_") + p_service + "._" + p_protocol;
+    m_instance = (p_name != NULL) ? p_name : m_hostname;
+    m_port = host_server_port(port);
+    m_announce_pending = true;
+
+    return &m_instance;
+}
+
+bool MDNSResponder::setDynamicServiceTxtCallback(MDNSDynamicServiceTxtCallbackFunc callback)
+{
+    m_txt_callback = callback;
+    return true;
+}
+
+MDNSResponder::hMDNSTxt MDNSResponder::addDynamicServiceTxt(hMDNSService service, const char *p_key, const char *p_value)
+{
+    m_txt.push_back(std::string(p_key) + "=" + p_value);
+    return &m_txt.back();
+}
+
+bool MDNSResponder::announce()
+{
+    if (!m_running || m_instance.empty())
+    {
+        return false;
+    }
+
+    m_announce_pending = false;
+    send_records(host_mdns_group, HOST_MDNS_PORT, 0U);
+    return true;
+}
+
+bool MDNSResponder::update()
+{
+    uint8_t packet_vu8[1472];
+    bool unicast;
+
+    if (m_announce_pending)
+    {
+        (void)announce();
+    }
+
+    while (m_running && (m_udp.parsePacket() > 0))
+    {
+        const int size = m_udp.read(packet_vu8, sizeof(packet_vu8));
+
+        if ((size < 12) || ((packet_vu8[2] & 0x80U) != 0U) || !is_ours(packet_vu8, (size_t)size, &unicast))
+        {
+            /* Answers, ours included, and questions about something else */
+            continue;
+        }
+
+        if (unicast || (m_udp.remotePort() != HOST_MDNS_PORT))
+        {
+            send_records(m_udp.remoteIP(), m_udp.remotePort(), (uint16_t)((packet_vu8[0] << 8) | packet_vu8[1]));
+        }
+        else
+        {
+            send_records(host_mdns_group, HOST_MDNS_PORT, 0U);
+        }
+    }
+
+    return true;
+}
+
+/*****************************************************************************/
+
+bool MDNSResponder::is_ours(const uint8_t *p_packet, size_t size, bool *p_unicast)
+{
+    const std::string type = m_type + ".local";
+    const std::string instance = m_instance + "." + type;
+    const uint16_t questions = (uint16_t)((p_packet[4] << 8) | p_packet[5]);
+    std::string name;
+    size_t pos = 12U;
+
+    if (m_instance.empty())
+    {
+        return false;
+    }
+
+    for (uint16_t i = 0U; i < questions; ++i)
+    {
+        uint16_t qtype;
+
+        pos = host_dns_get_name(p_packet, size, pos, &name);
+        if ((pos == 0U) || ((pos + 4U) > size))
+        {
+            return false;
+        }
+
+        qtype = (uint16_t)((p_packet[pos] << 8) | p_packet[pos + 1U]);
+        *p_unicast = ((p_packet[pos + 2U] & 0x80U) != 0U);
+        pos += 4U;
+
+        if (((strcasecmp(name.c_str(), type.c_str()) == 0) && ((qtype == HOST_DNS_TYPE_PTR) || (qtype == HOST_DNS_TYPE_ANY))) ||
+            ((strcasecmp(name.c_str(), instance.c_str()) == 0) && ((qtype == HOST_DNS_TYPE_SRV) || (qtype == HOST_DNS_TYPE_TXT) || (qtype == HOST_DNS_TYPE_ANY))))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MDNSResponder::send_records(IPAddress ip, uint16_t port, uint16_t id)
+{
+    const std::string type = m_type + ".local";
+    const std::string instance = m_instance + "." + type;
+    const std::string host = m_hostname + ".local";
+    std::string packet;
+    std::string data;
+
+    /* Response, authoritative, PTR, SRV, TXT and A all as answers */
+    host_dns_put_u16(&packet, id);
+    host_dns_put_u16(&packet, 0x8400U);
+    host_dns_put_u16(&packet, 0U);
+    host_dns_put_u16(&packet, 4U);
+    host_dns_put_u16(&packet, 0U);
+    host_dns_put_u16(&packet, 0U);
+
+    host_dns_put_name(&data, instance);
+    host_dns_put_record(&packet, type, HOST_DNS_TYPE_PTR, false, HOST_MDNS_TTL_SERVICE, data);
+
+    data.assign(4U, '\0');
+    host_dns_put_u16(&data, m_port);
+    host_dns_put_name(&data, host);
+    host_dns_put_record(&packet, instance, HOST_DNS_TYPE_SRV, true, HOST_MDNS_TTL_HOST, data);
+
+    /* Like LEAmDNS, the values are asked for whenever they are sent */
+    m_txt.clear();
+    if (m_txt_callback)
+    {
+        m_txt_callback(&m_instance);
+    }
+    data.clear();
+    for (const std::string &txt : m_txt)
+    {
+        data.push_back((char)min(txt.size(), (size_t)255U));
+        data.append(txt, 0U, 255U);
+    }
+    if (data.empty())
+    {
+        data.push_back('\0');
+    }
+    host_dns_put_record(&packet, instance, HOST_DNS_TYPE_TXT, true, HOST_MDNS_TTL_SERVICE, data);
+
+    data.assign("\x7f\0\0\x01", 4U);
+    host_dns_put_record(&packet, host, HOST_DNS_TYPE_A, true, HOST_MDNS_TTL_HOST, data);
+
+    if (((ip == host_mdns_group) ? m_udp.beginPacketMulticast(ip, port, IPAddress()) : m_udp.beginPacket(ip, port)) != 0)
+    {
+        (void)m_udp.write((const uint8_t *)packet.data(), packet.size());
+        (void)m_udp.endPacket();
+    }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,52 @@
+#ifndef HOST_ESP8266MDNS_H
+#define HOST_ESP8266MDNS_H
+
+/*****************************************************************************/
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+
+/* Just enough of LEAmDNS for browsers on the same machine: one service that is announced on
+ * request and whenever its type or instance is asked for. No probing, the host is 127.0.0.1. */
+class MDNSResponder
+{
+public:
+    typedef const void *hMDNSService;
+    typedef const void *hMDNSTxt;
+    typedef std::function<void(const hMDNSService)> MDNSDynamicServiceTxtCallbackFunc;
+
+    bool begin(const char *p_hostname);
+    bool close();
+    bool update();
+    bool announce();
+
+    bool addService(const char *p_service, const char *p_protocol, uint16_t port) { return addService(NULL, p_service, p_protocol, port) != NULL; }
+    hMDNSService addService(const char *p_name, const char *p_service, const char *p_protocol, uint16_t port);
+    bool setDynamicServiceTxtCallback(MDNSDynamicServiceTxtCallbackFunc callback);
+    hMDNSTxt addDynamicServiceTxt(hMDNSService service, const char *p_key, const char *p_value);
+
+private:
+    bool is_ours(const uint8_t *p_packet, size_t size, bool *p_unicast);
+    void send_records(IPAddress ip, uint16_t port, uint16_t id);
+
+    WiFiUDP m_udp;
+    bool m_running = false;
+    bool m_announce_pending = false; /* the first announcement goes out with the next update() */
+    std::string m_hostname;
+    std::string m_instance; /* empty without a service */
+    std::string m_type;     /* e.g. _flexidesk._tcp */
+    uint16_t m_port = 0U;
+    MDNSDynamicServiceTxtCallbackFunc m_txt_callback;
+    std::vector<std::string> m_txt; /* filled by the callback while a packet is assembled */
+};
+
+extern MDNSResponder MDNS;
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+/*****************************************************************************/
+
+#include <Arduino.h>
+
+/*****************************************************************************/
+
+class IPAddress
+{
+public:
+    IPAddress() : m_address(0U) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : m_address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : m_address(address) {}
+
+    operator uint32_t() const { return m_address; } /* network byte order, like on the ESP */
+    uint8_t operator[](int index) const { return (uint8_t)(m_address >> (8 * index)); }
+    bool fromString(const char *p_str);
+
+private:
+    uint32_t m_address;
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HOST_NTPCLIENT_H
+#define HOST_NTPCLIENT_H
+
+/*****************************************************************************/
+
+#include <WiFiUdp.h>
+
+#include <time.h>
+
+/*****************************************************************************/
+
+/* Uses the host clock, which is assumed to be synchronized already */
+class NTPClient
+{
+public:
+    NTPClient(WiFiUDP &udp) : m_offset(0) {}
+
+    void begin() {}
+    void end() {}
+    /* Like the real one: true whenever it synchronized, which it does once a minute */
+    bool update()
+    {
+        const time_t now = time(NULL);
+        const bool due = (now - m_last_sync) >= 60;
+
+        m_last_sync = due ? now : m_last_sync;
+        return due;
+    }
+    bool forceUpdate() { return true; }
+    bool isTimeSet() const { return true; }
+    unsigned long getEpochTime() const { return (unsigned long)time(NULL) + m_offset; }
+    void setTimeOffset(int offset) { m_offset = offset; }
+    void setPoolServerName(const char *p_pool_name) {}
+
+private:
+    long m_offset;
+    time_t m_last_sync = 0;
+};
+
+/*****************************************************************************/
+
+#endif
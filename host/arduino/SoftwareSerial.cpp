@@ -0,0 +1,257 @@
+#include <SoftwareSerial.h>
+
+#include <time.h>
+
+/*****************************************************************************/
+
+/* Behaves like the E8 controller as far as the firmware can tell: wakes up on any command,
+ * moves while UP/DOWN keep coming, drives to presets 3/4 and reports its height on the
+ * 7-segment bus at 9600 baud until it goes to sleep again */
+
+#define DESK_MIN_MM 620U
+#define DESK_MAX_MM 1270U
+#define DESK_SPEED_MM_S 38U
+#define DESK_HOLD_US 150000U         /* keeps moving this long after the last UP/DOWN frame */
+#define DESK_REPORT_US 500000U       /* height frame while nothing changes */
+#define DESK_SLEEP_US 10000000U      /* idle time until the sign-off */
+#define DESK_BYTE_US 1042U           /* 10 bits at 9600 baud */
+#define DESK_TX_QUEUE_SIZE 256U
+
+static const uint8_t desk_segments_vu8[10] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+
+static uint64_t desk_position_um = 750000U;
+static bool desk_awake_b = false;
+static int desk_direction_i = 0;     /* of the held button */
+static uint64_t desk_hold_until_us = 0U;
+static uint32_t desk_target_mm = 0U; /* preset being driven to, 0 if none */
+static uint64_t desk_last_update_us = 0U;
+static uint64_t desk_last_activity_us = 0U;
+static uint64_t desk_last_report_us = 0U;
+static uint8_t desk_last_display_vu8[3] = {0};
+
+static uint8_t desk_rx_vu8[8];
+static uint8_t desk_rx_size_u8 = 0U;
+
+static uint8_t desk_tx_vu8[DESK_TX_QUEUE_SIZE];
+static uint64_t desk_tx_ready_us[DESK_TX_QUEUE_SIZE];
+static uint16_t desk_tx_head_u16 = 0U;
+static uint16_t desk_tx_count_u16 = 0U;
+static uint64_t desk_tx_line_free_us = 0U;
+
+static const uint8_t *desk_replay_p = NULL;
+static size_t desk_replay_size = 0U;
+
+/*****************************************************************************/
+
+static uint64_t desk_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000U) + ((uint64_t)ts.tv_nsec / 1000U);
+}
+
+static void desk_send(const uint8_t *p_frame, uint8_t size_u8, uint64_t now_us)
+{
+    /* Bytes become readable one after the other, as fast as the line allows */
+    for (uint8_t i = 0U; (i < size_u8) && (desk_tx_count_u16 < DESK_TX_QUEUE_SIZE); ++i)
+    {
+        const uint16_t index_u16 = (desk_tx_head_u16 + desk_tx_count_u16) % DESK_TX_QUEUE_SIZE;
+
+        desk_tx_line_free_us = max(desk_tx_line_free_us, now_us) + DESK_BYTE_US;
+        desk_tx_vu8[index_u16] = p_frame[i];
+        desk_tx_ready_us[index_u16] = desk_tx_line_free_us;
+        desk_tx_count_u16++;
+    }
+}
+
+static void desk_report(uint64_t now_us)
+{
+    const uint32_t height_mm = (uint32_t)(desk_position_um / 1000U);
+    uint8_t frame_vu8[9] = {0x9b, 0x07, 0x12, 0x00, 0x00, 0x00, 0x55, 0xaa, 0x9d};
+
+    /* Display shows cm with one decimal below 100 cm, whole cm above */
+    if (height_mm >= 1000U)
+    {
+        frame_vu8[3] = desk_segments_vu8[(height_mm / 1000U) % 10U];
+        frame_vu8[4] = desk_segments_vu8[(height_mm / 100U) % 10U];
+        frame_vu8[5] = desk_segments_vu8[(height_mm / 10U) % 10U];
+    }
+    else
+    {
+        frame_vu8[3] = desk_segments_vu8[(height_mm / 100U) % 10U];
+        frame_vu8[4] = desk_segments_vu8[(height_mm / 10U) % 10U] | 0x80U;
+        frame_vu8[5] = desk_segments_vu8[height_mm % 10U];
+    }
+
+    if ((memcmp(&frame_vu8[3], desk_last_display_vu8, 3U) != 0) || ((now_us - desk_last_report_us) >= DESK_REPORT_US))
+    {
+        memcpy(desk_last_display_vu8, &frame_vu8[3], 3U);
+        desk_last_report_us = now_us;
+        desk_send(frame_vu8, sizeof(frame_vu8), now_us);
+    }
+}
+
+static void desk_update()
+{
+    const uint64_t now_us = desk_now_us();
+    const uint64_t step_um = ((now_us - desk_last_update_us) * DESK_SPEED_MM_S) / 1000U;
+    int direction_i = 0;
+
+    if (desk_last_update_us == 0U)
+    {
+        desk_last_update_us = now_us;
+        return;
+    }
+    desk_last_update_us = now_us;
+
+    if (desk_target_mm != 0U)
+    {
+        direction_i = ((uint64_t)desk_target_mm * 1000U > desk_position_um) ? 1 : -1;
+    }
+    else if (now_us < desk_hold_until_us)
+    {
+        direction_i = desk_direction_i;
+    }
+
+    if (direction_i > 0)
+    {
+        desk_position_um = min(desk_position_um + step_um, (uint64_t)DESK_MAX_MM * 1000U);
+    }
+    else if (direction_i < 0)
+    {
+        desk_position_um = max(desk_position_um - min(step_um, desk_position_um), (uint64_t)DESK_MIN_MM * 1000U);
+    }
+
+    if ((desk_target_mm != 0U) && ((uint64_t)llabs((long long)desk_position_um - ((long long)desk_target_mm * 1000)) <= step_um))
+    {
+        desk_position_um = (uint64_t)desk_target_mm * 1000U;
+        desk_target_mm = 0U;
+    }
+
+    if (direction_i != 0)
+    {
+        desk_last_activity_us = now_us;
+    }
+
+    if (desk_awake_b)
+    {
+        if ((now_us - desk_last_activity_us) >= DESK_SLEEP_US)
+        {
+            const uint8_t sign_off_vu8[9] = {0x9b, 0x07, 0x12, 0x00, 0x00, 0x00, 0x55, 0xaa, 0x9d};
+
+            desk_send(sign_off_vu8, sizeof(sign_off_vu8), now_us);
+            desk_awake_b = false;
+        }
+        else
+        {
+            desk_report(now_us);
+        }
+    }
+}
+
+static void desk_handle_command(uint8_t key_lo_u8, uint8_t key_hi_u8)
+{
+    const uint64_t now_us = desk_now_us();
+    const uint16_t key_u16 = (uint16_t)(key_hi_u8 << 8) | key_lo_u8;
+
+    desk_update();
+    if (!desk_awake_b)
+    {
+        /* Forces a full report right away */
+        memset(desk_last_display_vu8, 0, sizeof(desk_last_display_vu8));
+    }
+    desk_awake_b = true;
+    desk_last_activity_us = now_us;
+
+    if ((key_u16 == 0x0001U) || (key_u16 == 0x0002U))
+    {
+        desk_direction_i = (key_u16 == 0x0001U) ? 1 : -1;
+        desk_hold_until_us = now_us + DESK_HOLD_US;
+        desk_target_mm = 0U;
+    }
+    else if (key_u16 == 0x0010U)
+    {
+        desk_target_mm = 1150U;
+    }
+    else if (key_u16 == 0x0100U)
+    {
+        desk_target_mm = 750U;
+    }
+    else
+    {
+        /* Wakeup, M and the other presets only wake it up */
+    }
+}
+
+/*****************************************************************************/
+
+void host_serial_replay(const uint8_t *p_data, size_t size)
+{
+    desk_replay_p = p_data;
+    desk_replay_size = size;
+}
+
+int SoftwareSerial::available()
+{
+    uint64_t now_us;
+    int ready_i = 0;
+
+    if (desk_replay_size > 0U)
+    {
+        return (int)min(desk_replay_size, (size_t)INT32_MAX);
+    }
+
+    now_us = desk_now_us();
+    desk_update();
+    while ((ready_i < desk_tx_count_u16) && (desk_tx_ready_us[(desk_tx_head_u16 + ready_i) % DESK_TX_QUEUE_SIZE] <= now_us))
+    {
+        ready_i++;
+    }
+
+    return ready_i;
+}
+
+int SoftwareSerial::read()
+{
+    int c = -1;
+
+    if (desk_replay_size > 0U)
+    {
+        c = *desk_replay_p++;
+        desk_replay_size--;
+    }
+    else if (available() > 0)
+    {
+        c = desk_tx_vu8[desk_tx_head_u16];
+        desk_tx_head_u16 = (desk_tx_head_u16 + 1U) % DESK_TX_QUEUE_SIZE;
+        desk_tx_count_u16--;
+    }
+
+    return c;
+}
+
+size_t SoftwareSerial::write(uint8_t c)
+{
+    /* Command frames: 9b 06 02 <key lo> <key hi> <crc> <crc> 9d */
+    if (c == 0x9bU)
+    {
+        desk_rx_size_u8 = 0U;
+    }
+    else if (c == 0x9dU)
+    {
+        if ((desk_rx_size_u8 >= 4U) && (desk_rx_vu8[0] == 0x06U) && (desk_rx_vu8[1] == 0x02U))
+        {
+            desk_handle_command(desk_rx_vu8[2], desk_rx_vu8[3]);
+        }
+        desk_rx_size_u8 = 0U;
+    }
+    else if (desk_rx_size_u8 < sizeof(desk_rx_vu8))
+    {
+        desk_rx_vu8[desk_rx_size_u8++] = c;
+    }
+
+    return 1U;
+}
+
+/*****************************************************************************/
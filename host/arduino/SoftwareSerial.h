@@ -0,0 +1,30 @@
+#ifndef HOST_SOFTWARESERIAL_H
+#define HOST_SOFTWARESERIAL_H
+
+/*****************************************************************************/
+
+#include <Arduino.h>
+
+/*****************************************************************************/
+
+#define SWSERIAL_8N1 0
+
+/* Connected to a small emulation of the desk controller, see SoftwareSerial.cpp */
+class SoftwareSerial : public Stream
+{
+public:
+    void begin(uint32_t baud, int config, int8_t rx_pin, int8_t tx_pin) {}
+    int available() override;
+    int read() override;
+    size_t write(uint8_t c) override;
+    using Print::write;
+    void flush() {}
+    void enableTx(bool on) {}
+};
+
+/* Bytes are read from here instead of the emulated desk until they are used up, for benchmarks */
+extern void host_serial_replay(const uint8_t *p_data, size_t size);
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+/*****************************************************************************/
+
+#include <ESP8266WiFi.h>
+
+/*****************************************************************************/
+
+/* UDP over a non-blocking POSIX socket, one datagram is assembled or parsed at a time */
+class WiFiUDP : public Stream
+{
+public:
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress interface_ip, IPAddress multicast_ip, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *p_host, uint16_t port);
+    int beginPacketMulticast(IPAddress multicast_ip, uint16_t port, IPAddress interface_ip, int ttl = 1);
+    int endPacket();
+    size_t write(uint8_t c) override { return write(&c, 1U); }
+    size_t write(const uint8_t *p_buffer, size_t size) override;
+    using Print::write;
+
+    int parsePacket();
+    int available() override { return (int)(m_rx_size - m_rx_pos); }
+    int read() override;
+    int read(uint8_t *p_buffer, size_t size);
+    int read(char *p_buffer, size_t size) { return read((uint8_t *)p_buffer, size); }
+    void flush() {}
+
+    IPAddress remoteIP() { return m_remote_ip; }
+    uint16_t remotePort() { return m_remote_port; }
+
+private:
+    bool open();
+    bool bind_port(uint16_t port);
+
+    int m_fd = -1;
+    uint8_t m_tx[1472];
+    size_t m_tx_size = 0U;
+    uint32_t m_tx_ip = 0U;
+    uint16_t m_tx_port = 0U;
+    uint8_t m_rx[1472];
+    size_t m_rx_size = 0U;
+    size_t m_rx_pos = 0U;
+    IPAddress m_remote_ip;
+    uint16_t m_remote_port = 0U;
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_C_TYPES_H
+#define HOST_C_TYPES_H
+
+/*****************************************************************************/
+
+/* Host stand-in for the ESP8266 SDK integer types */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+typedef uint64_t uint64;
+typedef int64_t sint64;
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HOST_FLASH_HAL_H
+#define HOST_FLASH_HAL_H
+
+/*****************************************************************************/
+
+#include <Arduino.h>
+
+/*****************************************************************************/
+
+/* Filesystem area of the emulated flash, see EspClass */
+#define FS_PHYS_ADDR 0x00100000UL
+#define FS_PHYS_SIZE 0x00020000UL
+#define FLASH_SECTOR_SIZE 4096U
+
+/*****************************************************************************/
+
+#endif
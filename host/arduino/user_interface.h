@@ -0,0 +1,35 @@
+#ifndef HOST_USER_INTERFACE_H
+#define HOST_USER_INTERFACE_H
+
+/*****************************************************************************/
+
+#include <c_types.h>
+
+/*****************************************************************************/
+
+/* Reset reasons of the ESP8266 SDK, see EspClass::getResetInfoPtr() */
+enum rst_reason
+{
+    REASON_DEFAULT_RST = 0,
+    REASON_WDT_RST = 1,
+    REASON_EXCEPTION_RST = 2,
+    REASON_SOFT_WDT_RST = 3,
+    REASON_SOFT_RESTART = 4,
+    REASON_DEEP_SLEEP_AWAKE = 5,
+    REASON_EXT_SYS_RST = 6
+};
+
+struct rst_info
+{
+    uint32 reason;
+    uint32 exccause;
+    uint32 epc1;
+    uint32 epc2;
+    uint32 epc3;
+    uint32 excvaddr;
+    uint32 depc;
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,802 @@
+#include "api.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "deskcontrol.h"
+#include "events.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+#include "memory.h"
+#include "mqtt.h"
+#include "ntp.h"
+#include "scheduler.h"
+#include "sse.h"
+#include "stagger.h"
+#include "syslog.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+/* Renders one step of a document, returns true after the last one */
+typedef bool (*fn_api_step)(JSON_WRITER *p_writer, const uint32 step_u32);
+
+typedef struct
+{
+    const char *p_name;
+    DC_COMMAND command_e;
+} API_COMMAND_NAME;
+
+/*****************************************************************************/
+
+const char api_module_str[] PROGMEM = "API";
+const char *api_json_type_str = "application/json";
+
+const API_COMMAND_NAME api_command_names[] = {
+    {"wakeup", DC_CMD_WAKEUP},
+    {"up", DC_CMD_UP},
+    {"down", DC_CMD_DOWN},
+    {"m", DC_CMD_M},
+    {"preset1", DC_CMD_PRESET_1},
+    {"preset2", DC_CMD_PRESET_2},
+    {"preset3", DC_CMD_PRESET_3},
+    {"preset4", DC_CMD_PRESET_4},
+    /* Target heights, the desk has them stored in presets 3 and 4 */
+    {"standing", DC_CMD_PRESET_3},
+    {"sitting", DC_CMD_PRESET_4}};
+
+/*****************************************************************************/
+
+fn_command_receiver api_command_receiver_fn = NULL;
+
+/*****************************************************************************/
+
+void api_get_status(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_get_schedule(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_put_schedule(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_get_desk(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_put_desk(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_post_command(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void api_get_memory(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+
+bool api_produce_status(HTTP_CONN *p_conn);
+bool api_produce_schedule(HTTP_CONN *p_conn);
+bool api_produce_desk(HTTP_CONN *p_conn);
+bool api_produce_memory(HTTP_CONN *p_conn);
+bool api_stream(HTTP_CONN *p_conn, fn_api_step step_fn);
+bool api_render_status(JSON_WRITER *p_writer, const uint32 step_u32);
+bool api_render_schedule(JSON_WRITER *p_writer, const uint32 step_u32);
+bool api_render_desk(JSON_WRITER *p_writer, const uint32 step_u32);
+bool api_render_memory(JSON_WRITER *p_writer, const uint32 step_u32);
+void api_add_watermarks(JSON_WRITER *p_writer, const MM_WATERMARKS *p_watermarks);
+
+const char *api_parse_schedule(JSON_READER *p_reader, SYSTEM_CONFIG *p_config);
+const char *api_parse_day(JSON_READER *p_reader, SYSTEM_CONFIG *p_config);
+const char *api_parse_desk(JSON_READER *p_reader, SYSTEM_CONFIG *p_config);
+bool api_parse_u16(const JSON_TOKEN *p_token, uint16 *p_value_u16);
+bool api_parse_time(const JSON_TOKEN *p_token, TIME *p_time);
+
+void api_get_config(SYSTEM_CONFIG *p_config);
+void api_apply_config(const SYSTEM_CONFIG *p_config);
+void api_send_error(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_error);
+
+/*****************************************************************************/
+
+void api_init(fn_command_receiver command_receiver)
+{
+    api_command_receiver_fn = command_receiver;
+
+    (void)http_on(HTTP_METHOD_GET, "/api/status", api_get_status);
+    (void)http_on(HTTP_METHOD_GET, "/api/schedule", api_get_schedule);
+    (void)http_on(HTTP_METHOD_PUT, "/api/schedule", api_put_schedule);
+    (void)http_on(HTTP_METHOD_GET, "/api/desk", api_get_desk);
+    (void)http_on(HTTP_METHOD_PUT, "/api/desk", api_put_desk);
+    (void)http_on(HTTP_METHOD_POST, "/api/command", api_post_command);
+    (void)http_on(HTTP_METHOD_GET, "/api/memory", api_get_memory);
+}
+
+const char *api_update_schedule(const char *p_data, const uint16 size_u16)
+{
+    SYSTEM_CONFIG config;
+    JSON_READER reader;
+    const char *p_error;
+
+    api_get_config(&config);
+    json_reader_init(&reader, p_data, size_u16);
+
+    p_error = api_parse_schedule(&reader, &config);
+    if (NULL == p_error)
+    {
+        api_apply_config(&config);
+    }
+
+    return p_error;
+}
+
+const char *api_update_desk(const char *p_data, const uint16 size_u16)
+{
+    SYSTEM_CONFIG config;
+    JSON_READER reader;
+    const char *p_error;
+
+    api_get_config(&config);
+    json_reader_init(&reader, p_data, size_u16);
+
+    p_error = api_parse_desk(&reader, &config);
+    if (NULL == p_error)
+    {
+        api_apply_config(&config);
+    }
+
+    return p_error;
+}
+
+void api_store_config()
+{
+    SYSTEM_CONFIG config;
+
+    api_get_config(&config);
+    if (!cfg_save(&config))
+    {
+        log_msg(LOG_LEVEL_ERROR, api_module_str, "Could not store the new configuration.");
+    }
+}
+
+DC_COMMAND api_command_from_name(const char *p_name, const uint16 size_u16)
+{
+    for (uint8 i = 0U; i < (sizeof(api_command_names) / sizeof(api_command_names[0])); ++i)
+    {
+        if ((strlen(api_command_names[i].p_name) == size_u16) && (strncmp(api_command_names[i].p_name, p_name, size_u16) == 0))
+        {
+            return api_command_names[i].command_e;
+        }
+    }
+
+    return DC_CMD_INVALID;
+}
+
+/*****************************************************************************/
+
+void api_get_status(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    http_begin_response(p_conn, 200, api_json_type_str, HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, api_produce_status);
+}
+
+void api_get_schedule(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    http_begin_response(p_conn, 200, api_json_type_str, HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, api_produce_schedule);
+}
+
+void api_put_schedule(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    const char *p_error = api_update_schedule(p_request->body.p_data, p_request->body.size_u16);
+
+    if (NULL == p_error)
+    {
+        api_get_schedule(p_conn, p_request);
+    }
+    else
+    {
+        api_send_error(p_conn, 400, p_error);
+    }
+}
+
+void api_get_desk(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    http_begin_response(p_conn, 200, api_json_type_str, HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, api_produce_desk);
+}
+
+void api_put_desk(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    const char *p_error = api_update_desk(p_request->body.p_data, p_request->body.size_u16);
+
+    if (NULL == p_error)
+    {
+        api_get_desk(p_conn, p_request);
+    }
+    else
+    {
+        api_send_error(p_conn, 400, p_error);
+    }
+}
+
+void api_post_command(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JSON_READER reader;
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    DC_COMMAND command_e = DC_CMD_INVALID;
+    char response_str[32];
+    int ret = 0;
+
+    /* {"command": "up"} or {"target": "standing"} */
+    json_reader_init(&reader, p_request->body.p_data, p_request->body.size_u16);
+    if (json_next(&reader, &key) != JSON_TOKEN_OBJECT_BEGIN)
+    {
+        api_send_error(p_conn, 400, "expected an object");
+        return;
+    }
+
+    while ((json_next(&reader, &key) == JSON_TOKEN_STRING) && (json_next(&reader, &value) != JSON_TOKEN_ERROR))
+    {
+        if ((json_token_equals(&key, "command") || json_token_equals(&key, "target")) && (value.type_e == JSON_TOKEN_STRING) &&
+            (api_command_from_name(value.p_data, value.size_u16) != DC_CMD_INVALID))
+        {
+            command_e = api_command_from_name(value.p_data, value.size_u16);
+        }
+        else if (!json_skip(&reader, &value))
+        {
+            break;
+        }
+        else
+        {
+            /* Ignore unknown keys */
+        }
+    }
+
+    if (command_e == DC_CMD_INVALID)
+    {
+        api_send_error(p_conn, 400, "unknown command");
+    }
+    else if (NULL == api_command_receiver_fn)
+    {
+        api_send_error(p_conn, 503, "desk not available");
+    }
+    else
+    {
+        ret = api_command_receiver_fn(command_e);
+        (void)snprintf(response_str, sizeof(response_str), "{\"result\":%d}", ret);
+        http_send(p_conn, 202, api_json_type_str, response_str);
+    }
+}
+
+void api_get_memory(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    http_begin_response(p_conn, 200, api_json_type_str, HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, api_produce_memory);
+}
+
+/*****************************************************************************/
+
+bool api_produce_status(HTTP_CONN *p_conn)
+{
+    return api_stream(p_conn, api_render_status);
+}
+
+bool api_produce_schedule(HTTP_CONN *p_conn)
+{
+    return api_stream(p_conn, api_render_schedule);
+}
+
+bool api_produce_desk(HTTP_CONN *p_conn)
+{
+    return api_stream(p_conn, api_render_desk);
+}
+
+bool api_produce_memory(HTTP_CONN *p_conn)
+{
+    return api_stream(p_conn, api_render_memory);
+}
+
+bool api_stream(HTTP_CONN *p_conn, fn_api_step step_fn)
+{
+    uint32 *p_step_u32 = http_producer_state(p_conn);
+    JSON_WRITER writer;
+    uint16 size_u16;
+    uint16 used_u16 = 0U;
+    char *p_buffer = http_tx_reserve(p_conn, &size_u16);
+    bool done_b = false;
+
+    /* Serialize straight into the transmit buffer, as many steps as fit */
+    while (!done_b)
+    {
+        json_init(&writer, &p_buffer[used_u16], size_u16 - used_u16);
+        done_b = step_fn(&writer, *p_step_u32);
+
+        if (json_overflow(&writer))
+        {
+            if (used_u16 == 0U)
+            {
+                /* Does not even fit into an empty buffer, give up rather than stall */
+                log_msg(LOG_LEVEL_ERROR, api_module_str, "Step %u does not fit into the transmit buffer.", (unsigned)*p_step_u32);
+                done_b = true;
+            }
+            else
+            {
+                done_b = false;
+            }
+            break;
+        }
+
+        used_u16 += json_length(&writer);
+        *p_step_u32 += 1U;
+    }
+
+    http_tx_commit(p_conn, used_u16);
+
+    return done_b;
+}
+
+bool api_render_status(JSON_WRITER *p_writer, const uint32 step_u32)
+{
+    const DATETIME *p_time = ntp_get_current_time();
+    const DC_STATE state_e = dc_get_current_state();
+    const SC_TRANSITION_STATS *p_transitions = sc_get_transition_stats();
+    const HTTP_STATS *p_http = http_get_stats();
+    const SSE_STATS *p_sse = sse_get_stats();
+    char str[16];
+
+    json_object_begin(p_writer, NULL);
+    json_add_uint(p_writer, "height", dc_get_current_height());
+    json_add_string(p_writer, "state", (state_e == DC_STATE_STANDING) ? "standing" : ((state_e == DC_STATE_SITTING) ? "sitting" : "unknown"));
+
+    (void)snprintf(str, sizeof(str), "%02u:%02u:%02u", p_time->time.hour_u8, p_time->time.minute_u8, p_time->time.second_u8);
+    json_add_string(p_writer, "time", str);
+    (void)snprintf(str, sizeof(str), "%04u-%02u-%02u", p_time->date.year_u16, p_time->date.month_u8, p_time->date.day_u8);
+    json_add_string(p_writer, "date", str);
+    json_add_uint(p_writer, "uptime_s", millis() / 1000U);
+
+    json_object_begin(p_writer, "transitions");
+    json_add_uint(p_writer, "total", p_transitions->transitions_u32);
+    json_add_uint(p_writer, "reached", p_transitions->reached_u32);
+    json_add_uint(p_writer, "failed", p_transitions->failed_u32);
+    json_add_uint(p_writer, "retries", p_transitions->retries_u32);
+    json_add_int(p_writer, "arrival_error_ms", p_transitions->last.arrival_error_ms_s32);
+    json_add_uint(p_writer, "arrival_error_mean_ms", (p_transitions->arrivals_u32 > 0U) ? (p_transitions->arrival_error_abs_sum_ms_u32 / p_transitions->arrivals_u32) : 0U);
+    json_add_uint(p_writer, "lead_up_ms", sc_get_lead_ms(DC_STATE_STANDING));
+    json_add_uint(p_writer, "lead_down_ms", sc_get_lead_ms(DC_STATE_SITTING));
+    json_object_end(p_writer);
+
+    json_object_begin(p_writer, "memory");
+    json_add_uint(p_writer, "heap_free", ESP.getFreeHeap());
+    json_add_uint(p_writer, "request_heap_drop_max", p_http->heap_drop_max_u32);
+    json_object_end(p_writer);
+
+    json_object_begin(p_writer, "http");
+    json_add_uint(p_writer, "connections", p_http->connections_u32);
+    json_add_uint(p_writer, "rejected", p_http->rejected_u32);
+    json_add_uint(p_writer, "requests", p_http->requests_u32);
+    json_add_uint(p_writer, "errors", p_http->errors_u32);
+    json_object_end(p_writer);
+
+    json_object_begin(p_writer, "events");
+    json_add_uint(p_writer, "clients", p_sse->clients_u32);
+    json_add_uint(p_writer, "sent", p_sse->sent_u32);
+    json_add_uint(p_writer, "coalesced", p_sse->coalesced_u32);
+    json_add_uint(p_writer, "dropped", p_sse->dropped_u32);
+    json_object_end(p_writer);
+    json_object_end(p_writer);
+
+    return true;
+}
+
+bool api_render_schedule(JSON_WRITER *p_writer, const uint32 step_u32)
+{
+    DAY_CONFIG configs[NUM_WEEKDAYS];
+    uint16 transition_tolerance_u16;
+    uint16 command_tolerance_u16;
+    char str[12];
+    bool done_b = false;
+
+    /* Opening with the tolerances, one step per day, then closing */
+    if (step_u32 == 0U)
+    {
+        sc_get_tolerances(&transition_tolerance_u16, &command_tolerance_u16);
+        json_object_begin(p_writer, NULL);
+        json_add_uint(p_writer, "transition_tolerance", transition_tolerance_u16);
+        json_add_uint(p_writer, "command_tolerance", command_tolerance_u16);
+        json_array_begin(p_writer, "days");
+    }
+    else if (step_u32 <= NUM_WEEKDAYS)
+    {
+        const DAY_CONFIG *p_config = &configs[step_u32 - 1U];
+
+        sc_get_day_configs(configs);
+        json_resume(p_writer, 2U, step_u32 > 1U);
+        json_object_begin(p_writer, NULL);
+        json_add_uint(p_writer, "day", step_u32 - 1U);
+        json_add_bool(p_writer, "enabled", p_config->enabled != 0);
+        (void)snprintf(str, sizeof(str), "%02u:%02u:%02u", p_config->start_time.hour_u8, p_config->start_time.minute_u8, p_config->start_time.second_u8);
+        json_add_string(p_writer, "start", str);
+        (void)snprintf(str, sizeof(str), "%02u:%02u:%02u", p_config->end_time.hour_u8, p_config->end_time.minute_u8, p_config->end_time.second_u8);
+        json_add_string(p_writer, "end", str);
+        json_add_uint(p_writer, "interval", p_config->interval_u16);
+        json_add_uint(p_writer, "duration", p_config->duration_u16);
+        json_object_end(p_writer);
+    }
+    else
+    {
+        json_resume(p_writer, 2U, true);
+        json_array_end(p_writer);
+        json_object_end(p_writer);
+        done_b = true;
+    }
+
+    return done_b;
+}
+
+bool api_render_desk(JSON_WRITER *p_writer, const uint32 step_u32)
+{
+    uint16 height_standing_u16;
+    uint16 height_sitting_u16;
+    uint16 height_tolerance_u16;
+
+    dc_get_params(&height_standing_u16, &height_sitting_u16, &height_tolerance_u16);
+
+    json_object_begin(p_writer, NULL);
+    json_add_uint(p_writer, "height_standing", height_standing_u16);
+    json_add_uint(p_writer, "height_sitting", height_sitting_u16);
+    json_add_uint(p_writer, "height_tolerance", height_tolerance_u16);
+    json_object_end(p_writer);
+
+    return true;
+}
+
+bool api_render_memory(JSON_WRITER *p_writer, const uint32 step_u32)
+{
+    const uint8 num_tasks_u8 = tk_get_num_tasks();
+    const uint8 num_samples_u8 = mm_get_num_samples();
+    const MM_PREVIOUS_BOOT *p_previous = mm_get_previous_boot();
+    bool done_b = false;
+
+    /* Opening with the current values, one step per task, then one per sample, oldest first */
+    if (step_u32 == 0U)
+    {
+        json_object_begin(p_writer, NULL);
+        json_add_uint(p_writer, "uptime_s", millis() / 1000U);
+
+        json_object_begin(p_writer, "heap");
+        json_add_uint(p_writer, "free", ESP.getFreeHeap());
+        json_add_uint(p_writer, "max_block", ESP.getMaxFreeBlockSize());
+        json_add_uint(p_writer, "fragmentation", ESP.getHeapFragmentation());
+        json_add_uint(p_writer, "loop_stack_free", ESP.getFreeContStack());
+        json_object_end(p_writer);
+
+        json_object_begin(p_writer, "watermarks");
+        api_add_watermarks(p_writer, mm_get_watermarks());
+        json_object_end(p_writer);
+
+        json_object_begin(p_writer, "previous_boot");
+        json_add_string(p_writer, "reset_reason", mm_get_reset_reason_name(p_previous->reset_reason_u32));
+        if (p_previous->valid_b)
+        {
+            api_add_watermarks(p_writer, &(p_previous->watermarks));
+        }
+        json_object_end(p_writer);
+
+        json_object_begin(p_writer, "allocations");
+        json_add_uint(p_writer, "total", mm_get_allocations());
+        json_add_uint(p_writer, "frees", mm_get_frees());
+        json_add_uint(p_writer, "http", http_get_stats()->allocations_u32);
+        json_object_end(p_writer);
+
+        json_add_uint(p_writer, "stack_window", TK_STACK_WINDOW);
+        json_array_begin(p_writer, "tasks");
+    }
+    else if (step_u32 <= num_tasks_u8)
+    {
+        const TK_STATS *p_stats = tk_get_stats((sint8)(step_u32 - 1U));
+
+        json_resume(p_writer, 2U, step_u32 > 1U);
+        json_object_begin(p_writer, NULL);
+        json_add_string(p_writer, "name", p_stats->p_name);
+        json_add_uint(p_writer, "stack_max", p_stats->stack_max_u16);
+        json_add_uint(p_writer, "allocations", p_stats->allocations_u32);
+        json_object_end(p_writer);
+    }
+    else if (step_u32 == (num_tasks_u8 + 1U))
+    {
+        json_resume(p_writer, 2U, num_tasks_u8 > 0U);
+        json_array_end(p_writer);
+        json_resume(p_writer, 1U, true);
+        json_add_uint(p_writer, "sample_period_s", MM_SAMPLE_PERIOD_MS_U32 / 1000U);
+        json_array_begin(p_writer, "samples");
+    }
+    else if (step_u32 <= (num_tasks_u8 + 1U + num_samples_u8))
+    {
+        const uint8 sample_u8 = (uint8)(step_u32 - num_tasks_u8 - 2U);
+        const MM_SAMPLE *p_sample = mm_get_sample(sample_u8);
+
+        /* Heap free, largest block, loop stack free, fragmentation */
+        json_resume(p_writer, 2U, sample_u8 > 0U);
+        json_array_begin(p_writer, NULL);
+        json_add_uint(p_writer, NULL, p_sample->heap_free_u16);
+        json_add_uint(p_writer, NULL, p_sample->max_block_u16);
+        json_add_uint(p_writer, NULL, p_sample->cont_free_u16);
+        json_add_uint(p_writer, NULL, p_sample->fragmentation_u8);
+        json_array_end(p_writer);
+    }
+    else
+    {
+        json_resume(p_writer, 2U, num_samples_u8 > 0U);
+        json_array_end(p_writer);
+        json_object_end(p_writer);
+        done_b = true;
+    }
+
+    return done_b;
+}
+
+void api_add_watermarks(JSON_WRITER *p_writer, const MM_WATERMARKS *p_watermarks)
+{
+    json_add_uint(p_writer, "uptime_s", p_watermarks->uptime_s_u32);
+    json_add_uint(p_writer, "heap_free_min", p_watermarks->heap_free_min_u16);
+    json_add_uint(p_writer, "max_block_min", p_watermarks->max_block_min_u16);
+    json_add_uint(p_writer, "loop_stack_free_min", p_watermarks->cont_free_min_u16);
+    json_add_uint(p_writer, "fragmentation_max", p_watermarks->fragmentation_max_u8);
+}
+
+/*****************************************************************************/
+
+const char *api_parse_schedule(JSON_READER *p_reader, SYSTEM_CONFIG *p_config)
+{
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    const char *p_error = NULL;
+
+    if (json_next(p_reader, &key) != JSON_TOKEN_OBJECT_BEGIN)
+    {
+        return "expected an object";
+    }
+
+    /* Only what is in the document changes */
+    while ((NULL == p_error) && (json_next(p_reader, &key) == JSON_TOKEN_STRING))
+    {
+        (void)json_next(p_reader, &value);
+
+        if (json_token_equals(&key, "transition_tolerance"))
+        {
+            p_error = api_parse_u16(&value, &(p_config->transition_time_tolerance_u16)) ? NULL : "invalid transition_tolerance";
+        }
+        else if (json_token_equals(&key, "command_tolerance"))
+        {
+            p_error = api_parse_u16(&value, &(p_config->command_send_time_tolerance_u16)) ? NULL : "invalid command_tolerance";
+        }
+        else if (json_token_equals(&key, "days") && (value.type_e == JSON_TOKEN_ARRAY_BEGIN))
+        {
+            while ((NULL == p_error) && (json_next(p_reader, &value) == JSON_TOKEN_OBJECT_BEGIN))
+            {
+                p_error = api_parse_day(p_reader, p_config);
+            }
+
+            if ((NULL == p_error) && (value.type_e != JSON_TOKEN_ARRAY_END))
+            {
+                p_error = "invalid days";
+            }
+        }
+        else
+        {
+            p_error = json_skip(p_reader, &value) ? NULL : "malformed document";
+        }
+    }
+
+    if ((NULL == p_error) && (key.type_e != JSON_TOKEN_OBJECT_END))
+    {
+        p_error = "malformed document";
+    }
+
+    return p_error;
+}
+
+const char *api_parse_day(JSON_READER *p_reader, SYSTEM_CONFIG *p_config)
+{
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    DAY_CONFIG day_config = {0};
+    DAY_CONFIG *p_day_config;
+    sint32 day_s32 = -1;
+    uint8 given_u8 = 0U; /* bit per field in the order below */
+
+    while (json_next(p_reader, &key) == JSON_TOKEN_STRING)
+    {
+        (void)json_next(p_reader, &value);
+
+        if (json_token_equals(&key, "day") && (value.type_e == JSON_TOKEN_NUMBER) && (value.number_s32 >= 0) && (value.number_s32 < NUM_WEEKDAYS))
+        {
+            day_s32 = value.number_s32;
+        }
+        else if (json_token_equals(&key, "enabled") && ((value.type_e == JSON_TOKEN_TRUE) || (value.type_e == JSON_TOKEN_FALSE)))
+        {
+            day_config.enabled = (value.type_e == JSON_TOKEN_TRUE) ? 1 : 0;
+            given_u8 |= 0x01U;
+        }
+        else if (json_token_equals(&key, "start") && api_parse_time(&value, &(day_config.start_time)))
+        {
+            given_u8 |= 0x02U;
+        }
+        else if (json_token_equals(&key, "end") && api_parse_time(&value, &(day_config.end_time)))
+        {
+            given_u8 |= 0x04U;
+        }
+        else if (json_token_equals(&key, "interval") && api_parse_u16(&value, &(day_config.interval_u16)))
+        {
+            given_u8 |= 0x08U;
+        }
+        else if (json_token_equals(&key, "duration") && api_parse_u16(&value, &(day_config.duration_u16)))
+        {
+            given_u8 |= 0x10U;
+        }
+        else
+        {
+            return "invalid day entry";
+        }
+    }
+
+    if ((key.type_e != JSON_TOKEN_OBJECT_END) || (day_s32 < 0))
+    {
+        return "day entry without valid day";
+    }
+
+    p_day_config = &(p_config->day_configs[day_s32]);
+    day_config.enabled = ((given_u8 & 0x01U) != 0U) ? day_config.enabled : p_day_config->enabled;
+    day_config.start_time = ((given_u8 & 0x02U) != 0U) ? day_config.start_time : p_day_config->start_time;
+    day_config.end_time = ((given_u8 & 0x04U) != 0U) ? day_config.end_time : p_day_config->end_time;
+    day_config.interval_u16 = ((given_u8 & 0x08U) != 0U) ? day_config.interval_u16 : p_day_config->interval_u16;
+    day_config.duration_u16 = ((given_u8 & 0x10U) != 0U) ? day_config.duration_u16 : p_day_config->duration_u16;
+
+    /* The scheduler needs a sitting phase in every interval, disabled days may hold anything */
+    if (day_config.enabled != 0)
+    {
+        if (time_diff(&(day_config.start_time), &(day_config.end_time)) >= 0)
+        {
+            return "invalid end, not after start";
+        }
+        if (day_config.duration_u16 >= day_config.interval_u16)
+        {
+            return "invalid duration, not shorter than interval";
+        }
+    }
+
+    *p_day_config = day_config;
+
+    return NULL;
+}
+
+const char *api_parse_desk(JSON_READER *p_reader, SYSTEM_CONFIG *p_config)
+{
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    const char *p_error = NULL;
+
+    if (json_next(p_reader, &key) != JSON_TOKEN_OBJECT_BEGIN)
+    {
+        return "expected an object";
+    }
+
+    while ((NULL == p_error) && (json_next(p_reader, &key) == JSON_TOKEN_STRING))
+    {
+        (void)json_next(p_reader, &value);
+
+        if (json_token_equals(&key, "height_standing"))
+        {
+            p_error = api_parse_u16(&value, &(p_config->height_standing_u16)) ? NULL : "invalid height_standing";
+        }
+        else if (json_token_equals(&key, "height_sitting"))
+        {
+            p_error = api_parse_u16(&value, &(p_config->height_sitting_u16)) ? NULL : "invalid height_sitting";
+        }
+        else if (json_token_equals(&key, "height_tolerance"))
+        {
+            p_error = api_parse_u16(&value, &(p_config->height_tolerance_u16)) ? NULL : "invalid height_tolerance";
+        }
+        else
+        {
+            p_error = json_skip(p_reader, &value) ? NULL : "malformed document";
+        }
+    }
+
+    if ((NULL == p_error) && (key.type_e != JSON_TOKEN_OBJECT_END))
+    {
+        p_error = "malformed document";
+    }
+    else if ((NULL == p_error) && (p_config->height_sitting_u16 >= p_config->height_standing_u16))
+    {
+        p_error = "sitting height must be below standing height";
+    }
+    else
+    {
+        /* Fine */
+    }
+
+    return p_error;
+}
+
+bool api_parse_u16(const JSON_TOKEN *p_token, uint16 *p_value_u16)
+{
+    bool valid_b = (p_token->type_e == JSON_TOKEN_NUMBER) && (p_token->number_s32 >= 0) && (p_token->number_s32 <= 0xffff);
+
+    if (valid_b)
+    {
+        *p_value_u16 = (uint16)p_token->number_s32;
+    }
+
+    return valid_b;
+}
+
+bool api_parse_time(const JSON_TOKEN *p_token, TIME *p_time)
+{
+    const char *p_str = p_token->p_data;
+    uint8 fields_vu8[3] = {0U, 0U, 0U};
+    uint8 field_u8 = 0U;
+    uint8 digits_u8 = 0U;
+
+    /* "HH:MM" or "HH:MM:SS" */
+    if ((p_token->type_e != JSON_TOKEN_STRING) || ((p_token->size_u16 != 5U) && (p_token->size_u16 != 8U)))
+    {
+        return false;
+    }
+
+    for (uint16 i = 0U; i < p_token->size_u16; ++i)
+    {
+        if ((p_str[i] >= '0') && (p_str[i] <= '9') && (digits_u8 < 2U))
+        {
+            fields_vu8[field_u8] = (uint8)((fields_vu8[field_u8] * 10U) + (uint8)(p_str[i] - '0'));
+            digits_u8 += 1U;
+        }
+        else if ((p_str[i] == ':') && (digits_u8 == 2U) && (field_u8 < 2U))
+        {
+            field_u8 += 1U;
+            digits_u8 = 0U;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if ((fields_vu8[0] > 23U) || (fields_vu8[1] > 59U) || (fields_vu8[2] > 59U))
+    {
+        return false;
+    }
+
+    p_time->hour_u8 = fields_vu8[0];
+    p_time->minute_u8 = fields_vu8[1];
+    p_time->second_u8 = fields_vu8[2];
+
+    return true;
+}
+
+/*****************************************************************************/
+
+void api_get_config(SYSTEM_CONFIG *p_config)
+{
+    sc_get_day_configs(p_config->day_configs);
+    dc_get_params(&(p_config->height_standing_u16), &(p_config->height_sitting_u16), &(p_config->height_tolerance_u16));
+    sc_get_tolerances(&(p_config->transition_time_tolerance_u16), &(p_config->command_send_time_tolerance_u16));
+    sl_get_server(p_config->syslog_server_vu8, &(p_config->syslog_port_u16));
+    mq_get_broker(p_config->mqtt_broker_vu8, &(p_config->mqtt_port_u16));
+    p_config->stagger_window_s_u16 = sg_get_window();
+}
+
+void api_apply_config(const SYSTEM_CONFIG *p_config)
+{
+    EVENT event;
+
+    event.type_e = EV_CONFIG_CHANGED;
+    event.data.p_config = p_config;
+    ev_publish(&event);
+
+    if (!cfg_save(p_config))
+    {
+        log_msg(LOG_LEVEL_ERROR, api_module_str, "Could not store the new configuration.");
+    }
+}
+
+void api_send_error(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_error)
+{
+    char response_str[96];
+    JSON_WRITER writer;
+
+    json_init(&writer, response_str, sizeof(response_str) - 1U);
+    json_object_begin(&writer, NULL);
+    json_add_string(&writer, "error", p_error);
+    json_object_end(&writer);
+    response_str[json_length(&writer)] = '\0';
+
+    http_send(p_conn, status_u16, api_json_type_str, response_str);
+}
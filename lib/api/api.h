@@ -0,0 +1,25 @@
+#ifndef API_MAIN_H
+#define API_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+extern void api_init(fn_command_receiver command_receiver);
+
+/* The documents of PUT /api/schedule and /api/desk for other transports, applied and stored
+ * the same way. NULL on success, otherwise what is wrong with the document. */
+extern const char *api_update_schedule(const char *p_data, const uint16 size_u16);
+extern const char *api_update_desk(const char *p_data, const uint16 size_u16);
+
+/* Stores what the modules use right now, for settings changed through their own endpoints */
+extern void api_store_config();
+
+/* Names as in POST /api/command, "up" or "standing", DC_CMD_INVALID if unknown */
+extern DC_COMMAND api_command_from_name(const char *p_name, const uint16 size_u16);
+
+/*****************************************************************************/
+
+#endif
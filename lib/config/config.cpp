@@ -0,0 +1,363 @@
+#include "config.h"
+
+#include <string.h>
+#include <flash_hal.h>
+
+#include "log.h"
+
+/*****************************************************************************/
+
+/*
+ * Records are appended to fixed-size slots at the beginning of the (otherwise
+ * unused) filesystem area. The newest record with a valid CRC and commit marker
+ * wins. The commit marker is written last, so a record torn by a power loss is
+ * simply skipped and the previous one stays valid. A sector is only erased when
+ * writing moves on to it, which never holds the newest record.
+ *
+ * New fields are only ever appended to the payload and come with a new
+ * version. A record of an older version is still loaded, the fields it does
+ * not have yet keep the defaults the caller passes in.
+ */
+#define CFG_SECTOR_SIZE 4096U
+#define CFG_NUM_SECTORS 4U
+#define CFG_SLOT_SIZE 128U
+#define CFG_SLOTS_PER_SECTOR (CFG_SECTOR_SIZE / CFG_SLOT_SIZE)
+
+#define CFG_RECORD_MAGIC 0xdc5eU
+#define CFG_RECORD_VERSION 4U /* 2: syslog server, 3: MQTT broker, 4: stagger window */
+#define CFG_COMMIT_MARKER 0x4b4f4d43UL /* "CMOK" */
+#define CFG_ERASED_WORD 0xffffffffUL
+
+/*****************************************************************************/
+
+typedef struct __attribute__((packed))
+{
+    uint8 start_hms_vu8[3];
+    uint8 end_hms_vu8[3];
+    uint16 interval_u16;
+    uint16 duration_u16;
+    uint8 enabled_u8;
+} CFG_DAY_RECORD;
+
+typedef struct __attribute__((packed))
+{
+    CFG_DAY_RECORD days[NUM_WEEKDAYS];
+    uint16 height_standing_u16;
+    uint16 height_sitting_u16;
+    uint16 height_tolerance_u16;
+    uint16 transition_time_tolerance_u16;
+    uint16 command_send_time_tolerance_u16;
+    uint8 syslog_server_vu8[4]; /* since version 2 */
+    uint16 syslog_port_u16;
+    uint8 mqtt_broker_vu8[4]; /* since version 3 */
+    uint16 mqtt_port_u16;
+    uint16 stagger_window_s_u16; /* since version 4 */
+} CFG_PAYLOAD;
+
+typedef struct __attribute__((packed))
+{
+    uint16 magic_u16;
+    uint8 version_u8;
+    uint8 payload_size_u8;
+    uint32 sequence_u32;
+    uint32 crc_u32; /* over sequence and payload_size_u8 bytes of payload */
+    CFG_PAYLOAD payload;
+} CFG_RECORD;
+
+/* Word-aligned slot image, the flash API only deals in 32 bit words */
+typedef union
+{
+    CFG_RECORD record;
+    uint32 words_vu32[CFG_SLOT_SIZE / sizeof(uint32)];
+} CFG_SLOT;
+
+static_assert(sizeof(CFG_RECORD) <= (CFG_SLOT_SIZE - sizeof(uint32)), "Record and commit marker must fit into a slot");
+static_assert(sizeof(CFG_SLOT) == CFG_SLOT_SIZE, "Slot must have the exact slot size");
+
+/*****************************************************************************/
+
+const char cfg_module_str[] PROGMEM = "Config";
+
+/*****************************************************************************/
+
+bool cfg_available_b = false;
+uint32 cfg_first_sector_u32 = 0U;
+
+CFG_SLOT cfg_slot;                 /* shared scratch buffer for reading and writing */
+CFG_PAYLOAD cfg_latest_payload;    /* copy of the newest valid record */
+uint8 cfg_latest_size_u8 = 0U;     /* of its payload, smaller for older versions */
+bool cfg_latest_valid_b = false;
+uint32 cfg_latest_sequence_u32 = 0U;
+uint16 cfg_write_slot_u16 = 0U;    /* absolute slot index of the next write */
+bool cfg_write_needs_erase_b = true;
+
+/*****************************************************************************/
+
+uint32 cfg_slot_address(const uint16 slot_u16);
+uint32 cfg_record_crc(const CFG_RECORD *p_record);
+void cfg_encode(const SYSTEM_CONFIG *p_config, CFG_PAYLOAD *p_payload);
+void cfg_decode(const CFG_PAYLOAD *p_payload, SYSTEM_CONFIG *p_config);
+void cfg_advance_write_slot();
+
+/*****************************************************************************/
+
+void cfg_init()
+{
+    uint16 latest_slot_u16 = 0U;
+    uint32 marker_u32;
+    const CFG_RECORD *p_record = &(cfg_slot.record);
+
+    cfg_latest_valid_b = false;
+    cfg_latest_sequence_u32 = 0U;
+    cfg_write_slot_u16 = 0U;
+    cfg_write_needs_erase_b = true;
+
+    /* Only use the filesystem area if the linker script reserved one that is large enough */
+    cfg_first_sector_u32 = (uint32)FS_PHYS_ADDR / CFG_SECTOR_SIZE;
+    cfg_available_b = ((uint32)FS_PHYS_SIZE >= (CFG_NUM_SECTORS * CFG_SECTOR_SIZE));
+    if (!cfg_available_b)
+    {
+        log_msg(LOG_LEVEL_ERROR, cfg_module_str, "No flash area reserved for the configuration.");
+        return;
+    }
+
+    /* Single pass over all slots, stop scanning a sector at its first erased slot */
+    for (uint16 sector_u16 = 0U; sector_u16 < CFG_NUM_SECTORS; ++sector_u16)
+    {
+        for (uint16 i = 0U; i < CFG_SLOTS_PER_SECTOR; ++i)
+        {
+            const uint16 slot_u16 = (sector_u16 * CFG_SLOTS_PER_SECTOR) + i;
+
+            if (!ESP.flashRead(cfg_slot_address(slot_u16), cfg_slot.words_vu32, CFG_SLOT_SIZE))
+            {
+                break;
+            }
+            if (cfg_slot.words_vu32[0U] == CFG_ERASED_WORD)
+            {
+                break;
+            }
+
+            marker_u32 = cfg_slot.words_vu32[(CFG_SLOT_SIZE / sizeof(uint32)) - 1U];
+            if ((p_record->magic_u16 == CFG_RECORD_MAGIC) &&
+                (p_record->version_u8 >= 1U) && (p_record->version_u8 <= CFG_RECORD_VERSION) &&
+                (p_record->payload_size_u8 <= sizeof(CFG_PAYLOAD)) &&
+                (marker_u32 == CFG_COMMIT_MARKER) &&
+                (!cfg_latest_valid_b || ((sint32)(p_record->sequence_u32 - cfg_latest_sequence_u32) > 0)) &&
+                (p_record->crc_u32 == cfg_record_crc(p_record)))
+            {
+                (void)memcpy(&cfg_latest_payload, &(p_record->payload), p_record->payload_size_u8);
+                cfg_latest_size_u8 = p_record->payload_size_u8;
+                cfg_latest_sequence_u32 = p_record->sequence_u32;
+                cfg_latest_valid_b = true;
+                latest_slot_u16 = slot_u16;
+            }
+            else
+            {
+                /* Torn, stale or foreign data */
+            }
+        }
+    }
+
+    if (cfg_latest_valid_b)
+    {
+        /* Continue right after the newest record, garbage slots are skipped when writing */
+        cfg_write_slot_u16 = latest_slot_u16;
+        cfg_write_needs_erase_b = false;
+        cfg_advance_write_slot();
+
+        log_msg(LOG_LEVEL_INFO, cfg_module_str, "Found configuration #%u in slot %u.", cfg_latest_sequence_u32, latest_slot_u16);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_INFO, cfg_module_str, "No stored configuration found.");
+    }
+}
+
+bool cfg_load(SYSTEM_CONFIG *p_config)
+{
+    CFG_PAYLOAD payload;
+
+    if (cfg_latest_valid_b)
+    {
+        /* Stored fields over the defaults, an older record leaves the newer fields alone */
+        cfg_encode(p_config, &payload);
+        (void)memcpy(&payload, &cfg_latest_payload, cfg_latest_size_u8);
+        cfg_decode(&payload, p_config);
+    }
+    else
+    {
+        /* Caller keeps its defaults */
+    }
+
+    return cfg_latest_valid_b;
+}
+
+bool cfg_save(const SYSTEM_CONFIG *p_config)
+{
+    CFG_PAYLOAD payload;
+    CFG_RECORD *p_record = &(cfg_slot.record);
+    uint32 marker_u32 = CFG_COMMIT_MARKER;
+    bool ok_b = false;
+
+    if (!cfg_available_b)
+    {
+        return false;
+    }
+
+    /* Identical configs do not need to wear the flash */
+    cfg_encode(p_config, &payload);
+    if (cfg_latest_valid_b && (cfg_latest_size_u8 == sizeof(CFG_PAYLOAD)) && (memcmp(&payload, &cfg_latest_payload, sizeof(CFG_PAYLOAD)) == 0))
+    {
+        return true;
+    }
+
+    /* Find the next erased slot, erasing the next sector once the current one is full */
+    for (uint16 attempts_u16 = 0U; attempts_u16 < (CFG_NUM_SECTORS * CFG_SLOTS_PER_SECTOR); ++attempts_u16)
+    {
+        if (cfg_write_needs_erase_b)
+        {
+            ok_b = ESP.flashEraseSector(cfg_first_sector_u32 + (cfg_write_slot_u16 / CFG_SLOTS_PER_SECTOR));
+            cfg_write_needs_erase_b = false;
+            if (!ok_b)
+            {
+                break;
+            }
+        }
+
+        ok_b = ESP.flashRead(cfg_slot_address(cfg_write_slot_u16), cfg_slot.words_vu32, sizeof(uint32));
+        if (ok_b && (cfg_slot.words_vu32[0U] == CFG_ERASED_WORD))
+        {
+            break;
+        }
+
+        ok_b = false;
+        cfg_advance_write_slot();
+    }
+
+    if (ok_b)
+    {
+        (void)memset(&cfg_slot, 0xff, sizeof(CFG_SLOT));
+        p_record->magic_u16 = CFG_RECORD_MAGIC;
+        p_record->version_u8 = CFG_RECORD_VERSION;
+        p_record->payload_size_u8 = sizeof(CFG_PAYLOAD);
+        p_record->sequence_u32 = cfg_latest_sequence_u32 + 1U;
+        (void)memcpy(&(p_record->payload), &payload, sizeof(CFG_PAYLOAD));
+        p_record->crc_u32 = cfg_record_crc(p_record);
+
+        /* Record first, commit marker last */
+        ok_b = ESP.flashWrite(cfg_slot_address(cfg_write_slot_u16), cfg_slot.words_vu32, CFG_SLOT_SIZE - sizeof(uint32));
+        ok_b = ok_b && ESP.flashWrite(cfg_slot_address(cfg_write_slot_u16) + CFG_SLOT_SIZE - sizeof(uint32), &marker_u32, sizeof(uint32));
+    }
+
+    if (ok_b)
+    {
+        (void)memcpy(&cfg_latest_payload, &payload, sizeof(CFG_PAYLOAD));
+        cfg_latest_size_u8 = sizeof(CFG_PAYLOAD);
+        cfg_latest_sequence_u32 += 1U;
+        cfg_latest_valid_b = true;
+
+        log_msg(LOG_LEVEL_INFO, cfg_module_str, "Stored configuration #%u in slot %u.", cfg_latest_sequence_u32, cfg_write_slot_u16);
+        cfg_advance_write_slot();
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, cfg_module_str, "Failed to store configuration.");
+    }
+
+    return ok_b;
+}
+
+uint32 cfg_get_sequence()
+{
+    return cfg_latest_valid_b ? cfg_latest_sequence_u32 : 0U;
+}
+
+/*****************************************************************************/
+
+uint32 cfg_slot_address(const uint16 slot_u16)
+{
+    return (cfg_first_sector_u32 * CFG_SECTOR_SIZE) + ((uint32)slot_u16 * CFG_SLOT_SIZE);
+}
+
+uint32 cfg_record_crc(const CFG_RECORD *p_record)
+{
+    uint32 crc_u32;
+
+    crc_u32 = crc32_update(0U, (const uint8 *)&(p_record->sequence_u32), sizeof(p_record->sequence_u32));
+    crc_u32 = crc32_update(crc_u32, (const uint8 *)&(p_record->payload), p_record->payload_size_u8);
+
+    return crc_u32;
+}
+
+void cfg_encode(const SYSTEM_CONFIG *p_config, CFG_PAYLOAD *p_payload)
+{
+    for (uint8 i = 0U; i < NUM_WEEKDAYS; ++i)
+    {
+        const DAY_CONFIG *p_day = &(p_config->day_configs[i]);
+        CFG_DAY_RECORD *p_out = &(p_payload->days[i]);
+
+        p_out->start_hms_vu8[0U] = p_day->start_time.hour_u8;
+        p_out->start_hms_vu8[1U] = p_day->start_time.minute_u8;
+        p_out->start_hms_vu8[2U] = p_day->start_time.second_u8;
+        p_out->end_hms_vu8[0U] = p_day->end_time.hour_u8;
+        p_out->end_hms_vu8[1U] = p_day->end_time.minute_u8;
+        p_out->end_hms_vu8[2U] = p_day->end_time.second_u8;
+        p_out->interval_u16 = p_day->interval_u16;
+        p_out->duration_u16 = p_day->duration_u16;
+        p_out->enabled_u8 = (p_day->enabled > 0) ? 1U : 0U;
+    }
+
+    p_payload->height_standing_u16 = p_config->height_standing_u16;
+    p_payload->height_sitting_u16 = p_config->height_sitting_u16;
+    p_payload->height_tolerance_u16 = p_config->height_tolerance_u16;
+    p_payload->transition_time_tolerance_u16 = p_config->transition_time_tolerance_u16;
+    p_payload->command_send_time_tolerance_u16 = p_config->command_send_time_tolerance_u16;
+    (void)memcpy(p_payload->syslog_server_vu8, p_config->syslog_server_vu8, sizeof(p_payload->syslog_server_vu8));
+    p_payload->syslog_port_u16 = p_config->syslog_port_u16;
+    (void)memcpy(p_payload->mqtt_broker_vu8, p_config->mqtt_broker_vu8, sizeof(p_payload->mqtt_broker_vu8));
+    p_payload->mqtt_port_u16 = p_config->mqtt_port_u16;
+    p_payload->stagger_window_s_u16 = p_config->stagger_window_s_u16;
+}
+
+void cfg_decode(const CFG_PAYLOAD *p_payload, SYSTEM_CONFIG *p_config)
+{
+    for (uint8 i = 0U; i < NUM_WEEKDAYS; ++i)
+    {
+        const CFG_DAY_RECORD *p_in = &(p_payload->days[i]);
+        DAY_CONFIG *p_day = &(p_config->day_configs[i]);
+
+        p_day->start_time.hour_u8 = p_in->start_hms_vu8[0U];
+        p_day->start_time.minute_u8 = p_in->start_hms_vu8[1U];
+        p_day->start_time.second_u8 = p_in->start_hms_vu8[2U];
+        p_day->end_time.hour_u8 = p_in->end_hms_vu8[0U];
+        p_day->end_time.minute_u8 = p_in->end_hms_vu8[1U];
+        p_day->end_time.second_u8 = p_in->end_hms_vu8[2U];
+        p_day->interval_u16 = p_in->interval_u16;
+        p_day->duration_u16 = p_in->duration_u16;
+        p_day->enabled = p_in->enabled_u8;
+    }
+
+    p_config->height_standing_u16 = p_payload->height_standing_u16;
+    p_config->height_sitting_u16 = p_payload->height_sitting_u16;
+    p_config->height_tolerance_u16 = p_payload->height_tolerance_u16;
+    p_config->transition_time_tolerance_u16 = p_payload->transition_time_tolerance_u16;
+    p_config->command_send_time_tolerance_u16 = p_payload->command_send_time_tolerance_u16;
+    (void)memcpy(p_config->syslog_server_vu8, p_payload->syslog_server_vu8, sizeof(p_config->syslog_server_vu8));
+    p_config->syslog_port_u16 = p_payload->syslog_port_u16;
+    (void)memcpy(p_config->mqtt_broker_vu8, p_payload->mqtt_broker_vu8, sizeof(p_config->mqtt_broker_vu8));
+    p_config->mqtt_port_u16 = p_payload->mqtt_port_u16;
+    p_config->stagger_window_s_u16 = p_payload->stagger_window_s_u16;
+}
+
+void cfg_advance_write_slot()
+{
+    cfg_write_slot_u16 = (cfg_write_slot_u16 + 1U) % (CFG_NUM_SECTORS * CFG_SLOTS_PER_SECTOR);
+
+    /* Entering a new sector, which only holds older records by now */
+    if ((cfg_write_slot_u16 % CFG_SLOTS_PER_SECTOR) == 0U)
+    {
+        cfg_write_needs_erase_b = true;
+    }
+}
+
+/*****************************************************************************/
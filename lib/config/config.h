@@ -0,0 +1,18 @@
+#ifndef CFG_MAIN_H
+#define CFG_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+extern void cfg_init();
+
+extern bool cfg_load(SYSTEM_CONFIG *p_config); /* over the defaults in *p_config, returns false if nothing valid is stored */
+extern bool cfg_save(const SYSTEM_CONFIG *p_config);
+extern uint32 cfg_get_sequence(); /* of the stored configuration, counts up with every saved change, 0 if none */
+
+/*****************************************************************************/
+
+#endif
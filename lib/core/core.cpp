@@ -9,7 +9,7 @@ sint32 time_diff(const TIME *p_a, const TIME *p_b)
     return time_to_seconds(p_a) - time_to_seconds(p_b);
 }
 
-uint32 time_add(const TIME *p_time, const uint32 seconds_u32, TIME *p_time_out)
+uint32 time_add(const TIME *p_time, TIME *p_time_out, const uint32 seconds_u32)
 {
     uint16 day_carryover_u16 = 0U;
 
@@ -55,3 +55,22 @@ sint32 time_to_seconds(const TIME *p_time)
 }
 
 /*****************************************************************************/
+
+uint32 crc32_update(uint32 crc_u32, const uint8 *p_data, const uint32 size_u32)
+{
+    /* Nibble-wise CRC-32 (IEEE), small enough to keep the table in RAM */
+    static const uint32 CRC32_NIBBLE_TABLE[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+    crc_u32 = ~crc_u32;
+    for (uint32 i = 0U; i < size_u32; ++i)
+    {
+        crc_u32 = CRC32_NIBBLE_TABLE[(crc_u32 ^ p_data[i]) & 0x0fU] ^ (crc_u32 >> 4);
+        crc_u32 = CRC32_NIBBLE_TABLE[(crc_u32 ^ (p_data[i] >> 4)) & 0x0fU] ^ (crc_u32 >> 4);
+    }
+
+    return ~crc_u32;
+}
+
+/*****************************************************************************/
@@ -9,18 +9,11 @@
 /*****************************************************************************/
 
 #define UNSIGNED_DIFF(a, b) ((a) >= (b) ? ((a) - (b)) : ((b) - (a)))
-#define ONCE_EVERY_MS(ms)                     \
-    {                                         \
-        static unsigned long last = millis(); \
-        if ((millis() - last) < (ms))         \
-        {                                     \
-            return;                           \
-        }                                     \
-        else                                  \
-        {                                     \
-            last = millis();                  \
-        }                                     \
-    }
+
+/* Set by the build from git describe, see platformio.ini */
+#ifndef FW_VERSION
+#define FW_VERSION "dev"
+#endif
 
 /*****************************************************************************/
 
@@ -91,12 +84,47 @@ typedef struct
     int enabled;
 } DAY_CONFIG;
 
+/* Everything that is persisted across reboots */
+typedef struct
+{
+    DAY_CONFIG day_configs[NUM_WEEKDAYS];
+    uint16 height_standing_u16;
+    uint16 height_sitting_u16;
+    uint16 height_tolerance_u16;
+    uint16 transition_time_tolerance_u16;
+    uint16 command_send_time_tolerance_u16;
+    uint8 syslog_server_vu8[4]; /* IPv4 address, 0.0.0.0 while shipping is off */
+    uint16 syslog_port_u16;
+    uint8 mqtt_broker_vu8[4]; /* IPv4 address, 0.0.0.0 while MQTT is off */
+    uint16 mqtt_port_u16;
+    uint16 stagger_window_s_u16; /* 0 while staggering is off */
+} SYSTEM_CONFIG;
+
 /*****************************************************************************/
 
-/* Provider function pointers */
-typedef uint16 (*fn_height_provider)(void);
-typedef const DATETIME *(*fn_time_provider)(void);
-typedef DC_STATE (*fn_desk_state_provider)(void);
+/* Result of a scheduled transition, shared through EV_TRANSITION_DONE */
+typedef enum
+{
+    SC_OUTCOME_NONE = 0,
+    SC_OUTCOME_REACHED,     /* desk arrived in the target state */
+    SC_OUTCOME_NO_REACTION, /* desk never started moving, even after retries */
+    SC_OUTCOME_STALLED,     /* desk started moving but stopped short of the target */
+    SC_OUTCOME_ABORTED      /* schedule asked for something else in the meantime */
+} SC_OUTCOME;
+
+/* Outcome of one scheduled transition */
+typedef struct
+{
+    DC_COMMAND command_e;
+    SC_OUTCOME outcome_e;
+    uint8 attempts_u8;
+    uint32 start_latency_ms_u32; /* first command until the desk moved, 0 if it never did */
+    uint32 total_latency_ms_u32; /* first command until the outcome */
+    uint32 lead_ms_u32;          /* first command until the scheduled time, 0 if sent at or after it */
+    sint32 arrival_error_ms_s32; /* arrival minus scheduled time, negative when early, 0 unless reached */
+} SC_TRANSITION_RECORD;
+
+/*****************************************************************************/
 
 /* Receiver function pointers */
 typedef int (*fn_command_receiver)(const DC_COMMAND);
@@ -108,6 +136,8 @@ extern sint32 time_diff(const TIME *p_a, const TIME *p_b);
 extern uint32 time_add(const TIME *p_time, TIME *p_time_out, const uint32 seconds_u32); /* returns number of days carried over */
 extern sint32 time_to_seconds(const TIME *p_time);
 
+extern uint32 crc32_update(uint32 crc_u32, const uint8 *p_data, const uint32 size_u32); /* start with crc_u32 = 0 */
+
 /*****************************************************************************/
 
 #endif
\ No newline at end of file
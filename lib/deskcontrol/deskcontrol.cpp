@@ -2,7 +2,10 @@
 
 #include <SoftwareSerial.h>
 
+#include "events.h"
 #include "log.h"
+#include "tasks.h"
+#include "trace.h"
 
 /*****************************************************************************/
 
@@ -14,7 +17,11 @@ const uint32_t DC_SERIAL_BAUDRATE_U32 = 9600;
 const int8_t DC_SERIAL_RX_PIN_I8 = 13; // D7 GPIO13
 const int8_t DC_SERIAL_TX_PIN_I8 = 15; // D8 GPIO15
 const uint8_t DC_COMMS_PIN20_U8 = 05;  // D1 GPI05
-const char *dc_module_str = "Desk";
+const uint32 DC_WAKEUP_PERIOD_MS_U32 = 500U;
+const uint32 DC_ACTIVATION_MS_U32 = 1100U;   /* PIN20 high time the controller needs to listen */
+const uint32 DC_JOG_REPEAT_MS_U32 = 100U;    /* cadence of the keypad while a button is held */
+const uint32 DC_JOG_DEADMAN_MS_U32 = 500U;   /* stop if the client stops refreshing the jog */
+const char dc_module_str[] PROGMEM = "Desk";
 
 /*****************************************************************************/
 
@@ -29,22 +36,39 @@ uint16 dc_height_tolerance_u16 = 0U;
 DC_STATE dc_state_current_e = DC_STATE_UNKNOWN;
 uint16 dc_state_current_height_u16 = 0U;
 bool dc_state_currently_active_b = false;
+bool dc_activating_b = false;
+DC_COMMAND dc_pending_cmd_e = DC_CMD_INVALID; /* sent once the activation is over */
+
+DC_COMMAND dc_jog_cmd_e = DC_CMD_INVALID;
+uint32 dc_jog_refresh_ms_u32 = 0U;
+
+sint8 dc_activation_task_s8 = TK_INVALID_TASK;
+sint8 dc_jog_task_s8 = TK_INVALID_TASK;
 
 TIME dc_height_query_last_command_time = {0};
 
+DC_STATS dc_stats = {0};
+
 /*****************************************************************************/
 
 void dc_reset_read_buffer();
 void dc_reset_current_state();
 
+bool dc_serial_ready();
+void dc_handle_event(const EVENT *p_event);
+void dc_handle_wakeup();
 void dc_handle_serial();
 void dc_handle_state();
+void dc_handle_activation_done();
+void dc_handle_jog();
 
 void dc_parse_received_message(const byte *p_buffer, const uint8 size_u8);
 uint16 dc_parse_height_from_buffer(const byte *p_buffer, const uint8 size_u8);
 uint8 dc_parse_digit_from_byte(byte bt);
 
-void dc_request_activation();
+bool dc_request_activation();
+const byte *dc_get_frame(const DC_COMMAND cmd_e, uint8 *p_size_u8);
+void dc_transmit(const DC_COMMAND cmd_e);
 
 /*****************************************************************************/
 
@@ -67,15 +91,14 @@ void dc_init()
     /* Reset state */
     dc_set_params(0U, 0U, 0U);
     dc_reset_current_state();
-}
 
-void dc_loop()
-{
-    /* Make sure we handle all incoming data */
-    dc_handle_serial();
+    /* Incoming data is handled as soon as it arrives, waking up the desk is not urgent */
+    (void)tk_add_io_hook("Desk RX", dc_serial_ready, dc_handle_serial);
+    (void)tk_add_periodic("Desk wakeup", dc_handle_wakeup, DC_WAKEUP_PERIOD_MS_U32);
+    dc_activation_task_s8 = tk_add_oneshot("Desk activation", dc_handle_activation_done);
+    dc_jog_task_s8 = tk_add_oneshot("Desk jog", dc_handle_jog);
 
-    /* Keep state up to date */
-    dc_handle_state();
+    (void)ev_subscribe(EV_CONFIG_CHANGED, dc_handle_event);
 }
 
 void dc_set_params(uint16 height_standing_u16, uint16 height_sitting_u16, uint16 height_tolerance_u16)
@@ -83,6 +106,16 @@ void dc_set_params(uint16 height_standing_u16, uint16 height_sitting_u16, uint16
     dc_height_standing_u16 = height_standing_u16;
     dc_height_sitting_u16 = height_sitting_u16;
     dc_height_tolerance_u16 = height_tolerance_u16;
+
+    /* Thresholds changed, so might the state */
+    dc_handle_state();
+}
+
+void dc_get_params(uint16 *p_height_standing_u16, uint16 *p_height_sitting_u16, uint16 *p_height_tolerance_u16)
+{
+    *p_height_standing_u16 = dc_height_standing_u16;
+    *p_height_sitting_u16 = dc_height_sitting_u16;
+    *p_height_tolerance_u16 = dc_height_tolerance_u16;
 }
 
 /*****************************************************************************/
@@ -90,102 +123,103 @@ void dc_set_params(uint16 height_standing_u16, uint16 height_sitting_u16, uint16
 int dc_send_cmd(const DC_COMMAND cmd_e)
 {
     int ret = 0;
-
-    const byte CMD_WAKEUP[] = {0x9b, 0x06, 0x02, 0x00, 0x00, 0x6c, 0xa1, 0x9d};
-    const byte CMD_UP[] = {0x9b, 0x06, 0x02, 0x01, 0x00, 0xfc, 0xa0, 0x9d};
-    const byte CMD_DOWN[] = {0x9b, 0x06, 0x02, 0x02, 0x00, 0x0c, 0xa0, 0x9d};
-    const byte CMD_M[] = {0x9b, 0x06, 0x02, 0x20, 0x00, 0xac, 0xb8, 0x9d};
-    const byte CMD_PRESET_1[] = {0x9b, 0x06, 0x02, 0x04, 0x00, 0xac, 0xa3, 0x9d};
-    const byte CMD_PRESET_2[] = {0x9b, 0x06, 0x02, 0x08, 0x00, 0xac, 0xa6, 0x9d};
-    const byte CMD_PRESET_3[] = {0x9b, 0x06, 0x02, 0x10, 0x00, 0xac, 0xac, 0x9d};
-    const byte CMD_PRESET_4[] = {0x9b, 0x06, 0x02, 0x00, 0x01, 0xac, 0x60, 0x9d};
-
-    const byte *p_cmd_u8 = NULL;
     uint8 cmd_size_u8 = 0;
+    const byte *p_cmd_u8 = dc_get_frame(cmd_e, &cmd_size_u8);
 
-    switch (cmd_e)
-    {
-    case DC_CMD_WAKEUP:
-    {
-        p_cmd_u8 = CMD_WAKEUP;
-        cmd_size_u8 = sizeof(CMD_WAKEUP);
-        break;
-    }
-    case DC_CMD_UP:
-    {
-        p_cmd_u8 = CMD_UP;
-        cmd_size_u8 = sizeof(CMD_UP);
-        break;
-    }
-    case DC_CMD_DOWN:
-    {
-        p_cmd_u8 = CMD_DOWN;
-        cmd_size_u8 = sizeof(CMD_DOWN);
-        break;
-    }
-    case DC_CMD_M:
-    {
-        p_cmd_u8 = CMD_M;
-        cmd_size_u8 = sizeof(CMD_M);
-        break;
-    }
-    case DC_CMD_PRESET_1:
+    if ((p_cmd_u8 != NULL) && (cmd_size_u8 > 0))
     {
-        p_cmd_u8 = CMD_PRESET_1;
-        cmd_size_u8 = sizeof(CMD_PRESET_1);
-        break;
+        log_buffer(LOG_LEVEL_INFO, dc_module_str, "Sending command", p_cmd_u8, cmd_size_u8);
+
+        if (dc_request_activation())
+        {
+            dc_transmit(cmd_e);
+        }
+        else
+        {
+            /* Goes out as soon as the controller listens, a newer command replaces it */
+            dc_pending_cmd_e = cmd_e;
+        }
     }
-    case DC_CMD_PRESET_2:
+    else
     {
-        p_cmd_u8 = CMD_PRESET_2;
-        cmd_size_u8 = sizeof(CMD_PRESET_2);
-        break;
+        log_msg(LOG_LEVEL_ERROR, dc_module_str, "Cannot send command of enum index %i.", int(cmd_e));
+        ret = -1;
     }
-    case DC_CMD_PRESET_3:
+
+    return ret;
+}
+
+void dc_activate()
+{
+    if (!dc_activating_b)
     {
-        p_cmd_u8 = CMD_PRESET_3;
-        cmd_size_u8 = sizeof(CMD_PRESET_3);
-        break;
+        log_msg(LOG_LEVEL_INFO, dc_module_str, "Activating controller via PIN20.");
+
+        /* Everything else keeps running while PIN20 is held, dc_handle_activation_done() takes over */
+        digitalWrite(DC_COMMS_PIN20_U8, HIGH);
+        TR_BEGIN(TR_TRACK_DESK, "PIN20");
+        dc_activating_b = true;
+        dc_stats.activations_u32 += 1U;
+        tk_schedule(dc_activation_task_s8, DC_ACTIVATION_MS_U32);
     }
-    case DC_CMD_PRESET_4:
+    else
     {
-        p_cmd_u8 = CMD_PRESET_4;
-        cmd_size_u8 = sizeof(CMD_PRESET_4);
-        break;
+        /* Already on its way */
     }
-    default:
+}
+
+int dc_jog(const DC_COMMAND cmd_e)
+{
+    const DC_COMMAND previous_cmd_e = dc_jog_cmd_e;
+
+    if ((cmd_e != DC_CMD_UP) && (cmd_e != DC_CMD_DOWN))
     {
-        break;
-    }
+        log_msg(LOG_LEVEL_ERROR, dc_module_str, "Cannot jog with enum index %i.", int(cmd_e));
+        return -1;
     }
 
-    if ((p_cmd_u8 != NULL) && (cmd_size_u8 > 0))
+    dc_jog_cmd_e = cmd_e;
+    dc_jog_refresh_ms_u32 = millis();
+
+    /* Refreshes only move the dead-man deadline, a new direction goes out right away */
+    if (cmd_e != previous_cmd_e)
     {
-        dc_request_activation();
+        log_msg(LOG_LEVEL_INFO, dc_module_str, "Jogging %s.", (cmd_e == DC_CMD_UP) ? "up" : "down");
+        dc_handle_jog();
+    }
 
-        log_buffer(LOG_LEVEL_INFO, dc_module_str, "Sending command", p_cmd_u8, cmd_size_u8);
+    return 0;
+}
 
-        dc_serial.flush();
-        dc_serial.enableTx(true);
-        dc_serial.write(p_cmd_u8, (size_t)cmd_size_u8);
-        dc_serial.enableTx(false);
-    }
-    else
+void dc_jog_stop()
+{
+    if (dc_jog_cmd_e != DC_CMD_INVALID)
     {
-        log_msg(LOG_LEVEL_ERROR, dc_module_str, "Cannot send command of enum index %i.", int(cmd_e));
-        ret = -1;
-    }
+        log_msg(LOG_LEVEL_INFO, dc_module_str, "Jog stopped.");
 
-    return ret;
+        /* The controller stops on its own once the frames stop coming */
+        dc_jog_cmd_e = DC_CMD_INVALID;
+        tk_cancel(dc_jog_task_s8);
+        if ((dc_pending_cmd_e == DC_CMD_UP) || (dc_pending_cmd_e == DC_CMD_DOWN))
+        {
+            /* Still waiting for the activation, do not let it move at all */
+            dc_pending_cmd_e = DC_CMD_INVALID;
+        }
+        else
+        {
+            /* Nothing queued, or something else than a jog */
+        }
+    }
 }
 
-void dc_activate()
+DC_COMMAND dc_get_jog()
 {
-    log_msg(LOG_LEVEL_INFO, dc_module_str, "Activating controller via PIN20.");
+    return dc_jog_cmd_e;
+}
 
-    digitalWrite(DC_COMMS_PIN20_U8, HIGH);
-    delay(1100);
-    digitalWrite(DC_COMMS_PIN20_U8, LOW);
+bool dc_is_active()
+{
+    return dc_activating_b || dc_state_currently_active_b || (dc_jog_cmd_e != DC_CMD_INVALID);
 }
 
 uint16 dc_get_current_height()
@@ -198,6 +232,11 @@ DC_STATE dc_get_current_state()
     return dc_state_current_e;
 }
 
+const DC_STATS *dc_get_stats()
+{
+    return &dc_stats;
+}
+
 /*****************************************************************************/
 
 void dc_reset_read_buffer()
@@ -212,6 +251,30 @@ void dc_reset_current_state()
     dc_state_currently_active_b = false;
 }
 
+bool dc_serial_ready()
+{
+    return (dc_serial.available() > 0);
+}
+
+void dc_handle_event(const EVENT *p_event)
+{
+    const SYSTEM_CONFIG *p_config = p_event->data.p_config;
+
+    dc_set_params(p_config->height_standing_u16, p_config->height_sitting_u16, p_config->height_tolerance_u16);
+}
+
+void dc_handle_wakeup()
+{
+    if (dc_state_current_height_u16 == 0U)
+    {
+        dc_send_cmd(DC_CMD_WAKEUP); /* this should allow us to read the height with the next messages */
+    }
+    else
+    {
+        /* Already have a height */
+    }
+}
+
 void dc_handle_serial()
 {
     while (dc_serial.available())
@@ -230,6 +293,8 @@ void dc_handle_serial()
         else if (in == 0x9d)
         {
             /* Final byte, can now try to parse the buffer */
+            dc_stats.frames_u32 += 1U;
+            TR_INSTANT(TR_TRACK_DESK, "Frame RX", dc_rx_buffer_head_u8);
             dc_parse_received_message(dc_rx_buffer_vu8, (uint8)DC_RX_BUFFER_SIZE);
         }
         else
@@ -244,7 +309,9 @@ void dc_handle_serial()
 
 void dc_handle_state()
 {
+    const DC_STATE previous_state_e = dc_state_current_e;
     uint16 diff_u16;
+    EVENT event;
 
     /* Synchronize state to height if we have already received the height */
     if (dc_state_current_height_u16 > 0U)
@@ -271,14 +338,25 @@ void dc_handle_state()
     }
     else
     {
-        ONCE_EVERY_MS(500);
-        dc_send_cmd(DC_CMD_WAKEUP); /* this should allow us to read the height in the next loop calls */
+        /* No height yet, dc_handle_wakeup() takes care of that */
+    }
+
+    if (dc_state_current_e != previous_state_e)
+    {
+        event.type_e = EV_DESK_STATE_CHANGED;
+        event.data.desk_state_e = dc_state_current_e;
+        ev_publish(&event);
+    }
+    else
+    {
+        /* Nothing to tell */
     }
 }
 
 void dc_parse_received_message(const byte *p_buffer, const uint8 size_u8)
 {
     uint16 height_u16;
+    EVENT event;
 
     if (size_u8 >= 7U)
     {
@@ -296,6 +374,13 @@ void dc_parse_received_message(const byte *p_buffer, const uint8 size_u8)
                         dc_state_current_height_u16 = height_u16;
 
                         log_msg(LOG_LEVEL_INFO, dc_module_str, "Got height: %i cm.", height_u16);
+
+                        event.type_e = EV_HEIGHT_CHANGED;
+                        event.data.height_u16 = height_u16;
+                        ev_publish(&event);
+
+                        /* State can only change together with the height */
+                        dc_handle_state();
                     }
                 }
                 else
@@ -417,15 +502,144 @@ uint8 dc_parse_digit_from_byte(byte bt)
     return digit_u8;
 }
 
-void dc_request_activation()
+bool dc_request_activation()
 {
     if (dc_state_currently_active_b == false)
     {
         dc_activate();
-        dc_state_currently_active_b = true;
     }
     else
     {
         /* Already active */
     }
-}
\ No newline at end of file
+
+    return dc_state_currently_active_b;
+}
+
+const byte *dc_get_frame(const DC_COMMAND cmd_e, uint8 *p_size_u8)
+{
+    static const byte CMD_WAKEUP[] = {0x9b, 0x06, 0x02, 0x00, 0x00, 0x6c, 0xa1, 0x9d};
+    static const byte CMD_UP[] = {0x9b, 0x06, 0x02, 0x01, 0x00, 0xfc, 0xa0, 0x9d};
+    static const byte CMD_DOWN[] = {0x9b, 0x06, 0x02, 0x02, 0x00, 0x0c, 0xa0, 0x9d};
+    static const byte CMD_M[] = {0x9b, 0x06, 0x02, 0x20, 0x00, 0xac, 0xb8, 0x9d};
+    static const byte CMD_PRESET_1[] = {0x9b, 0x06, 0x02, 0x04, 0x00, 0xac, 0xa3, 0x9d};
+    static const byte CMD_PRESET_2[] = {0x9b, 0x06, 0x02, 0x08, 0x00, 0xac, 0xa6, 0x9d};
+    static const byte CMD_PRESET_3[] = {0x9b, 0x06, 0x02, 0x10, 0x00, 0xac, 0xac, 0x9d};
+    static const byte CMD_PRESET_4[] = {0x9b, 0x06, 0x02, 0x00, 0x01, 0xac, 0x60, 0x9d};
+
+    const byte *p_cmd_u8 = NULL;
+
+    switch (cmd_e)
+    {
+    case DC_CMD_WAKEUP:
+    {
+        p_cmd_u8 = CMD_WAKEUP;
+        *p_size_u8 = sizeof(CMD_WAKEUP);
+        break;
+    }
+    case DC_CMD_UP:
+    {
+        p_cmd_u8 = CMD_UP;
+        *p_size_u8 = sizeof(CMD_UP);
+        break;
+    }
+    case DC_CMD_DOWN:
+    {
+        p_cmd_u8 = CMD_DOWN;
+        *p_size_u8 = sizeof(CMD_DOWN);
+        break;
+    }
+    case DC_CMD_M:
+    {
+        p_cmd_u8 = CMD_M;
+        *p_size_u8 = sizeof(CMD_M);
+        break;
+    }
+    case DC_CMD_PRESET_1:
+    {
+        p_cmd_u8 = CMD_PRESET_1;
+        *p_size_u8 = sizeof(CMD_PRESET_1);
+        break;
+    }
+    case DC_CMD_PRESET_2:
+    {
+        p_cmd_u8 = CMD_PRESET_2;
+        *p_size_u8 = sizeof(CMD_PRESET_2);
+        break;
+    }
+    case DC_CMD_PRESET_3:
+    {
+        p_cmd_u8 = CMD_PRESET_3;
+        *p_size_u8 = sizeof(CMD_PRESET_3);
+        break;
+    }
+    case DC_CMD_PRESET_4:
+    {
+        p_cmd_u8 = CMD_PRESET_4;
+        *p_size_u8 = sizeof(CMD_PRESET_4);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+
+    return p_cmd_u8;
+}
+
+void dc_transmit(const DC_COMMAND cmd_e)
+{
+    uint8 cmd_size_u8 = 0;
+    const byte *p_cmd_u8 = dc_get_frame(cmd_e, &cmd_size_u8);
+
+    TR_INSTANT(TR_TRACK_DESK, "Command TX", cmd_e);
+    dc_serial.flush();
+    dc_serial.enableTx(true);
+    dc_serial.write(p_cmd_u8, (size_t)cmd_size_u8);
+    dc_serial.enableTx(false);
+
+    dc_stats.commands_u32 += 1U;
+}
+
+void dc_handle_activation_done()
+{
+    const DC_COMMAND pending_cmd_e = dc_pending_cmd_e;
+
+    digitalWrite(DC_COMMS_PIN20_U8, LOW);
+    TR_END(TR_TRACK_DESK, "PIN20");
+    dc_activating_b = false;
+    dc_state_currently_active_b = true;
+
+    dc_pending_cmd_e = DC_CMD_INVALID;
+    if (pending_cmd_e != DC_CMD_INVALID)
+    {
+        dc_transmit(pending_cmd_e);
+    }
+}
+
+void dc_handle_jog()
+{
+    if (dc_jog_cmd_e == DC_CMD_INVALID)
+    {
+        return;
+    }
+
+    if ((millis() - dc_jog_refresh_ms_u32) >= DC_JOG_DEADMAN_MS_U32)
+    {
+        log_msg(LOG_LEVEL_WARNING, dc_module_str, "Jog was not refreshed, stopping.");
+        dc_jog_stop();
+        return;
+    }
+
+    /* Same as a held button, without the log line for every frame */
+    if (dc_request_activation())
+    {
+        dc_transmit(dc_jog_cmd_e);
+    }
+    else
+    {
+        dc_pending_cmd_e = dc_jog_cmd_e;
+    }
+    tk_schedule(dc_jog_task_s8, DC_JOG_REPEAT_MS_U32);
+}
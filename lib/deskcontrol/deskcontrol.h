@@ -7,16 +7,33 @@
 
 /*****************************************************************************/
 
+typedef struct
+{
+    uint32 frames_u32;      /* complete frames received from the controller */
+    uint32 commands_u32;    /* frames sent, jog repeats included */
+    uint32 activations_u32; /* PIN20 pulses */
+} DC_STATS;
+
+/*****************************************************************************/
+
 extern void dc_init();
-extern void dc_loop();
 
 extern void dc_set_params(uint16 height_standing_u16, uint16 height_sitting_u16, uint16 height_tolerance_u16);
+extern void dc_get_params(uint16 *p_height_standing_u16, uint16 *p_height_sitting_u16, uint16 *p_height_tolerance_u16);
 
 extern int dc_send_cmd(const DC_COMMAND cmd_e);
 extern void dc_activate();
 
+/* Hold-to-move: UP/DOWN is repeated like a held keypad button until dc_jog_stop(),
+ * or until dc_jog() has not been called again for DC_JOG_DEADMAN_MS_U32 */
+extern int dc_jog(const DC_COMMAND cmd_e);
+extern void dc_jog_stop();
+extern DC_COMMAND dc_get_jog();
+extern bool dc_is_active(); /* from the PIN20 activation until the desk signs off, or while jogging */
+
 extern uint16 dc_get_current_height();
 extern DC_STATE dc_get_current_state();
+extern const DC_STATS *dc_get_stats();
 
 /*****************************************************************************/
 
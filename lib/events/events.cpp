@@ -0,0 +1,56 @@
+#include "events.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "log.h"
+
+/*****************************************************************************/
+
+const char ev_module_str[] PROGMEM = "Events";
+
+/*****************************************************************************/
+
+fn_event_receiver ev_receivers_vfn[NUM_EVENT_TYPES][EV_MAX_SUBSCRIBERS];
+uint16 ev_num_receivers_vu16[NUM_EVENT_TYPES];
+
+/*****************************************************************************/
+
+void ev_init()
+{
+    (void)memset(ev_receivers_vfn, 0, sizeof(ev_receivers_vfn));
+    (void)memset(ev_num_receivers_vu16, 0, sizeof(ev_num_receivers_vu16));
+}
+
+int ev_subscribe(const EV_TYPE type_e, fn_event_receiver p_receiver)
+{
+    int ret = 0;
+
+    if ((type_e < NUM_EVENT_TYPES) && (NULL != p_receiver) && (ev_num_receivers_vu16[type_e] < EV_MAX_SUBSCRIBERS))
+    {
+        ev_receivers_vfn[type_e][ev_num_receivers_vu16[type_e]++] = p_receiver;
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, ev_module_str, "Cannot subscribe to event type %i.", (int)type_e);
+        ret = -1;
+
+        /* Subscriptions are only made during setup, a missing one would silently lose events */
+        assert((type_e >= NUM_EVENT_TYPES) || (ev_num_receivers_vu16[type_e] < EV_MAX_SUBSCRIBERS));
+    }
+
+    return ret;
+}
+
+void ev_publish(const EVENT *p_event)
+{
+    const fn_event_receiver *p_receivers = ev_receivers_vfn[p_event->type_e];
+    const uint16 num_receivers_u16 = ev_num_receivers_vu16[p_event->type_e];
+
+    for (uint16 i = 0U; i < num_receivers_u16; ++i)
+    {
+        p_receivers[i](p_event);
+    }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,52 @@
+#ifndef EV_MAIN_H
+#define EV_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#ifndef EV_MAX_SUBSCRIBERS
+#define EV_MAX_SUBSCRIBERS 12U /* per event type, 7 on EV_HEIGHT_CHANGED so far, running out stops the boot */
+#endif
+
+/*****************************************************************************/
+
+typedef enum
+{
+    EV_HEIGHT_CHANGED = 0,
+    EV_DESK_STATE_CHANGED,
+    EV_SECOND_TICK,
+    EV_CONFIG_CHANGED,
+    EV_LINK_CHANGED,
+    EV_TRANSITION_DONE,
+    NUM_EVENT_TYPES
+} EV_TYPE;
+
+typedef struct
+{
+    EV_TYPE type_e;
+    union
+    {
+        uint16 height_u16;                        /* EV_HEIGHT_CHANGED */
+        DC_STATE desk_state_e;                    /* EV_DESK_STATE_CHANGED */
+        const DATETIME *p_time;                   /* EV_SECOND_TICK */
+        const SYSTEM_CONFIG *p_config;            /* EV_CONFIG_CHANGED */
+        bool link_up_b;                           /* EV_LINK_CHANGED */
+        const SC_TRANSITION_RECORD *p_transition; /* EV_TRANSITION_DONE */
+    } data;
+} EVENT;
+
+typedef void (*fn_event_receiver)(const EVENT *p_event);
+
+/*****************************************************************************/
+
+extern void ev_init();
+
+extern int ev_subscribe(const EV_TYPE type_e, fn_event_receiver p_receiver);
+extern void ev_publish(const EVENT *p_event); /* synchronous, receivers run before this returns */
+
+/*****************************************************************************/
+
+#endif
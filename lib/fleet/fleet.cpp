@@ -0,0 +1,280 @@
+#include "fleet.h"
+
+#include <WiFiUdp.h>
+#include <string.h>
+
+#include "config.h"
+#include "deskcontrol.h"
+#include "events.h"
+#include "log.h"
+#include "network.h"
+#include "ntp.h"
+#include "scheduler.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 address_u32;
+    uint16 port_u16; /* 0 for an unused entry */
+    uint32 request_id_u32;
+    uint8 command_u8;
+    uint8 result_u8;
+} FP_RECENT;
+
+/* Large enough for any request, longer datagrams are read up to this and then judged by their header */
+typedef union
+{
+    FP_HEADER header;
+    FP_COMMAND command;
+    uint8 bytes_vu8[sizeof(FP_ANNOUNCE)];
+} FP_DATAGRAM;
+
+/*****************************************************************************/
+
+const char fp_module_str[] PROGMEM = "Fleet";
+
+/*****************************************************************************/
+
+WiFiUDP fp_udp;
+uint16 fp_port_u16 = FP_DEFAULT_PORT;
+uint16 fp_http_port_u16 = 0U;
+const char *fp_name_str = "";
+fn_command_receiver fp_command_receiver_fn = NULL;
+bool fp_running_b = false;
+FP_STATS fp_stats;
+
+FP_RECENT fp_recent[FP_RECENT_COMMANDS];
+uint8 fp_recent_next_u8 = 0U;
+
+/*****************************************************************************/
+
+void fp_handle_event(const EVENT *p_event);
+void fp_handle_link(const bool link_up_b);
+void fp_publish_txt();
+bool fp_ready();
+void fp_receive();
+void fp_handle_command(const FP_COMMAND *p_command);
+void fp_fill_status(FP_STATUS *p_status, const FP_HEADER *p_request, const uint8 type_u8);
+void fp_reply(const void *p_data, const uint16 size_u16);
+
+/*****************************************************************************/
+
+void fp_init(const uint16 port_u16, fn_command_receiver command_receiver, const char *p_name, const uint16 http_port_u16)
+{
+    fp_port_u16 = port_u16;
+    fp_command_receiver_fn = command_receiver;
+    fp_name_str = p_name;
+    fp_http_port_u16 = http_port_u16;
+    fp_running_b = false;
+    (void)memset(&fp_stats, 0, sizeof(fp_stats));
+    (void)memset(fp_recent, 0, sizeof(fp_recent));
+
+    /* The socket is opened once we have a link */
+    (void)ev_subscribe(EV_LINK_CHANGED, fp_handle_event);
+    (void)tk_add_io_hook("Fleet", fp_ready, fp_receive);
+
+    /* The same status for mDNS browsers, the scheduler and config are looked at every second */
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, fp_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, fp_handle_event);
+    (void)ev_subscribe(EV_SECOND_TICK, fp_handle_event);
+    fp_publish_txt();
+}
+
+const FP_STATS *fp_get_stats()
+{
+    return &fp_stats;
+}
+
+/*****************************************************************************/
+
+void fp_handle_event(const EVENT *p_event)
+{
+    if (p_event->type_e == EV_LINK_CHANGED)
+    {
+        fp_handle_link(p_event->data.link_up_b);
+    }
+    else
+    {
+        fp_publish_txt();
+    }
+}
+
+void fp_handle_link(const bool link_up_b)
+{
+    if (link_up_b && !fp_running_b)
+    {
+        fp_running_b = (fp_udp.begin(fp_port_u16) != 0U);
+        if (fp_running_b)
+        {
+            log_msg(LOG_LEVEL_INFO, fp_module_str, "Listening on UDP port %u.", (unsigned)fp_port_u16);
+        }
+        else
+        {
+            log_msg(LOG_LEVEL_ERROR, fp_module_str, "Cannot listen on UDP port %u.", (unsigned)fp_port_u16);
+        }
+    }
+    else if (!link_up_b && fp_running_b)
+    {
+        fp_udp.stop();
+        fp_running_b = false;
+    }
+    else
+    {
+        /* Nothing changed */
+    }
+}
+
+/* Only values that differ from the last ones trigger an announcement, see nw_set_service_txt() */
+void fp_publish_txt()
+{
+    const DC_STATE state_e = dc_get_current_state();
+    char value_str[NW_TXT_VALUE_SIZE];
+
+    (void)snprintf(value_str, sizeof(value_str), "%u", (unsigned)dc_get_current_height());
+    (void)nw_set_service_txt("height", value_str);
+    (void)nw_set_service_txt("state", (state_e == DC_STATE_STANDING) ? "standing" : ((state_e == DC_STATE_SITTING) ? "sitting" : "unknown"));
+    (void)nw_set_service_txt("schedule", (sc_get_state() != SC_STATE_INACTIVE) ? "1" : "0");
+    (void)nw_set_service_txt("fw", FW_VERSION);
+    (void)snprintf(value_str, sizeof(value_str), "%u", (unsigned)cfg_get_sequence());
+    (void)nw_set_service_txt("cfg", value_str);
+    (void)snprintf(value_str, sizeof(value_str), "%u", (unsigned)fp_port_u16);
+    (void)nw_set_service_txt("udp", value_str);
+}
+
+/* Fetches the next datagram into the UDP buffer, fp_receive() reads it from there */
+bool fp_ready()
+{
+    return fp_running_b && (fp_udp.parsePacket() > 0);
+}
+
+void fp_receive()
+{
+    FP_DATAGRAM datagram;
+    FP_ANNOUNCE announce;
+    const int size_i = fp_udp.read(datagram.bytes_vu8, sizeof(datagram));
+
+    if ((size_i < (int)sizeof(FP_HEADER)) || (datagram.header.magic_u16 != FP_MAGIC) || (datagram.header.version_u8 != FP_VERSION))
+    {
+        fp_stats.invalid_u32 += 1U;
+        return;
+    }
+
+    switch (datagram.header.type_u8)
+    {
+    case FP_MSG_STATUS_REQUEST:
+    {
+        fp_stats.status_requests_u32 += 1U;
+        fp_fill_status(&announce.status, &datagram.header, FP_MSG_STATUS);
+        fp_reply(&announce.status, sizeof(FP_STATUS));
+        break;
+    }
+    case FP_MSG_DISCOVER:
+    {
+        fp_stats.status_requests_u32 += 1U;
+        fp_fill_status(&announce.status, &datagram.header, FP_MSG_ANNOUNCE);
+        announce.http_port_u16 = fp_http_port_u16;
+        (void)memset(announce.name_str, 0, FP_NAME_SIZE);
+        (void)strncpy(announce.name_str, fp_name_str, FP_NAME_SIZE - 1U);
+        fp_reply(&announce, sizeof(FP_ANNOUNCE));
+        break;
+    }
+    case FP_MSG_COMMAND:
+    {
+        if (size_i >= (int)sizeof(FP_COMMAND))
+        {
+            fp_handle_command(&datagram.command);
+        }
+        else
+        {
+            fp_stats.invalid_u32 += 1U;
+        }
+        break;
+    }
+    default:
+    {
+        /* Answers of other desks on the broadcast address end up here as well */
+        fp_stats.invalid_u32 += 1U;
+        break;
+    }
+    }
+}
+
+void fp_handle_command(const FP_COMMAND *p_command)
+{
+    const uint32 address_u32 = (uint32)fp_udp.remoteIP();
+    const uint16 port_u16 = fp_udp.remotePort();
+    FP_RECENT *p_recent = NULL;
+    FP_COMMAND_ACK ack;
+
+    (void)memset(&ack, 0, sizeof(ack));
+    ack.header = p_command->header;
+    ack.header.type_u8 = FP_MSG_COMMAND_ACK;
+    ack.command_u8 = p_command->command_u8;
+
+    /* Retransmissions get the answer the first one got */
+    for (uint8 i = 0U; (i < FP_RECENT_COMMANDS) && (NULL == p_recent); ++i)
+    {
+        if ((fp_recent[i].port_u16 == port_u16) && (fp_recent[i].address_u32 == address_u32) &&
+            (fp_recent[i].request_id_u32 == p_command->header.request_id_u32))
+        {
+            p_recent = &fp_recent[i];
+        }
+    }
+
+    if (NULL != p_recent)
+    {
+        fp_stats.duplicates_u32 += 1U;
+        ack.command_u8 = p_recent->command_u8;
+        ack.result_u8 = p_recent->result_u8;
+        ack.duplicate_u8 = 1U;
+    }
+    else
+    {
+        if ((p_command->command_u8 == DC_CMD_INVALID) || (p_command->command_u8 > DC_CMD_PRESET_4) || (NULL == fp_command_receiver_fn))
+        {
+            ack.result_u8 = FP_RESULT_INVALID;
+        }
+        else
+        {
+            fp_stats.commands_u32 += 1U;
+            ack.result_u8 = (fp_command_receiver_fn((DC_COMMAND)p_command->command_u8) == 0) ? FP_RESULT_OK : FP_RESULT_FAILED;
+        }
+
+        p_recent = &fp_recent[fp_recent_next_u8];
+        fp_recent_next_u8 = (fp_recent_next_u8 + 1U) % FP_RECENT_COMMANDS;
+        p_recent->address_u32 = address_u32;
+        p_recent->port_u16 = port_u16;
+        p_recent->request_id_u32 = p_command->header.request_id_u32;
+        p_recent->command_u8 = ack.command_u8;
+        p_recent->result_u8 = ack.result_u8;
+    }
+
+    fp_reply(&ack, sizeof(ack));
+}
+
+void fp_fill_status(FP_STATUS *p_status, const FP_HEADER *p_request, const uint8 type_u8)
+{
+    p_status->header = *p_request;
+    p_status->header.type_u8 = type_u8;
+    p_status->height_mm_u16 = dc_get_current_height();
+    p_status->desk_state_u8 = (uint8)dc_get_current_state();
+    p_status->scheduler_state_u8 = (uint8)sc_get_state();
+    p_status->jog_u8 = (uint8)dc_get_jog();
+    p_status->reserved_u8 = 0U;
+    p_status->sync_age_s_u32 = ntp_get_sync_age_s();
+    p_status->config_sequence_u32 = cfg_get_sequence();
+    p_status->uptime_s_u32 = millis() / 1000U;
+}
+
+void fp_reply(const void *p_data, const uint16 size_u16)
+{
+    /* Only queued in the stack, nothing waits for the network */
+    if ((fp_udp.beginPacket(fp_udp.remoteIP(), fp_udp.remotePort()) == 0) ||
+        (fp_udp.write((const uint8 *)p_data, size_u16) != size_u16) ||
+        (fp_udp.endPacket() == 0))
+    {
+        fp_stats.send_errors_u32 += 1U;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef FP_MAIN_H
+#define FP_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+#include "fleet_protocol.h"
+
+/*****************************************************************************/
+
+#define FP_RECENT_COMMANDS 8U /* remembered to answer repeated commands without carrying them out again */
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 status_requests_u32; /* discovery included */
+    uint32 commands_u32;        /* carried out */
+    uint32 duplicates_u32;      /* repeated commands only answered */
+    uint32 invalid_u32;         /* datagrams that were not ours, too short or of an unknown type */
+    uint32 send_errors_u32;
+} FP_STATS;
+
+/*****************************************************************************/
+
+extern void fp_init(const uint16 port_u16, fn_command_receiver command_receiver, const char *p_name, const uint16 http_port_u16);
+extern const FP_STATS *fp_get_stats();
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef FP_PROTOCOL_H
+#define FP_PROTOCOL_H
+
+/*****************************************************************************/
+
+/*
+ * Wire format of the UDP fleet protocol, shared by the firmware and the host
+ * tools, so it only depends on <stdint.h>. Every datagram starts with an
+ * FP_HEADER, all fields are little endian like both ends. A request is answered
+ * to the address and port it came from with its request id copied, status and
+ * discovery requests may also go to the broadcast address.
+ */
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+#define FP_MAGIC 0x4446U /* "FD" on the wire */
+#define FP_VERSION 1U
+#define FP_DEFAULT_PORT 8080U /* UDP, the web server has the same number on TCP */
+#define FP_NAME_SIZE 32U      /* hostname in FP_ANNOUNCE, zero padded */
+#define FP_NEVER_SYNCED 0xffffffffUL
+
+/*****************************************************************************/
+
+typedef enum
+{
+    FP_MSG_STATUS_REQUEST = 1, /* FP_HEADER only */
+    FP_MSG_STATUS,             /* FP_STATUS */
+    FP_MSG_COMMAND,            /* FP_COMMAND */
+    FP_MSG_COMMAND_ACK,        /* FP_COMMAND_ACK */
+    FP_MSG_DISCOVER,           /* FP_HEADER only */
+    FP_MSG_ANNOUNCE            /* FP_ANNOUNCE */
+} FP_MSG_TYPE;
+
+typedef enum
+{
+    FP_RESULT_OK = 0,
+    FP_RESULT_FAILED, /* the desk control did not take the command */
+    FP_RESULT_INVALID /* no such command */
+} FP_RESULT;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t magic_u16;
+    uint8_t version_u8;
+    uint8_t type_u8;         /* FP_MSG_TYPE */
+    uint32_t request_id_u32; /* chosen by the client, copied into the answer */
+} FP_HEADER;
+
+typedef struct __attribute__((packed))
+{
+    FP_HEADER header;
+    uint16_t height_mm_u16;
+    uint8_t desk_state_u8;       /* DC_STATE */
+    uint8_t scheduler_state_u8;  /* SCHEDULER_STATE */
+    uint8_t jog_u8;              /* DC_COMMAND of a running jog, 0 if none */
+    uint8_t reserved_u8;
+    uint32_t sync_age_s_u32;     /* since the last NTP sync, FP_NEVER_SYNCED before the first */
+    uint32_t config_sequence_u32; /* of the stored configuration, 0 while running on the defaults */
+    uint32_t uptime_s_u32;
+} FP_STATUS;
+
+/* A command is carried out once per client address, port and request id, a repeated one only gets the answer again */
+typedef struct __attribute__((packed))
+{
+    FP_HEADER header;
+    uint8_t command_u8; /* DC_COMMAND */
+    uint8_t reserved_vu8[3];
+} FP_COMMAND;
+
+typedef struct __attribute__((packed))
+{
+    FP_HEADER header;
+    uint8_t command_u8;
+    uint8_t result_u8;    /* FP_RESULT */
+    uint8_t duplicate_u8; /* 1 if this answers a repeated request */
+    uint8_t reserved_u8;
+} FP_COMMAND_ACK;
+
+/* Answer to FP_MSG_DISCOVER, the status plus what it takes to reach the desk over HTTP */
+typedef struct __attribute__((packed))
+{
+    FP_STATUS status; /* header.type_u8 is FP_MSG_ANNOUNCE */
+    uint16_t http_port_u16;
+    char name_str[FP_NAME_SIZE];
+} FP_ANNOUNCE;
+
+static_assert(sizeof(FP_HEADER) == 8U, "Header layout is part of the protocol");
+static_assert(sizeof(FP_STATUS) == 26U, "Status layout is part of the protocol");
+static_assert(sizeof(FP_COMMAND) == 12U, "Command layout is part of the protocol");
+static_assert(sizeof(FP_COMMAND_ACK) == 12U, "Command ack layout is part of the protocol");
+static_assert(sizeof(FP_ANNOUNCE) == 60U, "Announce layout is part of the protocol");
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,1073 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <flash_hal.h>
+
+#include "deskcontrol.h"
+#include "events.h"
+#include "http.h"
+#include "log.h"
+#include "ntp.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+/*
+ * Moves are appended to a circular log of sectors behind the configuration. Every sector
+ * starts with a header carrying a sequence number and the time and height the records in
+ * it are relative to, so each sector can be decoded on its own and the oldest one can be
+ * erased once the newest is full.
+ *
+ * A record starts with a tag byte, bit 7 is always clear so an erased byte (0xff) marks
+ * the end of a sector. The tag is written last, a record torn by a power loss therefore
+ * never shows up; init notices the garbage behind it and continues in a fresh sector.
+ *
+ *   move: tag (kind 0, trigger, from state, to state)
+ *         varint seconds since the previous move, zigzag varint from height relative to
+ *         the previous to height, zigzag varint height change, varint duration in 1/10 s
+ *   day:  tag (kind 1), varint day, varint moves per trigger, varint standing and
+ *         sitting minutes
+ *
+ * A typical move takes 6 to 8 bytes, a day 9 to 11, so a sector holds weeks of moves.
+ */
+#define HS_SECTOR_SIZE 4096U
+#define HS_FIRST_SECTOR_OFFSET 4U /* the configuration uses the first four sectors */
+#define HS_HEADER_SIZE 16U
+#define HS_MAX_RECORD_SIZE 24U
+#define HS_READ_CACHE_SIZE 32U
+
+#define HS_SECTOR_MAGIC 0x5348U /* "HS" */
+#define HS_SECTOR_VERSION 1U
+#define HS_ERASED_BYTE 0xffU
+
+#define HS_TAG_KIND_DAY 0x01U
+#define HS_TAG_TRIGGER_SHIFT 1U
+#define HS_TAG_FROM_SHIFT 3U
+#define HS_TAG_TO_SHIFT 5U
+
+#define HS_SECONDS_PER_DAY 86400UL
+
+#define HS_STEP_HEADER 0U
+#define HS_STEP_MOVES 1U
+#define HS_STEP_DAYS_HEADER 2U
+#define HS_STEP_DAYS 3U
+#define HS_STEP_TODAY 4U
+#define HS_STEP_FOOTER 5U
+#define HS_STEP_DONE 6U
+
+/*****************************************************************************/
+
+typedef struct __attribute__((packed))
+{
+    uint16 magic_u16;
+    uint8 version_u8;
+    uint8 reserved_u8;
+    uint32 sequence_u32;
+    uint32 base_time_u32;   /* start of the last move before this sector */
+    uint16 base_height_u16; /* its to height */
+    uint16 reserved_u16;
+} HS_SECTOR_HEADER;
+
+/* Word-aligned header image, the flash API only deals in 32 bit words */
+typedef union
+{
+    HS_SECTOR_HEADER header;
+    uint32 words_vu32[HS_HEADER_SIZE / sizeof(uint32)];
+} HS_HEADER_IMAGE;
+
+static_assert(sizeof(HS_HEADER_IMAGE) == HS_HEADER_SIZE, "Header must have the exact header size");
+
+/* Position in the log plus the decoder state, cheap enough to copy for a rollback */
+typedef struct
+{
+    uint32 sequence_u32; /* of the sector being read, 0 before the first one */
+    uint16 sector_u16;
+    uint16 offset_u16;
+    uint32 time_u32;
+    uint16 height_u16;
+    uint32 cache_address_u32;
+    uint32 cache_vu32[HS_READ_CACHE_SIZE / sizeof(uint32)];
+} HS_WALKER;
+
+typedef struct
+{
+    bool day_b; /* otherwise a move */
+    HS_MOVE move;
+    HS_DAY day;
+} HS_RECORD;
+
+/*****************************************************************************/
+
+const char hs_module_str[] PROGMEM = "History";
+const uint32 HS_SETTLE_MS_U32 = 1500U;          /* no height change for this long ends a move */
+const uint32 HS_TRIGGER_WINDOW_MS_U32 = 5000U;  /* a command this long before a move caused it */
+const char *hs_trigger_names[HS_NUM_TRIGGERS] = {"manual", "scheduler", "web"};
+
+/*****************************************************************************/
+
+bool hs_available_b = false;
+uint32 hs_first_sector_u32 = 0U;
+uint32 hs_sequences_vu32[HS_NUM_SECTORS]; /* 0 if the sector holds no valid header */
+
+/* Append position and the decoder state at that point */
+bool hs_head_valid_b = false;
+bool hs_head_full_b = false;
+uint16 hs_head_sector_u16 = 0U;
+uint16 hs_head_offset_u16 = 0U;
+uint32 hs_head_time_u32 = 0U;
+uint16 hs_head_height_u16 = 0U;
+
+/* Moves behind the newest day record, replayed into hs_today once the time is known */
+HS_WALKER hs_replay_walker;
+uint32 hs_closed_day_u32 = 0U;
+
+bool hs_today_valid_b = false;
+HS_DAY hs_today;
+DC_STATE hs_state_e = DC_STATE_UNKNOWN;
+uint32 hs_state_since_u32 = 0U;
+
+/* Move in progress */
+uint16 hs_height_u16 = 0U; /* last height, 0 until the desk reported one */
+bool hs_moving_b = false;
+HS_MOVE hs_move;
+uint32 hs_move_started_ms_u32 = 0U;
+uint32 hs_move_last_ms_u32 = 0U;
+sint8 hs_settle_task_s8 = TK_INVALID_TASK;
+
+bool hs_trigger_pending_b = false;
+HS_TRIGGER hs_trigger_e = HS_TRIGGER_MANUAL;
+uint32 hs_trigger_ms_u32 = 0U;
+
+HS_STATS hs_stats = {0};
+
+/* Only one query at a time, the walker is too large to keep per connection */
+HTTP_CONN *hs_query_conn_p = NULL;
+HS_WALKER hs_query_walker;
+uint32 hs_query_from_u32 = 0U;
+uint32 hs_query_to_u32 = 0U;
+uint32 hs_query_count_u32 = 0U;
+
+/*****************************************************************************/
+
+void hs_handle_event(const EVENT *p_event);
+void hs_handle_height(const uint16 height_u16);
+void hs_handle_settled();
+void hs_handle_tick();
+
+void hs_start_today(const uint32 now_u32);
+uint32 hs_continue_since(const uint32 time_u32);
+void hs_account(const uint32 now_u32);
+void hs_add_state_time(const uint32 until_u32);
+void hs_count_move(const HS_MOVE *p_move);
+uint32 hs_day_of(const uint32 utc_u32);
+uint32 hs_day_start(const uint32 day_u32);
+
+bool hs_append_move(const HS_MOVE *p_move);
+bool hs_append_day(const HS_DAY *p_day);
+bool hs_append(const uint8 *p_record, const uint8 size_u8);
+bool hs_open_sector();
+bool hs_program(const uint32 address_u32, const uint8 *p_data, const uint8 size_u8);
+uint32 hs_sector_address(const uint16 sector_u16);
+uint8 hs_put_varint(uint8 *p_buffer, uint32 value_u32);
+
+void hs_walker_init(HS_WALKER *p_walker);
+void hs_walker_seek(HS_WALKER *p_walker, const uint32 time_u32);
+bool hs_walker_next(HS_WALKER *p_walker, HS_RECORD *p_record);
+bool hs_walker_enter(HS_WALKER *p_walker, const uint32 before_time_u32);
+bool hs_walker_byte(HS_WALKER *p_walker, uint8 *p_byte_u8);
+bool hs_walker_varint(HS_WALKER *p_walker, uint32 *p_value_u32);
+bool hs_walker_erased(HS_WALKER *p_walker, const uint16 size_u16);
+
+void hs_get_history(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void hs_handle_query_done(HTTP_CONN *p_conn);
+bool hs_produce(HTTP_CONN *p_conn);
+int hs_render_move(const HS_MOVE *p_move, char *p_buffer, const uint16 size_u16);
+int hs_render_day(const HS_DAY *p_day, const bool partial_b, char *p_buffer, const uint16 size_u16);
+int hs_query_param(const HTTP_SLICE *p_query, const char *p_name, uint32 *p_value_u32);
+const char *hs_state_name(const DC_STATE state_e);
+
+/*****************************************************************************/
+
+void hs_init()
+{
+    HS_HEADER_IMAGE image;
+    HS_WALKER walker;
+    HS_RECORD record;
+    uint32 records_u32 = 0U;
+
+    (void)memset(hs_sequences_vu32, 0, sizeof(hs_sequences_vu32));
+    (void)memset(&hs_today, 0, sizeof(hs_today));
+    (void)memset(&hs_stats, 0, sizeof(hs_stats));
+    hs_head_valid_b = false;
+    hs_head_full_b = false;
+    hs_head_sector_u16 = 0U;
+    hs_head_time_u32 = 0U;
+    hs_head_height_u16 = 0U;
+    hs_closed_day_u32 = 0U;
+    hs_today_valid_b = false;
+    hs_settle_task_s8 = tk_add_oneshot("History settle", hs_handle_settled);
+
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, hs_handle_event);
+    (void)ev_subscribe(EV_SECOND_TICK, hs_handle_event);
+    (void)http_on(HTTP_METHOD_GET, "/api/history", hs_get_history);
+
+    /* Same area as the configuration, see cfg_init() */
+    hs_first_sector_u32 = ((uint32)FS_PHYS_ADDR / HS_SECTOR_SIZE) + HS_FIRST_SECTOR_OFFSET;
+    hs_available_b = ((uint32)FS_PHYS_SIZE >= ((HS_FIRST_SECTOR_OFFSET + HS_NUM_SECTORS) * HS_SECTOR_SIZE));
+    if (!hs_available_b)
+    {
+        log_msg(LOG_LEVEL_ERROR, hs_module_str, "No flash area reserved for the history.");
+        return;
+    }
+
+    /* The newest sector is the one to append to */
+    for (uint16 i = 0U; i < HS_NUM_SECTORS; ++i)
+    {
+        if (ESP.flashRead(hs_sector_address(i), image.words_vu32, HS_HEADER_SIZE) &&
+            (image.header.magic_u16 == HS_SECTOR_MAGIC) &&
+            (image.header.version_u8 == HS_SECTOR_VERSION) &&
+            (image.header.sequence_u32 != 0U))
+        {
+            hs_sequences_vu32[i] = image.header.sequence_u32;
+            if (!hs_head_valid_b || (image.header.sequence_u32 > hs_sequences_vu32[hs_head_sector_u16]))
+            {
+                hs_head_sector_u16 = i;
+                hs_head_valid_b = true;
+            }
+            hs_stats.used_sectors_u16 += 1U;
+        }
+        else
+        {
+            /* Erased, torn or foreign */
+        }
+    }
+
+    /* One pass over everything to find the end and the newest day record */
+    hs_walker_init(&walker);
+    hs_walker_init(&hs_replay_walker);
+    while (hs_walker_next(&walker, &record))
+    {
+        records_u32 += 1U;
+        if (record.day_b)
+        {
+            hs_closed_day_u32 = record.day.day_u32;
+            hs_replay_walker = walker;
+        }
+    }
+
+    if (hs_head_valid_b)
+    {
+        hs_head_offset_u16 = walker.offset_u16;
+        hs_head_time_u32 = walker.time_u32;
+        hs_head_height_u16 = walker.height_u16;
+
+        /* Leftovers of a torn record, appending behind them would not decode */
+        hs_head_full_b = !hs_walker_erased(&walker, HS_MAX_RECORD_SIZE);
+
+        log_msg(LOG_LEVEL_INFO, hs_module_str, "Found %u records in %u sectors, appending to sector %u at %u.",
+                records_u32, hs_stats.used_sectors_u16, hs_head_sector_u16, hs_head_offset_u16);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_INFO, hs_module_str, "No stored history found.");
+    }
+}
+
+void hs_note_trigger(const HS_TRIGGER trigger_e)
+{
+    hs_trigger_pending_b = true;
+    hs_trigger_e = trigger_e;
+    hs_trigger_ms_u32 = millis();
+}
+
+const HS_DAY *hs_get_today()
+{
+    return hs_today_valid_b ? &hs_today : NULL;
+}
+
+const HS_STATS *hs_get_stats()
+{
+    return &hs_stats;
+}
+
+/*****************************************************************************/
+
+void hs_handle_event(const EVENT *p_event)
+{
+    switch (p_event->type_e)
+    {
+    case EV_HEIGHT_CHANGED:
+    {
+        hs_handle_height(p_event->data.height_u16);
+        break;
+    }
+    case EV_SECOND_TICK:
+    {
+        hs_handle_tick();
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+void hs_handle_height(const uint16 height_u16)
+{
+    const uint32 now_ms_u32 = millis();
+
+    if (hs_height_u16 == 0U)
+    {
+        /* First height after boot, nothing to compare to */
+        hs_height_u16 = height_u16;
+        return;
+    }
+
+    if (!hs_moving_b)
+    {
+        /* The desk state is only updated after this event, so it is still the one we leave */
+        hs_moving_b = true;
+        hs_move_started_ms_u32 = now_ms_u32;
+        hs_move.start_u32 = ntp_get_utc_time();
+        hs_move.from_height_u16 = hs_height_u16;
+        hs_move.from_state_e = dc_get_current_state();
+        hs_move.trigger_e = (hs_trigger_pending_b && ((now_ms_u32 - hs_trigger_ms_u32) <= HS_TRIGGER_WINDOW_MS_U32)) ? hs_trigger_e : HS_TRIGGER_MANUAL;
+        hs_trigger_pending_b = false;
+    }
+
+    hs_move_last_ms_u32 = now_ms_u32;
+    hs_height_u16 = height_u16;
+    tk_schedule(hs_settle_task_s8, HS_SETTLE_MS_U32);
+}
+
+void hs_handle_settled()
+{
+    hs_moving_b = false;
+    hs_move.to_height_u16 = hs_height_u16;
+    hs_move.to_state_e = dc_get_current_state();
+    hs_move.duration_ds_u32 = (hs_move_last_ms_u32 - hs_move_started_ms_u32) / 100U;
+
+    if ((uint16)UNSIGNED_DIFF(hs_move.to_height_u16, hs_move.from_height_u16) < HS_MIN_MOVE_U16)
+    {
+        /* Display jitter, or a nudge too small to count */
+    }
+    else if (hs_move.start_u32 == 0U)
+    {
+        hs_stats.unsynced_u32 += 1U;
+        log_msg(LOG_LEVEL_WARNING, hs_module_str, "Time not known yet, move from %u to %u not recorded.", hs_move.from_height_u16, hs_move.to_height_u16);
+    }
+    else
+    {
+        hs_start_today(ntp_get_utc_time());
+        hs_account(hs_move.start_u32);
+        hs_count_move(&hs_move);
+        (void)hs_append_move(&hs_move);
+
+        log_msg(LOG_LEVEL_INFO, hs_module_str, "Recorded %s move from %u to %u in %u.%u s.", hs_trigger_names[hs_move.trigger_e],
+                hs_move.from_height_u16, hs_move.to_height_u16, hs_move.duration_ds_u32 / 10U, hs_move.duration_ds_u32 % 10U);
+    }
+}
+
+void hs_handle_tick()
+{
+    const uint32 now_u32 = ntp_get_utc_time();
+
+    if (now_u32 != 0U)
+    {
+        hs_start_today(now_u32);
+        hs_account(now_u32);
+    }
+    else
+    {
+        /* Days cannot be told apart yet */
+    }
+}
+
+/*****************************************************************************/
+
+void hs_start_today(const uint32 now_u32)
+{
+    HS_RECORD record;
+
+    if (hs_today_valid_b)
+    {
+        return;
+    }
+
+    /* Moves of days that were not closed before the reboot, day records written
+     * on the way are skipped, they end up behind the moves being replayed */
+    while (hs_walker_next(&hs_replay_walker, &record))
+    {
+        if (record.day_b || (hs_day_of(record.move.start_u32) <= hs_closed_day_u32))
+        {
+            continue;
+        }
+
+        if (!hs_today_valid_b)
+        {
+            hs_today_valid_b = true;
+            hs_today.day_u32 = hs_day_of(record.move.start_u32);
+            hs_state_e = record.move.from_state_e;
+            hs_state_since_u32 = hs_continue_since(record.move.start_u32);
+        }
+        hs_account(record.move.start_u32);
+        hs_count_move(&record.move);
+    }
+
+    if (!hs_today_valid_b)
+    {
+        hs_today_valid_b = true;
+        hs_today.day_u32 = hs_day_of(now_u32);
+        hs_state_e = dc_get_current_state();
+        hs_state_since_u32 = hs_continue_since(now_u32);
+    }
+    hs_account(now_u32);
+
+    log_msg(LOG_LEVEL_INFO, hs_module_str, "Time is known, today has %u moves so far.",
+            hs_today.moves_vu16[HS_TRIGGER_MANUAL] + hs_today.moves_vu16[HS_TRIGGER_SCHEDULER] + hs_today.moves_vu16[HS_TRIGGER_WEB]);
+}
+
+uint32 hs_continue_since(const uint32 time_u32)
+{
+    /* Yesterday was closed, so the desk has been where it is since midnight */
+    return (hs_day_of(time_u32) == (hs_closed_day_u32 + 1U)) ? hs_day_start(hs_day_of(time_u32)) : time_u32;
+}
+
+void hs_account(const uint32 now_u32)
+{
+    const uint32 day_u32 = hs_day_of(now_u32);
+
+    while (hs_today.day_u32 < day_u32)
+    {
+        /* The desk stays where it is over midnight */
+        hs_add_state_time(hs_day_start(hs_today.day_u32 + 1U));
+        (void)hs_append_day(&hs_today);
+
+        log_msg(LOG_LEVEL_INFO, hs_module_str, "Day %u closed: %u min standing, %u min sitting.",
+                hs_today.day_u32, hs_today.standing_s_u32 / 60U, hs_today.sitting_s_u32 / 60U);
+
+        (void)memset(hs_today.moves_vu16, 0, sizeof(hs_today.moves_vu16));
+        hs_today.standing_s_u32 = 0U;
+        hs_today.sitting_s_u32 = 0U;
+        hs_today.day_u32 += 1U;
+        if (hs_today.day_u32 < day_u32)
+        {
+            /* We were off for more than a day, nothing is known about the days in between */
+            hs_today.day_u32 = day_u32;
+            hs_state_since_u32 = hs_day_start(day_u32);
+        }
+    }
+
+    hs_add_state_time(now_u32);
+}
+
+void hs_add_state_time(const uint32 until_u32)
+{
+    if (until_u32 <= hs_state_since_u32)
+    {
+        /* Clock went backwards, or nothing passed */
+    }
+    else if (hs_state_e == DC_STATE_STANDING)
+    {
+        hs_today.standing_s_u32 += until_u32 - hs_state_since_u32;
+    }
+    else if (hs_state_e == DC_STATE_SITTING)
+    {
+        hs_today.sitting_s_u32 += until_u32 - hs_state_since_u32;
+    }
+    else
+    {
+        /* Somewhere in between, not counted */
+    }
+
+    hs_state_since_u32 = max(hs_state_since_u32, until_u32);
+}
+
+void hs_count_move(const HS_MOVE *p_move)
+{
+    hs_today.moves_vu16[p_move->trigger_e] += 1U;
+
+    /* Time spent moving is not counted for either state */
+    hs_state_e = p_move->to_state_e;
+    hs_state_since_u32 = max(hs_state_since_u32, p_move->start_u32 + (p_move->duration_ds_u32 / 10U));
+}
+
+uint32 hs_day_of(const uint32 utc_u32)
+{
+    return (uint32)(((sint64)utc_u32 + ntp_get_utc_offset()) / (sint64)HS_SECONDS_PER_DAY);
+}
+
+uint32 hs_day_start(const uint32 day_u32)
+{
+    return (uint32)(((sint64)day_u32 * (sint64)HS_SECONDS_PER_DAY) - ntp_get_utc_offset());
+}
+
+/*****************************************************************************/
+
+bool hs_append_move(const HS_MOVE *p_move)
+{
+    uint8 record_vu8[HS_MAX_RECORD_SIZE];
+    uint8 size_u8 = 1U;
+    const sint32 from_delta_s32 = (sint32)p_move->from_height_u16 - (sint32)hs_head_height_u16;
+    const sint32 change_s32 = (sint32)p_move->to_height_u16 - (sint32)p_move->from_height_u16;
+    bool ok_b;
+
+    record_vu8[0U] = (uint8)(((uint8)p_move->trigger_e << HS_TAG_TRIGGER_SHIFT) |
+                             (((uint8)p_move->from_state_e & 0x03U) << HS_TAG_FROM_SHIFT) |
+                             (((uint8)p_move->to_state_e & 0x03U) << HS_TAG_TO_SHIFT));
+
+    /* Deltas wrap around, a clock that went backwards costs a few bytes but still decodes */
+    size_u8 += hs_put_varint(&record_vu8[size_u8], p_move->start_u32 - hs_head_time_u32);
+    size_u8 += hs_put_varint(&record_vu8[size_u8], ((uint32)from_delta_s32 << 1U) ^ (uint32)(from_delta_s32 >> 31));
+    size_u8 += hs_put_varint(&record_vu8[size_u8], ((uint32)change_s32 << 1U) ^ (uint32)(change_s32 >> 31));
+    size_u8 += hs_put_varint(&record_vu8[size_u8], p_move->duration_ds_u32);
+
+    ok_b = hs_append(record_vu8, size_u8);
+    if (ok_b)
+    {
+        hs_head_time_u32 = p_move->start_u32;
+        hs_head_height_u16 = p_move->to_height_u16;
+        hs_stats.moves_u32 += 1U;
+    }
+
+    return ok_b;
+}
+
+bool hs_append_day(const HS_DAY *p_day)
+{
+    uint8 record_vu8[HS_MAX_RECORD_SIZE];
+    uint8 size_u8 = 1U;
+    bool ok_b;
+
+    record_vu8[0U] = HS_TAG_KIND_DAY;
+    size_u8 += hs_put_varint(&record_vu8[size_u8], p_day->day_u32);
+    for (uint8 i = 0U; i < HS_NUM_TRIGGERS; ++i)
+    {
+        size_u8 += hs_put_varint(&record_vu8[size_u8], p_day->moves_vu16[i]);
+    }
+    size_u8 += hs_put_varint(&record_vu8[size_u8], (p_day->standing_s_u32 + 30U) / 60U);
+    size_u8 += hs_put_varint(&record_vu8[size_u8], (p_day->sitting_s_u32 + 30U) / 60U);
+
+    ok_b = hs_append(record_vu8, size_u8);
+    if (ok_b)
+    {
+        hs_stats.days_u32 += 1U;
+    }
+
+    return ok_b;
+}
+
+bool hs_append(const uint8 *p_record, const uint8 size_u8)
+{
+    bool ok_b = hs_available_b;
+    uint32 address_u32;
+
+    if (ok_b && (!hs_head_valid_b || hs_head_full_b || ((hs_head_offset_u16 + size_u8) > HS_SECTOR_SIZE)))
+    {
+        ok_b = hs_open_sector();
+    }
+
+    if (ok_b)
+    {
+        /* Body first, the tag byte makes it visible */
+        address_u32 = hs_sector_address(hs_head_sector_u16) + hs_head_offset_u16;
+        ok_b = hs_program(address_u32 + 1U, &p_record[1U], size_u8 - 1U);
+        ok_b = ok_b && hs_program(address_u32, p_record, 1U);
+
+        /* Whatever made it to the flash cannot be written over */
+        hs_head_offset_u16 += size_u8;
+        hs_stats.bytes_u32 += size_u8;
+    }
+
+    if (!ok_b)
+    {
+        log_msg(LOG_LEVEL_ERROR, hs_module_str, "Failed to append a record.");
+    }
+
+    return ok_b;
+}
+
+bool hs_open_sector()
+{
+    HS_HEADER_IMAGE image;
+    const uint16 sector_u16 = hs_head_valid_b ? ((hs_head_sector_u16 + 1U) % HS_NUM_SECTORS) : 0U;
+    const uint32 sequence_u32 = hs_head_valid_b ? (hs_sequences_vu32[hs_head_sector_u16] + 1U) : 1U;
+    bool ok_b;
+
+    /* Readers check the sequence, a sector being erased is no longer theirs */
+    hs_stats.used_sectors_u16 -= (hs_sequences_vu32[sector_u16] != 0U) ? 1U : 0U;
+    hs_sequences_vu32[sector_u16] = 0U;
+    ok_b = ESP.flashEraseSector(hs_first_sector_u32 + sector_u16);
+    hs_stats.erases_u32 += 1U;
+
+    (void)memset(&image, 0xff, sizeof(image));
+    image.header.magic_u16 = HS_SECTOR_MAGIC;
+    image.header.version_u8 = HS_SECTOR_VERSION;
+    image.header.sequence_u32 = sequence_u32;
+    image.header.base_time_u32 = hs_head_time_u32;
+    image.header.base_height_u16 = hs_head_height_u16;
+
+    /* Magic word last, a torn header is ignored on the next boot */
+    ok_b = ok_b && ESP.flashWrite(hs_sector_address(sector_u16) + sizeof(uint32), &image.words_vu32[1U], HS_HEADER_SIZE - sizeof(uint32));
+    ok_b = ok_b && ESP.flashWrite(hs_sector_address(sector_u16), &image.words_vu32[0U], sizeof(uint32));
+
+    if (ok_b)
+    {
+        hs_sequences_vu32[sector_u16] = sequence_u32;
+        hs_head_sector_u16 = sector_u16;
+        hs_head_offset_u16 = HS_HEADER_SIZE;
+        hs_head_valid_b = true;
+        hs_head_full_b = false;
+        hs_stats.used_sectors_u16 += 1U;
+
+        log_msg(LOG_LEVEL_INFO, hs_module_str, "Started sector %u (#%u).", sector_u16, sequence_u32);
+    }
+
+    return ok_b;
+}
+
+bool hs_program(const uint32 address_u32, const uint8 *p_data, const uint8 size_u8)
+{
+    uint32 word_u32;
+    uint32 aligned_u32;
+    uint8 i = 0U;
+    bool ok_b = true;
+
+    /* Erased bytes are all ones, programming 0xff next to them leaves them alone */
+    while (ok_b && (i < size_u8))
+    {
+        aligned_u32 = (address_u32 + i) & ~(uint32)(sizeof(uint32) - 1U);
+        word_u32 = 0xffffffffUL;
+        while ((i < size_u8) && ((address_u32 + i) < (aligned_u32 + sizeof(uint32))))
+        {
+            ((uint8 *)&word_u32)[address_u32 + i - aligned_u32] = p_data[i];
+            i += 1U;
+        }
+        ok_b = ESP.flashWrite(aligned_u32, &word_u32, sizeof(uint32));
+    }
+
+    return ok_b;
+}
+
+uint32 hs_sector_address(const uint16 sector_u16)
+{
+    return (hs_first_sector_u32 + sector_u16) * HS_SECTOR_SIZE;
+}
+
+uint8 hs_put_varint(uint8 *p_buffer, uint32 value_u32)
+{
+    uint8 size_u8 = 0U;
+
+    while (value_u32 >= 0x80U)
+    {
+        p_buffer[size_u8++] = (uint8)(value_u32 | 0x80U);
+        value_u32 >>= 7U;
+    }
+    p_buffer[size_u8++] = (uint8)value_u32;
+
+    return size_u8;
+}
+
+/*****************************************************************************/
+
+void hs_walker_init(HS_WALKER *p_walker)
+{
+    (void)memset(p_walker, 0, sizeof(HS_WALKER));
+    p_walker->offset_u16 = HS_SECTOR_SIZE;
+    p_walker->cache_address_u32 = 0xffffffffUL;
+}
+
+void hs_walker_seek(HS_WALKER *p_walker, const uint32 time_u32)
+{
+    HS_WALKER next;
+
+    /* Starts in the last sector that begins before the time, every move before it is older */
+    hs_walker_init(p_walker);
+    if (hs_walker_enter(p_walker, time_u32))
+    {
+        next = *p_walker;
+        while (hs_walker_enter(&next, time_u32))
+        {
+            *p_walker = next;
+        }
+    }
+    else
+    {
+        /* Nothing that old, hs_walker_next() starts at the oldest sector */
+    }
+}
+
+bool hs_walker_next(HS_WALKER *p_walker, HS_RECORD *p_record)
+{
+    HS_WALKER walker = *p_walker;
+    uint8 tag_u8 = HS_ERASED_BYTE;
+    uint32 values_vu32[6];
+    bool ok_b;
+
+    /* The sector was recycled under us, continue with whatever is now the oldest */
+    if ((walker.sequence_u32 != 0U) && (hs_sequences_vu32[walker.sector_u16] != walker.sequence_u32))
+    {
+        walker.offset_u16 = HS_SECTOR_SIZE;
+    }
+
+    ok_b = hs_walker_byte(&walker, &tag_u8) && (tag_u8 != HS_ERASED_BYTE);
+    while (!ok_b && hs_walker_enter(&walker, 0xffffffffUL))
+    {
+        ok_b = hs_walker_byte(&walker, &tag_u8) && (tag_u8 != HS_ERASED_BYTE);
+    }
+    if (!ok_b)
+    {
+        /* End of the log, the position stays put so new records show up later */
+        return false;
+    }
+    walker.offset_u16 += 1U;
+
+    (void)memset(p_record, 0, sizeof(HS_RECORD));
+    p_record->day_b = ((tag_u8 & HS_TAG_KIND_DAY) != 0U);
+    for (uint8 i = 0U; ok_b && (i < (p_record->day_b ? 6U : 4U)); ++i)
+    {
+        ok_b = hs_walker_varint(&walker, &values_vu32[i]);
+    }
+    if (!ok_b)
+    {
+        /* Cut off at the end of the sector, nothing of ours writes that */
+        return false;
+    }
+
+    if (p_record->day_b)
+    {
+        p_record->day.day_u32 = values_vu32[0U];
+        for (uint8 i = 0U; i < HS_NUM_TRIGGERS; ++i)
+        {
+            p_record->day.moves_vu16[i] = (uint16)values_vu32[1U + i];
+        }
+        p_record->day.standing_s_u32 = values_vu32[4U] * 60U;
+        p_record->day.sitting_s_u32 = values_vu32[5U] * 60U;
+    }
+    else
+    {
+        walker.time_u32 += values_vu32[0U];
+        p_record->move.start_u32 = walker.time_u32;
+        p_record->move.from_height_u16 = (uint16)(walker.height_u16 + (sint32)((values_vu32[1U] >> 1U) ^ (0U - (values_vu32[1U] & 1U))));
+        p_record->move.to_height_u16 = (uint16)(p_record->move.from_height_u16 + (sint32)((values_vu32[2U] >> 1U) ^ (0U - (values_vu32[2U] & 1U))));
+        p_record->move.duration_ds_u32 = values_vu32[3U];
+        p_record->move.trigger_e = (HS_TRIGGER)((tag_u8 >> HS_TAG_TRIGGER_SHIFT) & 0x03U);
+        p_record->move.trigger_e = (p_record->move.trigger_e < HS_NUM_TRIGGERS) ? p_record->move.trigger_e : HS_TRIGGER_MANUAL;
+        p_record->move.from_state_e = (DC_STATE)((tag_u8 >> HS_TAG_FROM_SHIFT) & 0x03U);
+        p_record->move.to_state_e = (DC_STATE)((tag_u8 >> HS_TAG_TO_SHIFT) & 0x03U);
+        walker.height_u16 = p_record->move.to_height_u16;
+    }
+
+    *p_walker = walker;
+    return true;
+}
+
+bool hs_walker_enter(HS_WALKER *p_walker, const uint32 before_time_u32)
+{
+    HS_HEADER_IMAGE image;
+    uint16 sector_u16 = HS_NUM_SECTORS;
+
+    /* Sector with the next higher sequence number */
+    for (uint16 i = 0U; i < HS_NUM_SECTORS; ++i)
+    {
+        if ((hs_sequences_vu32[i] > p_walker->sequence_u32) &&
+            ((sector_u16 == HS_NUM_SECTORS) || (hs_sequences_vu32[i] < hs_sequences_vu32[sector_u16])))
+        {
+            sector_u16 = i;
+        }
+    }
+
+    if ((sector_u16 == HS_NUM_SECTORS) ||
+        !ESP.flashRead(hs_sector_address(sector_u16), image.words_vu32, HS_HEADER_SIZE) ||
+        (image.header.sequence_u32 != hs_sequences_vu32[sector_u16]) ||
+        (image.header.base_time_u32 >= before_time_u32))
+    {
+        return false;
+    }
+
+    p_walker->sequence_u32 = image.header.sequence_u32;
+    p_walker->sector_u16 = sector_u16;
+    p_walker->offset_u16 = HS_HEADER_SIZE;
+    p_walker->time_u32 = image.header.base_time_u32;
+    p_walker->height_u16 = image.header.base_height_u16;
+
+    return true;
+}
+
+bool hs_walker_byte(HS_WALKER *p_walker, uint8 *p_byte_u8)
+{
+    const uint32 address_u32 = hs_sector_address(p_walker->sector_u16) + p_walker->offset_u16;
+    const uint32 block_u32 = address_u32 & ~(uint32)(HS_READ_CACHE_SIZE - 1U);
+
+    if ((p_walker->sequence_u32 == 0U) || (p_walker->offset_u16 >= HS_SECTOR_SIZE))
+    {
+        return false;
+    }
+
+    if (block_u32 != p_walker->cache_address_u32)
+    {
+        if (!ESP.flashRead(block_u32, p_walker->cache_vu32, HS_READ_CACHE_SIZE))
+        {
+            return false;
+        }
+        p_walker->cache_address_u32 = block_u32;
+    }
+
+    *p_byte_u8 = ((const uint8 *)p_walker->cache_vu32)[address_u32 - block_u32];
+    return true;
+}
+
+bool hs_walker_varint(HS_WALKER *p_walker, uint32 *p_value_u32)
+{
+    uint8 byte_u8 = 0x80U;
+
+    *p_value_u32 = 0U;
+    for (uint8 shift_u8 = 0U; (byte_u8 & 0x80U) && (shift_u8 < 32U); shift_u8 += 7U)
+    {
+        if (!hs_walker_byte(p_walker, &byte_u8))
+        {
+            return false;
+        }
+        *p_value_u32 |= (uint32)(byte_u8 & 0x7fU) << shift_u8;
+        p_walker->offset_u16 += 1U;
+    }
+
+    return ((byte_u8 & 0x80U) == 0U);
+}
+
+bool hs_walker_erased(HS_WALKER *p_walker, const uint16 size_u16)
+{
+    HS_WALKER walker = *p_walker;
+    uint8 byte_u8;
+
+    /* Reading stops at the end of the sector, which counts as erased */
+    for (uint16 i = 0U; (i < size_u16) && hs_walker_byte(&walker, &byte_u8); ++i)
+    {
+        if (byte_u8 != HS_ERASED_BYTE)
+        {
+            return false;
+        }
+        walker.offset_u16 += 1U;
+    }
+
+    return true;
+}
+
+/*****************************************************************************/
+
+void hs_get_history(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    uint32 from_u32 = 0U;
+    uint32 to_u32 = 0xffffffffUL;
+
+    /* ?from=<utc seconds>&to=<utc seconds>, both optional and inclusive */
+    if ((hs_query_param(&p_request->query, "from", &from_u32) < 0) ||
+        (hs_query_param(&p_request->query, "to", &to_u32) < 0) ||
+        (from_u32 > to_u32))
+    {
+        http_send(p_conn, 400, "application/json", "{\"error\":\"expected ?from=<utc seconds>&to=<utc seconds>\"}");
+        return;
+    }
+
+    if (NULL != hs_query_conn_p)
+    {
+        http_send(p_conn, 503, "text/plain", "History query already running");
+        return;
+    }
+
+    hs_query_conn_p = p_conn;
+    hs_query_from_u32 = from_u32;
+    hs_query_to_u32 = to_u32;
+
+    http_begin_response(p_conn, 200, "application/json", HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, hs_produce);
+    http_set_done_handler(p_conn, hs_handle_query_done);
+}
+
+void hs_handle_query_done(HTTP_CONN *p_conn)
+{
+    if (p_conn == hs_query_conn_p)
+    {
+        hs_query_conn_p = NULL;
+    }
+}
+
+bool hs_produce(HTTP_CONN *p_conn)
+{
+    uint32 *p_step_u32 = http_producer_state(p_conn);
+    HS_WALKER walker;
+    HS_RECORD record;
+    uint32 next_step_u32;
+    uint16 size_u16;
+    uint16 used_u16 = 0U;
+    char *p_buffer = http_tx_reserve(p_conn, &size_u16);
+    char *p_line;
+    int line_i;
+    bool item_b;
+
+    while (*p_step_u32 < HS_STEP_DONE)
+    {
+        /* Nothing is taken over unless the line fits, the next call starts over with it */
+        walker = hs_query_walker;
+        next_step_u32 = *p_step_u32 + 1U;
+        p_line = &p_buffer[used_u16];
+        line_i = 0;
+        item_b = false;
+
+        if (*p_step_u32 == HS_STEP_HEADER)
+        {
+            line_i = snprintf(p_line, size_u16 - used_u16, "{\"from\":%lu,\"to\":%lu,\"utcOffset\":%ld,\"moves\":[",
+                              (unsigned long)hs_query_from_u32, (unsigned long)hs_query_to_u32, (long)ntp_get_utc_offset());
+            hs_walker_seek(&walker, hs_query_from_u32);
+        }
+        else if (*p_step_u32 == HS_STEP_DAYS_HEADER)
+        {
+            line_i = snprintf(p_line, size_u16 - used_u16, "],\"days\":[");
+            hs_walker_init(&walker);
+        }
+        else if (*p_step_u32 == HS_STEP_FOOTER)
+        {
+            line_i = snprintf(p_line, size_u16 - used_u16, "]}\n");
+        }
+        else if (*p_step_u32 == HS_STEP_TODAY)
+        {
+            if (hs_today_valid_b && (hs_day_start(hs_today.day_u32 + 1U) > hs_query_from_u32) && (hs_day_start(hs_today.day_u32) <= hs_query_to_u32))
+            {
+                hs_account(ntp_get_utc_time());
+                line_i = hs_render_day(&hs_today, true, p_line, size_u16 - used_u16);
+                item_b = true;
+            }
+        }
+        else if (!hs_walker_next(&walker, &record))
+        {
+            /* End of the log */
+        }
+        else if (*p_step_u32 == HS_STEP_MOVES)
+        {
+            /* Moves are in order, once past the range nothing else can match */
+            next_step_u32 = (!record.day_b && (record.move.start_u32 > hs_query_to_u32)) ? (*p_step_u32 + 1U) : *p_step_u32;
+            if (!record.day_b && (record.move.start_u32 >= hs_query_from_u32) && (record.move.start_u32 <= hs_query_to_u32))
+            {
+                line_i = hs_render_move(&record.move, p_line, size_u16 - used_u16);
+                item_b = true;
+            }
+        }
+        else
+        {
+            next_step_u32 = *p_step_u32;
+            if (record.day_b && (hs_day_start(record.day.day_u32 + 1U) > hs_query_from_u32) && (hs_day_start(record.day.day_u32) <= hs_query_to_u32))
+            {
+                line_i = hs_render_day(&record.day, false, p_line, size_u16 - used_u16);
+                item_b = true;
+            }
+        }
+
+        if ((line_i < 0) || (line_i >= (int)(size_u16 - used_u16)))
+        {
+            break;
+        }
+
+        used_u16 += (uint16)line_i;
+        hs_query_walker = walker;
+        if (item_b)
+        {
+            hs_query_count_u32 += 1U;
+        }
+        else if ((*p_step_u32 == HS_STEP_HEADER) || (*p_step_u32 == HS_STEP_DAYS_HEADER))
+        {
+            /* Each array starts without a comma */
+            hs_query_count_u32 = 0U;
+        }
+        else
+        {
+            /* Skipped record or end of a list */
+        }
+        *p_step_u32 = next_step_u32;
+    }
+
+    http_tx_commit(p_conn, used_u16);
+
+    return *p_step_u32 >= HS_STEP_DONE;
+}
+
+int hs_render_move(const HS_MOVE *p_move, char *p_buffer, const uint16 size_u16)
+{
+    return snprintf(p_buffer, size_u16,
+                    "%s{\"start\":%lu,\"duration\":%lu.%lu,\"fromHeight\":%u,\"toHeight\":%u,\"fromState\":\"%s\",\"toState\":\"%s\",\"trigger\":\"%s\"}",
+                    (hs_query_count_u32 > 0U) ? "," : "", (unsigned long)p_move->start_u32,
+                    (unsigned long)(p_move->duration_ds_u32 / 10U), (unsigned long)(p_move->duration_ds_u32 % 10U),
+                    (unsigned)p_move->from_height_u16, (unsigned)p_move->to_height_u16, hs_state_name(p_move->from_state_e),
+                    hs_state_name(p_move->to_state_e), hs_trigger_names[p_move->trigger_e]);
+}
+
+int hs_render_day(const HS_DAY *p_day, const bool partial_b, char *p_buffer, const uint16 size_u16)
+{
+    /* Civil date from the day number, see Howard Hinnant's days_from_civil() */
+    const sint32 z_s32 = (sint32)p_day->day_u32 + 719468;
+    const sint32 era_s32 = z_s32 / 146097;
+    const uint32 doe_u32 = (uint32)(z_s32 - (era_s32 * 146097));
+    const uint32 yoe_u32 = (doe_u32 - (doe_u32 / 1460U) + (doe_u32 / 36524U) - (doe_u32 / 146096U)) / 365U;
+    const uint32 doy_u32 = doe_u32 - ((365U * yoe_u32) + (yoe_u32 / 4U) - (yoe_u32 / 100U));
+    const uint32 mp_u32 = ((5U * doy_u32) + 2U) / 153U;
+    const uint32 day_u32 = doy_u32 - (((153U * mp_u32) + 2U) / 5U) + 1U;
+    const uint32 month_u32 = (mp_u32 < 10U) ? (mp_u32 + 3U) : (mp_u32 - 9U);
+    const uint32 year_u32 = yoe_u32 + ((uint32)era_s32 * 400U) + ((month_u32 <= 2U) ? 1U : 0U);
+
+    return snprintf(p_buffer, size_u16,
+                    "%s{\"date\":\"%04lu-%02lu-%02lu\",\"moves\":%u,\"manual\":%u,\"scheduler\":%u,\"web\":%u,\"standingMinutes\":%lu,\"sittingMinutes\":%lu%s}",
+                    (hs_query_count_u32 > 0U) ? "," : "", (unsigned long)year_u32, (unsigned long)month_u32, (unsigned long)day_u32,
+                    (unsigned)(p_day->moves_vu16[HS_TRIGGER_MANUAL] + p_day->moves_vu16[HS_TRIGGER_SCHEDULER] + p_day->moves_vu16[HS_TRIGGER_WEB]),
+                    (unsigned)p_day->moves_vu16[HS_TRIGGER_MANUAL], (unsigned)p_day->moves_vu16[HS_TRIGGER_SCHEDULER], (unsigned)p_day->moves_vu16[HS_TRIGGER_WEB],
+                    (unsigned long)((p_day->standing_s_u32 + 30U) / 60U), (unsigned long)((p_day->sitting_s_u32 + 30U) / 60U),
+                    partial_b ? ",\"partial\":true" : "");
+}
+
+int hs_query_param(const HTTP_SLICE *p_query, const char *p_name, uint32 *p_value_u32)
+{
+    const uint16 name_size_u16 = (uint16)strlen(p_name);
+    uint16 i = 0U;
+    uint16 end_u16;
+    uint32 value_u32 = 0U;
+
+    /* Returns 1 and the value for name=<digits>, 0 if the name is not there and -1 for anything else */
+    while (i < p_query->size_u16)
+    {
+        end_u16 = i;
+        while ((end_u16 < p_query->size_u16) && (p_query->p_data[end_u16] != '&'))
+        {
+            end_u16 += 1U;
+        }
+
+        if (((end_u16 - i) > name_size_u16) && (memcmp(&p_query->p_data[i], p_name, name_size_u16) == 0) && (p_query->p_data[i + name_size_u16] == '='))
+        {
+            if (end_u16 == (i + name_size_u16 + 1U))
+            {
+                return -1;
+            }
+
+            for (uint16 j = i + name_size_u16 + 1U; j < end_u16; ++j)
+            {
+                if ((p_query->p_data[j] < '0') || (p_query->p_data[j] > '9') ||
+                    (value_u32 > ((0xffffffffUL - (uint32)(p_query->p_data[j] - '0')) / 10U)))
+                {
+                    return -1;
+                }
+                value_u32 = (value_u32 * 10U) + (uint32)(p_query->p_data[j] - '0');
+            }
+            *p_value_u32 = value_u32;
+            return 1;
+        }
+
+        i = end_u16 + 1U;
+    }
+
+    return 0;
+}
+
+const char *hs_state_name(const DC_STATE state_e)
+{
+    return (state_e == DC_STATE_STANDING) ? "standing" : ((state_e == DC_STATE_SITTING) ? "sitting" : "unknown");
+}
@@ -0,0 +1,66 @@
+#ifndef HS_MAIN_H
+#define HS_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define HS_NUM_SECTORS 8U   /* circular log behind the configuration, months of moves */
+#define HS_MIN_MOVE_U16 20U /* smaller height changes are display jitter, same unit as the desk height */
+
+/*****************************************************************************/
+
+/* Who asked the desk to move, two bits on flash */
+typedef enum
+{
+    HS_TRIGGER_MANUAL = 0, /* keypad, nothing of ours sent a command */
+    HS_TRIGGER_SCHEDULER,
+    HS_TRIGGER_WEB,
+    HS_NUM_TRIGGERS
+} HS_TRIGGER;
+
+typedef struct
+{
+    uint32 start_u32;        /* UTC seconds */
+    uint32 duration_ds_u32;  /* tenths of a second */
+    uint16 from_height_u16;
+    uint16 to_height_u16;
+    DC_STATE from_state_e;
+    DC_STATE to_state_e;
+    HS_TRIGGER trigger_e;
+} HS_MOVE;
+
+/* Precomputed when a (local) day is over, the current one is kept in RAM */
+typedef struct
+{
+    uint32 day_u32; /* days since 1970-01-01 in local time */
+    uint16 moves_vu16[HS_NUM_TRIGGERS];
+    uint32 standing_s_u32;
+    uint32 sitting_s_u32;
+} HS_DAY;
+
+typedef struct
+{
+    uint32 moves_u32;       /* recorded since boot */
+    uint32 days_u32;        /* aggregates written since boot */
+    uint32 bytes_u32;       /* appended since boot, headers included */
+    uint32 erases_u32;
+    uint32 unsynced_u32;    /* moves dropped because the time was not known yet */
+    uint16 used_sectors_u16;
+} HS_STATS;
+
+/*****************************************************************************/
+
+extern void hs_init();
+
+/* Attributes the next move to the caller, call right before sending the command */
+extern void hs_note_trigger(const HS_TRIGGER trigger_e);
+
+extern const HS_DAY *hs_get_today(); /* NULL until the time is known */
+extern const HS_STATS *hs_get_stats();
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,1120 @@
+#include "http.h"
+
+#include <ESP8266WiFi.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "log.h"
+#include "memory.h"
+#include "tasks.h"
+#include "trace.h"
+
+/*****************************************************************************/
+
+#define HTTP_CHUNK_HEADER_SIZE 6U  /* "xxxx\r\n" */
+#define HTTP_CHUNK_TRAILER_SIZE 7U /* "\r\n" after the data plus "0\r\n\r\n" at the end */
+
+/*****************************************************************************/
+
+typedef enum
+{
+    HTTP_CONN_FREE = 0,
+    HTTP_CONN_READING,    /* collecting the next request */
+    HTTP_CONN_RESPONDING, /* response started, output pending */
+    HTTP_CONN_UPGRADED,   /* speaking another protocol now */
+    HTTP_CONN_CLOSING     /* flush what is left, then close */
+} HTTP_CONN_STATE;
+
+typedef struct
+{
+    HTTP_METHOD method_e;
+    const char *p_path;
+    fn_http_handler p_handler;
+} HTTP_ROUTE;
+
+struct HTTP_CONN
+{
+    WiFiClient client;
+    HTTP_CONN_STATE state_e;
+    uint32 last_activity_ms_u32;
+
+    /* Receive side, the request is parsed in place */
+    char rx_vc[HTTP_RX_BUFFER_SIZE];
+    uint16 rx_size_u16;
+    uint16 scan_pos_u16;     /* where the search for the end of the headers resumes */
+    uint16 request_size_u16; /* headers and body of the request being answered */
+    HTTP_REQUEST request;
+
+    /* Transmit side */
+    uint8 tx_vu8[HTTP_TX_BUFFER_SIZE];
+    uint16 tx_start_u16;
+    uint16 tx_end_u16;
+    const uint8 *p_body;
+    uint32 body_size_u32;
+    uint32 body_pos_u32;
+    fn_http_producer p_producer;
+    uint32 producer_state_u32;
+    bool producer_idle_b; /* last call produced nothing, poll it slowly */
+    fn_http_done p_done;
+    fn_http_receiver p_receiver;
+
+    bool response_started_b;
+    bool chunked_b;
+    bool head_only_b;
+    bool keep_alive_b;
+};
+
+/*****************************************************************************/
+
+const uint32 HTTP_IDLE_TIMEOUT_MS_U32 = 5000U;   /* keep-alive and slow requests */
+const uint32 HTTP_STALL_TIMEOUT_MS_U32 = 10000U; /* client not taking any data */
+const uint32 HTTP_HOUSEKEEPING_PERIOD_MS_U32 = 100U;
+const char http_module_str[] PROGMEM = "HTTP";
+const char *http_busy_response_str = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+/*****************************************************************************/
+
+WiFiServer http_server(80);
+bool http_running_b = false;
+
+HTTP_CONN http_conns[HTTP_MAX_CONNECTIONS];
+HTTP_ROUTE http_routes[HTTP_MAX_ROUTES];
+uint8 http_num_routes_u8 = 0U;
+fn_http_handler http_not_found_handler = NULL;
+HTTP_STATS http_stats = {0};
+
+/*****************************************************************************/
+
+bool http_ready();
+void http_poll();
+void http_housekeeping();
+
+void http_accept();
+void http_close(HTTP_CONN *p_conn);
+void http_release(HTTP_CONN *p_conn);
+void http_receive(HTTP_CONN *p_conn);
+void http_forward(HTTP_CONN *p_conn);
+void http_parse(HTTP_CONN *p_conn);
+bool http_parse_head(HTTP_CONN *p_conn, const uint16 head_size_u16, uint32 *p_content_length_u32);
+bool http_parse_length(const char *p_value, const uint16 size_u16, uint32 *p_length_u32);
+void http_dispatch(HTTP_CONN *p_conn);
+void http_transmit(HTTP_CONN *p_conn);
+void http_finish(HTTP_CONN *p_conn);
+void http_fail(HTTP_CONN *p_conn, const uint16 status_u16);
+
+bool http_has_output(const HTTP_CONN *p_conn);
+void http_track_heap(const uint32 heap_before_u32, const uint32 allocations_before_u32);
+void http_run_producer(HTTP_CONN *p_conn);
+uint16 http_append(HTTP_CONN *p_conn, const void *p_data, const uint16 size_u16);
+HTTP_METHOD http_parse_method(const char *p_str, const uint16 size_u16);
+const char *http_status_text(const uint16 status_u16);
+
+/*****************************************************************************/
+
+void http_init()
+{
+    http_running_b = false;
+    http_num_routes_u8 = 0U;
+    http_not_found_handler = NULL;
+    (void)memset(&http_stats, 0, sizeof(HTTP_STATS));
+
+    for (uint8 i = 0U; i < HTTP_MAX_CONNECTIONS; ++i)
+    {
+        http_conns[i].state_e = HTTP_CONN_FREE;
+    }
+
+    /* Sockets are serviced as soon as they have something for us, timeouts are not urgent */
+    (void)tk_add_io_hook("HTTP", http_ready, http_poll);
+    (void)tk_add_periodic("HTTP housekeeping", http_housekeeping, HTTP_HOUSEKEEPING_PERIOD_MS_U32);
+}
+
+void http_begin(const uint16 port_u16)
+{
+    http_server.begin(port_u16);
+    http_server.setNoDelay(true);
+    http_running_b = true;
+}
+
+void http_end()
+{
+    for (uint8 i = 0U; i < HTTP_MAX_CONNECTIONS; ++i)
+    {
+        http_close(&http_conns[i]);
+    }
+
+    http_server.stop();
+    http_running_b = false;
+}
+
+int http_on(const HTTP_METHOD method_e, const char *p_path, fn_http_handler p_handler)
+{
+    int ret = 0;
+
+    if ((http_num_routes_u8 < HTTP_MAX_ROUTES) && (NULL != p_path) && (NULL != p_handler))
+    {
+        http_routes[http_num_routes_u8].method_e = method_e;
+        http_routes[http_num_routes_u8].p_path = p_path;
+        http_routes[http_num_routes_u8].p_handler = p_handler;
+        http_num_routes_u8 += 1U;
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, http_module_str, "Cannot register route '%s'.", p_path);
+        ret = -1;
+
+        /* Routes are only added during setup, a missing one would just be a 404 later on */
+        assert(http_num_routes_u8 < HTTP_MAX_ROUTES);
+    }
+
+    return ret;
+}
+
+void http_on_not_found(fn_http_handler p_handler)
+{
+    http_not_found_handler = p_handler;
+}
+
+/*****************************************************************************/
+
+void http_begin_response(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type, const uint32 content_length_u32, const char *p_extra_headers)
+{
+    char header_str[160];
+    int size_i;
+
+    p_conn->response_started_b = true;
+    p_conn->chunked_b = (content_length_u32 == HTTP_LENGTH_CHUNKED) && !p_conn->head_only_b;
+
+    size_i = snprintf(header_str, sizeof(header_str), "HTTP/1.1 %u %s\r\nContent-Type: %s\r\nConnection: %s\r\n",
+                      (unsigned)status_u16, http_status_text(status_u16),
+                      (NULL != p_content_type) ? p_content_type : "text/plain",
+                      p_conn->keep_alive_b ? "keep-alive" : "close");
+    (void)http_append(p_conn, header_str, (uint16)size_i);
+
+    if ((status_u16 == 204U) || (status_u16 == 304U))
+    {
+        /* Never carry a body, so no framing either */
+        p_conn->chunked_b = false;
+    }
+    else if (content_length_u32 == HTTP_LENGTH_CHUNKED)
+    {
+        (void)http_write_str(p_conn, "Transfer-Encoding: chunked\r\n");
+    }
+    else
+    {
+        size_i = snprintf(header_str, sizeof(header_str), "Content-Length: %u\r\n", (unsigned)content_length_u32);
+        (void)http_append(p_conn, header_str, (uint16)size_i);
+    }
+
+    if (NULL != p_extra_headers)
+    {
+        (void)http_append(p_conn, p_extra_headers, (uint16)strlen(p_extra_headers));
+    }
+    (void)http_append(p_conn, "\r\n", 2U);
+
+    /* From here on http_write() only produces body */
+    p_conn->state_e = HTTP_CONN_RESPONDING;
+}
+
+uint16 http_write(HTTP_CONN *p_conn, const void *p_data, const uint16 size_u16)
+{
+    char chunk_header_str[HTTP_CHUNK_HEADER_SIZE + 1U];
+    uint16 written_u16 = 0U;
+
+    if (p_conn->head_only_b && (p_conn->state_e == HTTP_CONN_RESPONDING))
+    {
+        /* Pretend the body went out */
+        written_u16 = size_u16;
+    }
+    else if (p_conn->chunked_b && (p_conn->state_e == HTTP_CONN_RESPONDING) && (NULL == p_conn->p_producer))
+    {
+        /* Direct writes are framed one by one, producers get framed in bulk by http_run_producer() */
+        if ((size_u16 > 0U) && (http_tx_free(p_conn) >= size_u16))
+        {
+            (void)snprintf(chunk_header_str, sizeof(chunk_header_str), "%04x\r\n", (unsigned)size_u16);
+            (void)http_append(p_conn, chunk_header_str, HTTP_CHUNK_HEADER_SIZE);
+            written_u16 = http_append(p_conn, p_data, size_u16);
+            (void)http_append(p_conn, "\r\n", 2U);
+        }
+    }
+    else
+    {
+        written_u16 = http_append(p_conn, p_data, size_u16);
+    }
+
+    return written_u16;
+}
+
+uint16 http_write_str(HTTP_CONN *p_conn, const char *p_str)
+{
+    return http_write(p_conn, p_str, (uint16)strlen(p_str));
+}
+
+uint16 http_tx_free(HTTP_CONN *p_conn)
+{
+    uint16 free_u16 = HTTP_TX_BUFFER_SIZE - (p_conn->tx_end_u16 - p_conn->tx_start_u16);
+
+    /* Chunked bodies need room for the framing */
+    if (p_conn->chunked_b)
+    {
+        free_u16 = (free_u16 > (HTTP_CHUNK_HEADER_SIZE + HTTP_CHUNK_TRAILER_SIZE)) ? (free_u16 - HTTP_CHUNK_HEADER_SIZE - HTTP_CHUNK_TRAILER_SIZE) : 0U;
+    }
+
+    return free_u16;
+}
+
+char *http_tx_reserve(HTTP_CONN *p_conn, uint16 *p_size_u16)
+{
+    /* Only ever called from producers, which start with an empty buffer */
+    *p_size_u16 = http_tx_free(p_conn);
+
+    return (char *)&(p_conn->tx_vu8[p_conn->tx_end_u16]);
+}
+
+void http_tx_commit(HTTP_CONN *p_conn, const uint16 size_u16)
+{
+    p_conn->tx_end_u16 += min(size_u16, http_tx_free(p_conn));
+}
+
+void http_send(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type, const char *p_body)
+{
+    const uint16 size_u16 = (uint16)strlen(p_body);
+
+    http_begin_response(p_conn, status_u16, p_content_type, size_u16, NULL);
+    if (http_write(p_conn, p_body, size_u16) != size_u16)
+    {
+        log_msg(LOG_LEVEL_ERROR, http_module_str, "Response body does not fit, closing.");
+        p_conn->state_e = HTTP_CONN_CLOSING;
+    }
+}
+
+void http_send_static(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type,
+                      const void *p_body, const uint32 size_u32, const char *p_extra_headers)
+{
+    http_begin_response(p_conn, status_u16, p_content_type, size_u32, p_extra_headers);
+
+    /* Sent straight from where it lives once the headers are out */
+    if (!p_conn->head_only_b)
+    {
+        p_conn->p_body = (const uint8 *)p_body;
+        p_conn->body_size_u32 = size_u32;
+        p_conn->body_pos_u32 = 0U;
+    }
+}
+
+void http_set_producer(HTTP_CONN *p_conn, fn_http_producer p_producer)
+{
+    if (!p_conn->head_only_b)
+    {
+        p_conn->p_producer = p_producer;
+        p_conn->producer_state_u32 = 0U;
+        p_conn->producer_idle_b = false;
+    }
+}
+
+uint32 *http_producer_state(HTTP_CONN *p_conn)
+{
+    return &(p_conn->producer_state_u32);
+}
+
+void http_wake(HTTP_CONN *p_conn)
+{
+    p_conn->producer_idle_b = false;
+}
+
+void http_set_done_handler(HTTP_CONN *p_conn, fn_http_done p_done)
+{
+    p_conn->p_done = p_done;
+}
+
+void http_upgrade(HTTP_CONN *p_conn, const char *p_extra_headers, fn_http_receiver p_receiver, fn_http_producer p_producer)
+{
+    const uint16 leftover_u16 = p_conn->rx_size_u16 - p_conn->request_size_u16;
+
+    p_conn->response_started_b = true;
+    p_conn->chunked_b = false;
+    p_conn->keep_alive_b = true;
+    (void)http_write_str(p_conn, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n");
+    if (NULL != p_extra_headers)
+    {
+        (void)http_write_str(p_conn, p_extra_headers);
+    }
+    (void)http_write_str(p_conn, "\r\n");
+
+    /* Whatever came after the request already belongs to the new protocol */
+    (void)memmove(p_conn->rx_vc, &(p_conn->rx_vc[p_conn->request_size_u16]), leftover_u16);
+    p_conn->rx_size_u16 = leftover_u16;
+    p_conn->request_size_u16 = 0U;
+    p_conn->scan_pos_u16 = 0U;
+
+    p_conn->p_receiver = p_receiver;
+    p_conn->p_producer = p_producer;
+    p_conn->producer_state_u32 = 0U;
+    p_conn->producer_idle_b = false;
+    p_conn->state_e = HTTP_CONN_UPGRADED;
+}
+
+void http_shutdown(HTTP_CONN *p_conn)
+{
+    p_conn->p_producer = NULL;
+    p_conn->p_receiver = NULL;
+    p_conn->state_e = HTTP_CONN_CLOSING;
+}
+
+bool http_slice_equals(const HTTP_SLICE *p_slice, const char *p_str)
+{
+    return (strlen(p_str) == p_slice->size_u16) && (memcmp(p_slice->p_data, p_str, p_slice->size_u16) == 0);
+}
+
+const HTTP_STATS *http_get_stats()
+{
+    return &http_stats;
+}
+
+/*****************************************************************************/
+
+bool http_ready()
+{
+    bool ready_b = false;
+
+    if (http_running_b)
+    {
+        ready_b = http_server.hasClient();
+        for (uint8 i = 0U; (i < HTTP_MAX_CONNECTIONS) && !ready_b; ++i)
+        {
+            HTTP_CONN *p_conn = &http_conns[i];
+
+            if (p_conn->state_e == HTTP_CONN_READING)
+            {
+                ready_b = (p_conn->client.available() > 0) || (p_conn->scan_pos_u16 < p_conn->rx_size_u16);
+            }
+            else if (p_conn->state_e != HTTP_CONN_FREE)
+            {
+                /* Upgraded connections also read, everything else only writes */
+                ready_b = (p_conn->state_e == HTTP_CONN_UPGRADED) && (p_conn->client.available() > 0);
+                ready_b = ready_b ||
+                          (((p_conn->tx_end_u16 > p_conn->tx_start_u16) ||
+                            ((NULL != p_conn->p_body) && (p_conn->body_pos_u32 < p_conn->body_size_u32)) ||
+                            ((NULL != p_conn->p_producer) && !p_conn->producer_idle_b)) &&
+                           (p_conn->client.availableForWrite() > 0));
+            }
+            else
+            {
+                /* Unused slot */
+            }
+        }
+    }
+
+    return ready_b;
+}
+
+void http_poll()
+{
+    http_accept();
+
+    for (uint8 i = 0U; i < HTTP_MAX_CONNECTIONS; ++i)
+    {
+        HTTP_CONN *p_conn = &http_conns[i];
+
+        if (p_conn->state_e == HTTP_CONN_READING)
+        {
+            http_receive(p_conn);
+            http_parse(p_conn);
+        }
+        else if (p_conn->state_e == HTTP_CONN_UPGRADED)
+        {
+            http_receive(p_conn);
+            http_forward(p_conn);
+        }
+        else
+        {
+            /* Nothing to read */
+        }
+
+        if (p_conn->state_e >= HTTP_CONN_RESPONDING)
+        {
+            http_transmit(p_conn);
+        }
+    }
+}
+
+void http_housekeeping()
+{
+    const uint32 now_ms_u32 = millis();
+
+    for (uint8 i = 0U; i < HTTP_MAX_CONNECTIONS; ++i)
+    {
+        HTTP_CONN *p_conn = &http_conns[i];
+
+        if (p_conn->state_e == HTTP_CONN_FREE)
+        {
+            continue;
+        }
+
+        if (!p_conn->client.connected())
+        {
+            http_close(p_conn);
+        }
+        else if ((p_conn->state_e == HTTP_CONN_READING) && ((now_ms_u32 - p_conn->last_activity_ms_u32) >= HTTP_IDLE_TIMEOUT_MS_U32))
+        {
+            http_close(p_conn);
+        }
+        else if ((p_conn->state_e != HTTP_CONN_READING) && ((now_ms_u32 - p_conn->last_activity_ms_u32) >= HTTP_STALL_TIMEOUT_MS_U32) &&
+                 ((p_conn->tx_end_u16 > p_conn->tx_start_u16) || ((NULL != p_conn->p_body) && (p_conn->body_pos_u32 < p_conn->body_size_u32))))
+        {
+            log_msg(LOG_LEVEL_WARNING, http_module_str, "Client stopped taking data, closing.");
+            http_close(p_conn);
+        }
+        else if ((NULL != p_conn->p_producer) && p_conn->producer_idle_b)
+        {
+            /* Producers waiting for something to send are only polled from here */
+            http_transmit(p_conn);
+        }
+        else
+        {
+            /* Fine */
+        }
+    }
+}
+
+/*****************************************************************************/
+
+void http_accept()
+{
+    HTTP_CONN *p_free = NULL;
+    WiFiClient client;
+
+    while (http_server.hasClient())
+    {
+        client = http_server.accept();
+
+        p_free = NULL;
+        for (uint8 i = 0U; (i < HTTP_MAX_CONNECTIONS) && (NULL == p_free); ++i)
+        {
+            if ((http_conns[i].state_e == HTTP_CONN_READING) && !http_conns[i].client.connected())
+            {
+                /* Peer is gone, no need to wait for the housekeeping to notice */
+                http_close(&http_conns[i]);
+            }
+
+            if (http_conns[i].state_e == HTTP_CONN_FREE)
+            {
+                p_free = &http_conns[i];
+            }
+        }
+
+        if (NULL != p_free)
+        {
+            http_stats.connections_u32 += 1U;
+
+            p_free->client = client;
+            p_free->client.setNoDelay(true);
+            p_free->state_e = HTTP_CONN_READING;
+            p_free->last_activity_ms_u32 = millis();
+            p_free->rx_size_u16 = 0U;
+            p_free->scan_pos_u16 = 0U;
+            p_free->tx_start_u16 = 0U;
+            p_free->tx_end_u16 = 0U;
+            p_free->p_body = NULL;
+            p_free->p_producer = NULL;
+            p_free->p_done = NULL;
+            p_free->p_receiver = NULL;
+        }
+        else
+        {
+            /* No slot left, better a quick answer than a connection that hangs */
+            http_stats.rejected_u32 += 1U;
+            (void)client.write((const uint8 *)http_busy_response_str, strlen(http_busy_response_str));
+            client.stop();
+        }
+    }
+}
+
+void http_close(HTTP_CONN *p_conn)
+{
+    if (p_conn->state_e != HTTP_CONN_FREE)
+    {
+        http_release(p_conn);
+        p_conn->client.stop();
+        p_conn->client = WiFiClient();
+        p_conn->state_e = HTTP_CONN_FREE;
+    }
+}
+
+void http_release(HTTP_CONN *p_conn)
+{
+    const fn_http_done p_done = p_conn->p_done;
+
+    p_conn->p_body = NULL;
+    p_conn->p_producer = NULL;
+    p_conn->p_receiver = NULL;
+    p_conn->p_done = NULL;
+
+    if (NULL != p_done)
+    {
+        p_done(p_conn);
+    }
+}
+
+void http_forward(HTTP_CONN *p_conn)
+{
+    uint16 consumed_u16;
+
+    if ((NULL == p_conn->p_receiver) || (p_conn->rx_size_u16 == 0U))
+    {
+        return;
+    }
+
+    consumed_u16 = min(p_conn->p_receiver(p_conn, (const uint8 *)p_conn->rx_vc, p_conn->rx_size_u16), p_conn->rx_size_u16);
+    if ((consumed_u16 == 0U) && (p_conn->rx_size_u16 >= HTTP_RX_BUFFER_SIZE))
+    {
+        log_msg(LOG_LEVEL_WARNING, http_module_str, "Receiver does not take any data, closing.");
+        http_shutdown(p_conn);
+    }
+    else if (p_conn->state_e == HTTP_CONN_UPGRADED)
+    {
+        (void)memmove(p_conn->rx_vc, &(p_conn->rx_vc[consumed_u16]), p_conn->rx_size_u16 - consumed_u16);
+        p_conn->rx_size_u16 -= consumed_u16;
+    }
+    else
+    {
+        /* Receiver shut the connection down */
+    }
+}
+
+void http_receive(HTTP_CONN *p_conn)
+{
+    const int available_i = p_conn->client.available();
+    const uint16 space_u16 = HTTP_RX_BUFFER_SIZE - p_conn->rx_size_u16;
+    int read_i;
+
+    if ((available_i > 0) && (space_u16 > 0U))
+    {
+        read_i = p_conn->client.read((uint8 *)&(p_conn->rx_vc[p_conn->rx_size_u16]), min((uint16)available_i, space_u16));
+        if (read_i > 0)
+        {
+            p_conn->rx_size_u16 += (uint16)read_i;
+            p_conn->last_activity_ms_u32 = millis();
+        }
+    }
+}
+
+void http_parse(HTTP_CONN *p_conn)
+{
+    uint16 pos_u16 = (p_conn->scan_pos_u16 >= 3U) ? (p_conn->scan_pos_u16 - 3U) : 0U;
+    uint16 head_size_u16 = 0U;
+    uint32 content_length_u32 = 0U;
+
+    /* Only look at bytes we have not seen yet, minus a possibly split "\r\n\r\n" */
+    for (; (pos_u16 + 3U) < p_conn->rx_size_u16; ++pos_u16)
+    {
+        if ((p_conn->rx_vc[pos_u16] == '\r') && (memcmp(&(p_conn->rx_vc[pos_u16]), "\r\n\r\n", 4U) == 0))
+        {
+            head_size_u16 = pos_u16 + 4U;
+            break;
+        }
+    }
+
+    if (head_size_u16 == 0U)
+    {
+        p_conn->scan_pos_u16 = p_conn->rx_size_u16;
+        if (p_conn->rx_size_u16 >= HTTP_RX_BUFFER_SIZE)
+        {
+            http_fail(p_conn, 431);
+        }
+        return;
+    }
+
+    if (!http_parse_head(p_conn, head_size_u16, &content_length_u32))
+    {
+        http_fail(p_conn, 400);
+    }
+    else if (content_length_u32 > (uint32)(HTTP_RX_BUFFER_SIZE - head_size_u16))
+    {
+        http_fail(p_conn, 413);
+    }
+    else if ((head_size_u16 + content_length_u32) > p_conn->rx_size_u16)
+    {
+        /* Body still incomplete, keep the scan position so we come back here */
+        p_conn->scan_pos_u16 = head_size_u16 - 1U;
+    }
+    else
+    {
+        p_conn->request.body.p_data = &(p_conn->rx_vc[head_size_u16]);
+        p_conn->request.body.size_u16 = (uint16)content_length_u32;
+        p_conn->request_size_u16 = head_size_u16 + (uint16)content_length_u32;
+        p_conn->scan_pos_u16 = p_conn->request_size_u16;
+
+        http_dispatch(p_conn);
+    }
+}
+
+bool http_parse_head(HTTP_CONN *p_conn, const uint16 head_size_u16, uint32 *p_content_length_u32)
+{
+    HTTP_REQUEST *p_request = &(p_conn->request);
+    const char *p_head = p_conn->rx_vc;
+    const char *p_end = p_head + head_size_u16 - 2U; /* last header line ends before the final "\r\n" */
+    const char *p_line = p_head;
+    const char *p_eol;
+    const char *p_sp1;
+    const char *p_sp2;
+    const char *p_query;
+    bool http_11_b;
+
+    /* Request line: METHOD SP target SP version */
+    p_eol = (const char *)memchr(p_line, '\r', p_end - p_line + 1);
+    p_sp1 = (NULL != p_eol) ? (const char *)memchr(p_line, ' ', p_eol - p_line) : NULL;
+    p_sp2 = (NULL != p_sp1) ? (const char *)memchr(p_sp1 + 1, ' ', p_eol - p_sp1 - 1) : NULL;
+    if ((NULL == p_sp2) || ((p_eol - p_sp2 - 1) != 8) || (memcmp(p_sp2 + 1, "HTTP/1.", 7U) != 0))
+    {
+        return false;
+    }
+
+    p_request->method_e = http_parse_method(p_line, (uint16)(p_sp1 - p_line));
+    p_query = (const char *)memchr(p_sp1 + 1, '?', p_sp2 - p_sp1 - 1);
+    p_request->path.p_data = p_sp1 + 1;
+    p_request->path.size_u16 = (uint16)(((NULL != p_query) ? p_query : p_sp2) - p_sp1 - 1);
+    p_request->query.p_data = (NULL != p_query) ? (p_query + 1) : p_sp2;
+    p_request->query.size_u16 = (NULL != p_query) ? (uint16)(p_sp2 - p_query - 1) : 0U;
+    http_11_b = (p_sp2[8] == '1');
+    p_request->keep_alive_b = http_11_b;
+
+    /* Headers, only the ones we care about */
+    *p_content_length_u32 = 0U;
+    p_request->if_none_match.p_data = p_end;
+    p_request->if_none_match.size_u16 = 0U;
+    p_request->websocket_key.p_data = p_end;
+    p_request->websocket_key.size_u16 = 0U;
+    for (p_line = p_eol + 2; p_line < p_end; p_line = p_eol + 2)
+    {
+        const char *p_colon;
+        const char *p_value;
+        uint16 name_size_u16;
+        uint16 value_size_u16;
+
+        p_eol = (const char *)memchr(p_line, '\r', p_end - p_line + 1);
+        p_colon = (NULL != p_eol) ? (const char *)memchr(p_line, ':', p_eol - p_line) : NULL;
+        if (NULL == p_colon)
+        {
+            return false;
+        }
+
+        name_size_u16 = (uint16)(p_colon - p_line);
+        for (p_value = p_colon + 1; (p_value < p_eol) && (*p_value == ' '); ++p_value)
+        {
+        }
+        value_size_u16 = (uint16)(p_eol - p_value);
+
+        if ((name_size_u16 == 14U) && (strncasecmp(p_line, "Content-Length", 14U) == 0))
+        {
+            if (!http_parse_length(p_value, value_size_u16, p_content_length_u32))
+            {
+                return false;
+            }
+        }
+        else if ((name_size_u16 == 10U) && (strncasecmp(p_line, "Connection", 10U) == 0))
+        {
+            if ((value_size_u16 >= 5U) && (strncasecmp(p_value, "close", 5U) == 0))
+            {
+                p_request->keep_alive_b = false;
+            }
+            else if ((value_size_u16 >= 10U) && (strncasecmp(p_value, "keep-alive", 10U) == 0))
+            {
+                p_request->keep_alive_b = true;
+            }
+            else
+            {
+                /* Upgrade and friends */
+            }
+        }
+        else if ((name_size_u16 == 17U) && (strncasecmp(p_line, "Sec-WebSocket-Key", 17U) == 0))
+        {
+            p_request->websocket_key.p_data = p_value;
+            p_request->websocket_key.size_u16 = value_size_u16;
+        }
+        else if ((name_size_u16 == 13U) && (strncasecmp(p_line, "If-None-Match", 13U) == 0))
+        {
+            p_request->if_none_match.p_data = p_value;
+            p_request->if_none_match.size_u16 = value_size_u16;
+        }
+        else
+        {
+            /* Not interesting */
+        }
+    }
+
+    return true;
+}
+
+/* Digits only, a value too large for 32 bits saturates so that it is answered with 413 like any other oversized body */
+bool http_parse_length(const char *p_value, const uint16 size_u16, uint32 *p_length_u32)
+{
+    uint32 length_u32 = 0U;
+    uint16 i = 0U;
+
+    for (; (i < size_u16) && (p_value[i] >= '0') && (p_value[i] <= '9'); ++i)
+    {
+        const uint32 digit_u32 = (uint32)(p_value[i] - '0');
+
+        length_u32 = (length_u32 > ((0xffffffffU - digit_u32) / 10U)) ? 0xffffffffU : ((length_u32 * 10U) + digit_u32);
+    }
+
+    /* Trailing whitespace is allowed, anything else is not a length */
+    if (i == 0U)
+    {
+        return false;
+    }
+    for (; i < size_u16; ++i)
+    {
+        if ((p_value[i] != ' ') && (p_value[i] != '\t'))
+        {
+            return false;
+        }
+    }
+
+    *p_length_u32 = length_u32;
+    return true;
+}
+
+void http_dispatch(HTTP_CONN *p_conn)
+{
+    const HTTP_REQUEST *p_request = &(p_conn->request);
+    fn_http_handler p_handler = NULL;
+    bool path_known_b = false;
+    uint32 heap_before_u32;
+    uint32 allocations_before_u32;
+
+    http_stats.requests_u32 += 1U;
+
+    p_conn->response_started_b = false;
+    p_conn->chunked_b = false;
+    p_conn->head_only_b = (p_request->method_e == HTTP_METHOD_HEAD);
+    p_conn->keep_alive_b = p_request->keep_alive_b;
+    p_conn->p_body = NULL;
+    p_conn->p_producer = NULL;
+
+    for (uint8 i = 0U; (i < http_num_routes_u8) && (NULL == p_handler); ++i)
+    {
+        const HTTP_ROUTE *p_route = &http_routes[i];
+
+        if (http_slice_equals(&(p_request->path), p_route->p_path))
+        {
+            path_known_b = true;
+            if ((p_route->method_e == HTTP_METHOD_ANY) || (p_route->method_e == p_request->method_e) ||
+                ((p_route->method_e == HTTP_METHOD_GET) && (p_request->method_e == HTTP_METHOD_HEAD)))
+            {
+                p_handler = p_route->p_handler;
+            }
+        }
+    }
+
+    TR_BEGIN(TR_TRACK_HTTP, "Request");
+    heap_before_u32 = ESP.getFreeHeap();
+    allocations_before_u32 = mm_get_allocations();
+    if (NULL != p_handler)
+    {
+        p_handler(p_conn, p_request);
+    }
+    else if (path_known_b)
+    {
+        http_send(p_conn, 405, "text/plain", "405: Method not allowed");
+    }
+    else if (NULL != http_not_found_handler)
+    {
+        http_not_found_handler(p_conn, p_request);
+    }
+    else
+    {
+        http_send(p_conn, 404, "text/plain", "404: Not found");
+    }
+    http_track_heap(heap_before_u32, allocations_before_u32);
+
+    if (!p_conn->response_started_b)
+    {
+        log_msg(LOG_LEVEL_ERROR, http_module_str, "Handler did not respond.");
+        http_send(p_conn, 500, "text/plain", "500: No response");
+    }
+
+    /* Try to get it out right away */
+    http_transmit(p_conn);
+    TR_END(TR_TRACK_HTTP, "Request");
+}
+
+void http_transmit(HTTP_CONN *p_conn)
+{
+    int window_i = p_conn->client.availableForWrite();
+    size_t written_u32;
+    bool progress_b = false;
+
+    while ((window_i > 0) && http_has_output(p_conn))
+    {
+        /* Buffered output first, then the referenced body, then whatever the producer makes */
+        if (p_conn->tx_end_u16 > p_conn->tx_start_u16)
+        {
+            written_u32 = p_conn->client.write(&(p_conn->tx_vu8[p_conn->tx_start_u16]),
+                                               min((size_t)(p_conn->tx_end_u16 - p_conn->tx_start_u16), (size_t)window_i));
+            p_conn->tx_start_u16 += (uint16)written_u32;
+            if (p_conn->tx_start_u16 == p_conn->tx_end_u16)
+            {
+                p_conn->tx_start_u16 = 0U;
+                p_conn->tx_end_u16 = 0U;
+            }
+        }
+        else if ((NULL != p_conn->p_body) && (p_conn->body_pos_u32 < p_conn->body_size_u32))
+        {
+            /* write_P() copes with bodies in flash as well as in RAM */
+            written_u32 = p_conn->client.write_P((PGM_P)&(p_conn->p_body[p_conn->body_pos_u32]),
+                                                 min((size_t)(p_conn->body_size_u32 - p_conn->body_pos_u32), (size_t)window_i));
+            p_conn->body_pos_u32 += (uint32)written_u32;
+        }
+        else
+        {
+            http_run_producer(p_conn);
+            written_u32 = 0U;
+            if (p_conn->tx_end_u16 == p_conn->tx_start_u16)
+            {
+                /* Producer has nothing right now */
+                break;
+            }
+            continue;
+        }
+
+        if (written_u32 == 0U)
+        {
+            break;
+        }
+
+        progress_b = true;
+        window_i -= (int)written_u32;
+    }
+
+    if (progress_b)
+    {
+        p_conn->last_activity_ms_u32 = millis();
+    }
+
+    if (!http_has_output(p_conn))
+    {
+        http_finish(p_conn);
+    }
+}
+
+void http_finish(HTTP_CONN *p_conn)
+{
+    const uint16 leftover_u16 = p_conn->rx_size_u16 - p_conn->request_size_u16;
+
+    if (p_conn->state_e == HTTP_CONN_UPGRADED)
+    {
+        /* Only ends with the connection */
+        return;
+    }
+
+    http_release(p_conn);
+    if ((p_conn->state_e == HTTP_CONN_CLOSING) || !p_conn->keep_alive_b)
+    {
+        http_close(p_conn);
+    }
+    else
+    {
+        /* Keep whatever the client already pipelined behind this request */
+        (void)memmove(p_conn->rx_vc, &(p_conn->rx_vc[p_conn->request_size_u16]), leftover_u16);
+        p_conn->rx_size_u16 = leftover_u16;
+        p_conn->scan_pos_u16 = 0U;
+        p_conn->request_size_u16 = 0U;
+        p_conn->state_e = HTTP_CONN_READING;
+    }
+}
+
+void http_fail(HTTP_CONN *p_conn, const uint16 status_u16)
+{
+    http_stats.errors_u32 += 1U;
+
+    /* Framing is lost, so this connection is done after the answer */
+    p_conn->keep_alive_b = false;
+    p_conn->head_only_b = false;
+    p_conn->p_body = NULL;
+    p_conn->p_producer = NULL;
+    http_begin_response(p_conn, status_u16, "text/plain", 0U, NULL);
+    p_conn->state_e = HTTP_CONN_CLOSING;
+    http_transmit(p_conn);
+}
+
+/*****************************************************************************/
+
+void http_track_heap(const uint32 heap_before_u32, const uint32 allocations_before_u32)
+{
+    const uint32 heap_after_u32 = ESP.getFreeHeap();
+
+    http_stats.allocations_u32 += mm_get_allocations() - allocations_before_u32;
+
+    /* Request handling is meant to run without the heap, anything showing up here is a leak or fragmentation risk */
+    if ((heap_before_u32 > heap_after_u32) && ((heap_before_u32 - heap_after_u32) > http_stats.heap_drop_max_u32))
+    {
+        http_stats.heap_drop_max_u32 = heap_before_u32 - heap_after_u32;
+        log_msg(LOG_LEVEL_WARNING, http_module_str, "Request handling kept %u bytes of heap.", (unsigned)http_stats.heap_drop_max_u32);
+    }
+}
+
+bool http_has_output(const HTTP_CONN *p_conn)
+{
+    return (p_conn->tx_end_u16 > p_conn->tx_start_u16) ||
+           ((NULL != p_conn->p_body) && (p_conn->body_pos_u32 < p_conn->body_size_u32)) ||
+           (NULL != p_conn->p_producer);
+}
+
+void http_run_producer(HTTP_CONN *p_conn)
+{
+    char chunk_header_str[HTTP_CHUNK_HEADER_SIZE + 1U];
+    const fn_http_producer p_producer = p_conn->p_producer;
+    uint16 chunk_start_u16;
+    uint16 chunk_size_u16;
+    uint32 heap_before_u32;
+    uint32 allocations_before_u32;
+    bool done_b;
+
+    /* Make the whole buffer available, it is empty at this point */
+    p_conn->tx_start_u16 = 0U;
+    p_conn->tx_end_u16 = 0U;
+
+    if (p_conn->chunked_b)
+    {
+        p_conn->tx_end_u16 = HTTP_CHUNK_HEADER_SIZE;
+    }
+    chunk_start_u16 = p_conn->tx_end_u16;
+
+    TR_BEGIN(TR_TRACK_HTTP, "Produce");
+    heap_before_u32 = ESP.getFreeHeap();
+    allocations_before_u32 = mm_get_allocations();
+    done_b = p_producer(p_conn);
+    http_track_heap(heap_before_u32, allocations_before_u32);
+    TR_END(TR_TRACK_HTTP, "Produce");
+    p_conn->producer_idle_b = (p_conn->tx_end_u16 == chunk_start_u16);
+
+    if (p_conn->chunked_b)
+    {
+        chunk_size_u16 = p_conn->tx_end_u16 - chunk_start_u16;
+        if (chunk_size_u16 > 0U)
+        {
+            (void)snprintf(chunk_header_str, sizeof(chunk_header_str), "%04x\r\n", (unsigned)chunk_size_u16);
+            (void)memcpy(p_conn->tx_vu8, chunk_header_str, HTTP_CHUNK_HEADER_SIZE);
+            (void)http_append(p_conn, "\r\n", 2U);
+        }
+        else
+        {
+            p_conn->tx_start_u16 = HTTP_CHUNK_HEADER_SIZE;
+        }
+
+        if (done_b)
+        {
+            (void)http_append(p_conn, "0\r\n\r\n", 5U);
+        }
+    }
+
+    if (done_b)
+    {
+        p_conn->p_producer = NULL;
+    }
+}
+
+uint16 http_append(HTTP_CONN *p_conn, const void *p_data, const uint16 size_u16)
+{
+    uint16 free_u16 = HTTP_TX_BUFFER_SIZE - p_conn->tx_end_u16;
+    uint16 written_u16;
+
+    /* Compact if the free space is split */
+    if ((free_u16 < size_u16) && (p_conn->tx_start_u16 > 0U))
+    {
+        (void)memmove(p_conn->tx_vu8, &(p_conn->tx_vu8[p_conn->tx_start_u16]), p_conn->tx_end_u16 - p_conn->tx_start_u16);
+        p_conn->tx_end_u16 -= p_conn->tx_start_u16;
+        p_conn->tx_start_u16 = 0U;
+        free_u16 = HTTP_TX_BUFFER_SIZE - p_conn->tx_end_u16;
+    }
+
+    written_u16 = min(free_u16, size_u16);
+    (void)memcpy(&(p_conn->tx_vu8[p_conn->tx_end_u16]), p_data, written_u16);
+    p_conn->tx_end_u16 += written_u16;
+
+    return written_u16;
+}
+
+HTTP_METHOD http_parse_method(const char *p_str, const uint16 size_u16)
+{
+    HTTP_METHOD method_e = HTTP_METHOD_UNKNOWN;
+
+    if ((size_u16 == 3U) && (memcmp(p_str, "GET", 3U) == 0))
+    {
+        method_e = HTTP_METHOD_GET;
+    }
+    else if ((size_u16 == 4U) && (memcmp(p_str, "HEAD", 4U) == 0))
+    {
+        method_e = HTTP_METHOD_HEAD;
+    }
+    else if ((size_u16 == 4U) && (memcmp(p_str, "POST", 4U) == 0))
+    {
+        method_e = HTTP_METHOD_POST;
+    }
+    else if ((size_u16 == 3U) && (memcmp(p_str, "PUT", 3U) == 0))
+    {
+        method_e = HTTP_METHOD_PUT;
+    }
+    else if ((size_u16 == 6U) && (memcmp(p_str, "DELETE", 6U) == 0))
+    {
+        method_e = HTTP_METHOD_DELETE;
+    }
+    else
+    {
+        /* Unknown */
+    }
+
+    return method_e;
+}
+
+const char *http_status_text(const uint16 status_u16)
+{
+    const char *p_text;
+
+    switch (status_u16)
+    {
+    case 101:
+        p_text = "Switching Protocols";
+        break;
+    case 200:
+        p_text = "OK";
+        break;
+    case 202:
+        p_text = "Accepted";
+        break;
+    case 204:
+        p_text = "No Content";
+        break;
+    case 304:
+        p_text = "Not Modified";
+        break;
+    case 400:
+        p_text = "Bad Request";
+        break;
+    case 404:
+        p_text = "Not Found";
+        break;
+    case 405:
+        p_text = "Method Not Allowed";
+        break;
+    case 413:
+        p_text = "Payload Too Large";
+        break;
+    case 431:
+        p_text = "Request Header Fields Too Large";
+        break;
+    case 503:
+        p_text = "Service Unavailable";
+        break;
+    default:
+        p_text = (status_u16 >= 500U) ? "Internal Server Error" : "Unknown";
+        break;
+    }
+
+    return p_text;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,104 @@
+#ifndef HTTP_MAIN_H
+#define HTTP_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define HTTP_MAX_CONNECTIONS 4U
+#define HTTP_RX_BUFFER_SIZE 1024U /* request line, headers and body of one request */
+#define HTTP_TX_BUFFER_SIZE 768U
+#define HTTP_MAX_ROUTES 32U /* 21 module routes and the UI assets so far, running out stops the boot */
+
+#define HTTP_LENGTH_CHUNKED 0xffffffffUL /* body length unknown, use chunked transfer encoding */
+
+/*****************************************************************************/
+
+typedef enum
+{
+    HTTP_METHOD_UNKNOWN = 0,
+    HTTP_METHOD_GET,
+    HTTP_METHOD_HEAD,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT,
+    HTTP_METHOD_DELETE,
+    HTTP_METHOD_ANY /* only for routes */
+} HTTP_METHOD;
+
+/* View into the receive buffer, not NUL-terminated */
+typedef struct
+{
+    const char *p_data;
+    uint16 size_u16;
+} HTTP_SLICE;
+
+typedef struct
+{
+    HTTP_METHOD method_e;
+    HTTP_SLICE path;
+    HTTP_SLICE query;
+    HTTP_SLICE body;
+    HTTP_SLICE if_none_match; /* empty if not sent */
+    HTTP_SLICE websocket_key; /* empty unless the client asks for a WebSocket */
+    bool keep_alive_b;
+} HTTP_REQUEST;
+
+typedef struct
+{
+    uint32 connections_u32;
+    uint32 rejected_u32; /* all connection slots were busy */
+    uint32 requests_u32;
+    uint32 errors_u32;   /* malformed or oversized requests */
+    uint32 heap_drop_max_u32; /* most heap a handler or producer call has not given back */
+    uint32 allocations_u32;   /* heap allocations made by handlers and producers, see mm_get_allocations() */
+} HTTP_STATS;
+
+typedef struct HTTP_CONN HTTP_CONN;
+
+typedef void (*fn_http_handler)(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+typedef bool (*fn_http_producer)(HTTP_CONN *p_conn); /* returns true once the body is complete */
+typedef void (*fn_http_done)(HTTP_CONN *p_conn);     /* response is over, finished or not */
+typedef uint16 (*fn_http_receiver)(HTTP_CONN *p_conn, const uint8 *p_data, const uint16 size_u16); /* returns bytes consumed */
+
+/*****************************************************************************/
+
+extern void http_init();
+extern void http_begin(const uint16 port_u16);
+extern void http_end();
+
+extern int http_on(const HTTP_METHOD method_e, const char *p_path, fn_http_handler p_handler);
+extern void http_on_not_found(fn_http_handler p_handler);
+
+/* Responses - exactly one per request, started from within the handler */
+extern void http_begin_response(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type, const uint32 content_length_u32, const char *p_extra_headers);
+extern uint16 http_write(HTTP_CONN *p_conn, const void *p_data, const uint16 size_u16); /* copies, returns bytes taken */
+extern uint16 http_write_str(HTTP_CONN *p_conn, const char *p_str);
+extern uint16 http_tx_free(HTTP_CONN *p_conn);
+
+/* Lets a producer render straight into the transmit buffer */
+extern char *http_tx_reserve(HTTP_CONN *p_conn, uint16 *p_size_u16);
+extern void http_tx_commit(HTTP_CONN *p_conn, const uint16 size_u16);
+
+extern void http_send(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type, const char *p_body); /* copies the body */
+extern void http_send_static(HTTP_CONN *p_conn, const uint16 status_u16, const char *p_content_type,
+                             const void *p_body, const uint32 size_u32, const char *p_extra_headers); /* body must outlive the response */
+
+/* Streams the body from a callback whenever there is room in the transmit buffer */
+extern void http_set_producer(HTTP_CONN *p_conn, fn_http_producer p_producer);
+extern uint32 *http_producer_state(HTTP_CONN *p_conn);
+extern void http_wake(HTTP_CONN *p_conn); /* producer has something to send again */
+extern void http_set_done_handler(HTTP_CONN *p_conn, fn_http_done p_done);
+
+/* Answers with 101 and hands the connection over to another protocol, everything
+ * received goes to the receiver and the producer is polled for output until it closes */
+extern void http_upgrade(HTTP_CONN *p_conn, const char *p_extra_headers, fn_http_receiver p_receiver, fn_http_producer p_producer);
+extern void http_shutdown(HTTP_CONN *p_conn); /* close once pending output is out */
+
+extern bool http_slice_equals(const HTTP_SLICE *p_slice, const char *p_str);
+extern const HTTP_STATS *http_get_stats();
+
+/*****************************************************************************/
+
+#endif
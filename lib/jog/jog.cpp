@@ -0,0 +1,177 @@
+#include "jog.h"
+
+#include <string.h>
+
+#include "deskcontrol.h"
+#include "events.h"
+#include "history.h"
+#include "http.h"
+#include "log.h"
+#include "websocket.h"
+
+/*****************************************************************************/
+
+typedef struct
+{
+    HTTP_CONN *p_conn; /* NULL if the slot is free */
+    bool telemetry_due_b;
+} JOG_CLIENT;
+
+/*****************************************************************************/
+
+const char jog_module_str[] PROGMEM = "Jog";
+
+/*****************************************************************************/
+
+JOG_CLIENT jog_clients[WSK_MAX_SESSIONS];
+HTTP_CONN *jog_owner_conn_p = NULL; /* the client whose refreshes keep the current jog going */
+
+/*****************************************************************************/
+
+void jog_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void jog_handle_message(HTTP_CONN *p_conn, const WSK_OPCODE opcode_e, const uint8 *p_data, const uint16 size_u16);
+void jog_handle_closed(HTTP_CONN *p_conn);
+void jog_handle_event(const EVENT *p_event);
+bool jog_produce(HTTP_CONN *p_conn);
+
+JOG_CLIENT *jog_find_client(const HTTP_CONN *p_conn);
+void jog_notify_all();
+
+/*****************************************************************************/
+
+void jog_init()
+{
+    (void)memset(jog_clients, 0, sizeof(jog_clients));
+
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, jog_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, jog_handle_event);
+
+    (void)http_on(HTTP_METHOD_GET, "/api/jog", jog_handle_request);
+}
+
+/*****************************************************************************/
+
+void jog_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JOG_CLIENT *p_client = jog_find_client(NULL);
+
+    if (NULL == p_client)
+    {
+        http_send(p_conn, 503, "text/plain", "Too many jog sessions");
+        return;
+    }
+
+    if (wsk_accept(p_conn, p_request, jog_handle_message, jog_produce, jog_handle_closed))
+    {
+        /* First telemetry goes out right behind the handshake */
+        p_client->p_conn = p_conn;
+        p_client->telemetry_due_b = true;
+    }
+}
+
+void jog_handle_message(HTTP_CONN *p_conn, const WSK_OPCODE opcode_e, const uint8 *p_data, const uint16 size_u16)
+{
+    if ((opcode_e != WSK_OPCODE_BINARY) || (size_u16 == 0U))
+    {
+        log_msg(LOG_LEVEL_WARNING, jog_module_str, "Ignoring message that is not binary.");
+        return;
+    }
+
+    if ((p_data[0] == JOG_MSG_START) && (size_u16 >= 2U) && (p_data[1] == JOG_DIRECTION_UP))
+    {
+        hs_note_trigger(HS_TRIGGER_WEB);
+        jog_owner_conn_p = (dc_jog(DC_CMD_UP) == 0) ? p_conn : jog_owner_conn_p;
+    }
+    else if ((p_data[0] == JOG_MSG_START) && (size_u16 >= 2U) && (p_data[1] == JOG_DIRECTION_DOWN))
+    {
+        hs_note_trigger(HS_TRIGGER_WEB);
+        jog_owner_conn_p = (dc_jog(DC_CMD_DOWN) == 0) ? p_conn : jog_owner_conn_p;
+    }
+    else if (p_data[0] == JOG_MSG_STOP)
+    {
+        /* Anyone may stop the desk */
+        jog_owner_conn_p = NULL;
+        dc_jog_stop();
+    }
+    else
+    {
+        log_buffer(LOG_LEVEL_WARNING, jog_module_str, "Unknown message", p_data, (uint8)min(size_u16, (uint16)16U));
+    }
+
+    /* Every client gets to see that the jog changed */
+    jog_notify_all();
+}
+
+void jog_handle_closed(HTTP_CONN *p_conn)
+{
+    JOG_CLIENT *p_client = jog_find_client(p_conn);
+
+    if (NULL != p_client)
+    {
+        p_client->p_conn = NULL;
+
+        /* A dropped connection must not leave the desk moving until the dead-man timeout, other tabs closing must not stop it */
+        if (jog_owner_conn_p == p_conn)
+        {
+            jog_owner_conn_p = NULL;
+            dc_jog_stop();
+        }
+    }
+}
+
+void jog_handle_event(const EVENT *p_event)
+{
+    jog_notify_all();
+}
+
+bool jog_produce(HTTP_CONN *p_conn)
+{
+    JOG_CLIENT *p_client = jog_find_client(p_conn);
+    const uint16 height_u16 = dc_get_current_height();
+    const DC_COMMAND jog_e = dc_get_jog();
+    uint8 message_vu8[5];
+
+    if ((NULL != p_client) && p_client->telemetry_due_b)
+    {
+        message_vu8[0] = JOG_MSG_TELEMETRY;
+        message_vu8[1] = (uint8)height_u16;
+        message_vu8[2] = (uint8)(height_u16 >> 8);
+        message_vu8[3] = (uint8)dc_get_current_state();
+        message_vu8[4] = (jog_e == DC_CMD_UP) ? JOG_DIRECTION_UP : ((jog_e == DC_CMD_DOWN) ? JOG_DIRECTION_DOWN : JOG_DIRECTION_NONE);
+
+        /* Always the latest values, so there is nothing to queue */
+        p_client->telemetry_due_b = !wsk_send(p_conn, WSK_OPCODE_BINARY, message_vu8, sizeof(message_vu8));
+    }
+
+    /* The session only ends with the connection */
+    return false;
+}
+
+/*****************************************************************************/
+
+JOG_CLIENT *jog_find_client(const HTTP_CONN *p_conn)
+{
+    JOG_CLIENT *p_client = NULL;
+
+    for (uint8 i = 0U; (i < WSK_MAX_SESSIONS) && (NULL == p_client); ++i)
+    {
+        if (jog_clients[i].p_conn == p_conn)
+        {
+            p_client = &jog_clients[i];
+        }
+    }
+
+    return p_client;
+}
+
+void jog_notify_all()
+{
+    for (uint8 i = 0U; i < WSK_MAX_SESSIONS; ++i)
+    {
+        if (NULL != jog_clients[i].p_conn)
+        {
+            jog_clients[i].telemetry_due_b = true;
+            http_wake(jog_clients[i].p_conn);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef JOG_MAIN_H
+#define JOG_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+/* Binary messages on the /api/jog WebSocket, all values little endian
+ *
+ * client -> desk:  JOG_MSG_START, direction (1 = up, 2 = down)   start or refresh, at least every 500 ms while held
+ *                  JOG_MSG_STOP                                    button released
+ * desk -> client:  JOG_MSG_TELEMETRY, height_lo, height_hi, desk state, jog direction
+ */
+#define JOG_MSG_START 0x01U
+#define JOG_MSG_STOP 0x02U
+#define JOG_MSG_TELEMETRY 0x81U
+
+#define JOG_DIRECTION_NONE 0U
+#define JOG_DIRECTION_UP 1U
+#define JOG_DIRECTION_DOWN 2U
+
+/*****************************************************************************/
+
+extern void jog_init();
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,345 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*****************************************************************************/
+
+void json_put(JSON_WRITER *p_writer, const char *p_data, const uint16 size_u16);
+void json_put_char(JSON_WRITER *p_writer, const char c);
+void json_put_key(JSON_WRITER *p_writer, const char *p_key);
+void json_put_escaped(JSON_WRITER *p_writer, const char *p_str);
+
+/*****************************************************************************/
+
+void json_init(JSON_WRITER *p_writer, char *p_buffer, const uint16 size_u16)
+{
+    p_writer->p_buffer = p_buffer;
+    p_writer->size_u16 = size_u16;
+    p_writer->length_u16 = 0U;
+    p_writer->has_value_u16 = 0U;
+    p_writer->depth_u8 = 0U;
+    p_writer->overflow_b = false;
+}
+
+void json_resume(JSON_WRITER *p_writer, const uint8 depth_u8, const bool has_value_b)
+{
+    p_writer->depth_u8 = min(depth_u8, (uint8)(JSON_MAX_DEPTH - 1U));
+    p_writer->has_value_u16 = has_value_b ? (uint16)(1U << p_writer->depth_u8) : 0U;
+}
+
+void json_object_begin(JSON_WRITER *p_writer, const char *p_key)
+{
+    json_put_key(p_writer, p_key);
+    json_put_char(p_writer, '{');
+
+    if (p_writer->depth_u8 < (JSON_MAX_DEPTH - 1U))
+    {
+        p_writer->depth_u8 += 1U;
+        p_writer->has_value_u16 &= (uint16)~(1U << p_writer->depth_u8);
+    }
+}
+
+void json_object_end(JSON_WRITER *p_writer)
+{
+    json_put_char(p_writer, '}');
+    p_writer->depth_u8 = (p_writer->depth_u8 > 0U) ? (p_writer->depth_u8 - 1U) : 0U;
+}
+
+void json_array_begin(JSON_WRITER *p_writer, const char *p_key)
+{
+    json_put_key(p_writer, p_key);
+    json_put_char(p_writer, '[');
+
+    if (p_writer->depth_u8 < (JSON_MAX_DEPTH - 1U))
+    {
+        p_writer->depth_u8 += 1U;
+        p_writer->has_value_u16 &= (uint16)~(1U << p_writer->depth_u8);
+    }
+}
+
+void json_array_end(JSON_WRITER *p_writer)
+{
+    json_put_char(p_writer, ']');
+    p_writer->depth_u8 = (p_writer->depth_u8 > 0U) ? (p_writer->depth_u8 - 1U) : 0U;
+}
+
+void json_add_uint(JSON_WRITER *p_writer, const char *p_key, const uint32 value_u32)
+{
+    char value_str[12];
+    const int size_i = snprintf(value_str, sizeof(value_str), "%u", (unsigned)value_u32);
+
+    json_put_key(p_writer, p_key);
+    json_put(p_writer, value_str, (uint16)size_i);
+}
+
+void json_add_int(JSON_WRITER *p_writer, const char *p_key, const sint32 value_s32)
+{
+    char value_str[12];
+    const int size_i = snprintf(value_str, sizeof(value_str), "%d", (int)value_s32);
+
+    json_put_key(p_writer, p_key);
+    json_put(p_writer, value_str, (uint16)size_i);
+}
+
+void json_add_bool(JSON_WRITER *p_writer, const char *p_key, const bool value_b)
+{
+    json_put_key(p_writer, p_key);
+    if (value_b)
+    {
+        json_put(p_writer, "true", 4U);
+    }
+    else
+    {
+        json_put(p_writer, "false", 5U);
+    }
+}
+
+void json_add_string(JSON_WRITER *p_writer, const char *p_key, const char *p_value)
+{
+    json_put_key(p_writer, p_key);
+    json_put_escaped(p_writer, p_value);
+}
+
+uint16 json_length(const JSON_WRITER *p_writer)
+{
+    return p_writer->length_u16;
+}
+
+bool json_overflow(const JSON_WRITER *p_writer)
+{
+    return p_writer->overflow_b;
+}
+
+/*****************************************************************************/
+
+void json_put(JSON_WRITER *p_writer, const char *p_data, const uint16 size_u16)
+{
+    if ((p_writer->size_u16 - p_writer->length_u16) >= size_u16)
+    {
+        (void)memcpy(&(p_writer->p_buffer[p_writer->length_u16]), p_data, size_u16);
+        p_writer->length_u16 += size_u16;
+    }
+    else
+    {
+        p_writer->overflow_b = true;
+    }
+}
+
+void json_put_char(JSON_WRITER *p_writer, const char c)
+{
+    json_put(p_writer, &c, 1U);
+}
+
+void json_put_key(JSON_WRITER *p_writer, const char *p_key)
+{
+    const uint16 level_u16 = (uint16)(1U << p_writer->depth_u8);
+
+    /* Every value but the first on a level needs a separator */
+    if ((p_writer->has_value_u16 & level_u16) != 0U)
+    {
+        json_put_char(p_writer, ',');
+    }
+    p_writer->has_value_u16 |= level_u16;
+
+    if (NULL != p_key)
+    {
+        json_put_escaped(p_writer, p_key);
+        json_put_char(p_writer, ':');
+    }
+}
+
+void json_put_escaped(JSON_WRITER *p_writer, const char *p_str)
+{
+    char escape_str[8];
+
+    json_put_char(p_writer, '"');
+    for (; '\0' != *p_str; ++p_str)
+    {
+        if ((*p_str == '"') || (*p_str == '\\'))
+        {
+            escape_str[0] = '\\';
+            escape_str[1] = *p_str;
+            json_put(p_writer, escape_str, 2U);
+        }
+        else if ((uint8)*p_str < 0x20U)
+        {
+            (void)snprintf(escape_str, sizeof(escape_str), "\\u%04x", (unsigned)(uint8)*p_str);
+            json_put(p_writer, escape_str, 6U);
+        }
+        else
+        {
+            json_put_char(p_writer, *p_str);
+        }
+    }
+    json_put_char(p_writer, '"');
+}
+
+/*****************************************************************************/
+
+void json_reader_init(JSON_READER *p_reader, const char *p_data, const uint16 size_u16)
+{
+    p_reader->p_data = p_data;
+    p_reader->size_u16 = size_u16;
+    p_reader->pos_u16 = 0U;
+}
+
+JSON_TOKEN_TYPE json_next(JSON_READER *p_reader, JSON_TOKEN *p_token)
+{
+    const char *p_data = p_reader->p_data;
+    uint16 pos_u16 = p_reader->pos_u16;
+    uint16 start_u16;
+    bool negative_b = false;
+    char c;
+
+    /* Whitespace and separators */
+    while ((pos_u16 < p_reader->size_u16) &&
+           ((p_data[pos_u16] == ' ') || (p_data[pos_u16] == '\t') || (p_data[pos_u16] == '\r') ||
+            (p_data[pos_u16] == '\n') || (p_data[pos_u16] == ',') || (p_data[pos_u16] == ':')))
+    {
+        pos_u16 += 1U;
+    }
+
+    p_token->type_e = JSON_TOKEN_ERROR;
+    p_token->p_data = &p_data[pos_u16];
+    p_token->size_u16 = 0U;
+    p_token->number_s32 = 0;
+
+    if (pos_u16 >= p_reader->size_u16)
+    {
+        p_token->type_e = JSON_TOKEN_END;
+        p_reader->pos_u16 = pos_u16;
+        return p_token->type_e;
+    }
+
+    c = p_data[pos_u16];
+    pos_u16 += 1U;
+    switch (c)
+    {
+    case '{':
+        p_token->type_e = JSON_TOKEN_OBJECT_BEGIN;
+        break;
+    case '}':
+        p_token->type_e = JSON_TOKEN_OBJECT_END;
+        break;
+    case '[':
+        p_token->type_e = JSON_TOKEN_ARRAY_BEGIN;
+        break;
+    case ']':
+        p_token->type_e = JSON_TOKEN_ARRAY_END;
+        break;
+    case '"':
+    {
+        start_u16 = pos_u16;
+        while ((pos_u16 < p_reader->size_u16) && (p_data[pos_u16] != '"'))
+        {
+            /* Skip whatever is escaped */
+            pos_u16 += (p_data[pos_u16] == '\\') ? 2U : 1U;
+        }
+
+        if (pos_u16 < p_reader->size_u16)
+        {
+            p_token->type_e = JSON_TOKEN_STRING;
+            p_token->p_data = &p_data[start_u16];
+            p_token->size_u16 = pos_u16 - start_u16;
+            pos_u16 += 1U;
+        }
+        break;
+    }
+    default:
+    {
+        if ((c == '-') || ((c >= '0') && (c <= '9')))
+        {
+            /* Integers only, that is all the API deals with. All digits are consumed, one too many is an error rather than the next token */
+            const uint32 limit_u32 = (c == '-') ? 0x80000000U : 0x7fffffffU;
+            uint32 magnitude_u32 = 0U;
+            bool overflow_b = false;
+
+            negative_b = (c == '-');
+            pos_u16 -= negative_b ? 0U : 1U;
+            start_u16 = pos_u16;
+            while ((pos_u16 < p_reader->size_u16) && (p_data[pos_u16] >= '0') && (p_data[pos_u16] <= '9'))
+            {
+                const uint32 digit_u32 = (uint32)(p_data[pos_u16] - '0');
+
+                overflow_b = overflow_b || (magnitude_u32 > ((limit_u32 - digit_u32) / 10U));
+                magnitude_u32 = overflow_b ? magnitude_u32 : ((magnitude_u32 * 10U) + digit_u32);
+                pos_u16 += 1U;
+            }
+
+            if ((pos_u16 > start_u16) && !overflow_b)
+            {
+                p_token->type_e = JSON_TOKEN_NUMBER;
+                p_token->number_s32 = negative_b ? (sint32)(0U - magnitude_u32) : (sint32)magnitude_u32;
+            }
+        }
+        else if ((c == 't') && ((uint16)(p_reader->size_u16 - pos_u16) >= 3U) && (memcmp(&p_data[pos_u16], "rue", 3U) == 0))
+        {
+            p_token->type_e = JSON_TOKEN_TRUE;
+            pos_u16 += 3U;
+        }
+        else if ((c == 'f') && ((uint16)(p_reader->size_u16 - pos_u16) >= 4U) && (memcmp(&p_data[pos_u16], "alse", 4U) == 0))
+        {
+            p_token->type_e = JSON_TOKEN_FALSE;
+            pos_u16 += 4U;
+        }
+        else if ((c == 'n') && ((uint16)(p_reader->size_u16 - pos_u16) >= 3U) && (memcmp(&p_data[pos_u16], "ull", 3U) == 0))
+        {
+            p_token->type_e = JSON_TOKEN_NULL;
+            pos_u16 += 3U;
+        }
+        else
+        {
+            /* Garbage */
+        }
+        break;
+    }
+    }
+
+    p_reader->pos_u16 = pos_u16;
+
+    return p_token->type_e;
+}
+
+bool json_skip(JSON_READER *p_reader, const JSON_TOKEN *p_token)
+{
+    JSON_TOKEN token;
+    uint8 depth_u8 = 0U;
+
+    if ((p_token->type_e == JSON_TOKEN_OBJECT_BEGIN) || (p_token->type_e == JSON_TOKEN_ARRAY_BEGIN))
+    {
+        depth_u8 = 1U;
+    }
+    else
+    {
+        return (p_token->type_e != JSON_TOKEN_ERROR) && (p_token->type_e != JSON_TOKEN_END);
+    }
+
+    while (depth_u8 > 0U)
+    {
+        switch (json_next(p_reader, &token))
+        {
+        case JSON_TOKEN_OBJECT_BEGIN:
+        case JSON_TOKEN_ARRAY_BEGIN:
+            depth_u8 += 1U;
+            break;
+        case JSON_TOKEN_OBJECT_END:
+        case JSON_TOKEN_ARRAY_END:
+            depth_u8 -= 1U;
+            break;
+        case JSON_TOKEN_ERROR:
+        case JSON_TOKEN_END:
+            return false;
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool json_token_equals(const JSON_TOKEN *p_token, const char *p_str)
+{
+    return (p_token->type_e == JSON_TOKEN_STRING) && (strlen(p_str) == p_token->size_u16) &&
+           (memcmp(p_token->p_data, p_str, p_token->size_u16) == 0);
+}
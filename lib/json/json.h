@@ -0,0 +1,82 @@
+#ifndef JSON_MAIN_H
+#define JSON_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define JSON_MAX_DEPTH 16U
+
+/*****************************************************************************/
+
+/* Writes a document into a caller supplied buffer, nothing is allocated */
+typedef struct
+{
+    char *p_buffer;
+    uint16 size_u16;
+    uint16 length_u16;
+    uint16 has_value_u16; /* bit per nesting level, a separator is needed before the next value */
+    uint8 depth_u8;
+    bool overflow_b;
+} JSON_WRITER;
+
+typedef enum
+{
+    JSON_TOKEN_ERROR = 0,
+    JSON_TOKEN_END,
+    JSON_TOKEN_OBJECT_BEGIN,
+    JSON_TOKEN_OBJECT_END,
+    JSON_TOKEN_ARRAY_BEGIN,
+    JSON_TOKEN_ARRAY_END,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_NUMBER,
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NULL
+} JSON_TOKEN_TYPE;
+
+/* Strings point into the input with escapes left as they are */
+typedef struct
+{
+    JSON_TOKEN_TYPE type_e;
+    const char *p_data;
+    uint16 size_u16;
+    sint32 number_s32;
+} JSON_TOKEN;
+
+typedef struct
+{
+    const char *p_data;
+    uint16 size_u16;
+    uint16 pos_u16;
+} JSON_READER;
+
+/*****************************************************************************/
+
+extern void json_init(JSON_WRITER *p_writer, char *p_buffer, const uint16 size_u16);
+extern void json_resume(JSON_WRITER *p_writer, const uint8 depth_u8, const bool has_value_b); /* continue a document started by an earlier writer */
+
+extern void json_object_begin(JSON_WRITER *p_writer, const char *p_key); /* key is NULL inside arrays and at the top */
+extern void json_object_end(JSON_WRITER *p_writer);
+extern void json_array_begin(JSON_WRITER *p_writer, const char *p_key);
+extern void json_array_end(JSON_WRITER *p_writer);
+
+extern void json_add_uint(JSON_WRITER *p_writer, const char *p_key, const uint32 value_u32);
+extern void json_add_int(JSON_WRITER *p_writer, const char *p_key, const sint32 value_s32);
+extern void json_add_bool(JSON_WRITER *p_writer, const char *p_key, const bool value_b);
+extern void json_add_string(JSON_WRITER *p_writer, const char *p_key, const char *p_value);
+
+extern uint16 json_length(const JSON_WRITER *p_writer);
+extern bool json_overflow(const JSON_WRITER *p_writer);
+
+/* Tokenizer, ',' and ':' are treated as separators and not checked */
+extern void json_reader_init(JSON_READER *p_reader, const char *p_data, const uint16 size_u16);
+extern JSON_TOKEN_TYPE json_next(JSON_READER *p_reader, JSON_TOKEN *p_token);
+extern bool json_skip(JSON_READER *p_reader, const JSON_TOKEN *p_token); /* skips the rest of a value starting with the given token */
+extern bool json_token_equals(const JSON_TOKEN *p_token, const char *p_str);
+
+/*****************************************************************************/
+
+#endif
@@ -1,15 +1,82 @@
 #include "log.h"
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
-#include <SoftwareSerial.h>
+#include "tasks.h"
+
+/*****************************************************************************/
+
+#define LOG_KIND_MESSAGE 0U
+#define LOG_KIND_BUFFER 1U
+#define LOG_MAX_PAYLOAD 255U   /* raw arguments of a message or the bytes of a buffer */
+#define LOG_MAX_SPEC_SIZE 16U  /* one conversion like "%-08lu" */
+
+/*****************************************************************************/
+
+/* Written to the ring as is, followed by the payload */
+typedef struct
+{
+    uint16 size_u16; /* header plus payload */
+    uint8 level_u8;
+    uint8 kind_u8;
+    PGM_P p_module;  /* both in flash, copied out when the line is formatted */
+    PGM_P p_message;
+} LOG_RECORD;
+
+/* One conversion of a format string, "*" width or precision is not supported */
+typedef struct
+{
+    const char *p_start;   /* the '%' */
+    uint8 length_u8;       /* up to and including the conversion character */
+    char conversion_c;
+    char modifier_c;       /* 0, 'h', 'l', 'L' for "ll" or 'z' */
+} LOG_SPEC;
 
 /*****************************************************************************/
 
 LOG_LEVEL log_global_level_e = LOG_LEVEL_SILENT;
 
+/* Single producer (everything that logs) and single consumer (the drain task), so no locking needed */
+uint8 log_ring_vu8[LOG_RING_SIZE];
+volatile uint16 log_head_u16 = 0U; /* free running, only moved by the producer */
+volatile uint16 log_tail_u16 = 0U; /* free running, only moved by the drain */
+uint32 log_dropped_u32 = 0U;
+uint32 log_dropped_reported_u32 = 0U;
+fn_log_sink log_sink_fn = NULL;
+
+char log_encode_format_str[LOG_MAX_FORMAT_SIZE];
+uint8 log_encode_vu8[LOG_MAX_PAYLOAD];
+
+LOG_RECORD log_record;
+uint8 log_record_payload_vu8[LOG_MAX_PAYLOAD];
+char log_record_module_str[LOG_MAX_MODULE_SIZE];
+char log_record_format_str[LOG_MAX_FORMAT_SIZE];
+char log_line_str[LOG_LINE_SIZE];
+uint16 log_line_pos_u16 = 0U;
+uint16 log_line_size_u16 = 0U;
+
+/*****************************************************************************/
+
+void log_commit(const LOG_LEVEL level_e, const uint8 kind_u8, PGM_P module, PGM_P message, const uint8 *p_payload, const uint8 size_u8);
+void log_copy_P(char *p_dest, PGM_P p_src, const uint16 size_u16);
+void log_ring_copy(const uint16 position_u16, void *p_dest, const void *p_src, const uint16 size_u16, const bool to_ring_b);
+bool log_next_spec(const char **pp_format, LOG_SPEC *p_spec);
+uint8 log_encode_args(const char *p_format, va_list args, uint8 *p_payload);
+uint16 log_format_message(char *p_line, const uint16 size_u16, const char *p_format, const uint8 *p_payload, const uint8 payload_size_u8);
+uint16 log_format_buffer(char *p_line, const uint16 size_u16, const uint8 *p_payload, const uint8 payload_size_u8);
+bool log_next_line();
+bool log_drain_ready();
+void log_drain();
+
 /*****************************************************************************/
 
+void log_init()
+{
+    (void)tk_add_io_hook("Log", log_drain_ready, log_drain);
+}
+
 LOG_LEVEL log_get_global_level()
 {
     return log_global_level_e;
@@ -20,43 +87,425 @@ void log_set_global_level(const LOG_LEVEL level_e)
     log_global_level_e = level_e;
 }
 
-void log_msg(const LOG_LEVEL level_e, const char *module, const char *message, ...)
+void log_write(const LOG_LEVEL level_e, PGM_P module, PGM_P message, ...)
 {
-#ifndef DISABLE_LOGGING
     va_list args;
+    uint8 size_u8;
+
+    /* Only the raw arguments are stored, formatting happens when the serial port has room */
+    log_copy_P(log_encode_format_str, message, sizeof(log_encode_format_str));
+    va_start(args, message);
+    size_u8 = log_encode_args(log_encode_format_str, args, log_encode_vu8);
+    va_end(args);
 
-    if (level_e <= log_global_level_e)
+    log_commit(level_e, LOG_KIND_MESSAGE, module, message, log_encode_vu8, size_u8);
+}
+
+void log_write_buffer(const LOG_LEVEL level_e, PGM_P module, PGM_P message, const uint8 *p_buffer, uint8 size_u8)
+{
+    log_commit(level_e, LOG_KIND_BUFFER, module, message, p_buffer, size_u8);
+}
+
+void log_set_sink(fn_log_sink p_sink)
+{
+    log_sink_fn = p_sink;
+}
+
+uint32 log_get_dropped()
+{
+    return log_dropped_u32;
+}
+
+/*****************************************************************************/
+
+void log_commit(const LOG_LEVEL level_e, const uint8 kind_u8, PGM_P module, PGM_P message, const uint8 *p_payload, const uint8 size_u8)
+{
+    const uint16 head_u16 = log_head_u16;
+    const uint16 free_u16 = LOG_RING_SIZE - (uint16)(head_u16 - log_tail_u16);
+    LOG_RECORD record;
+
+    record.size_u16 = sizeof(LOG_RECORD) + size_u8;
+    record.level_u8 = (uint8)level_e;
+    record.kind_u8 = kind_u8;
+    record.p_module = module;
+    record.p_message = message;
+
+    if (record.size_u16 > free_u16)
     {
-        char buffer[256];
-        va_start(args, message);
-        vsprintf(buffer, message, args);
-        Serial.printf("[%s] ", module);
-        Serial.println(buffer);
-        va_end(args);
+        /* Serial port cannot keep up, the drain reports how many went missing */
+        log_dropped_u32 += 1U;
+        return;
+    }
+
+    log_ring_copy(head_u16, NULL, &record, sizeof(LOG_RECORD), true);
+    log_ring_copy(head_u16 + sizeof(LOG_RECORD), NULL, p_payload, size_u8, true);
+
+    /* Contents first, then publish them */
+    __asm__ __volatile__("" ::: "memory");
+    log_head_u16 = head_u16 + record.size_u16;
+}
+
+void log_copy_P(char *p_dest, PGM_P p_src, const uint16 size_u16)
+{
+    (void)strncpy_P(p_dest, p_src, size_u16 - 1U);
+    p_dest[size_u16 - 1U] = '\0';
+}
+
+void log_ring_copy(const uint16 position_u16, void *p_dest, const void *p_src, const uint16 size_u16, const bool to_ring_b)
+{
+    const uint16 offset_u16 = position_u16 & (LOG_RING_SIZE - 1U);
+    const uint16 first_u16 = min(size_u16, (uint16)(LOG_RING_SIZE - offset_u16));
+
+    if (to_ring_b)
+    {
+        (void)memcpy(&log_ring_vu8[offset_u16], p_src, first_u16);
+        (void)memcpy(log_ring_vu8, (const uint8 *)p_src + first_u16, size_u16 - first_u16);
     }
     else
     {
+        (void)memcpy(p_dest, &log_ring_vu8[offset_u16], first_u16);
+        (void)memcpy((uint8 *)p_dest + first_u16, log_ring_vu8, size_u16 - first_u16);
     }
-#endif
 }
 
-void log_buffer(const LOG_LEVEL level_e, const char *module, const char *message, const uint8 *p_buffer, uint8 size_u8)
+bool log_next_spec(const char **pp_format, LOG_SPEC *p_spec)
 {
-#ifndef DISABLE_LOGGING
-    if (level_e <= log_global_level_e)
+    const char *p_char = strchr(*pp_format, '%');
+
+    if (NULL == p_char)
     {
-        Serial.printf("[%s]", module);
-        Serial.printf("%s: ", message);
-        for (uint8 i = 0; i < size_u8; ++i)
+        return false;
+    }
+
+    p_spec->p_start = p_char++;
+    p_spec->modifier_c = 0;
+
+    /* Flags, width and precision are handed to snprintf() as they are */
+    while ((NULL != strchr("-+ #0", *p_char)) && (*p_char != '\0'))
+    {
+        p_char++;
+    }
+    while (((*p_char >= '0') && (*p_char <= '9')) || (*p_char == '.'))
+    {
+        p_char++;
+    }
+
+    if ((p_char[0] == 'l') && (p_char[1] == 'l'))
+    {
+        p_spec->modifier_c = 'L';
+        p_char += 2;
+    }
+    else if ((p_char[0] == 'h') && (p_char[1] == 'h'))
+    {
+        /* Promoted to int just the same */
+        p_spec->modifier_c = 'h';
+        p_char += 2;
+    }
+    else if ((*p_char == 'l') || (*p_char == 'h') || (*p_char == 'z'))
+    {
+        p_spec->modifier_c = *p_char;
+        p_char++;
+    }
+    else
+    {
+        /* No length modifier */
+    }
+
+    p_spec->conversion_c = *p_char;
+    p_spec->length_u8 = (uint8)min((size_t)(p_char - p_spec->p_start + 1), (size_t)(LOG_MAX_SPEC_SIZE - 1U));
+    *pp_format = (*p_char != '\0') ? (p_char + 1) : p_char;
+
+    return true;
+}
+
+/* Which C type a conversion takes, the decoder relies on the very same sizes */
+#define LOG_IS_FLOAT(c) (((c) != '\0') && (NULL != strchr("fFeEgGaA", (c))))
+#define LOG_IS_SCALAR(c) (((c) != '\0') && (NULL != strchr("diouxXcpfFeEgGaA", (c))))
+#define LOG_ARG_SIZE(spec)                                                                           \
+    (LOG_IS_FLOAT((spec).conversion_c)                 ? sizeof(double)                              \
+     : ((spec).conversion_c == 'p')                    ? sizeof(void *)                              \
+     : ((spec).modifier_c == 'L')                      ? sizeof(long long)                           \
+     : ((spec).modifier_c == 'l')                      ? sizeof(long)                                \
+     : ((spec).modifier_c == 'z')                      ? sizeof(size_t)                              \
+                                                       : sizeof(int))
+
+uint8 log_encode_args(const char *p_format, va_list args, uint8 *p_payload)
+{
+    LOG_SPEC spec;
+    uint8 used_u8 = 0U;
+    bool full_b = false;
+
+    while (!full_b && log_next_spec(&p_format, &spec))
+    {
+        if (spec.conversion_c == 's')
+        {
+            const char *p_str = va_arg(args, const char *);
+            const uint8 length_u8 = (NULL != p_str) ? (uint8)strnlen(p_str, LOG_MAX_STRING_ARG - 1U) : 0U;
+
+            full_b = ((used_u8 + length_u8 + 1U) > LOG_MAX_PAYLOAD);
+            if (!full_b)
+            {
+                (void)memcpy(&p_payload[used_u8], p_str, length_u8);
+                p_payload[used_u8 + length_u8] = '\0';
+                used_u8 += length_u8 + 1U;
+            }
+        }
+        else if (!LOG_IS_SCALAR(spec.conversion_c))
         {
-            Serial.printf(" %i", p_buffer[i]);
+            /* "%%" or something printf() would not understand either, nothing to store */
         }
-        Serial.println();
+        else
+        {
+            const uint8 size_u8 = (uint8)LOG_ARG_SIZE(spec);
+            union
+            {
+                int i;
+                long l;
+                long long ll;
+                size_t z;
+                void *p;
+                double d;
+            } value;
+
+            if (LOG_IS_FLOAT(spec.conversion_c))
+            {
+                value.d = va_arg(args, double);
+            }
+            else if (spec.conversion_c == 'p')
+            {
+                value.p = va_arg(args, void *);
+            }
+            else if (spec.modifier_c == 'L')
+            {
+                value.ll = va_arg(args, long long);
+            }
+            else if (spec.modifier_c == 'l')
+            {
+                value.l = va_arg(args, long);
+            }
+            else if (spec.modifier_c == 'z')
+            {
+                value.z = va_arg(args, size_t);
+            }
+            else
+            {
+                value.i = va_arg(args, int);
+            }
+
+            full_b = ((used_u8 + size_u8) > LOG_MAX_PAYLOAD);
+            if (!full_b)
+            {
+                (void)memcpy(&p_payload[used_u8], &value, size_u8);
+                used_u8 += size_u8;
+            }
+        }
+    }
+
+    return used_u8;
+}
+
+/*****************************************************************************/
+
+uint16 log_format_message(char *p_line, const uint16 size_u16, const char *p_format, const uint8 *p_payload, const uint8 payload_size_u8)
+{
+    char spec_str[LOG_MAX_SPEC_SIZE];
+    LOG_SPEC spec;
+    uint16 used_u16 = 0U;
+    uint8 read_u8 = 0U;
+    int ret = 0;
+
+    while ((ret >= 0) && (used_u16 < size_u16))
+    {
+        const char *p_literal = p_format;
+        const bool found_b = log_next_spec(&p_format, &spec);
+        const uint16 literal_u16 = found_b ? (uint16)(spec.p_start - p_literal) : (uint16)strlen(p_literal);
+        const uint16 copy_u16 = min(literal_u16, (uint16)(size_u16 - used_u16 - 1U));
+
+        (void)memcpy(&p_line[used_u16], p_literal, copy_u16);
+        used_u16 += copy_u16;
+        if (!found_b || (spec.conversion_c == '\0'))
+        {
+            break;
+        }
+
+        (void)memcpy(spec_str, spec.p_start, spec.length_u8);
+        spec_str[spec.length_u8] = '\0';
+
+        if (spec.conversion_c == '%')
+        {
+            ret = snprintf(&p_line[used_u16], size_u16 - used_u16, "%%");
+        }
+        else if (spec.conversion_c == 's')
+        {
+            const uint8 length_u8 = (uint8)strnlen((const char *)&p_payload[read_u8], payload_size_u8 - read_u8);
+
+            if ((read_u8 + length_u8) >= payload_size_u8)
+            {
+                /* Did not fit into the record */
+                break;
+            }
+            ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, (const char *)&p_payload[read_u8]);
+            read_u8 += length_u8 + 1U;
+        }
+        else if (!LOG_IS_SCALAR(spec.conversion_c))
+        {
+            /* Printed as it is */
+            ret = snprintf(&p_line[used_u16], size_u16 - used_u16, "%s", spec_str);
+        }
+        else
+        {
+            const uint8 arg_size_u8 = (uint8)LOG_ARG_SIZE(spec);
+            union
+            {
+                int i;
+                long l;
+                long long ll;
+                size_t z;
+                void *p;
+                double d;
+            } value;
+
+            if ((read_u8 + arg_size_u8) > payload_size_u8)
+            {
+                break;
+            }
+            (void)memcpy(&value, &p_payload[read_u8], arg_size_u8);
+            read_u8 += arg_size_u8;
+
+            if (LOG_IS_FLOAT(spec.conversion_c))
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.d);
+            }
+            else if (spec.conversion_c == 'p')
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.p);
+            }
+            else if (spec.modifier_c == 'L')
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.ll);
+            }
+            else if (spec.modifier_c == 'l')
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.l);
+            }
+            else if (spec.modifier_c == 'z')
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.z);
+            }
+            else
+            {
+                ret = snprintf(&p_line[used_u16], size_u16 - used_u16, spec_str, value.i);
+            }
+        }
+
+        used_u16 = (ret >= 0) ? min((uint16)(used_u16 + ret), (uint16)(size_u16 - 1U)) : used_u16;
+    }
+
+    return used_u16;
+}
+
+uint16 log_format_buffer(char *p_line, const uint16 size_u16, const uint8 *p_payload, const uint8 payload_size_u8)
+{
+    uint16 used_u16 = 0U;
+
+    /* " 155 6 2" like before, without a printf() per byte */
+    for (uint8 i = 0U; (i < payload_size_u8) && ((used_u16 + 4U) < size_u16); ++i)
+    {
+        const uint8 byte_u8 = p_payload[i];
+
+        p_line[used_u16++] = ' ';
+        if (byte_u8 >= 100U)
+        {
+            p_line[used_u16++] = (char)('0' + (byte_u8 / 100U));
+        }
+        if (byte_u8 >= 10U)
+        {
+            p_line[used_u16++] = (char)('0' + ((byte_u8 / 10U) % 10U));
+        }
+        p_line[used_u16++] = (char)('0' + (byte_u8 % 10U));
+    }
+
+    return used_u16;
+}
+
+bool log_next_line()
+{
+    const uint16 tail_u16 = log_tail_u16;
+    const uint16 size_u16 = sizeof(log_line_str) - 2U; /* room for the line end */
+    LOG_LEVEL level_e = LOG_LEVEL_WARNING;
+    uint16 used_u16;
+
+    if (tail_u16 != log_head_u16)
+    {
+        log_ring_copy(tail_u16, &log_record, NULL, sizeof(LOG_RECORD), false);
+        log_ring_copy(tail_u16 + sizeof(LOG_RECORD), log_record_payload_vu8, NULL, log_record.size_u16 - sizeof(LOG_RECORD), false);
+        __asm__ __volatile__("" ::: "memory");
+        log_tail_u16 = tail_u16 + log_record.size_u16;
+        log_copy_P(log_record_module_str, log_record.p_module, sizeof(log_record_module_str));
+        log_copy_P(log_record_format_str, log_record.p_message, sizeof(log_record_format_str));
+        level_e = (LOG_LEVEL)log_record.level_u8;
+
+        if (log_record.kind_u8 == LOG_KIND_MESSAGE)
+        {
+            used_u16 = (uint16)snprintf(log_line_str, size_u16, "[%s] ", log_record_module_str);
+            used_u16 = min(used_u16, (uint16)(size_u16 - 1U));
+            used_u16 += log_format_message(&log_line_str[used_u16], size_u16 - used_u16, log_record_format_str,
+                                           log_record_payload_vu8, (uint8)(log_record.size_u16 - sizeof(LOG_RECORD)));
+        }
+        else
+        {
+            used_u16 = (uint16)snprintf(log_line_str, size_u16, "[%s]%s: ", log_record_module_str, log_record_format_str);
+            used_u16 = min(used_u16, (uint16)(size_u16 - 1U));
+            used_u16 += log_format_buffer(&log_line_str[used_u16], size_u16 - used_u16,
+                                          log_record_payload_vu8, (uint8)(log_record.size_u16 - sizeof(LOG_RECORD)));
+        }
+    }
+    else if (log_dropped_reported_u32 != log_dropped_u32)
+    {
+        /* Reported once the backlog is out, so it shows up next to where messages went missing */
+        used_u16 = (uint16)snprintf(log_line_str, size_u16, "[Log] %u message(s) dropped", (unsigned)(log_dropped_u32 - log_dropped_reported_u32));
+        log_dropped_reported_u32 = log_dropped_u32;
     }
     else
     {
+        return false;
     }
-#endif
+
+    if (NULL != log_sink_fn)
+    {
+        log_sink_fn(level_e, log_line_str, used_u16);
+    }
+
+    log_line_str[used_u16++] = '\r';
+    log_line_str[used_u16++] = '\n';
+    log_line_pos_u16 = 0U;
+    log_line_size_u16 = used_u16;
+
+    return true;
 }
 
-/*****************************************************************************/
+bool log_drain_ready()
+{
+    const bool pending_b = (log_line_pos_u16 < log_line_size_u16) || (log_tail_u16 != log_head_u16) || (log_dropped_reported_u32 != log_dropped_u32);
+
+    return pending_b && (Serial.availableForWrite() > 0);
+}
+
+void log_drain()
+{
+    int room_i = Serial.availableForWrite();
+
+    /* Never more than the UART FIFO takes, writing must not block */
+    while (room_i > 0)
+    {
+        if ((log_line_pos_u16 == log_line_size_u16) && !log_next_line())
+        {
+            break;
+        }
+
+        const uint16 chunk_u16 = min((uint16)room_i, (uint16)(log_line_size_u16 - log_line_pos_u16));
+        (void)Serial.write((const uint8 *)&log_line_str[log_line_pos_u16], chunk_u16);
+        log_line_pos_u16 += chunk_u16;
+        room_i -= chunk_u16;
+    }
+}
@@ -1,8 +1,20 @@
 #ifndef LOG_H_
+#define LOG_H_
 
 /*****************************************************************************/
 
 #include <c_types.h>
+#include <Arduino.h>
+
+/*****************************************************************************/
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 2048U /* power of two, recorded messages waiting for the serial port */
+#endif
+#define LOG_MAX_STRING_ARG 32U /* %s arguments are copied, longer ones get cut */
+#define LOG_MAX_FORMAT_SIZE 128U /* anything after that is not printed */
+#define LOG_MAX_MODULE_SIZE 16U
+#define LOG_LINE_SIZE 256U
 
 /*****************************************************************************/
 
@@ -16,14 +28,53 @@ typedef enum
     LOG_LEVEL_DEBUG
 } LOG_LEVEL;
 
+/* Calls above this level are compiled out together with their arguments, e.g. -DLOG_MIN_LEVEL=LOG_LEVEL_INFO */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#ifdef DISABLE_LOGGING
+#undef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_SILENT
+#endif
+
+/* The message has to be a string literal, it is put into flash. Module tags are PROGMEM arrays like
+ * const char xx_module_str[] PROGMEM = "Module"; */
+#define log_msg(level_e, module, message, ...)                                                      \
+    do                                                                                              \
+    {                                                                                               \
+        if (((level_e) <= LOG_MIN_LEVEL) && ((level_e) <= log_global_level_e))                      \
+        {                                                                                           \
+            log_write((level_e), (module), PSTR(message), ##__VA_ARGS__);                           \
+        }                                                                                           \
+    } while (0)
+
+#define log_buffer(level_e, module, message, p_buffer, size_u8)                                     \
+    do                                                                                              \
+    {                                                                                               \
+        if (((level_e) <= LOG_MIN_LEVEL) && ((level_e) <= log_global_level_e))                      \
+        {                                                                                           \
+            log_write_buffer((level_e), (module), PSTR(message), (p_buffer), (size_u8));            \
+        }                                                                                           \
+    } while (0)
+
+/* Gets every line as it goes out to the serial port, without the line end */
+typedef void (*fn_log_sink)(const LOG_LEVEL level_e, const char *p_line, const uint16 size_u16);
+
 /*****************************************************************************/
 
+extern LOG_LEVEL log_global_level_e;
+
+extern void log_init(); /* registers the task that drains the ring, call after tk_init() */
+
 extern LOG_LEVEL log_get_global_level();
 extern void log_set_global_level(const LOG_LEVEL level_e);
 
-extern void log_msg(const LOG_LEVEL level_e, const char *module, const char *message, ...);
-extern void log_buffer(const LOG_LEVEL level_e, const char *module, const char *message, const uint8 *p_buffer, uint8 size_u8);
+/* Use the macros above, module and message are in flash and formatted later */
+extern void log_write(const LOG_LEVEL level_e, PGM_P module, PGM_P message, ...);
+extern void log_write_buffer(const LOG_LEVEL level_e, PGM_P module, PGM_P message, const uint8 *p_buffer, uint8 size_u8);
+extern void log_set_sink(fn_log_sink p_sink);
+extern uint32 log_get_dropped();
 
 /*****************************************************************************/
 
-#endif
\ No newline at end of file
+#endif
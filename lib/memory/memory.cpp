@@ -0,0 +1,264 @@
+#include "memory.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "log.h"
+#include "tasks.h"
+
+extern "C"
+{
+#include <user_interface.h>
+}
+
+/*****************************************************************************/
+
+#define MM_RTC_OFFSET 32U /* in 4 byte blocks, the first 128 bytes of RTC user memory belong to OTA */
+#define MM_RTC_MAGIC 0x4d454d31UL
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 magic_u32;
+    MM_WATERMARKS watermarks;
+    uint32 checksum_u32;
+} MM_RTC_RECORD;
+
+/*****************************************************************************/
+
+const char mm_module_str[] PROGMEM = "Memory";
+
+/* Indexed by rst_info.reason */
+const char *mm_reset_reason_names[] = {"power_on", "hardware_watchdog", "exception", "software_watchdog",
+                                       "software_restart", "deep_sleep", "external"};
+
+/*****************************************************************************/
+
+volatile uint32 mm_allocations_u32 = 0U;
+volatile uint32 mm_frees_u32 = 0U;
+
+MM_SAMPLE mm_samples[MM_NUM_SAMPLES];
+uint8 mm_next_sample_u8 = 0U;
+uint8 mm_num_samples_u8 = 0U;
+
+MM_WATERMARKS mm_watermarks;
+MM_PREVIOUS_BOOT mm_previous_boot;
+bool mm_low_b = false;
+
+/*****************************************************************************/
+
+void mm_sample();
+void mm_save();
+uint32 mm_checksum(const MM_RTC_RECORD *p_record);
+
+/*****************************************************************************/
+
+void mm_init()
+{
+    MM_RTC_RECORD record;
+
+    (void)memset(mm_samples, 0, sizeof(mm_samples));
+    (void)memset(&mm_previous_boot, 0, sizeof(MM_PREVIOUS_BOOT));
+    (void)memset(&mm_watermarks, 0, sizeof(MM_WATERMARKS));
+    mm_watermarks.heap_free_min_u16 = 0xffffU;
+    mm_watermarks.max_block_min_u16 = 0xffffU;
+    mm_watermarks.cont_free_min_u16 = 0xffffU;
+    mm_next_sample_u8 = 0U;
+    mm_num_samples_u8 = 0U;
+    mm_low_b = false;
+
+    /* Whatever the previous boot saved last, RTC memory survives everything but a power cycle */
+    mm_previous_boot.reset_reason_u32 = ESP.getResetInfoPtr()->reason;
+    if (ESP.rtcUserMemoryRead(MM_RTC_OFFSET, (uint32 *)&record, sizeof(MM_RTC_RECORD)) &&
+        (record.magic_u32 == MM_RTC_MAGIC) && (record.checksum_u32 == mm_checksum(&record)))
+    {
+        mm_previous_boot.valid_b = true;
+        mm_previous_boot.watermarks = record.watermarks;
+        log_msg(LOG_LEVEL_INFO, mm_module_str, "Previous boot ended by %s after %u s, heap free min %u, largest block min %u, loop stack free min %u, fragmentation max %u%%.",
+                mm_get_reset_reason_name(mm_previous_boot.reset_reason_u32), record.watermarks.uptime_s_u32,
+                record.watermarks.heap_free_min_u16, record.watermarks.max_block_min_u16,
+                record.watermarks.cont_free_min_u16, record.watermarks.fragmentation_max_u8);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_INFO, mm_module_str, "Boot after %s, nothing known about the previous one.",
+                mm_get_reset_reason_name(mm_previous_boot.reset_reason_u32));
+    }
+
+    /* The first sample is taken right away */
+    (void)tk_add_periodic("Memory", mm_sample, MM_SAMPLE_PERIOD_MS_U32);
+}
+
+uint32 mm_get_allocations()
+{
+    return mm_allocations_u32;
+}
+
+uint32 mm_get_frees()
+{
+    return mm_frees_u32;
+}
+
+const MM_WATERMARKS *mm_get_watermarks()
+{
+    return &mm_watermarks;
+}
+
+const MM_PREVIOUS_BOOT *mm_get_previous_boot()
+{
+    return &mm_previous_boot;
+}
+
+const char *mm_get_reset_reason_name(const uint32 reason_u32)
+{
+    return (reason_u32 < (sizeof(mm_reset_reason_names) / sizeof(mm_reset_reason_names[0]))) ? mm_reset_reason_names[reason_u32] : "unknown";
+}
+
+uint8 mm_get_num_samples()
+{
+    return mm_num_samples_u8;
+}
+
+const MM_SAMPLE *mm_get_sample(const uint8 index_u8)
+{
+    return &mm_samples[(mm_next_sample_u8 + MM_NUM_SAMPLES - mm_num_samples_u8 + index_u8) % MM_NUM_SAMPLES];
+}
+
+/*****************************************************************************/
+
+void mm_sample()
+{
+    MM_SAMPLE *p_sample = &mm_samples[mm_next_sample_u8];
+    bool new_low_b = false;
+    bool low_b;
+
+    p_sample->heap_free_u16 = (uint16)min(ESP.getFreeHeap(), (uint32)0xffffU);
+    p_sample->max_block_u16 = (uint16)min(ESP.getMaxFreeBlockSize(), (uint32)0xffffU);
+    p_sample->cont_free_u16 = (uint16)min(ESP.getFreeContStack(), (uint32)0xffffU);
+    p_sample->fragmentation_u8 = ESP.getHeapFragmentation();
+
+    mm_next_sample_u8 = (mm_next_sample_u8 + 1U) % MM_NUM_SAMPLES;
+    mm_num_samples_u8 = min((uint8)(mm_num_samples_u8 + 1U), (uint8)MM_NUM_SAMPLES);
+
+    if (p_sample->heap_free_u16 < mm_watermarks.heap_free_min_u16)
+    {
+        mm_watermarks.heap_free_min_u16 = p_sample->heap_free_u16;
+        new_low_b = true;
+    }
+    if (p_sample->max_block_u16 < mm_watermarks.max_block_min_u16)
+    {
+        mm_watermarks.max_block_min_u16 = p_sample->max_block_u16;
+        new_low_b = true;
+    }
+    if (p_sample->cont_free_u16 < mm_watermarks.cont_free_min_u16)
+    {
+        mm_watermarks.cont_free_min_u16 = p_sample->cont_free_u16;
+        new_low_b = true;
+    }
+    if (p_sample->fragmentation_u8 > mm_watermarks.fragmentation_max_u8)
+    {
+        mm_watermarks.fragmentation_max_u8 = p_sample->fragmentation_u8;
+        new_low_b = true;
+    }
+    mm_watermarks.uptime_s_u32 = millis() / 1000U;
+
+    /* Warn once when it gets tight and once it recovered, the lows are logged as they come */
+    low_b = (p_sample->heap_free_u16 < MM_HEAP_LOW_U32) || (p_sample->max_block_u16 < MM_BLOCK_LOW_U32);
+    if (low_b != mm_low_b)
+    {
+        mm_low_b = low_b;
+        if (low_b)
+        {
+            log_msg(LOG_LEVEL_WARNING, mm_module_str, "Heap is running low, %u bytes free, largest block %u bytes.",
+                    p_sample->heap_free_u16, p_sample->max_block_u16);
+        }
+        else
+        {
+            log_msg(LOG_LEVEL_INFO, mm_module_str, "Heap recovered, %u bytes free, largest block %u bytes.",
+                    p_sample->heap_free_u16, p_sample->max_block_u16);
+        }
+    }
+
+    if (new_low_b)
+    {
+        log_msg(LOG_LEVEL_INFO, mm_module_str, "New low: heap free %u, largest block %u, loop stack free %u, fragmentation %u%%.",
+                mm_watermarks.heap_free_min_u16, mm_watermarks.max_block_min_u16,
+                mm_watermarks.cont_free_min_u16, mm_watermarks.fragmentation_max_u8);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_DEBUG, mm_module_str, "Heap free %u, largest block %u, loop stack free %u, fragmentation %u%%, %u allocations.",
+                p_sample->heap_free_u16, p_sample->max_block_u16, p_sample->cont_free_u16, p_sample->fragmentation_u8,
+                mm_allocations_u32);
+    }
+
+    mm_save();
+}
+
+void mm_save()
+{
+    MM_RTC_RECORD record;
+
+    /* The next boot tells what this one got down to, even after a watchdog reset */
+    (void)memset(&record, 0, sizeof(MM_RTC_RECORD));
+    record.magic_u32 = MM_RTC_MAGIC;
+    record.watermarks = mm_watermarks;
+    record.checksum_u32 = mm_checksum(&record);
+
+    (void)ESP.rtcUserMemoryWrite(MM_RTC_OFFSET, (uint32 *)&record, sizeof(MM_RTC_RECORD));
+}
+
+uint32 mm_checksum(const MM_RTC_RECORD *p_record)
+{
+    const uint32 *p_words = (const uint32 *)p_record;
+    uint32 checksum_u32 = 0x12345678UL;
+
+    for (uint8 i = 0U; i < (offsetof(MM_RTC_RECORD, checksum_u32) / sizeof(uint32)); ++i)
+    {
+        checksum_u32 = ((checksum_u32 << 5) | (checksum_u32 >> 27)) ^ p_words[i];
+    }
+
+    return checksum_u32;
+}
+
+/*****************************************************************************/
+
+#ifdef MM_COUNT_ALLOCATIONS
+
+/* Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free, every reference to malloc() ends up here */
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t num, size_t size);
+    void *__real_realloc(void *p_ptr, size_t size);
+    void __real_free(void *p_ptr);
+
+    void *__wrap_malloc(size_t size)
+    {
+        mm_allocations_u32 += 1U;
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t num, size_t size)
+    {
+        mm_allocations_u32 += 1U;
+        return __real_calloc(num, size);
+    }
+
+    void *__wrap_realloc(void *p_ptr, size_t size)
+    {
+        /* Counted as giving back the old block and getting a new one */
+        mm_allocations_u32 += (size > 0U) ? 1U : 0U;
+        mm_frees_u32 += (NULL != p_ptr) ? 1U : 0U;
+        return __real_realloc(p_ptr, size);
+    }
+
+    void __wrap_free(void *p_ptr)
+    {
+        mm_frees_u32 += (NULL != p_ptr) ? 1U : 0U;
+        __real_free(p_ptr);
+    }
+}
+
+#endif
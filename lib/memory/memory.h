@@ -0,0 +1,61 @@
+#ifndef MM_MAIN_H
+#define MM_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define MM_NUM_SAMPLES 60U            /* an hour at one sample per minute */
+#define MM_SAMPLE_PERIOD_MS_U32 60000U
+#define MM_HEAP_LOW_U32 8192U         /* warn below this much free heap */
+#define MM_BLOCK_LOW_U32 4096U        /* or when no block of this size can be allocated any more */
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint16 heap_free_u16;
+    uint16 max_block_u16;   /* largest allocatable block */
+    uint16 cont_free_u16;   /* free stack of the loop, see README */
+    uint8 fragmentation_u8; /* percent */
+} MM_SAMPLE;
+
+/* Worst values since boot */
+typedef struct
+{
+    uint32 uptime_s_u32;    /* when they were last updated */
+    uint16 heap_free_min_u16;
+    uint16 max_block_min_u16;
+    uint16 cont_free_min_u16;
+    uint8 fragmentation_max_u8;
+} MM_WATERMARKS;
+
+/* Kept in RTC memory across resets, valid_b is false after a power cycle */
+typedef struct
+{
+    bool valid_b;
+    uint32 reset_reason_u32; /* why the previous boot ended, rst_info.reason */
+    MM_WATERMARKS watermarks;
+} MM_PREVIOUS_BOOT;
+
+/*****************************************************************************/
+
+extern void mm_init();
+
+/* Always 0 unless built with -DMM_COUNT_ALLOCATIONS and the linker wraps malloc, see platformio.ini */
+extern uint32 mm_get_allocations();
+extern uint32 mm_get_frees();
+
+extern const MM_WATERMARKS *mm_get_watermarks();
+extern const MM_PREVIOUS_BOOT *mm_get_previous_boot();
+extern const char *mm_get_reset_reason_name(const uint32 reason_u32);
+
+/* Oldest first, index below mm_get_num_samples() */
+extern uint8 mm_get_num_samples();
+extern const MM_SAMPLE *mm_get_sample(const uint8 index_u8);
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,496 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deskcontrol.h"
+#include "fleet.h"
+#include "history.h"
+#include "http.h"
+#include "log.h"
+#include "memory.h"
+#include "mqtt.h"
+#include "ntp.h"
+#include "sse.h"
+#include "syslog.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+/* Producer state: family in the upper half, line within the family in the lower */
+#define MT_STEP(family, line) (((uint32)(family) << 16) | (uint32)(line))
+#define MT_STEP_FAMILY(step) ((uint16)((step) >> 16))
+#define MT_STEP_LINE(step) ((uint16)(step))
+
+#define MT_HISTOGRAM_LINES (TK_HISTOGRAM_BUCKETS + 3U) /* buckets, +Inf, sum, count */
+
+/*****************************************************************************/
+
+typedef enum
+{
+    MT_KIND_SCALAR = 0,     /* one sample */
+    MT_KIND_PER_TASK,       /* one sample per task, labeled with its name */
+    MT_KIND_TASK_HISTOGRAM  /* runtime histogram of every task */
+} MT_KIND;
+
+typedef uint32 (*fn_mt_value)(const uint8 task_u8);
+
+typedef struct
+{
+    const char *p_name;
+    const char *p_type;
+    const char *p_help;
+    MT_KIND kind_e;
+    fn_mt_value value_fn;
+    bool micros_b; /* value is in microseconds, exported in seconds */
+} MT_FAMILY;
+
+typedef struct
+{
+    HTTP_CONN *p_conn;  /* NULL if the slot is free */
+    TK_STATS task_stats; /* the histogram takes several calls, the task may run in between */
+} MT_SCRAPE;
+
+/*****************************************************************************/
+
+uint32 mt_desk_frames(const uint8 task_u8);
+uint32 mt_desk_commands(const uint8 task_u8);
+uint32 mt_desk_activations(const uint8 task_u8);
+uint32 mt_ntp_syncs(const uint8 task_u8);
+uint32 mt_http_connections(const uint8 task_u8);
+uint32 mt_http_rejected(const uint8 task_u8);
+uint32 mt_http_requests(const uint8 task_u8);
+uint32 mt_http_errors(const uint8 task_u8);
+uint32 mt_sse_dropped(const uint8 task_u8);
+uint32 mt_log_dropped(const uint8 task_u8);
+uint32 mt_syslog_datagrams(const uint8 task_u8);
+uint32 mt_syslog_dropped(const uint8 task_u8);
+uint32 mt_fleet_status_requests(const uint8 task_u8);
+uint32 mt_fleet_commands(const uint8 task_u8);
+uint32 mt_fleet_duplicates(const uint8 task_u8);
+uint32 mt_mqtt_connects(const uint8 task_u8);
+uint32 mt_mqtt_publishes(const uint8 task_u8);
+uint32 mt_mqtt_commands(const uint8 task_u8);
+uint32 mt_history_moves(const uint8 task_u8);
+uint32 mt_history_erases(const uint8 task_u8);
+uint32 mt_heap_free(const uint8 task_u8);
+uint32 mt_heap_max_block(const uint8 task_u8);
+uint32 mt_heap_fragmentation(const uint8 task_u8);
+uint32 mt_heap_free_min(const uint8 task_u8);
+uint32 mt_heap_max_block_min(const uint8 task_u8);
+uint32 mt_loop_stack_free_min(const uint8 task_u8);
+uint32 mt_allocations(const uint8 task_u8);
+uint32 mt_http_allocations(const uint8 task_u8);
+uint32 mt_loop_max_pass(const uint8 task_u8);
+uint32 mt_task_overruns(const uint8 task_u8);
+uint32 mt_task_max_lateness(const uint8 task_u8);
+uint32 mt_task_stack_max(const uint8 task_u8);
+uint32 mt_task_allocations(const uint8 task_u8);
+
+void mt_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void mt_handle_done(HTTP_CONN *p_conn);
+bool mt_produce(HTTP_CONN *p_conn);
+int mt_render_line(MT_SCRAPE *p_scrape, const MT_FAMILY *p_family, const uint16 line_u16, char *p_buffer, const uint16 size_u16, bool *p_last_b);
+int mt_render_sample(char *p_buffer, const uint16 size_u16, const char *p_name, const char *p_suffix,
+                     const char *p_task, const char *p_le, const uint64 value_u64, const bool micros_b);
+
+/*****************************************************************************/
+
+const char mt_module_str[] PROGMEM = "Metrics";
+const char *mt_content_type_str = "text/plain; version=0.0.4";
+
+/* Upper bounds of tk_histogram_bounds_us in seconds */
+const char *mt_bucket_labels[TK_HISTOGRAM_BUCKETS] = {"1e-05", "5e-05", "0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05"};
+
+const MT_FAMILY mt_families[] = {
+    {"flexidesk_desk_frames_received_total", "counter", "Frames received from the desk controller.", MT_KIND_SCALAR, mt_desk_frames, false},
+    {"flexidesk_desk_commands_sent_total", "counter", "Command frames sent to the desk controller.", MT_KIND_SCALAR, mt_desk_commands, false},
+    {"flexidesk_desk_activations_total", "counter", "Activations of the desk controller via PIN20.", MT_KIND_SCALAR, mt_desk_activations, false},
+    {"flexidesk_ntp_syncs_total", "counter", "Successful NTP synchronizations.", MT_KIND_SCALAR, mt_ntp_syncs, false},
+    {"flexidesk_http_connections_total", "counter", "Accepted HTTP connections.", MT_KIND_SCALAR, mt_http_connections, false},
+    {"flexidesk_http_rejected_total", "counter", "HTTP connections rejected because all slots were busy.", MT_KIND_SCALAR, mt_http_rejected, false},
+    {"flexidesk_http_requests_total", "counter", "HTTP requests handled.", MT_KIND_SCALAR, mt_http_requests, false},
+    {"flexidesk_http_errors_total", "counter", "Malformed or oversized HTTP requests.", MT_KIND_SCALAR, mt_http_errors, false},
+    {"flexidesk_sse_dropped_total", "counter", "Server-Sent Events dropped because a client queue was full.", MT_KIND_SCALAR, mt_sse_dropped, false},
+    {"flexidesk_log_dropped_total", "counter", "Log messages dropped because the serial port could not keep up.", MT_KIND_SCALAR, mt_log_dropped, false},
+    {"flexidesk_syslog_datagrams_total", "counter", "Syslog datagrams sent.", MT_KIND_SCALAR, mt_syslog_datagrams, false},
+    {"flexidesk_syslog_dropped_total", "counter", "Log lines that did not make it into a syslog datagram or whose datagram could not be sent.", MT_KIND_SCALAR, mt_syslog_dropped, false},
+    {"flexidesk_fleet_status_requests_total", "counter", "Status and discovery requests answered over UDP.", MT_KIND_SCALAR, mt_fleet_status_requests, false},
+    {"flexidesk_fleet_commands_total", "counter", "Commands carried out for the UDP fleet protocol.", MT_KIND_SCALAR, mt_fleet_commands, false},
+    {"flexidesk_fleet_duplicates_total", "counter", "Repeated UDP commands that were only answered again.", MT_KIND_SCALAR, mt_fleet_duplicates, false},
+    {"flexidesk_mqtt_connects_total", "counter", "Connections accepted by the MQTT broker.", MT_KIND_SCALAR, mt_mqtt_connects, false},
+    {"flexidesk_mqtt_publishes_total", "counter", "MQTT messages published.", MT_KIND_SCALAR, mt_mqtt_publishes, false},
+    {"flexidesk_mqtt_commands_total", "counter", "Desk commands received over MQTT.", MT_KIND_SCALAR, mt_mqtt_commands, false},
+    {"flexidesk_history_moves_total", "counter", "Desk moves written to the flash history.", MT_KIND_SCALAR, mt_history_moves, false},
+    {"flexidesk_history_erases_total", "counter", "Flash sectors erased by the history.", MT_KIND_SCALAR, mt_history_erases, false},
+    {"flexidesk_heap_free_bytes", "gauge", "Free heap.", MT_KIND_SCALAR, mt_heap_free, false},
+    {"flexidesk_heap_max_block_bytes", "gauge", "Largest allocatable block.", MT_KIND_SCALAR, mt_heap_max_block, false},
+    {"flexidesk_heap_fragmentation_percent", "gauge", "Heap fragmentation.", MT_KIND_SCALAR, mt_heap_fragmentation, false},
+    {"flexidesk_heap_free_min_bytes", "gauge", "Least free heap seen since boot.", MT_KIND_SCALAR, mt_heap_free_min, false},
+    {"flexidesk_heap_max_block_min_bytes", "gauge", "Smallest largest allocatable block seen since boot.", MT_KIND_SCALAR, mt_heap_max_block_min, false},
+    {"flexidesk_loop_stack_free_min_bytes", "gauge", "Least free stack of the loop seen since boot.", MT_KIND_SCALAR, mt_loop_stack_free_min, false},
+    {"flexidesk_heap_allocations_total", "counter", "Heap allocations, 0 unless built with MM_COUNT_ALLOCATIONS.", MT_KIND_SCALAR, mt_allocations, false},
+    {"flexidesk_http_allocations_total", "counter", "Heap allocations made by HTTP handlers and producers.", MT_KIND_SCALAR, mt_http_allocations, false},
+    {"flexidesk_loop_pass_max_seconds", "gauge", "Longest pass of the task runtime, bounds the latency of every I/O hook.", MT_KIND_SCALAR, mt_loop_max_pass, true},
+    {"flexidesk_task_overruns_total", "counter", "Periods a task missed or ran longer than.", MT_KIND_PER_TASK, mt_task_overruns, false},
+    {"flexidesk_task_lateness_max_seconds", "gauge", "Longest a task was started after its deadline.", MT_KIND_PER_TASK, mt_task_max_lateness, true},
+    {"flexidesk_task_stack_max_bytes", "gauge", "Deepest stack use of a task run.", MT_KIND_PER_TASK, mt_task_stack_max, false},
+    {"flexidesk_task_allocations_total", "counter", "Heap allocations made while a task ran.", MT_KIND_PER_TASK, mt_task_allocations, false},
+    {"flexidesk_task_runtime_seconds", "histogram", "Runtime of each task run.", MT_KIND_TASK_HISTOGRAM, NULL, true}};
+
+/*****************************************************************************/
+
+MT_SCRAPE mt_scrapes[MT_MAX_SCRAPES];
+
+/*****************************************************************************/
+
+void mt_init()
+{
+    (void)memset(mt_scrapes, 0, sizeof(mt_scrapes));
+
+    (void)http_on(HTTP_METHOD_GET, "/metrics", mt_handle_request);
+}
+
+/*****************************************************************************/
+
+uint32 mt_desk_frames(const uint8 task_u8)
+{
+    return dc_get_stats()->frames_u32;
+}
+
+uint32 mt_desk_commands(const uint8 task_u8)
+{
+    return dc_get_stats()->commands_u32;
+}
+
+uint32 mt_desk_activations(const uint8 task_u8)
+{
+    return dc_get_stats()->activations_u32;
+}
+
+uint32 mt_ntp_syncs(const uint8 task_u8)
+{
+    return ntp_get_sync_count();
+}
+
+uint32 mt_http_connections(const uint8 task_u8)
+{
+    return http_get_stats()->connections_u32;
+}
+
+uint32 mt_http_rejected(const uint8 task_u8)
+{
+    return http_get_stats()->rejected_u32;
+}
+
+uint32 mt_http_requests(const uint8 task_u8)
+{
+    return http_get_stats()->requests_u32;
+}
+
+uint32 mt_http_errors(const uint8 task_u8)
+{
+    return http_get_stats()->errors_u32;
+}
+
+uint32 mt_sse_dropped(const uint8 task_u8)
+{
+    return sse_get_stats()->dropped_u32;
+}
+
+uint32 mt_log_dropped(const uint8 task_u8)
+{
+    return log_get_dropped();
+}
+
+uint32 mt_syslog_datagrams(const uint8 task_u8)
+{
+    return sl_get_stats()->datagrams_u32;
+}
+
+uint32 mt_syslog_dropped(const uint8 task_u8)
+{
+    return sl_get_stats()->dropped_records_u32;
+}
+
+uint32 mt_fleet_status_requests(const uint8 task_u8)
+{
+    return fp_get_stats()->status_requests_u32;
+}
+
+uint32 mt_fleet_commands(const uint8 task_u8)
+{
+    return fp_get_stats()->commands_u32;
+}
+
+uint32 mt_fleet_duplicates(const uint8 task_u8)
+{
+    return fp_get_stats()->duplicates_u32;
+}
+
+uint32 mt_mqtt_connects(const uint8 task_u8)
+{
+    return mq_get_stats()->connects_u32;
+}
+
+uint32 mt_mqtt_publishes(const uint8 task_u8)
+{
+    return mq_get_stats()->publishes_u32;
+}
+
+uint32 mt_mqtt_commands(const uint8 task_u8)
+{
+    return mq_get_stats()->commands_u32;
+}
+
+uint32 mt_history_moves(const uint8 task_u8)
+{
+    return hs_get_stats()->moves_u32;
+}
+
+uint32 mt_history_erases(const uint8 task_u8)
+{
+    return hs_get_stats()->erases_u32;
+}
+
+uint32 mt_heap_free(const uint8 task_u8)
+{
+    return ESP.getFreeHeap();
+}
+
+uint32 mt_heap_max_block(const uint8 task_u8)
+{
+    return ESP.getMaxFreeBlockSize();
+}
+
+uint32 mt_heap_fragmentation(const uint8 task_u8)
+{
+    return ESP.getHeapFragmentation();
+}
+
+uint32 mt_heap_free_min(const uint8 task_u8)
+{
+    return mm_get_watermarks()->heap_free_min_u16;
+}
+
+uint32 mt_heap_max_block_min(const uint8 task_u8)
+{
+    return mm_get_watermarks()->max_block_min_u16;
+}
+
+uint32 mt_loop_stack_free_min(const uint8 task_u8)
+{
+    return mm_get_watermarks()->cont_free_min_u16;
+}
+
+uint32 mt_allocations(const uint8 task_u8)
+{
+    return mm_get_allocations();
+}
+
+uint32 mt_http_allocations(const uint8 task_u8)
+{
+    return http_get_stats()->allocations_u32;
+}
+
+uint32 mt_loop_max_pass(const uint8 task_u8)
+{
+    return tk_get_loop_stats()->max_pass_us_u32;
+}
+
+uint32 mt_task_overruns(const uint8 task_u8)
+{
+    return tk_get_stats((sint8)task_u8)->overruns_u32;
+}
+
+uint32 mt_task_max_lateness(const uint8 task_u8)
+{
+    return tk_get_stats((sint8)task_u8)->max_lateness_ms_u32 * 1000U;
+}
+
+uint32 mt_task_stack_max(const uint8 task_u8)
+{
+    return tk_get_stats((sint8)task_u8)->stack_max_u16;
+}
+
+uint32 mt_task_allocations(const uint8 task_u8)
+{
+    return tk_get_stats((sint8)task_u8)->allocations_u32;
+}
+
+/*****************************************************************************/
+
+void mt_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    MT_SCRAPE *p_scrape = NULL;
+
+    for (uint8 i = 0U; (i < MT_MAX_SCRAPES) && (NULL == p_scrape); ++i)
+    {
+        if (NULL == mt_scrapes[i].p_conn)
+        {
+            p_scrape = &mt_scrapes[i];
+        }
+    }
+
+    if (NULL == p_scrape)
+    {
+        http_send(p_conn, 503, "text/plain", "Too many scrapes");
+        return;
+    }
+
+    p_scrape->p_conn = p_conn;
+    http_begin_response(p_conn, 200, mt_content_type_str, HTTP_LENGTH_CHUNKED, NULL);
+    http_set_producer(p_conn, mt_produce);
+    http_set_done_handler(p_conn, mt_handle_done);
+}
+
+void mt_handle_done(HTTP_CONN *p_conn)
+{
+    for (uint8 i = 0U; i < MT_MAX_SCRAPES; ++i)
+    {
+        if (mt_scrapes[i].p_conn == p_conn)
+        {
+            mt_scrapes[i].p_conn = NULL;
+        }
+    }
+}
+
+bool mt_produce(HTTP_CONN *p_conn)
+{
+    MT_SCRAPE *p_scrape = NULL;
+    uint32 *p_step_u32 = http_producer_state(p_conn);
+    const uint16 num_families_u16 = sizeof(mt_families) / sizeof(mt_families[0]);
+    uint16 size_u16;
+    uint16 used_u16 = 0U;
+    char *p_buffer = http_tx_reserve(p_conn, &size_u16);
+    bool last_b;
+    int line_i;
+
+    for (uint8 i = 0U; (i < MT_MAX_SCRAPES) && (NULL == p_scrape); ++i)
+    {
+        if (mt_scrapes[i].p_conn == p_conn)
+        {
+            p_scrape = &mt_scrapes[i];
+        }
+    }
+
+    /* One line per step, as many as fit, the rest follows once this went out */
+    while (MT_STEP_FAMILY(*p_step_u32) < num_families_u16)
+    {
+        line_i = mt_render_line(p_scrape, &mt_families[MT_STEP_FAMILY(*p_step_u32)], MT_STEP_LINE(*p_step_u32),
+                                &p_buffer[used_u16], size_u16 - used_u16, &last_b);
+        if ((line_i < 0) || (line_i >= (int)(size_u16 - used_u16)))
+        {
+            if (used_u16 == 0U)
+            {
+                /* Does not even fit into an empty buffer, skip it rather than stall */
+                log_msg(LOG_LEVEL_ERROR, mt_module_str, "Line %u of %s does not fit.", (unsigned)MT_STEP_LINE(*p_step_u32),
+                        mt_families[MT_STEP_FAMILY(*p_step_u32)].p_name);
+                line_i = 0;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        used_u16 += (uint16)line_i;
+        *p_step_u32 = last_b ? MT_STEP(MT_STEP_FAMILY(*p_step_u32) + 1U, 0U) : (*p_step_u32 + 1U);
+    }
+
+    http_tx_commit(p_conn, used_u16);
+
+    return MT_STEP_FAMILY(*p_step_u32) >= num_families_u16;
+}
+
+int mt_render_line(MT_SCRAPE *p_scrape, const MT_FAMILY *p_family, const uint16 line_u16, char *p_buffer, const uint16 size_u16, bool *p_last_b)
+{
+    const uint8 num_tasks_u8 = tk_get_num_tasks();
+    const TK_STATS *p_stats;
+    uint16 bucket_u16;
+    uint32 count_u32 = 0U;
+    int size_i;
+
+    *p_last_b = false;
+
+    if (line_u16 == 0U)
+    {
+        size_i = snprintf(p_buffer, size_u16, "# HELP %s %s\n# TYPE %s %s\n", p_family->p_name, p_family->p_help, p_family->p_name, p_family->p_type);
+        if ((p_family->kind_e == MT_KIND_SCALAR) && (size_i >= 0) && (size_i < (int)size_u16))
+        {
+            /* Scalars come with their only sample */
+            *p_last_b = true;
+            size_i += mt_render_sample(&p_buffer[size_i], size_u16 - (uint16)size_i, p_family->p_name, "", NULL, NULL,
+                                       p_family->value_fn(0U), p_family->micros_b);
+        }
+        else
+        {
+            *p_last_b = (p_family->kind_e == MT_KIND_SCALAR) || (num_tasks_u8 == 0U);
+        }
+
+        return size_i;
+    }
+
+    if (p_family->kind_e == MT_KIND_PER_TASK)
+    {
+        *p_last_b = (line_u16 >= num_tasks_u8);
+        p_stats = tk_get_stats((sint8)(line_u16 - 1U));
+
+        return mt_render_sample(p_buffer, size_u16, p_family->p_name, "", p_stats->p_name, NULL,
+                                p_family->value_fn((uint8)(line_u16 - 1U)), p_family->micros_b);
+    }
+
+    /* Histogram: buckets, +Inf, sum and count for one task after the other, all from the same snapshot */
+    bucket_u16 = (line_u16 - 1U) % MT_HISTOGRAM_LINES;
+    if (bucket_u16 == 0U)
+    {
+        p_scrape->task_stats = *tk_get_stats((sint8)((line_u16 - 1U) / MT_HISTOGRAM_LINES));
+    }
+    p_stats = &(p_scrape->task_stats);
+    *p_last_b = (((line_u16 - 1U) / MT_HISTOGRAM_LINES) >= (num_tasks_u8 - 1U)) && (bucket_u16 == (MT_HISTOGRAM_LINES - 1U));
+
+    if (bucket_u16 <= TK_HISTOGRAM_BUCKETS)
+    {
+        /* Prometheus buckets are cumulative, ours are not */
+        for (uint16 i = 0U; i <= bucket_u16; ++i)
+        {
+            count_u32 += p_stats->runtime_histogram_vu32[i];
+        }
+        size_i = mt_render_sample(p_buffer, size_u16, p_family->p_name, "_bucket", p_stats->p_name,
+                                  (bucket_u16 < TK_HISTOGRAM_BUCKETS) ? mt_bucket_labels[bucket_u16] : "+Inf", count_u32, false);
+    }
+    else if (bucket_u16 == (TK_HISTOGRAM_BUCKETS + 1U))
+    {
+        size_i = mt_render_sample(p_buffer, size_u16, p_family->p_name, "_sum", p_stats->p_name, NULL, p_stats->total_runtime_us_u64, true);
+    }
+    else
+    {
+        size_i = mt_render_sample(p_buffer, size_u16, p_family->p_name, "_count", p_stats->p_name, NULL, p_stats->runs_u32, false);
+    }
+
+    return size_i;
+}
+
+int mt_render_sample(char *p_buffer, const uint16 size_u16, const char *p_name, const char *p_suffix,
+                     const char *p_task, const char *p_le, const uint64 value_u64, const bool micros_b)
+{
+    char labels_str[48] = "";
+
+    if (NULL != p_le)
+    {
+        (void)snprintf(labels_str, sizeof(labels_str), "{task=\"%s\",le=\"%s\"}", p_task, p_le);
+    }
+    else if (NULL != p_task)
+    {
+        (void)snprintf(labels_str, sizeof(labels_str), "{task=\"%s\"}", p_task);
+    }
+    else
+    {
+        /* No labels */
+    }
+
+    /* No floating point needed for microseconds to seconds */
+    return micros_b ? snprintf(p_buffer, size_u16, "%s%s%s %u.%06u\n", p_name, p_suffix, labels_str,
+                               (unsigned)(value_u64 / 1000000U), (unsigned)(value_u64 % 1000000U))
+                    : snprintf(p_buffer, size_u16, "%s%s%s %u\n", p_name, p_suffix, labels_str, (unsigned)value_u64);
+}
@@ -0,0 +1,19 @@
+#ifndef MT_MAIN_H
+#define MT_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define MT_MAX_SCRAPES 2U /* scrapes in flight at the same time */
+
+/*****************************************************************************/
+
+/* Serves GET /metrics in the Prometheus text format, rendered line by line into the transmit buffer */
+extern void mt_init();
+
+/*****************************************************************************/
+
+#endif
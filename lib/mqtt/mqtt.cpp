@@ -0,0 +1,801 @@
+#include "mqtt.h"
+
+#include <ESP8266WiFi.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "api.h"
+#include "deskcontrol.h"
+#include "events.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+#include "network.h"
+#include "scheduler.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+/* MQTT 3.1.1 control packets, first byte with the flags the spec demands */
+#define MQ_CONNECT 0x10U
+#define MQ_CONNACK 0x20U
+#define MQ_PUBLISH 0x30U
+#define MQ_SUBSCRIBE 0x82U
+#define MQ_SUBACK 0x90U
+#define MQ_PINGREQ 0xc0U
+#define MQ_PINGRESP 0xd0U
+
+#define MQ_FLAG_RETAIN 0x01U
+
+/* Retained topics that changed since they were last published */
+#define MQ_DIRTY_STATUS 0x01U
+#define MQ_DIRTY_HEIGHT 0x02U
+#define MQ_DIRTY_STATE 0x04U
+#define MQ_DIRTY_ALL 0x07U
+
+#define MQ_CLIENT_ID_SIZE 32U
+#define MQ_BASE_SIZE (MQ_TOPIC_SIZE - 16U) /* leaves room for the longest suffix */
+
+/*****************************************************************************/
+
+typedef enum
+{
+    MQ_STATE_WAITING = 0, /* for the next connection attempt, or for a broker and a link */
+    MQ_STATE_CONNECTING,  /* CONNECT sent, waiting for CONNACK */
+    MQ_STATE_CONNECTED
+} MQ_STATE;
+
+/*****************************************************************************/
+
+const char mq_module_str[] PROGMEM = "MQTT";
+const uint32 MQ_UPDATE_PERIOD_MS_U32 = 100U;
+const uint32 MQ_BACKOFF_INITIAL_MS_U32 = 1000U;
+const uint32 MQ_BACKOFF_MAX_MS_U32 = 60000U;
+const uint32 MQ_CONNECT_TIMEOUT_MS_U32 = 500U; /* the TCP connect blocks the loop, a broker on the LAN answers much faster */
+const uint32 MQ_CONNACK_TIMEOUT_MS_U32 = 5000U;
+const uint16 MQ_KEEP_ALIVE_S_U16 = 60U;
+const uint32 MQ_PUBLISH_INTERVAL_MS_U32 = 1000U; /* a moving desk publishes its height once a second */
+const uint8 mq_connect_vu8[] = {4U, 0x26U}; /* protocol level 3.1.1, clean session with a retained will at QoS 0 */
+const char *mq_subscriptions[] = {"command", "schedule/set", "desk/set"};
+
+/*****************************************************************************/
+
+WiFiClient mq_client;
+IPAddress mq_broker_ip;
+uint16 mq_broker_port_u16 = 0U; /* 0 while turned off */
+char mq_client_id_str[MQ_CLIENT_ID_SIZE];
+char mq_base_str[MQ_BASE_SIZE]; /* all topics are below it */
+fn_command_receiver mq_command_receiver_fn = NULL;
+MQ_STATS mq_stats;
+
+MQ_STATE mq_state_e = MQ_STATE_WAITING;
+uint32 mq_state_since_ms_u32 = 0U;
+uint32 mq_backoff_ms_u32 = 0U;
+uint32 mq_last_rx_ms_u32 = 0U;
+uint32 mq_last_tx_ms_u32 = 0U;
+
+uint8 mq_dirty_u8 = 0U;
+sint8 mq_publish_task_s8 = TK_INVALID_TASK;
+uint32 mq_last_publish_ms_u32 = 0U;
+bool mq_publish_pending_b = false;
+
+/* Whole packets from start to end, only queued if they fit completely */
+uint8 mq_tx_vu8[MQ_TX_BUFFER_SIZE];
+uint16 mq_tx_start_u16 = 0U;
+uint16 mq_tx_end_u16 = 0U;
+
+/* Received bytes until a packet is complete, a packet too large for it is skipped */
+uint8 mq_rx_vu8[MQ_RX_BUFFER_SIZE];
+uint16 mq_rx_size_u16 = 0U;
+uint32 mq_rx_skip_u32 = 0U;
+
+/*****************************************************************************/
+
+void mq_update();
+void mq_connect();
+void mq_disconnect();
+void mq_handle_event(const EVENT *p_event);
+void mq_apply_broker(const IPAddress &address, const uint16 port_u16);
+void mq_request_publish();
+void mq_publish_dirty();
+bool mq_io_ready();
+void mq_io();
+void mq_transmit();
+void mq_receive();
+void mq_handle_packet(const uint8 *p_packet, const uint16 header_u16, const uint16 size_u16);
+void mq_handle_publish(const uint8 flags_u8, const uint8 *p_data, const uint16 size_u16);
+bool mq_topic_is(const char *p_topic, const uint16 size_u16, const char *p_suffix);
+bool mq_queue(const uint8 type_u8, const uint16 remaining_u16);
+void mq_put(const void *p_data, const uint16 size_u16);
+void mq_put_u16(const uint16 value_u16);
+void mq_put_string(const char *p_str);
+bool mq_publish(const char *p_suffix, const char *p_payload, const bool retain_b);
+void mq_subscribe();
+void mq_get_mqtt(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void mq_put_mqtt(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+
+/*****************************************************************************/
+
+void mq_init(const char *p_client_id, const char *p_broker, const uint16 port_u16, fn_command_receiver command_receiver)
+{
+    (void)memset(&mq_stats, 0, sizeof(mq_stats));
+    (void)snprintf(mq_client_id_str, sizeof(mq_client_id_str), "%s", p_client_id);
+    (void)snprintf(mq_base_str, sizeof(mq_base_str), "flexidesk/%s", p_client_id);
+    mq_command_receiver_fn = command_receiver;
+
+    (void)tk_add_periodic("MQTT", mq_update, MQ_UPDATE_PERIOD_MS_U32);
+    mq_publish_task_s8 = tk_add_oneshot("MQTT publish", mq_publish_dirty);
+    (void)tk_add_io_hook("MQTT I/O", mq_io_ready, mq_io);
+
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, mq_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, mq_handle_event);
+    (void)ev_subscribe(EV_CONFIG_CHANGED, mq_handle_event); /* the stored broker replaces this one */
+
+    (void)http_on(HTTP_METHOD_GET, "/api/mqtt", mq_get_mqtt);
+    (void)http_on(HTTP_METHOD_PUT, "/api/mqtt", mq_put_mqtt);
+
+    (void)mq_set_broker(p_broker, port_u16);
+}
+
+bool mq_set_broker(const char *p_broker, const uint16 port_u16)
+{
+    IPAddress address;
+
+    /* Only addresses, a DNS lookup would block the loop */
+    if ((NULL == p_broker) || (p_broker[0] == '\0'))
+    {
+        mq_apply_broker(IPAddress(), 0U);
+    }
+    else if (address.fromString(p_broker) && ((uint32)address != 0U) && (port_u16 != 0U))
+    {
+        mq_apply_broker(address, port_u16);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void mq_get_broker(uint8 *p_broker_vu8, uint16 *p_port_u16)
+{
+    for (uint8 i = 0U; i < 4U; ++i)
+    {
+        p_broker_vu8[i] = (mq_broker_port_u16 != 0U) ? mq_broker_ip[i] : 0U;
+    }
+    *p_port_u16 = mq_broker_port_u16;
+}
+
+const MQ_STATS *mq_get_stats()
+{
+    return &mq_stats;
+}
+
+/*****************************************************************************/
+
+void mq_update()
+{
+    const uint32 now_ms_u32 = millis();
+
+    if ((mq_broker_port_u16 == 0U) || !nw_is_link_up())
+    {
+        if (mq_state_e != MQ_STATE_WAITING)
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Disconnected from the broker.");
+            mq_disconnect();
+        }
+        return;
+    }
+
+    switch (mq_state_e)
+    {
+    case MQ_STATE_WAITING:
+    {
+        if ((now_ms_u32 - mq_state_since_ms_u32) < mq_backoff_ms_u32)
+        {
+            /* Not yet */
+        }
+        else if (dc_is_active() || sc_is_tracking())
+        {
+            /* The core only has a blocking connect, the desk frames and the jog repeat cannot wait that long */
+        }
+        else
+        {
+            mq_backoff_ms_u32 = min(mq_backoff_ms_u32 * 2U, MQ_BACKOFF_MAX_MS_U32);
+            mq_connect();
+        }
+        break;
+    }
+    case MQ_STATE_CONNECTING:
+    {
+        if (!mq_client.connected())
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Broker closed the connection.");
+            mq_disconnect();
+        }
+        else if ((now_ms_u32 - mq_state_since_ms_u32) >= MQ_CONNACK_TIMEOUT_MS_U32)
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Broker did not accept the connection in time.");
+            mq_disconnect();
+        }
+        else
+        {
+            /* Waiting for CONNACK */
+        }
+        break;
+    }
+    case MQ_STATE_CONNECTED:
+    {
+        /* The broker gives up on us after one and a half keep alive periods, we do the same */
+        if (!mq_client.connected())
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Lost the connection to the broker.");
+            mq_disconnect();
+        }
+        else if ((now_ms_u32 - mq_last_rx_ms_u32) >= (MQ_KEEP_ALIVE_S_U16 * 1500U))
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Broker stopped answering.");
+            mq_disconnect();
+        }
+        else if (((now_ms_u32 - mq_last_tx_ms_u32) >= (MQ_KEEP_ALIVE_S_U16 * 500U)) && mq_queue(MQ_PINGREQ, 0U))
+        {
+            mq_last_tx_ms_u32 = now_ms_u32;
+            mq_transmit();
+        }
+        else
+        {
+            /* Nothing to do */
+        }
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+void mq_connect()
+{
+    char will_str[MQ_TOPIC_SIZE];
+
+    log_msg(LOG_LEVEL_INFO, mq_module_str, "Connecting to %u.%u.%u.%u:%u.", mq_broker_ip[0], mq_broker_ip[1], mq_broker_ip[2], mq_broker_ip[3],
+            (unsigned)mq_broker_port_u16);
+
+    mq_state_since_ms_u32 = millis();
+    mq_tx_start_u16 = 0U;
+    mq_tx_end_u16 = 0U;
+    mq_rx_size_u16 = 0U;
+    mq_rx_skip_u32 = 0U;
+
+    mq_client.setTimeout(MQ_CONNECT_TIMEOUT_MS_U32);
+    if (mq_client.connect(mq_broker_ip, mq_broker_port_u16) == 0)
+    {
+        log_msg(LOG_LEVEL_WARNING, mq_module_str, "Cannot connect to the broker, retrying in %u ms.", (unsigned)mq_backoff_ms_u32);
+        return;
+    }
+    mq_client.setNoDelay(true);
+
+    /* The broker marks us offline if we disappear without a word */
+    (void)snprintf(will_str, sizeof(will_str), "%s/status", mq_base_str);
+    (void)mq_queue(MQ_CONNECT, (uint16)(10U + 2U + strlen(mq_client_id_str) + 2U + strlen(will_str) + 2U + strlen("offline")));
+    mq_put_string("MQTT");
+    mq_put(mq_connect_vu8, sizeof(mq_connect_vu8));
+    mq_put_u16(MQ_KEEP_ALIVE_S_U16);
+    mq_put_string(mq_client_id_str);
+    mq_put_string(will_str);
+    mq_put_string("offline");
+
+    mq_state_e = MQ_STATE_CONNECTING;
+    mq_state_since_ms_u32 = millis();
+    mq_last_rx_ms_u32 = mq_state_since_ms_u32;
+    mq_transmit();
+}
+
+/* Back to waiting for the next attempt */
+void mq_disconnect()
+{
+    mq_client.stop();
+    mq_state_e = MQ_STATE_WAITING;
+    mq_state_since_ms_u32 = millis();
+    tk_cancel(mq_publish_task_s8);
+    mq_publish_pending_b = false;
+}
+
+/*****************************************************************************/
+
+void mq_handle_event(const EVENT *p_event)
+{
+    if (p_event->type_e == EV_CONFIG_CHANGED)
+    {
+        const uint8 *p_broker_vu8 = p_event->data.p_config->mqtt_broker_vu8;
+        const IPAddress address(p_broker_vu8[0], p_broker_vu8[1], p_broker_vu8[2], p_broker_vu8[3]);
+
+        mq_apply_broker(address, ((uint32)address != 0U) ? p_event->data.p_config->mqtt_port_u16 : 0U);
+        return;
+    }
+
+    if (p_event->type_e == EV_HEIGHT_CHANGED)
+    {
+        mq_stats.coalesced_u32 += ((mq_dirty_u8 & MQ_DIRTY_HEIGHT) != 0U) ? 1U : 0U;
+        mq_dirty_u8 |= MQ_DIRTY_HEIGHT;
+    }
+    else
+    {
+        mq_dirty_u8 |= MQ_DIRTY_STATE;
+    }
+
+    mq_request_publish();
+}
+
+void mq_apply_broker(const IPAddress &address, const uint16 port_u16)
+{
+    /* Every config change comes through here, schedule/set included, only a different broker restarts the session */
+    if ((port_u16 == mq_broker_port_u16) && ((port_u16 == 0U) || ((uint32)address == (uint32)mq_broker_ip)))
+    {
+        return;
+    }
+
+    mq_broker_ip = address;
+    mq_broker_port_u16 = port_u16;
+    if (port_u16 != 0U)
+    {
+        log_msg(LOG_LEVEL_INFO, mq_module_str, "Using broker %u.%u.%u.%u:%u.", address[0], address[1], address[2], address[3], (unsigned)port_u16);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_INFO, mq_module_str, "Turned off.");
+    }
+
+    /* Whatever we were connected to, start over with the new one */
+    mq_disconnect();
+    mq_backoff_ms_u32 = MQ_BACKOFF_INITIAL_MS_U32;
+}
+
+void mq_request_publish()
+{
+    uint32 elapsed_ms_u32;
+
+    /* Without a connection everything goes out right after the next CONNACK */
+    if (mq_publish_pending_b || (mq_state_e != MQ_STATE_CONNECTED))
+    {
+        return;
+    }
+
+    /* A moving desk changes its height all the time, only the latest one within the interval is sent */
+    elapsed_ms_u32 = millis() - mq_last_publish_ms_u32;
+    tk_schedule(mq_publish_task_s8, (elapsed_ms_u32 >= MQ_PUBLISH_INTERVAL_MS_U32) ? 0U : (MQ_PUBLISH_INTERVAL_MS_U32 - elapsed_ms_u32));
+    mq_publish_pending_b = true;
+}
+
+void mq_publish_dirty()
+{
+    const DC_STATE state_e = dc_get_current_state();
+    char height_str[8];
+
+    mq_publish_pending_b = false;
+    mq_last_publish_ms_u32 = millis();
+    if (mq_state_e != MQ_STATE_CONNECTED)
+    {
+        return;
+    }
+
+    /* A topic stays dirty if its packet did not fit, it is tried again with the next batch */
+    (void)snprintf(height_str, sizeof(height_str), "%u", (unsigned)dc_get_current_height());
+    if (((mq_dirty_u8 & MQ_DIRTY_STATUS) != 0U) && mq_publish("status", "online", true))
+    {
+        mq_dirty_u8 &= (uint8)~MQ_DIRTY_STATUS;
+    }
+    if (((mq_dirty_u8 & MQ_DIRTY_HEIGHT) != 0U) && mq_publish("height", height_str, true))
+    {
+        mq_dirty_u8 &= (uint8)~MQ_DIRTY_HEIGHT;
+    }
+    if (((mq_dirty_u8 & MQ_DIRTY_STATE) != 0U) &&
+        mq_publish("state", (state_e == DC_STATE_STANDING) ? "standing" : ((state_e == DC_STATE_SITTING) ? "sitting" : "unknown"), true))
+    {
+        mq_dirty_u8 &= (uint8)~MQ_DIRTY_STATE;
+    }
+
+    mq_transmit();
+    if (mq_dirty_u8 != 0U)
+    {
+        mq_request_publish();
+    }
+}
+
+/*****************************************************************************/
+
+bool mq_io_ready()
+{
+    return (mq_state_e != MQ_STATE_WAITING) &&
+           ((mq_client.available() > 0) || ((mq_tx_end_u16 > mq_tx_start_u16) && (mq_client.availableForWrite() > 0)));
+}
+
+void mq_io()
+{
+    mq_transmit();
+    mq_receive();
+}
+
+void mq_transmit()
+{
+    const int window_i = mq_client.availableForWrite();
+    size_t written_u32;
+
+    if ((mq_tx_end_u16 == mq_tx_start_u16) || (window_i <= 0))
+    {
+        return;
+    }
+
+    written_u32 = mq_client.write(&mq_tx_vu8[mq_tx_start_u16], min((size_t)(mq_tx_end_u16 - mq_tx_start_u16), (size_t)window_i));
+    mq_tx_start_u16 += (uint16)written_u32;
+    if (mq_tx_start_u16 == mq_tx_end_u16)
+    {
+        mq_tx_start_u16 = 0U;
+        mq_tx_end_u16 = 0U;
+    }
+    if (written_u32 > 0U)
+    {
+        mq_last_tx_ms_u32 = millis();
+    }
+}
+
+void mq_receive()
+{
+    const int read_i = mq_client.read(&mq_rx_vu8[mq_rx_size_u16], MQ_RX_BUFFER_SIZE - mq_rx_size_u16);
+    uint16 skip_u16;
+
+    if (read_i <= 0)
+    {
+        return;
+    }
+
+    mq_last_rx_ms_u32 = millis();
+    mq_rx_size_u16 += (uint16)read_i;
+
+    /* Rest of a packet that did not fit */
+    skip_u16 = (uint16)min((uint32)mq_rx_size_u16, mq_rx_skip_u32);
+    (void)memmove(mq_rx_vu8, &mq_rx_vu8[skip_u16], mq_rx_size_u16 - skip_u16);
+    mq_rx_size_u16 -= skip_u16;
+    mq_rx_skip_u32 -= skip_u16;
+
+    while ((mq_rx_size_u16 > 0U) && (mq_state_e != MQ_STATE_WAITING))
+    {
+        uint32 remaining_u32 = 0U;
+        uint32 size_u32;
+        uint16 header_u16 = 1U;
+        bool complete_b = false;
+
+        /* Remaining length, 7 bits per byte and at most 4 of them */
+        while (!complete_b && (header_u16 < mq_rx_size_u16) && (header_u16 <= 4U))
+        {
+            remaining_u32 |= (uint32)(mq_rx_vu8[header_u16] & 0x7fU) << (7U * (header_u16 - 1U));
+            complete_b = ((mq_rx_vu8[header_u16] & 0x80U) == 0U);
+            header_u16 += 1U;
+        }
+
+        if (!complete_b)
+        {
+            if (header_u16 > 4U)
+            {
+                log_msg(LOG_LEVEL_WARNING, mq_module_str, "Malformed packet from the broker.");
+                mq_disconnect();
+            }
+            return;
+        }
+
+        size_u32 = header_u16 + remaining_u32;
+        if (size_u32 > MQ_RX_BUFFER_SIZE)
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Skipping a packet of %u bytes.", (unsigned)size_u32);
+            mq_stats.rejected_u32 += 1U;
+            mq_rx_skip_u32 = size_u32 - mq_rx_size_u16;
+            mq_rx_size_u16 = 0U;
+            return;
+        }
+        if (size_u32 > mq_rx_size_u16)
+        {
+            return;
+        }
+
+        mq_handle_packet(mq_rx_vu8, header_u16, (uint16)size_u32);
+        (void)memmove(mq_rx_vu8, &mq_rx_vu8[size_u32], mq_rx_size_u16 - size_u32);
+        mq_rx_size_u16 -= (uint16)size_u32;
+    }
+}
+
+void mq_handle_packet(const uint8 *p_packet, const uint16 header_u16, const uint16 size_u16)
+{
+    switch (p_packet[0] & 0xf0U)
+    {
+    case MQ_CONNACK:
+    {
+        if ((mq_state_e == MQ_STATE_CONNECTING) && (size_u16 >= 4U) && (p_packet[3] == 0U))
+        {
+            log_msg(LOG_LEVEL_INFO, mq_module_str, "Connected to the broker as %s.", mq_client_id_str);
+            mq_state_e = MQ_STATE_CONNECTED;
+            mq_state_since_ms_u32 = millis();
+            mq_backoff_ms_u32 = MQ_BACKOFF_INITIAL_MS_U32;
+            mq_stats.connects_u32 += 1U;
+
+            /* Clean session, subscriptions and retained values are set up every time */
+            mq_subscribe();
+            mq_dirty_u8 = MQ_DIRTY_ALL;
+            mq_request_publish();
+        }
+        else
+        {
+            log_msg(LOG_LEVEL_ERROR, mq_module_str, "Broker refused the connection with code %u.", (size_u16 >= 4U) ? (unsigned)p_packet[3] : 0U);
+            mq_disconnect();
+        }
+        break;
+    }
+    case MQ_PUBLISH:
+    {
+        mq_handle_publish(p_packet[0] & 0x0fU, &p_packet[header_u16], size_u16 - header_u16);
+        break;
+    }
+    case MQ_SUBACK:
+    {
+        /* Packet id, then one result per topic */
+        for (uint16 i = header_u16 + 2U; i < size_u16; ++i)
+        {
+            if (p_packet[i] == 0x80U)
+            {
+                log_msg(LOG_LEVEL_ERROR, mq_module_str, "Broker refused the subscription to %s.",
+                        ((i - header_u16 - 2U) < (sizeof(mq_subscriptions) / sizeof(mq_subscriptions[0]))) ? mq_subscriptions[i - header_u16 - 2U] : "?");
+            }
+        }
+        break;
+    }
+    default:
+    {
+        /* PINGRESP only tells us the broker is there, which the receive time already says */
+        break;
+    }
+    }
+}
+
+void mq_handle_publish(const uint8 flags_u8, const uint8 *p_data, const uint16 size_u16)
+{
+    const uint16 topic_size_u16 = (size_u16 >= 2U) ? (uint16)((p_data[0] << 8) | p_data[1]) : 0U;
+    const char *p_topic = (const char *)&p_data[2];
+    /* All subscriptions are QoS 0, there is no packet id */
+    const char *p_payload = (const char *)&p_data[2U + topic_size_u16];
+    const uint16 payload_size_u16 = (size_u16 >= (2U + topic_size_u16)) ? (uint16)(size_u16 - 2U - topic_size_u16) : 0U;
+    const char *p_error = NULL;
+    DC_COMMAND command_e;
+
+    if ((size_u16 < 2U) || (size_u16 < (2U + topic_size_u16)) || ((flags_u8 & 0x06U) != 0U))
+    {
+        mq_stats.rejected_u32 += 1U;
+        return;
+    }
+
+    if (mq_topic_is(p_topic, topic_size_u16, "command"))
+    {
+        /* A retained command would move the desk again with every reconnect */
+        command_e = api_command_from_name(p_payload, payload_size_u16);
+        if (((flags_u8 & MQ_FLAG_RETAIN) != 0U) || (command_e == DC_CMD_INVALID) || (NULL == mq_command_receiver_fn))
+        {
+            log_msg(LOG_LEVEL_WARNING, mq_module_str, "Ignoring %s command.", ((flags_u8 & MQ_FLAG_RETAIN) != 0U) ? "a retained" : "an unknown");
+            mq_stats.rejected_u32 += 1U;
+        }
+        else
+        {
+            mq_stats.commands_u32 += 1U;
+            (void)mq_command_receiver_fn(command_e);
+        }
+        return;
+    }
+
+    if (mq_topic_is(p_topic, topic_size_u16, "schedule/set"))
+    {
+        p_error = api_update_schedule(p_payload, payload_size_u16);
+    }
+    else if (mq_topic_is(p_topic, topic_size_u16, "desk/set"))
+    {
+        p_error = api_update_desk(p_payload, payload_size_u16);
+    }
+    else
+    {
+        p_error = "unknown topic";
+    }
+
+    if (NULL == p_error)
+    {
+        mq_stats.configs_u32 += 1U;
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_WARNING, mq_module_str, "Ignoring a message: %s.", p_error);
+        mq_stats.rejected_u32 += 1U;
+    }
+}
+
+bool mq_topic_is(const char *p_topic, const uint16 size_u16, const char *p_suffix)
+{
+    const size_t base_size = strlen(mq_base_str);
+
+    return (size_u16 == (base_size + 1U + strlen(p_suffix))) && (memcmp(p_topic, mq_base_str, base_size) == 0) &&
+           (p_topic[base_size] == '/') && (memcmp(&p_topic[base_size + 1U], p_suffix, strlen(p_suffix)) == 0);
+}
+
+/*****************************************************************************/
+
+/* Adds the fixed header if the whole packet fits, the rest is added with mq_put() */
+bool mq_queue(const uint8 type_u8, const uint16 remaining_u16)
+{
+    const uint16 size_u16 = (uint16)(1U + ((remaining_u16 < 128U) ? 1U : 2U) + remaining_u16);
+
+    if ((mq_tx_end_u16 + size_u16) > MQ_TX_BUFFER_SIZE)
+    {
+        (void)memmove(mq_tx_vu8, &mq_tx_vu8[mq_tx_start_u16], mq_tx_end_u16 - mq_tx_start_u16);
+        mq_tx_end_u16 -= mq_tx_start_u16;
+        mq_tx_start_u16 = 0U;
+    }
+    if ((mq_tx_end_u16 + size_u16) > MQ_TX_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    mq_tx_vu8[mq_tx_end_u16++] = type_u8;
+    if (remaining_u16 < 128U)
+    {
+        mq_tx_vu8[mq_tx_end_u16++] = (uint8)remaining_u16;
+    }
+    else
+    {
+        mq_tx_vu8[mq_tx_end_u16++] = (uint8)((remaining_u16 & 0x7fU) | 0x80U);
+        mq_tx_vu8[mq_tx_end_u16++] = (uint8)(remaining_u16 >> 7);
+    }
+
+    return true;
+}
+
+void mq_put(const void *p_data, const uint16 size_u16)
+{
+    (void)memcpy(&mq_tx_vu8[mq_tx_end_u16], p_data, size_u16);
+    mq_tx_end_u16 += size_u16;
+}
+
+void mq_put_u16(const uint16 value_u16)
+{
+    const uint8 bytes_vu8[2] = {(uint8)(value_u16 >> 8), (uint8)value_u16};
+
+    mq_put(bytes_vu8, 2U);
+}
+
+void mq_put_string(const char *p_str)
+{
+    const uint16 size_u16 = (uint16)strlen(p_str);
+
+    mq_put_u16(size_u16);
+    mq_put(p_str, size_u16);
+}
+
+bool mq_publish(const char *p_suffix, const char *p_payload, const bool retain_b)
+{
+    char topic_str[MQ_TOPIC_SIZE];
+    const uint16 topic_size_u16 = (uint16)min((size_t)snprintf(topic_str, sizeof(topic_str), "%s/%s", mq_base_str, p_suffix), sizeof(topic_str) - 1U);
+    const uint16 payload_size_u16 = (uint16)strlen(p_payload);
+
+    if (!mq_queue(MQ_PUBLISH | (retain_b ? MQ_FLAG_RETAIN : 0U), (uint16)(2U + topic_size_u16 + payload_size_u16)))
+    {
+        return false;
+    }
+
+    mq_put_u16(topic_size_u16);
+    mq_put(topic_str, topic_size_u16);
+    mq_put(p_payload, payload_size_u16);
+    mq_stats.publishes_u32 += 1U;
+
+    return true;
+}
+
+void mq_subscribe()
+{
+    char topic_str[MQ_TOPIC_SIZE];
+    uint16 remaining_u16 = 2U;
+
+    for (uint8 i = 0U; i < (sizeof(mq_subscriptions) / sizeof(mq_subscriptions[0])); ++i)
+    {
+        remaining_u16 += (uint16)(2U + strlen(mq_base_str) + 1U + strlen(mq_subscriptions[i]) + 1U);
+    }
+
+    /* One packet for all of them, packet id 1, QoS 0 */
+    if (mq_queue(MQ_SUBSCRIBE, remaining_u16))
+    {
+        mq_put_u16(1U);
+        for (uint8 i = 0U; i < (sizeof(mq_subscriptions) / sizeof(mq_subscriptions[0])); ++i)
+        {
+            (void)snprintf(topic_str, sizeof(topic_str), "%s/%s", mq_base_str, mq_subscriptions[i]);
+            mq_put_string(topic_str);
+            mq_put("\x00", 1U);
+        }
+    }
+    mq_transmit();
+}
+
+/*****************************************************************************/
+
+void mq_get_mqtt(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    char response_str[256];
+    JSON_WRITER writer;
+    char broker_str[16];
+
+    (void)snprintf(broker_str, sizeof(broker_str), "%u.%u.%u.%u", mq_broker_ip[0], mq_broker_ip[1], mq_broker_ip[2], mq_broker_ip[3]);
+
+    json_init(&writer, response_str, sizeof(response_str) - 1U);
+    json_object_begin(&writer, NULL);
+    json_add_string(&writer, "broker", (mq_broker_port_u16 != 0U) ? broker_str : "");
+    json_add_uint(&writer, "port", mq_broker_port_u16);
+    json_add_string(&writer, "topic", mq_base_str);
+    json_add_bool(&writer, "connected", mq_state_e == MQ_STATE_CONNECTED);
+    json_add_uint(&writer, "connects", mq_stats.connects_u32);
+    json_add_uint(&writer, "publishes", mq_stats.publishes_u32);
+    json_add_uint(&writer, "coalesced", mq_stats.coalesced_u32);
+    json_add_uint(&writer, "commands", mq_stats.commands_u32);
+    json_add_uint(&writer, "configs", mq_stats.configs_u32);
+    json_add_uint(&writer, "rejected", mq_stats.rejected_u32);
+    json_object_end(&writer);
+    response_str[json_length(&writer)] = '\0';
+
+    http_send(p_conn, 200, "application/json", response_str);
+}
+
+void mq_put_mqtt(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JSON_READER reader;
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    char broker_str[16] = "";
+    uint16 port_u16 = (mq_broker_port_u16 != 0U) ? mq_broker_port_u16 : MQ_DEFAULT_PORT;
+    bool valid_b = true;
+
+    /* {"broker": "192.168.1.10", "port": 1883}, an empty broker turns it off, keys left out stay as they are */
+    if (mq_broker_port_u16 != 0U)
+    {
+        (void)snprintf(broker_str, sizeof(broker_str), "%u.%u.%u.%u", mq_broker_ip[0], mq_broker_ip[1], mq_broker_ip[2], mq_broker_ip[3]);
+    }
+    json_reader_init(&reader, p_request->body.p_data, p_request->body.size_u16);
+    valid_b = (json_next(&reader, &key) == JSON_TOKEN_OBJECT_BEGIN);
+    while (valid_b && (json_next(&reader, &key) == JSON_TOKEN_STRING) && (json_next(&reader, &value) != JSON_TOKEN_ERROR))
+    {
+        if (json_token_equals(&key, "broker") && (value.type_e == JSON_TOKEN_STRING) && (value.size_u16 < sizeof(broker_str)))
+        {
+            (void)memcpy(broker_str, value.p_data, value.size_u16);
+            broker_str[value.size_u16] = '\0';
+        }
+        else if (json_token_equals(&key, "port") && (value.type_e == JSON_TOKEN_NUMBER) && (value.number_s32 > 0) && (value.number_s32 <= 0xffff))
+        {
+            port_u16 = (uint16)value.number_s32;
+        }
+        else if (json_token_equals(&key, "broker") || json_token_equals(&key, "port"))
+        {
+            valid_b = false;
+        }
+        else if (!json_skip(&reader, &value))
+        {
+            valid_b = false;
+        }
+        else
+        {
+            /* Ignore unknown keys */
+        }
+    }
+
+    if (valid_b && mq_set_broker(broker_str, port_u16))
+    {
+        api_store_config();
+        mq_get_mqtt(p_conn, p_request);
+    }
+    else
+    {
+        http_send(p_conn, 400, "application/json", "{\"error\":\"expected {\\\"broker\\\": \\\"a.b.c.d\\\", \\\"port\\\": 1883}\"}");
+    }
+}
+
+/*****************************************************************************/
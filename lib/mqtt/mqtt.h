@@ -0,0 +1,36 @@
+#ifndef MQ_MAIN_H
+#define MQ_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define MQ_DEFAULT_PORT 1883U
+#define MQ_TX_BUFFER_SIZE 256U /* outgoing packets wait here for the TCP window, nothing is allocated */
+#define MQ_RX_BUFFER_SIZE 768U /* largest packet taken from the broker, a whole schedule document */
+#define MQ_TOPIC_SIZE 64U      /* "flexidesk/<client id>/schedule/set" */
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 connects_u32;  /* accepted by the broker */
+    uint32 publishes_u32;
+    uint32 coalesced_u32; /* height changes that went out together with a later one */
+    uint32 commands_u32;  /* passed on to the desk */
+    uint32 configs_u32;   /* schedule and desk documents applied */
+    uint32 rejected_u32;  /* unknown commands, invalid documents and packets too large for the buffer */
+} MQ_STATS;
+
+/*****************************************************************************/
+
+extern void mq_init(const char *p_client_id, const char *p_broker, const uint16 port_u16, fn_command_receiver command_receiver);
+extern bool mq_set_broker(const char *p_broker, const uint16 port_u16); /* IPv4 address, empty to turn it off */
+extern void mq_get_broker(uint8 *p_broker_vu8, uint16 *p_port_u16);     /* 0.0.0.0 and 0 while turned off */
+extern const MQ_STATS *mq_get_stats();
+
+/*****************************************************************************/
+
+#endif
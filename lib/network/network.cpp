@@ -0,0 +1,325 @@
+#include "network.h"
+
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+
+#include "events.h"
+#include "log.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+typedef enum
+{
+    NW_STATE_WAITING = 0, /* waiting for the next connection attempt */
+    NW_STATE_CONNECTING,
+    NW_STATE_CONNECTED
+} NW_STATE;
+
+typedef struct
+{
+    const char *p_key;
+    char value_str[NW_TXT_VALUE_SIZE];
+} NW_TXT;
+
+/*****************************************************************************/
+
+const uint32 NW_CONNECT_TIMEOUT_MS_U32 = 15000U;
+const uint32 NW_BACKOFF_INITIAL_MS_U32 = 1000U;
+const uint32 NW_BACKOFF_MAX_MS_U32 = 60000U;
+const uint32 NW_UPDATE_PERIOD_MS_U32 = 50U;
+const uint32 NW_ANNOUNCE_INTERVAL_MS_U32 = 1000U; /* RFC 6762 section 6, a record is multicast at most once a second */
+const char nw_module_str[] PROGMEM = "WiFi";
+
+/*****************************************************************************/
+
+const char *nw_ssid_str = NULL;
+const char *nw_password_str = NULL;
+const char *nw_hostname_str = NULL;
+const char *nw_service_str = NULL;
+uint16 nw_service_port_u16 = 0U;
+char nw_instance_str[NW_INSTANCE_SIZE] = "";
+MDNSResponder::hMDNSService nw_service_h = NULL; /* only while the responder runs */
+
+NW_TXT nw_txt[NW_MAX_SERVICE_TXT];
+uint8 nw_num_txt_u8 = 0U;
+sint8 nw_announce_task_s8 = TK_INVALID_TASK;
+uint32 nw_last_announce_ms_u32 = 0U;
+bool nw_announce_pending_b = false;
+
+NW_STATE nw_state_e = NW_STATE_WAITING;
+uint32 nw_state_since_ms_u32 = 0U;
+uint32 nw_backoff_ms_u32 = 0U;
+
+/* Set from the WiFi event callbacks (SDK context), consumed in nw_update() */
+WiFiEventHandler nw_got_ip_handler;
+WiFiEventHandler nw_disconnected_handler;
+volatile bool nw_event_got_ip_b = false;
+volatile bool nw_event_disconnected_b = false;
+
+/*****************************************************************************/
+
+void nw_update();
+void nw_connect();
+void nw_handle_link_up();
+void nw_handle_link_down();
+void nw_wait_for_retry();
+void nw_publish_link_state(const bool link_up_b);
+void nw_add_service_txt(const MDNSResponder::hMDNSService service_h);
+void nw_request_announce();
+void nw_announce();
+
+/*****************************************************************************/
+
+void nw_init(const char *p_ssid, const char *p_password, const char *p_hostname)
+{
+    nw_ssid_str = p_ssid;
+    nw_password_str = p_password;
+    nw_hostname_str = p_hostname;
+    nw_backoff_ms_u32 = NW_BACKOFF_INITIAL_MS_U32;
+
+    /* We do the reconnect handling ourselves, the SDK should not interfere */
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+
+    nw_got_ip_handler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &event)
+                                                { nw_event_got_ip_b = true; });
+    nw_disconnected_handler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected &event)
+                                                             { nw_event_disconnected_b = true; });
+
+    /* Only kick off the association, nw_update() takes it from here */
+    nw_connect();
+    (void)tk_add_periodic("WiFi", nw_update, NW_UPDATE_PERIOD_MS_U32);
+    nw_announce_task_s8 = tk_add_oneshot("mDNS announce", nw_announce);
+}
+
+void nw_update()
+{
+    const uint32 now_ms_u32 = millis();
+    const bool got_ip_b = nw_event_got_ip_b;
+    const bool disconnected_b = nw_event_disconnected_b;
+
+    nw_event_got_ip_b = false;
+    nw_event_disconnected_b = false;
+
+    switch (nw_state_e)
+    {
+    case NW_STATE_WAITING:
+    {
+        if (got_ip_b || (WiFi.status() == WL_CONNECTED))
+        {
+            /* The SDK often reports a transient disconnect before the IP, the link is fine */
+            nw_handle_link_up();
+        }
+        else if ((now_ms_u32 - nw_state_since_ms_u32) >= nw_backoff_ms_u32)
+        {
+            nw_backoff_ms_u32 = min(nw_backoff_ms_u32 * 2U, NW_BACKOFF_MAX_MS_U32);
+            nw_connect();
+        }
+        break;
+    }
+    case NW_STATE_CONNECTING:
+    {
+        if (got_ip_b)
+        {
+            nw_handle_link_up();
+        }
+        else if ((disconnected_b && (WiFi.status() != WL_CONNECTED)) || ((now_ms_u32 - nw_state_since_ms_u32) >= NW_CONNECT_TIMEOUT_MS_U32))
+        {
+            log_msg(LOG_LEVEL_WARNING, nw_module_str, "Connection attempt failed, retrying in %u ms.", nw_backoff_ms_u32);
+            nw_wait_for_retry();
+        }
+        else
+        {
+            /* Still associating */
+        }
+        break;
+    }
+    case NW_STATE_CONNECTED:
+    {
+        if (disconnected_b)
+        {
+            nw_handle_link_down();
+        }
+        else
+        {
+            MDNS.update();
+        }
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+void nw_set_service(const char *p_service, const uint16 port_u16)
+{
+    /* Announced on the next connect, the responder is restarted on every one */
+    nw_service_str = p_service;
+    nw_service_port_u16 = port_u16;
+
+    /* The hostname is the same on every board, the chip id tells them apart */
+    (void)snprintf(nw_instance_str, sizeof(nw_instance_str), "%s-%06x", p_service, (unsigned)(ESP.getChipId() & 0x00ffffffU));
+}
+
+const char *nw_get_instance_name()
+{
+    return nw_instance_str;
+}
+
+bool nw_set_service_txt(const char *p_key, const char *p_value)
+{
+    NW_TXT *p_txt = NULL;
+
+    for (uint8 i = 0U; (i < nw_num_txt_u8) && (NULL == p_txt); ++i)
+    {
+        if (strcmp(nw_txt[i].p_key, p_key) == 0)
+        {
+            p_txt = &nw_txt[i];
+        }
+    }
+
+    if (NULL == p_txt)
+    {
+        if (nw_num_txt_u8 >= NW_MAX_SERVICE_TXT)
+        {
+            return false;
+        }
+        p_txt = &nw_txt[nw_num_txt_u8++];
+        p_txt->p_key = p_key;
+        p_txt->value_str[0] = '\0';
+    }
+
+    if (strncmp(p_txt->value_str, p_value, sizeof(p_txt->value_str) - 1U) != 0)
+    {
+        (void)strncpy(p_txt->value_str, p_value, sizeof(p_txt->value_str) - 1U);
+        p_txt->value_str[sizeof(p_txt->value_str) - 1U] = '\0';
+        nw_request_announce();
+    }
+
+    return true;
+}
+
+bool nw_is_link_up()
+{
+    return (nw_state_e == NW_STATE_CONNECTED);
+}
+
+/*****************************************************************************/
+
+void nw_connect()
+{
+    log_msg(LOG_LEVEL_INFO, nw_module_str, "Connecting to WiFi.");
+
+    nw_state_e = NW_STATE_CONNECTING;
+    nw_state_since_ms_u32 = millis();
+
+    WiFi.disconnect();
+    WiFi.begin(nw_ssid_str, nw_password_str);
+}
+
+void nw_handle_link_up()
+{
+    const IPAddress ip = WiFi.localIP();
+
+    nw_state_e = NW_STATE_CONNECTED;
+    nw_state_since_ms_u32 = millis();
+    nw_backoff_ms_u32 = NW_BACKOFF_INITIAL_MS_U32;
+
+    log_msg(LOG_LEVEL_INFO, nw_module_str, "Connected with IP %i.%i.%i.%i", ip[0], ip[1], ip[2], ip[3]);
+
+    if (MDNS.begin(nw_hostname_str))
+    {
+        log_msg(LOG_LEVEL_INFO, nw_module_str, "mDNS responder started.");
+
+        if (NULL != nw_service_str)
+        {
+            /* The TXT records are filled in when they are sent, they are always current */
+            nw_service_h = MDNS.addService(nw_instance_str, nw_service_str, "tcp", nw_service_port_u16);
+            if (NULL != nw_service_h)
+            {
+                (void)MDNS.setDynamicServiceTxtCallback(nw_add_service_txt);
+            }
+            else
+            {
+                log_msg(LOG_LEVEL_ERROR, nw_module_str, "Error announcing the %s service.", nw_service_str);
+            }
+        }
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, nw_module_str, "Error setting up MDNS responder.");
+    }
+
+    nw_publish_link_state(true);
+}
+
+void nw_handle_link_down()
+{
+    log_msg(LOG_LEVEL_WARNING, nw_module_str, "Lost connection.");
+
+    nw_publish_link_state(false);
+    tk_cancel(nw_announce_task_s8);
+    nw_announce_pending_b = false;
+    nw_service_h = NULL;
+    MDNS.close();
+
+    /* An AP reboot usually takes a while, but the first retry should still be quick */
+    nw_backoff_ms_u32 = NW_BACKOFF_INITIAL_MS_U32;
+    nw_wait_for_retry();
+}
+
+void nw_wait_for_retry()
+{
+    nw_state_e = NW_STATE_WAITING;
+    nw_state_since_ms_u32 = millis();
+}
+
+void nw_publish_link_state(const bool link_up_b)
+{
+    EVENT event;
+
+    event.type_e = EV_LINK_CHANGED;
+    event.data.link_up_b = link_up_b;
+    ev_publish(&event);
+}
+
+void nw_add_service_txt(const MDNSResponder::hMDNSService service_h)
+{
+    for (uint8 i = 0U; i < nw_num_txt_u8; ++i)
+    {
+        (void)MDNS.addDynamicServiceTxt(service_h, nw_txt[i].p_key, nw_txt[i].value_str);
+    }
+}
+
+void nw_request_announce()
+{
+    uint32 elapsed_ms_u32;
+
+    /* Without a responder the records go out with the first announcement after the next connect */
+    if (nw_announce_pending_b || (NULL == nw_service_h))
+    {
+        return;
+    }
+
+    /* A moving desk changes its height all the time, everything within the interval goes out at once */
+    elapsed_ms_u32 = millis() - nw_last_announce_ms_u32;
+    tk_schedule(nw_announce_task_s8, (elapsed_ms_u32 >= NW_ANNOUNCE_INTERVAL_MS_U32) ? 0U : (NW_ANNOUNCE_INTERVAL_MS_U32 - elapsed_ms_u32));
+    nw_announce_pending_b = true;
+}
+
+void nw_announce()
+{
+    nw_announce_pending_b = false;
+    nw_last_announce_ms_u32 = millis();
+
+    if (!MDNS.announce())
+    {
+        log_msg(LOG_LEVEL_DEBUG, nw_module_str, "mDNS announcement not sent.");
+    }
+}
+
+/*****************************************************************************/
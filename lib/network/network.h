@@ -0,0 +1,30 @@
+#ifndef NW_MAIN_H
+#define NW_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+#define NW_MAX_SERVICE_TXT 8U /* TXT records of the service */
+#define NW_TXT_VALUE_SIZE 32U /* including the terminator */
+#define NW_INSTANCE_SIZE 32U  /* service name, a dash and the chip id */
+
+/*****************************************************************************/
+
+extern void nw_init(const char *p_ssid, const char *p_password, const char *p_hostname);
+
+/* DNS-SD service announced by the mDNS responder while connected, e.g. "flexidesk" for _flexidesk._tcp */
+extern void nw_set_service(const char *p_service, const uint16 port_u16);
+
+/* Instance name of the service, unique per board, e.g. "flexidesk-1a2b3c" */
+extern const char *nw_get_instance_name();
+
+/* Sets a TXT record of the service, the key must stay valid. Changes go out in an unsolicited
+ * announcement at most once a second, false if all NW_MAX_SERVICE_TXT are taken. */
+extern bool nw_set_service_txt(const char *p_key, const char *p_value);
+
+extern bool nw_is_link_up();
+
+/*****************************************************************************/
+
+#endif
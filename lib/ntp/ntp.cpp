@@ -4,17 +4,32 @@
 #include <WiFiUdp.h>
 #include <time.h>
 
+#include "events.h"
 #include "log.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+const char ntp_module_str[] PROGMEM = "NTP";
+const uint32 NTP_UPDATE_PERIOD_MS_U32 = 100U;
 
 /*****************************************************************************/
 
 WiFiUDP ntp_udp;
 NTPClient ntp_client(ntp_udp);
 DATETIME ntp_current_time;
+bool ntp_link_up_b = false;
+uint8 ntp_last_tick_second_u8 = 0xffU;
+uint32 ntp_syncs_u32 = 0U;
+uint32 ntp_last_sync_ms_u32 = 0U;
+int ntp_utc_offset_i32 = 0;
 
 /*****************************************************************************/
 
 void ntp_reset_time();
+void ntp_update();
+void ntp_handle_event(const EVENT *p_event);
+void ntp_set_link_state(const bool link_up_b);
 
 /*****************************************************************************/
 
@@ -25,15 +40,24 @@ void ntp_init(const char *p_ntp_server, const int utc_offset_i32)
     ntp_set_pool_name(p_ntp_server);
     ntp_set_time_offset(utc_offset_i32);
 
-    ntp_client.begin();
+    /* The client is only started once we have a link, see ntp_set_link_state() */
+    (void)ev_subscribe(EV_LINK_CHANGED, ntp_handle_event);
+    (void)tk_add_periodic("NTP", ntp_update, NTP_UPDATE_PERIOD_MS_U32);
 }
 
-void ntp_loop()
+void ntp_update()
 {
     time_t t;
     tm local_time;
+    EVENT event;
 
-    ntp_client.update();
+    /* Without a link, keep counting on the last synchronized time */
+    if (ntp_link_up_b && ntp_client.update())
+    {
+        /* Only true when it actually talked to the server */
+        ntp_syncs_u32 += 1U;
+        ntp_last_sync_ms_u32 = millis();
+    }
 
     t = ntp_client.getEpochTime();
     localtime_r(&t, &local_time);
@@ -46,18 +70,54 @@ void ntp_loop()
     ntp_current_time.time.hour_u8 = local_time.tm_hour;
     ntp_current_time.time.minute_u8 = local_time.tm_min;
     ntp_current_time.time.second_u8 = local_time.tm_sec;
+
+    /* Everybody interested in the time gets it pushed once per second */
+    if (ntp_current_time.time.second_u8 != ntp_last_tick_second_u8)
+    {
+        ntp_last_tick_second_u8 = ntp_current_time.time.second_u8;
+
+        event.type_e = EV_SECOND_TICK;
+        event.data.p_time = &ntp_current_time;
+        ev_publish(&event);
+    }
+}
+
+void ntp_handle_event(const EVENT *p_event)
+{
+    ntp_set_link_state(p_event->data.link_up_b);
+}
+
+void ntp_set_link_state(const bool link_up_b)
+{
+    if (link_up_b && !ntp_link_up_b)
+    {
+        log_msg(LOG_LEVEL_INFO, ntp_module_str, "Link is up, starting client.");
+        ntp_client.begin();
+    }
+    else if (!link_up_b && ntp_link_up_b)
+    {
+        log_msg(LOG_LEVEL_INFO, ntp_module_str, "Link is down, stopping client.");
+        ntp_client.end();
+    }
+    else
+    {
+        /* Nothing changed */
+    }
+
+    ntp_link_up_b = link_up_b;
 }
 
 void ntp_set_pool_name(const char *p_pool_name)
 {
-    log_msg(LOG_LEVEL_INFO, "NTP", "Setting pool name to '%s'.", p_pool_name);
+    log_msg(LOG_LEVEL_INFO, ntp_module_str, "Setting pool name to '%s'.", p_pool_name);
     ntp_client.setPoolServerName(p_pool_name);
 }
 
 void ntp_set_time_offset(const int utc_offset_i32)
 {
-    log_msg(LOG_LEVEL_INFO, "NTP", "Setting time offset to %i seconds.", utc_offset_i32);
+    log_msg(LOG_LEVEL_INFO, ntp_module_str, "Setting time offset to %i seconds.", utc_offset_i32);
     ntp_client.setTimeOffset(utc_offset_i32);
+    ntp_utc_offset_i32 = utc_offset_i32;
 }
 
 const DATETIME *ntp_get_current_time()
@@ -65,6 +125,26 @@ const DATETIME *ntp_get_current_time()
     return &ntp_current_time; /* only safe because we have no concurrency */
 }
 
+uint32 ntp_get_utc_time()
+{
+    return (ntp_syncs_u32 > 0U) ? (uint32)(ntp_client.getEpochTime() - ntp_utc_offset_i32) : 0U;
+}
+
+int ntp_get_utc_offset()
+{
+    return ntp_utc_offset_i32;
+}
+
+uint32 ntp_get_sync_count()
+{
+    return ntp_syncs_u32;
+}
+
+uint32 ntp_get_sync_age_s()
+{
+    return (ntp_syncs_u32 > 0U) ? ((millis() - ntp_last_sync_ms_u32) / 1000U) : NTP_NEVER_SYNCED;
+}
+
 void ntp_reset_time()
 {
     (void)memset(&ntp_current_time, 0, sizeof(DATETIME));
@@ -7,13 +7,20 @@
 
 /*****************************************************************************/
 
+#define NTP_NEVER_SYNCED 0xffffffffUL
+
+/*****************************************************************************/
+
 extern void ntp_init(const char *p_ntp_server, const int utc_offset_i32);
-extern void ntp_loop();
 
 extern void ntp_set_pool_name(const char *p_pool_name);
 extern void ntp_set_time_offset(const int utc_offset_i32);
 
 extern const DATETIME *ntp_get_current_time();
+extern uint32 ntp_get_utc_time(); /* seconds since 1970, 0 until synchronized */
+extern int ntp_get_utc_offset();  /* seconds local time is ahead of UTC */
+extern uint32 ntp_get_sync_count();
+extern uint32 ntp_get_sync_age_s(); /* since the last successful sync, NTP_NEVER_SYNCED before the first */
 
 /*****************************************************************************/
 
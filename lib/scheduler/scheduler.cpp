@@ -2,24 +2,40 @@
 
 #include <string.h>
 
+#include "events.h"
 #include "log.h"
+#include "tasks.h"
+#include "trace.h"
 
 /*****************************************************************************/
 
 typedef enum
 {
-    SC_STATE_INACTIVE = 0,
-    SC_STATE_TRANSITION_SIT_TO_STAND,
-    SC_STATE_TRANSITION_STAND_TO_SIT,
-    SC_STATE_SITTING,
-    SC_STATE_STANDING
-} SCHEDULER_STATE;
+    SC_TRACKER_IDLE = 0,
+    SC_TRACKER_AWAIT_START, /* command sent, waiting for the height to change */
+    SC_TRACKER_BACKOFF,     /* desk did not react, waiting to retry */
+    SC_TRACKER_MOVING       /* desk is moving, waiting for the target state */
+} SC_TRACKER_STATE;
+
+/*****************************************************************************/
+
+const char sc_module_str[] PROGMEM = "Scheduler";
+const uint32 SC_START_TIMEOUT_MS_U32 = 4000U; /* includes the 1.1 s PIN20 activation */
+const uint32 SC_STALL_TIMEOUT_MS_U32 = 3000U; /* no height change while moving */
+const uint32 SC_RETRY_BACKOFF_MS_U32 = 1000U; /* doubled on every retry */
+const uint8 SC_MAX_ATTEMPTS_U8 = 4U;
+const uint16 SC_MOVE_THRESHOLD_U16 = 5U; /* same unit as the desk height */
+const uint32 SC_DEFAULT_START_LATENCY_MS_U32 = 1500U; /* PIN20 activation and the first height frames */
+const uint32 SC_DEFAULT_MS_PER_M_U32 = 27000U;        /* about 37 mm/s, until the first transition was measured */
+const uint32 SC_MAX_LEAD_MS_U32 = 60000U;
+const uint16 SC_LEARN_MIN_DISTANCE_U16 = 50U; /* shorter moves are mostly acceleration */
+const sint32 SC_LEARN_WEIGHT_S32 = 4;         /* every measurement moves the estimate a quarter of the way */
 
 /*****************************************************************************/
 
-fn_desk_state_provider sc_desk_state_provider = NULL;
 fn_command_receiver sc_desk_command_receiver = NULL;
-fn_time_provider sc_time_provider = NULL;
+DC_STATE sc_desk_state_e = DC_STATE_UNKNOWN;
+SCHEDULER_STATE sc_state_e = SC_STATE_INACTIVE; /* as of the last second tick */
 
 DAY_CONFIG sc_day_configs[NUM_WEEKDAYS] = {0};
 uint16 sc_config_transition_time_tolerance_u16 = 1U * 60U; /* 1 minute */
@@ -28,80 +44,143 @@ uint16 sc_config_command_send_time_tolerance_u16 = 30U;    /* 30 seconds */
 DC_COMMAND sc_command_last_sent_e = DC_CMD_INVALID;
 TIME sc_command_last_sent_time = {0};
 
+/* Travel distance for the lead, in the same unit as the desk height */
+uint16 sc_height_standing_u16 = 0U;
+uint16 sc_height_sitting_u16 = 0U;
+uint16 sc_height_tolerance_u16 = 0U;
+uint32 sc_plan_due_ms_u32 = 0U; /* scheduled time of the transition asked for in the current tick */
+uint16 sc_delay_s_u16 = 0U;     /* of the next transition, so desks in one building do not all start together */
+bool sc_next_valid_b = false;
+sint32 sc_next_second_s32 = 0;  /* second of the day of the next transition, as of the last tick */
+DC_STATE sc_next_target_e = DC_STATE_UNKNOWN;
+
+/* Closed-loop tracking of the command currently in flight */
+SC_TRACKER_STATE sc_tracker_state_e = SC_TRACKER_IDLE;
+sint8 sc_tracker_task_s8 = TK_INVALID_TASK;
+DC_COMMAND sc_tracker_command_e = DC_CMD_INVALID;
+DC_STATE sc_tracker_target_e = DC_STATE_UNKNOWN;
+uint16 sc_tracker_start_height_u16 = 0U;
+uint16 sc_desk_height_u16 = 0U;
+uint8 sc_tracker_attempts_u8 = 0U;
+uint32 sc_tracker_first_sent_ms_u32 = 0U;
+uint32 sc_tracker_move_started_ms_u32 = 0U;
+uint32 sc_tracker_due_ms_u32 = 0U;
+SC_OUTCOME sc_tracker_last_outcome_e = SC_OUTCOME_NONE;
+SC_TRANSITION_STATS sc_transition_stats = {0};
+
 /*****************************************************************************/
 
 void sc_reset();
+void sc_handle_event(const EVENT *p_event);
+void sc_handle_tick(const DATETIME *p_time);
 SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_config, const uint16 transition_time_tolerance_u16);
+SCHEDULER_STATE sc_plan_ahead(const TIME *p_time, const DAY_CONFIG *p_config, const SCHEDULER_STATE state_e);
+uint32 sc_transition_elapsed(const TIME *p_time, const DAY_CONFIG *p_config, const SCHEDULER_STATE state_e);
+void sc_find_next_transition(const TIME *p_time, const DAY_CONFIG *p_config);
 void sc_handle_target_state(const TIME *p_time, const SCHEDULER_STATE target_state_e);
 void sc_handle_command_request(const TIME *p_time, const DC_COMMAND requested_command_e);
 
+void sc_tracker_start(const DC_COMMAND command_e);
+void sc_tracker_send();
+void sc_tracker_handle_height(const uint16 height_u16);
+void sc_tracker_handle_desk_state(const DC_STATE desk_state_e);
+void sc_tracker_handle_timeout();
+void sc_tracker_finish(const SC_OUTCOME outcome_e);
+void sc_tracker_learn(const uint32 now_ms_u32);
+
 /*****************************************************************************/
 
 void sc_init()
 {
-    sc_desk_state_provider = NULL;
     sc_desk_command_receiver = NULL;
-    sc_time_provider = NULL;
+    sc_desk_state_e = DC_STATE_UNKNOWN;
 
     sc_reset();
+
+    /* Check for an active schedule and a potentially necessary state change - enough to do it every second */
+    (void)ev_subscribe(EV_SECOND_TICK, sc_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, sc_handle_event);
+    (void)ev_subscribe(EV_CONFIG_CHANGED, sc_handle_event);
+
+    /* Commands are verified against the height telemetry */
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, sc_handle_event);
+    sc_tracker_task_s8 = tk_add_oneshot("Scheduler tracker", sc_tracker_handle_timeout);
 }
 
-void sc_loop()
+void sc_handle_event(const EVENT *p_event)
+{
+    switch (p_event->type_e)
+    {
+    case EV_SECOND_TICK:
+    {
+        sc_handle_tick(p_event->data.p_time);
+        break;
+    }
+    case EV_DESK_STATE_CHANGED:
+    {
+        sc_desk_state_e = p_event->data.desk_state_e;
+        sc_tracker_handle_desk_state(sc_desk_state_e);
+        break;
+    }
+    case EV_HEIGHT_CHANGED:
+    {
+        sc_desk_height_u16 = p_event->data.height_u16;
+        sc_tracker_handle_height(sc_desk_height_u16);
+        break;
+    }
+    case EV_CONFIG_CHANGED:
+    {
+        sc_set_tolerances(p_event->data.p_config->transition_time_tolerance_u16, p_event->data.p_config->command_send_time_tolerance_u16);
+        sc_set_day_configs(p_event->data.p_config->day_configs);
+        sc_height_standing_u16 = p_event->data.p_config->height_standing_u16;
+        sc_height_sitting_u16 = p_event->data.p_config->height_sitting_u16;
+        sc_height_tolerance_u16 = p_event->data.p_config->height_tolerance_u16;
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+void sc_handle_tick(const DATETIME *p_time)
 {
     const DAY_CONFIG *p_config;
-    const DATETIME *p_time;
     SCHEDULER_STATE target_state_e;
 
-    /* Check for an active schedule and a potentially necessary state change - enough to do it every second */
-    ONCE_EVERY_MS(1000U);
-    if (NULL != sc_time_provider)
+    /* Determine the config of this weekday and then check whether the schedule is active */
+    if (p_time->date.day_of_week_e < NUM_WEEKDAYS)
     {
-        p_time = sc_time_provider();
-
-        /* Determine the config of this weekday and then check whether the schedule is active */
-        if (p_time->date.day_of_week_e < NUM_WEEKDAYS)
-        {
-            log_msg(LOG_LEVEL_DEBUG, "Scheduler", "Got time %i:%i:%i and date %i/%i%/%i (day of week %i)",
-                    (int)p_time->time.hour_u8, (int)p_time->time.minute_u8, (int)p_time->time.second_u8,
-                    (int)p_time->date.year_u16, (int)p_time->date.month_u8, (int)p_time->date.day_u8,
-                    (int)p_time->date.day_of_week_e);
-
-            p_config = &(sc_day_configs[p_time->date.day_of_week_e]);
-            log_msg(LOG_LEVEL_INFO, "Scheduler", "Got config for day %i from %i:%i to %i:%i with enabled: %i",
-                    (int)p_time->date.day_of_week_e,
-                    p_config->start_time.hour_u8, p_config->start_time.minute_u8,
-                    p_config->end_time.hour_u8, p_config->end_time.minute_u8,
-                    p_config->enabled);
-
-            target_state_e = sc_determine_state(&(p_time->time), p_config, sc_config_transition_time_tolerance_u16);
-            sc_handle_target_state(&(p_time->time), target_state_e);
-        }
-        else
-        {
-            /* Something went weirdly wrong */
-        }
+        log_msg(LOG_LEVEL_DEBUG, sc_module_str, "Got time %i:%i:%i and date %i/%i/%i (day of week %i)",
+                (int)p_time->time.hour_u8, (int)p_time->time.minute_u8, (int)p_time->time.second_u8,
+                (int)p_time->date.year_u16, (int)p_time->date.month_u8, (int)p_time->date.day_u8,
+                (int)p_time->date.day_of_week_e);
+
+        p_config = &(sc_day_configs[p_time->date.day_of_week_e]);
+        log_msg(LOG_LEVEL_DEBUG, sc_module_str, "Got config for day %i from %i:%i to %i:%i with enabled: %i",
+                (int)p_time->date.day_of_week_e,
+                p_config->start_time.hour_u8, p_config->start_time.minute_u8,
+                p_config->end_time.hour_u8, p_config->end_time.minute_u8,
+                p_config->enabled);
+
+        target_state_e = sc_determine_state(&(p_time->time), p_config, sc_config_transition_time_tolerance_u16);
+        target_state_e = sc_plan_ahead(&(p_time->time), p_config, target_state_e);
+        sc_find_next_transition(&(p_time->time), p_config);
+        sc_state_e = target_state_e;
+        sc_handle_target_state(&(p_time->time), target_state_e);
     }
     else
     {
-        log_msg(LOG_LEVEL_ERROR, "Scheduler", "No time provider set.");
+        /* Something went weirdly wrong */
     }
 }
 
-void sc_set_desk_state_provider(fn_desk_state_provider p_desk_state_provider)
-{
-    sc_desk_state_provider = p_desk_state_provider;
-}
-
 void sc_set_desk_command_receiver(fn_command_receiver p_desk_command_receiver)
 {
     sc_desk_command_receiver = p_desk_command_receiver;
 }
 
-void sc_set_time_provider(fn_time_provider p_time_provider)
-{
-    sc_time_provider = p_time_provider;
-}
-
 void sc_set_day_configs(const DAY_CONFIG configs[NUM_WEEKDAYS])
 {
     (void)memcpy(sc_day_configs, configs, sizeof(DAY_CONFIG) * NUM_WEEKDAYS);
@@ -111,7 +190,7 @@ void sc_set_day_config(const WEEKDAY day_e, const DAY_CONFIG *p_config)
 {
     if ((day_e < NUM_WEEKDAYS) && (NULL != p_config))
     {
-        log_msg(LOG_LEVEL_INFO, "Scheduler", "Setting day config for day %i", (int)day_e);
+        log_msg(LOG_LEVEL_INFO, sc_module_str, "Setting day config for day %i", (int)day_e);
         (void)memcpy(&sc_day_configs[day_e], p_config, sizeof(DAY_CONFIG));
     }
     else
@@ -120,6 +199,71 @@ void sc_set_day_config(const WEEKDAY day_e, const DAY_CONFIG *p_config)
     }
 }
 
+void sc_get_day_configs(DAY_CONFIG configs[NUM_WEEKDAYS])
+{
+    (void)memcpy(configs, sc_day_configs, sizeof(DAY_CONFIG) * NUM_WEEKDAYS);
+}
+
+void sc_set_tolerances(const uint16 transition_time_tolerance_u16, const uint16 command_send_time_tolerance_u16)
+{
+    sc_config_transition_time_tolerance_u16 = transition_time_tolerance_u16;
+    sc_config_command_send_time_tolerance_u16 = command_send_time_tolerance_u16;
+}
+
+void sc_get_tolerances(uint16 *p_transition_time_tolerance_u16, uint16 *p_command_send_time_tolerance_u16)
+{
+    *p_transition_time_tolerance_u16 = sc_config_transition_time_tolerance_u16;
+    *p_command_send_time_tolerance_u16 = sc_config_command_send_time_tolerance_u16;
+}
+
+SCHEDULER_STATE sc_get_state()
+{
+    return sc_state_e;
+}
+
+const SC_TRANSITION_STATS *sc_get_transition_stats()
+{
+    return &sc_transition_stats;
+}
+
+bool sc_is_tracking()
+{
+    return sc_tracker_state_e != SC_TRACKER_IDLE;
+}
+
+bool sc_get_next_transition(uint32 *p_second_u32, DC_STATE *p_target_e)
+{
+    *p_second_u32 = (uint32)sc_next_second_s32;
+    *p_target_e = sc_next_target_e;
+
+    return sc_next_valid_b;
+}
+
+void sc_set_transition_delay(const uint16 delay_s_u16)
+{
+    sc_delay_s_u16 = delay_s_u16;
+}
+
+uint32 sc_get_lead_ms(const DC_STATE target_e)
+{
+    const SC_TRAVEL *p_travel = &(sc_transition_stats.travel[(target_e == DC_STATE_STANDING) ? 0U : 1U]);
+    const uint16 target_height_u16 = (target_e == DC_STATE_STANDING) ? sc_height_standing_u16 : sc_height_sitting_u16;
+    uint16 from_height_u16 = (target_e == DC_STATE_STANDING) ? sc_height_sitting_u16 : sc_height_standing_u16;
+    uint32 distance_u32;
+
+    /* From where the desk is, if we know that already */
+    if (sc_desk_height_u16 != 0U)
+    {
+        from_height_u16 = sc_desk_height_u16;
+    }
+
+    /* Arrived is where desk control switches the state, like when the travel was measured */
+    distance_u32 = UNSIGNED_DIFF(target_height_u16, from_height_u16);
+    distance_u32 = (distance_u32 > sc_height_tolerance_u16) ? (distance_u32 - sc_height_tolerance_u16) : 0U;
+
+    return min(p_travel->start_latency_ms_u32 + ((distance_u32 * p_travel->ms_per_m_u32) / 1000U), SC_MAX_LEAD_MS_U32);
+}
+
 /*****************************************************************************/
 
 void sc_reset()
@@ -127,6 +271,16 @@ void sc_reset()
     (void)memset(sc_day_configs, 0, sizeof(DAY_CONFIG) * NUM_WEEKDAYS);
     sc_command_last_sent_e = DC_CMD_INVALID;
     sc_command_last_sent_time = {0};
+    sc_state_e = SC_STATE_INACTIVE;
+
+    sc_tracker_state_e = SC_TRACKER_IDLE;
+    sc_tracker_last_outcome_e = SC_OUTCOME_NONE;
+    (void)memset(&sc_transition_stats, 0, sizeof(SC_TRANSITION_STATS));
+    for (uint8 i = 0U; i < 2U; ++i)
+    {
+        sc_transition_stats.travel[i].start_latency_ms_u32 = SC_DEFAULT_START_LATENCY_MS_U32;
+        sc_transition_stats.travel[i].ms_per_m_u32 = SC_DEFAULT_MS_PER_M_U32;
+    }
 }
 
 SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_config, const uint16 transition_time_tolerance_u16)
@@ -146,7 +300,7 @@ SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_confi
         if ((diff_to_start_s32 >= 0) && (diff_to_end_s32 <= 0) && (p_config->interval_u16 > 0U))
         {
             /* Compute relative time within interval to determine the state */
-            relative_time_u32 = (uint16)diff_to_start_s32 % p_config->interval_u16;
+            relative_time_u32 = (uint32)diff_to_start_s32 % p_config->interval_u16;
 
             if (relative_time_u32 < transition_time_tolerance_u16)
             {
@@ -168,7 +322,7 @@ SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_confi
         else
         {
             /* State already inactive */
-            log_msg(LOG_LEVEL_DEBUG, "Scheduler", "Outside of schedule (current time %u:%u:%u, start time %u:%u:%u, end time %u:%u:%u).",
+            log_msg(LOG_LEVEL_DEBUG, sc_module_str, "Outside of schedule (current time %u:%u:%u, start time %u:%u:%u, end time %u:%u:%u).",
                     p_time->hour_u8, p_time->minute_u8, p_time->second_u8,
                     p_config->start_time.hour_u8, p_config->start_time.minute_u8, p_config->start_time.second_u8,
                     p_config->end_time.hour_u8, p_config->end_time.minute_u8, p_config->end_time.second_u8);
@@ -177,57 +331,141 @@ SCHEDULER_STATE sc_determine_state(const TIME *p_time, const DAY_CONFIG *p_confi
     else
     {
         /* State already inactive */
-        log_msg(LOG_LEVEL_INFO, "Scheduler", "Current schedule config is disabled");
+        log_msg(LOG_LEVEL_DEBUG, sc_module_str, "Current schedule config is disabled");
     }
 
     return state_e;
 }
 
-void sc_handle_target_state(const TIME *p_time, const SCHEDULER_STATE target_state_e)
+/* Asks for a transition as long before its scheduled time as the desk takes to get there, which is
+ * then kept in sc_plan_due_ms_u32. Whole seconds, like the ticks. */
+SCHEDULER_STATE sc_plan_ahead(const TIME *p_time, const DAY_CONFIG *p_config, const SCHEDULER_STATE state_e)
 {
-    DC_STATE desk_state_e;
-    DC_COMMAND command_to_send_e = DC_CMD_INVALID;
+    /* The desk has to get going before the window is over, or the transition is missed */
+    const uint16 delay_s_u16 = min(sc_delay_s_u16, (uint16)((sc_config_transition_time_tolerance_u16 > 0U) ? (sc_config_transition_time_tolerance_u16 - 1U) : 0U));
+    TIME ahead;
+    uint32 lead_s_u32;
+    uint32 elapsed_s_u32;
 
-    if (NULL != sc_desk_state_provider)
+    if ((state_e == SC_STATE_TRANSITION_SIT_TO_STAND) || (state_e == SC_STATE_TRANSITION_STAND_TO_SIT))
     {
-        if (target_state_e != SC_STATE_INACTIVE)
+        lead_s_u32 = (sc_get_lead_ms((state_e == SC_STATE_TRANSITION_SIT_TO_STAND) ? DC_STATE_STANDING : DC_STATE_SITTING) + 500U) / 1000U;
+        elapsed_s_u32 = sc_transition_elapsed(p_time, p_config, state_e);
+        if ((elapsed_s_u32 + lead_s_u32) < delay_s_u16)
         {
-            /* Figure out from desk control which state the desk is in, and which we are in */
-            desk_state_e = sc_desk_state_provider();
-            log_msg(LOG_LEVEL_INFO, "Scheduler", "Target state is %i and desk state is %i.", target_state_e, desk_state_e);
+            /* Delayed, still in the state before */
+            return (state_e == SC_STATE_TRANSITION_SIT_TO_STAND) ? SC_STATE_SITTING : SC_STATE_STANDING;
+        }
 
-            /* Now match our target state to the desk state */
-            if ((desk_state_e == DC_STATE_SITTING) && ((target_state_e == SC_STATE_SITTING) || (target_state_e == SC_STATE_TRANSITION_STAND_TO_SIT)))
-            {
-                /* Already in requested sitting state */
-            }
-            else if ((desk_state_e == DC_STATE_STANDING) && ((target_state_e == SC_STATE_STANDING) || (target_state_e == SC_STATE_TRANSITION_SIT_TO_STAND)))
-            {
-                /* Already in requested standing state) */
-            }
-            else if ((desk_state_e == DC_STATE_SITTING) && (target_state_e == SC_STATE_TRANSITION_SIT_TO_STAND))
-            {
-                command_to_send_e = DC_CMD_PRESET_3;
-            }
-            else if ((desk_state_e == DC_STATE_STANDING) && (target_state_e == SC_STATE_TRANSITION_STAND_TO_SIT))
-            {
-                command_to_send_e = DC_CMD_PRESET_4;
-            }
-            else
-            {
-                /* Command already invalid */
-            }
+        /* Right on time with a delay, or late, e.g. right after a reboot */
+        sc_plan_due_ms_u32 = millis() + (uint32)(((sint32)delay_s_u16 - (sint32)elapsed_s_u32) * 1000);
+        return state_e;
+    }
+
+    for (uint8 i = 0U; i < 2U; ++i)
+    {
+        const SCHEDULER_STATE transition_e = (i == 0U) ? SC_STATE_TRANSITION_SIT_TO_STAND : SC_STATE_TRANSITION_STAND_TO_SIT;
+
+        /* Not across midnight, tomorrow has a config of its own */
+        lead_s_u32 = (sc_get_lead_ms((i == 0U) ? DC_STATE_STANDING : DC_STATE_SITTING) + 500U) / 1000U;
+        if ((lead_s_u32 > delay_s_u16) && (time_add(p_time, &ahead, lead_s_u32 - delay_s_u16) == 0U) &&
+            (sc_determine_state(&ahead, p_config, sc_config_transition_time_tolerance_u16) == transition_e))
+        {
+            sc_plan_due_ms_u32 = millis() + ((lead_s_u32 - sc_transition_elapsed(&ahead, p_config, transition_e)) * 1000U);
+            return transition_e;
+        }
+    }
+
+    return state_e;
+}
+
+/* Seconds since the transition window began, state_e is what sc_determine_state() returned for p_time */
+uint32 sc_transition_elapsed(const TIME *p_time, const DAY_CONFIG *p_config, const SCHEDULER_STATE state_e)
+{
+    const uint32 relative_time_u32 = (uint32)time_diff(p_time, &(p_config->start_time)) % p_config->interval_u16;
+
+    return (state_e == SC_STATE_TRANSITION_STAND_TO_SIT) ? (relative_time_u32 - p_config->duration_u16) : relative_time_u32;
+}
+
+/* Mirrors sc_determine_state(), a transition stays the next one until its window is over */
+void sc_find_next_transition(const TIME *p_time, const DAY_CONFIG *p_config)
+{
+    const sint32 now_s32 = time_to_seconds(p_time);
+    const sint32 diff_to_start_s32 = time_diff(p_time, &(p_config->start_time));
+    uint32 relative_time_u32;
+    sint32 in_s32;
+
+    sc_next_valid_b = false;
+    if ((p_config->enabled <= 0) || (p_config->interval_u16 == 0U))
+    {
+        return;
+    }
+
+    if (diff_to_start_s32 < 0)
+    {
+        in_s32 = -diff_to_start_s32;
+        sc_next_target_e = DC_STATE_STANDING;
+    }
+    else
+    {
+        relative_time_u32 = (uint32)diff_to_start_s32 % p_config->interval_u16;
+        if (relative_time_u32 < sc_config_transition_time_tolerance_u16)
+        {
+            in_s32 = -(sint32)relative_time_u32;
+            sc_next_target_e = DC_STATE_STANDING;
+        }
+        else if (relative_time_u32 < (p_config->duration_u16 + sc_config_transition_time_tolerance_u16))
+        {
+            in_s32 = (sint32)p_config->duration_u16 - (sint32)relative_time_u32;
+            sc_next_target_e = DC_STATE_SITTING;
+        }
+        else
+        {
+            in_s32 = (sint32)p_config->interval_u16 - (sint32)relative_time_u32;
+            sc_next_target_e = DC_STATE_STANDING;
+        }
+    }
+
+    sc_next_second_s32 = now_s32 + in_s32;
+    sc_next_valid_b = (sc_next_second_s32 <= time_to_seconds(&(p_config->end_time)));
+}
+
+void sc_handle_target_state(const TIME *p_time, const SCHEDULER_STATE target_state_e)
+{
+    const DC_STATE desk_state_e = sc_desk_state_e; /* as last pushed by desk control */
+    DC_COMMAND command_to_send_e = DC_CMD_INVALID;
+
+    if (target_state_e != SC_STATE_INACTIVE)
+    {
+        log_msg(LOG_LEVEL_DEBUG, sc_module_str, "Target state is %i and desk state is %i.", target_state_e, desk_state_e);
 
-            sc_handle_command_request(p_time, command_to_send_e);
+        /* Now match our target state to the desk state */
+        if ((desk_state_e == DC_STATE_SITTING) && ((target_state_e == SC_STATE_SITTING) || (target_state_e == SC_STATE_TRANSITION_STAND_TO_SIT)))
+        {
+            /* Already in requested sitting state */
+        }
+        else if ((desk_state_e == DC_STATE_STANDING) && ((target_state_e == SC_STATE_STANDING) || (target_state_e == SC_STATE_TRANSITION_SIT_TO_STAND)))
+        {
+            /* Already in requested standing state) */
+        }
+        else if ((desk_state_e == DC_STATE_SITTING) && (target_state_e == SC_STATE_TRANSITION_SIT_TO_STAND))
+        {
+            command_to_send_e = DC_CMD_PRESET_3;
+        }
+        else if ((desk_state_e == DC_STATE_STANDING) && (target_state_e == SC_STATE_TRANSITION_STAND_TO_SIT))
+        {
+            command_to_send_e = DC_CMD_PRESET_4;
         }
         else
         {
-            log_msg(LOG_LEVEL_INFO, "Scheduler", "State is inactive");
+            /* Command already invalid */
         }
+
+        sc_handle_command_request(p_time, command_to_send_e);
     }
     else
     {
-        log_msg(LOG_LEVEL_ERROR, "Scheduler", "No desk state provider set");
+        log_msg(LOG_LEVEL_DEBUG, sc_module_str, "State is inactive");
     }
 }
 
@@ -236,14 +474,30 @@ void sc_handle_command_request(const TIME *p_time, const DC_COMMAND requested_co
     sint32 diff_s32;
 
     /* Check whether we have a valid command that we are allowed to send (again) */
-    if (requested_command_e != DC_CMD_INVALID)
+    if (requested_command_e == DC_CMD_INVALID)
+    {
+        /* Nothing to do, an active tracker finishes on the desk state */
+    }
+    else if (sc_tracker_state_e != SC_TRACKER_IDLE)
     {
-        /* Compute how long ago last command was sent */
+        if (requested_command_e != sc_tracker_command_e)
+        {
+            sc_tracker_finish(SC_OUTCOME_ABORTED);
+            sc_tracker_start(requested_command_e);
+        }
+        else
+        {
+            /* The tracker takes care of confirming and retrying this one */
+        }
+    }
+    else
+    {
+        /* Only hold back after a failed transition, so we do not keep hammering a desk that does not react */
         diff_s32 = time_diff(p_time, &sc_command_last_sent_time);
-        if ((requested_command_e != sc_command_last_sent_e) || ((diff_s32 >= 0) && ((uint16)diff_s32 >= sc_config_command_send_time_tolerance_u16)))
+        if ((requested_command_e != sc_command_last_sent_e) || (sc_tracker_last_outcome_e == SC_OUTCOME_REACHED) ||
+            ((diff_s32 >= 0) && ((uint16)diff_s32 >= sc_config_command_send_time_tolerance_u16)))
         {
-            /* Send the command. TODO handle failure case? */
-            (void)sc_desk_command_receiver(requested_command_e);
+            sc_tracker_start(requested_command_e);
 
             /* Store for next time */
             sc_command_last_sent_e = requested_command_e;
@@ -252,9 +506,236 @@ void sc_handle_command_request(const TIME *p_time, const DC_COMMAND requested_co
         else
         {
             /* We are not yet allowed to send the same command again */
-            log_msg(LOG_LEVEL_INFO, "Scheduler", "Want to send command %i but time diff %i to last send time too small.", requested_command_e, diff_s32);
+            log_msg(LOG_LEVEL_INFO, sc_module_str, "Want to send command %i but time diff %i to last send time too small.", requested_command_e, diff_s32);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+void sc_tracker_start(const DC_COMMAND command_e)
+{
+    sc_tracker_command_e = command_e;
+    sc_tracker_target_e = (command_e == DC_CMD_PRESET_3) ? DC_STATE_STANDING : DC_STATE_SITTING;
+    sc_tracker_attempts_u8 = 0U;
+    sc_tracker_first_sent_ms_u32 = millis();
+    sc_tracker_move_started_ms_u32 = 0U;
+    sc_tracker_due_ms_u32 = sc_plan_due_ms_u32;
+
+    sc_transition_stats.transitions_u32 += 1U;
+    TR_BEGIN(TR_TRACK_SCHEDULER, "Transition");
+    sc_tracker_send();
+}
+
+void sc_tracker_send()
+{
+    int ret = -1;
+
+    sc_tracker_attempts_u8 += 1U;
+    sc_tracker_start_height_u16 = sc_desk_height_u16;
+    TR_INSTANT(TR_TRACK_SCHEDULER, "Attempt", sc_tracker_attempts_u8);
+
+    if (NULL != sc_desk_command_receiver)
+    {
+        ret = sc_desk_command_receiver(sc_tracker_command_e);
+    }
+
+    if (ret == 0)
+    {
+        sc_tracker_state_e = SC_TRACKER_AWAIT_START;
+        tk_schedule(sc_tracker_task_s8, SC_START_TIMEOUT_MS_U32);
+    }
+    else
+    {
+        /* Could not even send it, treat it like a desk that did not react */
+        log_msg(LOG_LEVEL_WARNING, sc_module_str, "Sending command %i failed.", sc_tracker_command_e);
+        sc_tracker_state_e = SC_TRACKER_AWAIT_START;
+        sc_tracker_handle_timeout();
+    }
+}
+
+void sc_tracker_handle_height(const uint16 height_u16)
+{
+    bool moved_b;
+
+    if (sc_tracker_state_e == SC_TRACKER_AWAIT_START)
+    {
+        /* Without a reference height, any reading counts as the desk being awake and moving */
+        if (sc_tracker_start_height_u16 == 0U)
+        {
+            moved_b = true;
+        }
+        else if (sc_tracker_target_e == DC_STATE_STANDING)
+        {
+            moved_b = (height_u16 >= (sc_tracker_start_height_u16 + SC_MOVE_THRESHOLD_U16));
+        }
+        else
+        {
+            moved_b = ((height_u16 + SC_MOVE_THRESHOLD_U16) <= sc_tracker_start_height_u16);
+        }
+
+        if (moved_b)
+        {
+            sc_tracker_state_e = SC_TRACKER_MOVING;
+            sc_tracker_move_started_ms_u32 = millis();
+            TR_INSTANT(TR_TRACK_SCHEDULER, "Moving", height_u16);
+            tk_schedule(sc_tracker_task_s8, SC_STALL_TIMEOUT_MS_U32);
+        }
+        else
+        {
+            /* Not yet */
+        }
+    }
+    else if (sc_tracker_state_e == SC_TRACKER_MOVING)
+    {
+        /* Still moving, push the stall detection out */
+        tk_schedule(sc_tracker_task_s8, SC_STALL_TIMEOUT_MS_U32);
+    }
+    else
+    {
+        /* Not waiting for anything */
+    }
+}
+
+void sc_tracker_handle_desk_state(const DC_STATE desk_state_e)
+{
+    if ((sc_tracker_state_e != SC_TRACKER_IDLE) && (desk_state_e == sc_tracker_target_e))
+    {
+        if (sc_tracker_move_started_ms_u32 == 0U)
+        {
+            sc_tracker_move_started_ms_u32 = millis();
         }
+        sc_tracker_finish(SC_OUTCOME_REACHED);
+    }
+    else
+    {
+        /* Not there yet */
+    }
+}
+
+void sc_tracker_handle_timeout()
+{
+    uint32 backoff_ms_u32;
+
+    switch (sc_tracker_state_e)
+    {
+    case SC_TRACKER_AWAIT_START:
+    {
+        if (sc_tracker_attempts_u8 < SC_MAX_ATTEMPTS_U8)
+        {
+            /* The command was most likely dropped, try again a little later each time */
+            backoff_ms_u32 = SC_RETRY_BACKOFF_MS_U32 << (sc_tracker_attempts_u8 - 1U);
+            log_msg(LOG_LEVEL_WARNING, sc_module_str, "Desk did not react to command %i, retrying in %u ms.", sc_tracker_command_e, backoff_ms_u32);
+
+            sc_tracker_state_e = SC_TRACKER_BACKOFF;
+            sc_transition_stats.retries_u32 += 1U;
+            tk_schedule(sc_tracker_task_s8, backoff_ms_u32);
+        }
+        else
+        {
+            sc_tracker_finish(SC_OUTCOME_NO_REACTION);
+        }
+        break;
+    }
+    case SC_TRACKER_BACKOFF:
+    {
+        sc_tracker_send();
+        break;
+    }
+    case SC_TRACKER_MOVING:
+    {
+        /* Someone pressed a key or the desk hit something - not something a retry should override */
+        sc_tracker_finish(SC_OUTCOME_STALLED);
+        break;
     }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+void sc_tracker_finish(const SC_OUTCOME outcome_e)
+{
+    const uint32 now_ms_u32 = millis();
+    SC_TRANSITION_RECORD *p_record = &(sc_transition_stats.last);
+    EVENT event;
+
+    tk_cancel(sc_tracker_task_s8);
+    TR_INSTANT(TR_TRACK_SCHEDULER, "Outcome", outcome_e);
+    TR_END(TR_TRACK_SCHEDULER, "Transition");
+
+    p_record->command_e = sc_tracker_command_e;
+    p_record->outcome_e = outcome_e;
+    p_record->attempts_u8 = sc_tracker_attempts_u8;
+    p_record->start_latency_ms_u32 = (sc_tracker_move_started_ms_u32 > 0U) ? (sc_tracker_move_started_ms_u32 - sc_tracker_first_sent_ms_u32) : 0U;
+    p_record->total_latency_ms_u32 = now_ms_u32 - sc_tracker_first_sent_ms_u32;
+    p_record->lead_ms_u32 = max((sint32)(sc_tracker_due_ms_u32 - sc_tracker_first_sent_ms_u32), (sint32)0);
+    p_record->arrival_error_ms_s32 = 0;
+
+    if (outcome_e == SC_OUTCOME_REACHED)
+    {
+        p_record->arrival_error_ms_s32 = (sint32)(now_ms_u32 - sc_tracker_due_ms_u32);
+        sc_transition_stats.reached_u32 += 1U;
+        sc_transition_stats.arrivals_u32 += 1U;
+        sc_transition_stats.arrival_error_abs_sum_ms_u32 += (uint32)abs(p_record->arrival_error_ms_s32);
+
+        /* Retries would count as travel time */
+        if (sc_tracker_attempts_u8 == 1U)
+        {
+            sc_tracker_learn(now_ms_u32);
+        }
+
+        log_msg(LOG_LEVEL_INFO, sc_module_str, "Arrived %i ms after the scheduled time, the command went out %u ms ahead.",
+                p_record->arrival_error_ms_s32, p_record->lead_ms_u32);
+    }
+    else
+    {
+        sc_transition_stats.failed_u32 += 1U;
+    }
+
+    log_msg(LOG_LEVEL_INFO, sc_module_str, "Command %i finished with outcome %i after %u attempt(s), started moving after %u ms, done after %u ms.",
+            p_record->command_e, p_record->outcome_e, p_record->attempts_u8, p_record->start_latency_ms_u32, p_record->total_latency_ms_u32);
+
+    sc_tracker_last_outcome_e = outcome_e;
+    sc_tracker_state_e = SC_TRACKER_IDLE;
+
+    event.type_e = EV_TRANSITION_DONE;
+    event.data.p_transition = p_record;
+    ev_publish(&event);
+}
+
+void sc_tracker_learn(const uint32 now_ms_u32)
+{
+    SC_TRAVEL *p_travel = &(sc_transition_stats.travel[(sc_tracker_target_e == DC_STATE_STANDING) ? 0U : 1U]);
+    const uint16 distance_u16 = UNSIGNED_DIFF(sc_desk_height_u16, sc_tracker_start_height_u16);
+    const uint32 start_latency_ms_u32 = sc_tracker_move_started_ms_u32 - sc_tracker_first_sent_ms_u32;
+    const uint32 travel_ms_u32 = now_ms_u32 - sc_tracker_move_started_ms_u32;
+    uint32 ms_per_m_u32;
+
+    /* Needs a height to start from and a move long enough to be more than acceleration */
+    if ((sc_tracker_start_height_u16 == 0U) || (distance_u16 < SC_LEARN_MIN_DISTANCE_U16) || (travel_ms_u32 == 0U))
+    {
+        return;
+    }
+
+    ms_per_m_u32 = (travel_ms_u32 * 1000U) / distance_u16;
+    if (p_travel->samples_u16 == 0U)
+    {
+        /* The defaults are only a guess, the first measurement replaces them */
+        p_travel->start_latency_ms_u32 = start_latency_ms_u32;
+        p_travel->ms_per_m_u32 = ms_per_m_u32;
+    }
+    else
+    {
+        p_travel->start_latency_ms_u32 += ((sint32)start_latency_ms_u32 - (sint32)p_travel->start_latency_ms_u32) / SC_LEARN_WEIGHT_S32;
+        p_travel->ms_per_m_u32 += ((sint32)ms_per_m_u32 - (sint32)p_travel->ms_per_m_u32) / SC_LEARN_WEIGHT_S32;
+    }
+    p_travel->samples_u16 += (p_travel->samples_u16 < 0xffffU) ? 1U : 0U;
+
+    log_msg(LOG_LEVEL_INFO, sc_module_str, "Travel %s: %u ms to start, %u ms/m (%u mm in %u ms).",
+            (sc_tracker_target_e == DC_STATE_STANDING) ? "up" : "down", p_travel->start_latency_ms_u32, p_travel->ms_per_m_u32,
+            (unsigned)distance_u16, travel_ms_u32);
 }
 
 /*****************************************************************************/
@@ -5,15 +5,55 @@
 
 /*****************************************************************************/
 
+/* What the schedule asks for right now, the numbers go out in the UDP status */
+typedef enum
+{
+    SC_STATE_INACTIVE = 0,
+    SC_STATE_TRANSITION_SIT_TO_STAND,
+    SC_STATE_TRANSITION_STAND_TO_SIT,
+    SC_STATE_SITTING,
+    SC_STATE_STANDING
+} SCHEDULER_STATE;
+
+/* Learned from the height telemetry of transitions that went through on the first attempt */
+typedef struct
+{
+    uint32 start_latency_ms_u32; /* command until the desk moves, includes the PIN20 activation */
+    uint32 ms_per_m_u32;         /* travel time, so it still fits when the preset heights change */
+    uint16 samples_u16;          /* 0 while the defaults are used */
+} SC_TRAVEL;
+
+typedef struct
+{
+    uint32 transitions_u32;
+    uint32 reached_u32;
+    uint32 failed_u32;
+    uint32 retries_u32;
+    uint32 arrivals_u32;                 /* reached transitions with a scheduled time */
+    uint32 arrival_error_abs_sum_ms_u32; /* divided by arrivals_u32 for the mean error */
+    SC_TRAVEL travel[2];                 /* up, down */
+    SC_TRANSITION_RECORD last;
+} SC_TRANSITION_STATS;
+
+/*****************************************************************************/
+
 extern void sc_init();
-extern void sc_loop();
 
-extern void sc_set_desk_state_provider(fn_desk_state_provider p_desk_state_provider);
 extern void sc_set_desk_command_receiver(fn_command_receiver p_command_receiver);
-extern void sc_set_time_provider(fn_time_provider p_time_provider);
 
 extern void sc_set_day_configs(const DAY_CONFIG configs[NUM_WEEKDAYS]);
 extern void sc_set_day_config(const WEEKDAY day_e, const DAY_CONFIG *p_config);
+extern void sc_get_day_configs(DAY_CONFIG configs[NUM_WEEKDAYS]);
+
+extern void sc_set_tolerances(const uint16 transition_time_tolerance_u16, const uint16 command_send_time_tolerance_u16);
+extern void sc_get_tolerances(uint16 *p_transition_time_tolerance_u16, uint16 *p_command_send_time_tolerance_u16);
+
+extern SCHEDULER_STATE sc_get_state();
+extern uint32 sc_get_lead_ms(const DC_STATE target_e); /* how far ahead of a transition the command goes out */
+extern bool sc_get_next_transition(uint32 *p_second_u32, DC_STATE *p_target_e); /* second of the day, false if there is none today */
+extern void sc_set_transition_delay(const uint16 delay_s_u16);                  /* for the next transition, below the transition tolerance */
+extern const SC_TRANSITION_STATS *sc_get_transition_stats();
+extern bool sc_is_tracking(); /* a transition command is in flight, until its outcome */
 
 /*****************************************************************************/
 
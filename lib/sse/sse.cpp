@@ -0,0 +1,303 @@
+#include "sse.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deskcontrol.h"
+#include "events.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+
+/*****************************************************************************/
+
+typedef enum
+{
+    SSE_ITEM_HEIGHT = 0,
+    SSE_ITEM_STATE,
+    SSE_ITEM_TRANSITION
+} SSE_ITEM_TYPE;
+
+typedef struct
+{
+    SSE_ITEM_TYPE type_e;
+    union
+    {
+        uint16 height_u16;
+        DC_STATE state_e;
+        SC_TRANSITION_RECORD transition;
+    } data;
+} SSE_ITEM;
+
+typedef struct
+{
+    HTTP_CONN *p_conn; /* NULL if the slot is free */
+    SSE_ITEM queue[SSE_QUEUE_SIZE];
+    uint8 head_u8;
+    uint8 count_u8;
+    uint32 last_write_ms_u32;
+} SSE_CLIENT;
+
+/*****************************************************************************/
+
+const uint32 SSE_HEARTBEAT_MS_U32 = 15000U; /* lets proxies and us notice dead clients */
+const char sse_module_str[] PROGMEM = "SSE";
+const char *sse_item_names[] = {"height", "state", "transition"};
+const char *sse_outcome_names[] = {"none", "reached", "no_reaction", "stalled", "aborted"};
+
+/*****************************************************************************/
+
+SSE_CLIENT sse_clients[SSE_MAX_CLIENTS];
+SSE_STATS sse_stats = {0};
+
+/*****************************************************************************/
+
+void sse_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void sse_handle_done(HTTP_CONN *p_conn);
+void sse_handle_event(const EVENT *p_event);
+bool sse_produce(HTTP_CONN *p_conn);
+
+void sse_enqueue(SSE_CLIENT *p_client, const SSE_ITEM *p_item);
+uint16 sse_render(const SSE_ITEM *p_item, char *p_buffer, const uint16 size_u16);
+
+/*****************************************************************************/
+
+void sse_init()
+{
+    (void)memset(sse_clients, 0, sizeof(sse_clients));
+    (void)memset(&sse_stats, 0, sizeof(SSE_STATS));
+
+    /* Heights come straight from the deskcontrol parse path */
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, sse_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, sse_handle_event);
+    (void)ev_subscribe(EV_TRANSITION_DONE, sse_handle_event);
+
+    (void)http_on(HTTP_METHOD_GET, "/api/events", sse_handle_request);
+}
+
+const SSE_STATS *sse_get_stats()
+{
+    return &sse_stats;
+}
+
+/*****************************************************************************/
+
+void sse_handle_request(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    SSE_CLIENT *p_client = NULL;
+    SSE_ITEM item;
+    uint8 index_u8 = 0U;
+
+    for (uint8 i = 0U; (i < SSE_MAX_CLIENTS) && (NULL == p_client); ++i)
+    {
+        if (NULL == sse_clients[i].p_conn)
+        {
+            p_client = &sse_clients[i];
+            index_u8 = i;
+        }
+    }
+
+    if (NULL == p_client)
+    {
+        sse_stats.rejected_u32 += 1U;
+        http_send(p_conn, 503, "text/plain", "Too many event streams");
+        return;
+    }
+
+    sse_stats.clients_u32 += 1U;
+    p_client->p_conn = p_conn;
+    p_client->head_u8 = 0U;
+    p_client->count_u8 = 0U;
+    p_client->last_write_ms_u32 = millis();
+
+    http_begin_response(p_conn, 200, "text/event-stream", HTTP_LENGTH_CHUNKED, "Cache-Control: no-cache\r\n");
+    http_set_producer(p_conn, sse_produce);
+    *http_producer_state(p_conn) = index_u8;
+    http_set_done_handler(p_conn, sse_handle_done);
+
+    /* Start with where the desk is right now */
+    item.type_e = SSE_ITEM_HEIGHT;
+    item.data.height_u16 = dc_get_current_height();
+    sse_enqueue(p_client, &item);
+    item.type_e = SSE_ITEM_STATE;
+    item.data.state_e = dc_get_current_state();
+    sse_enqueue(p_client, &item);
+}
+
+void sse_handle_done(HTTP_CONN *p_conn)
+{
+    for (uint8 i = 0U; i < SSE_MAX_CLIENTS; ++i)
+    {
+        if (sse_clients[i].p_conn == p_conn)
+        {
+            sse_clients[i].p_conn = NULL;
+            sse_stats.clients_u32 -= 1U;
+        }
+    }
+}
+
+void sse_handle_event(const EVENT *p_event)
+{
+    SSE_ITEM item;
+
+    switch (p_event->type_e)
+    {
+    case EV_HEIGHT_CHANGED:
+    {
+        item.type_e = SSE_ITEM_HEIGHT;
+        item.data.height_u16 = p_event->data.height_u16;
+        break;
+    }
+    case EV_DESK_STATE_CHANGED:
+    {
+        item.type_e = SSE_ITEM_STATE;
+        item.data.state_e = p_event->data.desk_state_e;
+        break;
+    }
+    case EV_TRANSITION_DONE:
+    {
+        item.type_e = SSE_ITEM_TRANSITION;
+        item.data.transition = *(p_event->data.p_transition);
+        break;
+    }
+    default:
+    {
+        return;
+    }
+    }
+
+    for (uint8 i = 0U; i < SSE_MAX_CLIENTS; ++i)
+    {
+        if (NULL != sse_clients[i].p_conn)
+        {
+            sse_enqueue(&sse_clients[i], &item);
+            http_wake(sse_clients[i].p_conn);
+        }
+    }
+}
+
+bool sse_produce(HTTP_CONN *p_conn)
+{
+    SSE_CLIENT *p_client = &sse_clients[*http_producer_state(p_conn)];
+    const uint32 now_ms_u32 = millis();
+    uint16 size_u16;
+    uint16 used_u16 = 0U;
+    uint16 item_size_u16;
+    char *p_buffer = http_tx_reserve(p_conn, &size_u16);
+
+    /* Only called once everything before went out, so this is as fast as the client reads */
+    while (p_client->count_u8 > 0U)
+    {
+        item_size_u16 = sse_render(&(p_client->queue[p_client->head_u8]), &p_buffer[used_u16], size_u16 - used_u16);
+        if (item_size_u16 == 0U)
+        {
+            break;
+        }
+
+        used_u16 += item_size_u16;
+        p_client->head_u8 = (p_client->head_u8 + 1U) % SSE_QUEUE_SIZE;
+        p_client->count_u8 -= 1U;
+        sse_stats.sent_u32 += 1U;
+    }
+
+    if ((used_u16 == 0U) && ((now_ms_u32 - p_client->last_write_ms_u32) >= SSE_HEARTBEAT_MS_U32) && (size_u16 >= 3U))
+    {
+        (void)memcpy(p_buffer, ":\n\n", 3U);
+        used_u16 = 3U;
+    }
+
+    if (used_u16 > 0U)
+    {
+        p_client->last_write_ms_u32 = now_ms_u32;
+    }
+    http_tx_commit(p_conn, used_u16);
+
+    /* The stream only ends with the connection */
+    return false;
+}
+
+/*****************************************************************************/
+
+void sse_enqueue(SSE_CLIENT *p_client, const SSE_ITEM *p_item)
+{
+    uint8 index_u8;
+
+    /* Height and state only matter with their latest value, so replace what did not go out yet */
+    if (p_item->type_e != SSE_ITEM_TRANSITION)
+    {
+        for (uint8 i = 0U; i < p_client->count_u8; ++i)
+        {
+            index_u8 = (p_client->head_u8 + i) % SSE_QUEUE_SIZE;
+            if (p_client->queue[index_u8].type_e == p_item->type_e)
+            {
+                p_client->queue[index_u8] = *p_item;
+                sse_stats.coalesced_u32 += 1U;
+                return;
+            }
+        }
+    }
+
+    if (p_client->count_u8 < SSE_QUEUE_SIZE)
+    {
+        p_client->queue[(p_client->head_u8 + p_client->count_u8) % SSE_QUEUE_SIZE] = *p_item;
+        p_client->count_u8 += 1U;
+    }
+    else
+    {
+        sse_stats.dropped_u32 += 1U;
+    }
+}
+
+uint16 sse_render(const SSE_ITEM *p_item, char *p_buffer, const uint16 size_u16)
+{
+    JSON_WRITER writer;
+    int prefix_i;
+
+    prefix_i = snprintf(p_buffer, size_u16, "event: %s\ndata: ", sse_item_names[p_item->type_e]);
+    if ((prefix_i < 0) || ((prefix_i + 2) >= (int)size_u16))
+    {
+        return 0U;
+    }
+
+    /* Leave room for the blank line that ends the event */
+    json_init(&writer, &p_buffer[prefix_i], size_u16 - (uint16)prefix_i - 2U);
+    json_object_begin(&writer, NULL);
+    switch (p_item->type_e)
+    {
+    case SSE_ITEM_HEIGHT:
+    {
+        json_add_uint(&writer, "height", p_item->data.height_u16);
+        break;
+    }
+    case SSE_ITEM_STATE:
+    {
+        json_add_string(&writer, "state", (p_item->data.state_e == DC_STATE_STANDING) ? "standing" : ((p_item->data.state_e == DC_STATE_SITTING) ? "sitting" : "unknown"));
+        break;
+    }
+    case SSE_ITEM_TRANSITION:
+    {
+        json_add_uint(&writer, "command", p_item->data.transition.command_e);
+        json_add_string(&writer, "outcome", sse_outcome_names[p_item->data.transition.outcome_e]);
+        json_add_uint(&writer, "attempts", p_item->data.transition.attempts_u8);
+        json_add_uint(&writer, "start_latency_ms", p_item->data.transition.start_latency_ms_u32);
+        json_add_uint(&writer, "total_latency_ms", p_item->data.transition.total_latency_ms_u32);
+        json_add_uint(&writer, "lead_ms", p_item->data.transition.lead_ms_u32);
+        json_add_int(&writer, "arrival_error_ms", p_item->data.transition.arrival_error_ms_s32);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+    json_object_end(&writer);
+
+    if (json_overflow(&writer))
+    {
+        return 0U;
+    }
+
+    (void)memcpy(&p_buffer[prefix_i + json_length(&writer)], "\n\n", 2U);
+
+    return (uint16)prefix_i + json_length(&writer) + 2U;
+}
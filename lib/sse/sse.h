@@ -0,0 +1,31 @@
+#ifndef SSE_MAIN_H
+#define SSE_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define SSE_MAX_CLIENTS 2U
+#define SSE_QUEUE_SIZE 8U /* pending events per client */
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 clients_u32; /* streams open right now */
+    uint32 rejected_u32;
+    uint32 sent_u32;
+    uint32 coalesced_u32; /* replaced by a newer value before it went out */
+    uint32 dropped_u32;   /* queue was full */
+} SSE_STATS;
+
+/*****************************************************************************/
+
+extern void sse_init();
+extern const SSE_STATS *sse_get_stats();
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,395 @@
+#include "stagger.h"
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <string.h>
+
+#include "api.h"
+#include "deskcontrol.h"
+#include "events.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+#include "scheduler.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+#define SG_MAGIC 0x5346U /* "FS" on the wire */
+#define SG_VERSION 1U
+
+/*****************************************************************************/
+
+/* Sent to the group by every desk that is going to move for a transition, little endian */
+typedef struct __attribute__((packed))
+{
+    uint16_t magic_u16;
+    uint8_t version_u8;
+    uint8_t target_u8;   /* DC_STATE the desk moves to */
+    uint32_t node_u32;   /* chip id, orders the desks */
+    uint32_t second_u32; /* second of the day the transition is scheduled for, local time */
+} SG_ANNOUNCE;
+
+typedef struct
+{
+    uint32 node_u32; /* 0 for an unused entry */
+    uint32 second_u32;
+    uint8 target_u8;
+    uint32 heard_ms_u32;
+} SG_PEER;
+
+/*****************************************************************************/
+
+const char sg_module_str[] PROGMEM = "Stagger";
+const uint32 SG_ANNOUNCE_PERIOD_MS_U32 = 2000U;
+const uint32 SG_PEER_TIMEOUT_MS_U32 = 10000U; /* five announcements in a row lost */
+const uint32 SG_HORIZON_S_U32 = 120U;         /* announcing starts this long before a transition, more than any lead */
+
+/*****************************************************************************/
+
+IPAddress sg_group(239U, 255U, 70U, 68U);
+WiFiUDP sg_udp;
+uint16 sg_port_u16 = SG_DEFAULT_PORT;
+uint16 sg_window_s_u16 = 0U;
+uint32 sg_node_u32 = 0U;
+bool sg_running_b = false;
+SG_PEER sg_peers[SG_MAX_PEERS];
+SG_STATS sg_stats;
+
+/* The transition being coordinated */
+bool sg_active_b = false;
+bool sg_moving_b = false; /* only desks that are not there already take a slot */
+uint32 sg_second_u32 = 0U;
+uint8 sg_target_u8 = DC_STATE_UNKNOWN;
+uint32 sg_last_announce_ms_u32 = 0U;
+uint8 sg_desks_u8 = 1U;
+uint8 sg_slot_u8 = 0U;
+uint16 sg_delay_s_u16 = 0U;
+
+/*****************************************************************************/
+
+void sg_handle_event(const EVENT *p_event);
+void sg_handle_link(const bool link_up_b);
+void sg_handle_tick(const DATETIME *p_time);
+void sg_reset_delay();
+void sg_assign_slot();
+void sg_announce();
+bool sg_ready();
+void sg_receive();
+void sg_get_stagger(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void sg_put_stagger(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+
+/*****************************************************************************/
+
+void sg_init(const uint16 port_u16, const uint16 window_s_u16)
+{
+    sg_port_u16 = port_u16;
+    sg_node_u32 = ESP.getChipId();
+    sg_running_b = false;
+    (void)memset(&sg_stats, 0, sizeof(sg_stats));
+    (void)memset(sg_peers, 0, sizeof(sg_peers));
+
+    /* The group is joined once we have a link */
+    (void)ev_subscribe(EV_LINK_CHANGED, sg_handle_event);
+    (void)ev_subscribe(EV_SECOND_TICK, sg_handle_event);
+    (void)tk_add_io_hook("Stagger", sg_ready, sg_receive);
+
+    (void)http_on(HTTP_METHOD_GET, "/api/stagger", sg_get_stagger);
+    (void)http_on(HTTP_METHOD_PUT, "/api/stagger", sg_put_stagger);
+
+    /* The stored window replaces this one once the config is applied */
+    (void)ev_subscribe(EV_CONFIG_CHANGED, sg_handle_event);
+    sg_set_window(window_s_u16);
+}
+
+void sg_set_window(const uint16 window_s_u16)
+{
+    sg_window_s_u16 = min(window_s_u16, (uint16)SG_MAX_WINDOW_S);
+    log_msg(LOG_LEVEL_INFO, sg_module_str, "Spreading transitions over %u s.", (unsigned)sg_window_s_u16);
+}
+
+uint16 sg_get_window()
+{
+    return sg_window_s_u16;
+}
+
+const SG_STATS *sg_get_stats()
+{
+    return &sg_stats;
+}
+
+/*****************************************************************************/
+
+void sg_handle_event(const EVENT *p_event)
+{
+    if (p_event->type_e == EV_LINK_CHANGED)
+    {
+        sg_handle_link(p_event->data.link_up_b);
+    }
+    else if (p_event->type_e == EV_CONFIG_CHANGED)
+    {
+        /* Every config change comes through here, only log actual changes */
+        if (p_event->data.p_config->stagger_window_s_u16 != sg_window_s_u16)
+        {
+            sg_set_window(p_event->data.p_config->stagger_window_s_u16);
+        }
+        else
+        {
+            /* Unchanged */
+        }
+    }
+    else
+    {
+        sg_handle_tick(p_event->data.p_time);
+    }
+}
+
+void sg_handle_link(const bool link_up_b)
+{
+    if (link_up_b && !sg_running_b)
+    {
+        sg_running_b = (sg_udp.beginMulticast(WiFi.localIP(), sg_group, sg_port_u16) != 0U);
+        if (!sg_running_b)
+        {
+            log_msg(LOG_LEVEL_ERROR, sg_module_str, "Cannot join the group on UDP port %u.", (unsigned)sg_port_u16);
+        }
+        else
+        {
+            /* Nothing to tell */
+        }
+    }
+    else if (!link_up_b && sg_running_b)
+    {
+        /* Peers that cannot be heard do not count, the schedule runs on local time alone */
+        sg_udp.stop();
+        sg_running_b = false;
+        sg_reset_delay();
+    }
+    else
+    {
+        /* Nothing changed */
+    }
+}
+
+void sg_handle_tick(const DATETIME *p_time)
+{
+    uint32 second_u32;
+    DC_STATE target_e;
+    const bool next_b = sc_get_next_transition(&second_u32, &target_e);
+    const sint32 in_s32 = (sint32)second_u32 - time_to_seconds(&(p_time->time));
+
+    if (!sg_running_b || (sg_window_s_u16 == 0U) || !next_b || (in_s32 > (sint32)SG_HORIZON_S_U32))
+    {
+        sg_reset_delay();
+        return;
+    }
+
+    if (!sg_active_b || (second_u32 != sg_second_u32) || (target_e != sg_target_u8))
+    {
+        /* Decided once per transition, a desk that drops out halfway would shift the slots of all others */
+        sg_active_b = true;
+        sg_moving_b = (dc_get_current_state() != target_e);
+        sg_second_u32 = second_u32;
+        sg_target_u8 = (uint8)target_e;
+        sg_last_announce_ms_u32 = millis() - SG_ANNOUNCE_PERIOD_MS_U32;
+        sg_desks_u8 = 1U;
+        sg_slot_u8 = 0U;
+        sg_delay_s_u16 = 0U;
+    }
+
+    if (sg_moving_b)
+    {
+        if ((millis() - sg_last_announce_ms_u32) >= SG_ANNOUNCE_PERIOD_MS_U32)
+        {
+            sg_announce();
+        }
+        sg_assign_slot();
+    }
+
+    sc_set_transition_delay(sg_delay_s_u16);
+}
+
+void sg_reset_delay()
+{
+    sg_active_b = false;
+    sg_desks_u8 = 1U;
+    sg_slot_u8 = 0U;
+    sg_delay_s_u16 = 0U;
+    sc_set_transition_delay(0U);
+}
+
+/* Every desk sorts the same announcements the same way, so they end up in different slots without talking it over */
+void sg_assign_slot()
+{
+    const uint32 now_ms_u32 = millis();
+    uint8 desks_u8 = 1U;
+    uint8 slot_u8 = 0U;
+
+    for (uint8 i = 0U; i < SG_MAX_PEERS; ++i)
+    {
+        const SG_PEER *p_peer = &sg_peers[i];
+
+        if ((p_peer->node_u32 != 0U) && ((now_ms_u32 - p_peer->heard_ms_u32) < SG_PEER_TIMEOUT_MS_U32) &&
+            (p_peer->second_u32 == sg_second_u32) && (p_peer->target_u8 == sg_target_u8))
+        {
+            desks_u8 += 1U;
+            slot_u8 += (p_peer->node_u32 < sg_node_u32) ? 1U : 0U;
+        }
+    }
+
+    if ((desks_u8 != sg_desks_u8) || (slot_u8 != sg_slot_u8))
+    {
+        sg_desks_u8 = desks_u8;
+        sg_slot_u8 = slot_u8;
+        sg_delay_s_u16 = (uint16)(((uint32)slot_u8 * sg_window_s_u16) / desks_u8);
+        log_msg(LOG_LEVEL_INFO, sg_module_str, "Slot %u of %u desks, starting %u s later.", (unsigned)slot_u8, (unsigned)desks_u8, (unsigned)sg_delay_s_u16);
+    }
+    else
+    {
+        /* Same as last second */
+    }
+}
+
+void sg_announce()
+{
+    SG_ANNOUNCE announce;
+
+    announce.magic_u16 = SG_MAGIC;
+    announce.version_u8 = SG_VERSION;
+    announce.target_u8 = sg_target_u8;
+    announce.node_u32 = sg_node_u32;
+    announce.second_u32 = sg_second_u32;
+
+    sg_last_announce_ms_u32 = millis();
+    if ((sg_udp.beginPacketMulticast(sg_group, sg_port_u16, WiFi.localIP()) != 0) &&
+        (sg_udp.write((const uint8 *)&announce, sizeof(announce)) == sizeof(announce)) && (sg_udp.endPacket() != 0))
+    {
+        sg_stats.announcements_u32 += 1U;
+    }
+    else
+    {
+        /* Peers keep the last one for a while, the next one goes out in two seconds */
+    }
+}
+
+/* Fetches the next datagram into the UDP buffer, sg_receive() reads it from there */
+bool sg_ready()
+{
+    return sg_running_b && (sg_udp.parsePacket() > 0);
+}
+
+void sg_receive()
+{
+    const uint32 now_ms_u32 = millis();
+    SG_ANNOUNCE announce;
+    SG_PEER *p_free = NULL;
+    SG_PEER *p_peer = NULL;
+    const int size_i = sg_udp.read((uint8 *)&announce, sizeof(announce));
+
+    if ((size_i < (int)sizeof(announce)) || (announce.magic_u16 != SG_MAGIC) || (announce.version_u8 != SG_VERSION) || (announce.node_u32 == 0U))
+    {
+        sg_stats.invalid_u32 += 1U;
+        return;
+    }
+    if (announce.node_u32 == sg_node_u32)
+    {
+        /* Our own, looped back */
+        return;
+    }
+
+    for (uint8 i = 0U; (i < SG_MAX_PEERS) && (NULL == p_peer); ++i)
+    {
+        if (sg_peers[i].node_u32 == announce.node_u32)
+        {
+            p_peer = &sg_peers[i];
+        }
+        else if ((NULL == p_free) && ((sg_peers[i].node_u32 == 0U) || ((now_ms_u32 - sg_peers[i].heard_ms_u32) >= SG_PEER_TIMEOUT_MS_U32)))
+        {
+            p_free = &sg_peers[i];
+        }
+        else
+        {
+            /* Someone else */
+        }
+    }
+
+    p_peer = (NULL != p_peer) ? p_peer : p_free;
+    if (NULL == p_peer)
+    {
+        sg_stats.table_full_u32 += 1U;
+        return;
+    }
+
+    sg_stats.received_u32 += 1U;
+    p_peer->node_u32 = announce.node_u32;
+    p_peer->second_u32 = announce.second_u32;
+    p_peer->target_u8 = announce.target_u8;
+    p_peer->heard_ms_u32 = now_ms_u32;
+}
+
+/*****************************************************************************/
+
+void sg_get_stagger(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    char response_str[256];
+    JSON_WRITER writer;
+
+    json_init(&writer, response_str, sizeof(response_str) - 1U);
+    json_object_begin(&writer, NULL);
+    json_add_uint(&writer, "window", sg_window_s_u16);
+    json_add_uint(&writer, "port", sg_port_u16);
+    json_add_uint(&writer, "node", sg_node_u32);
+    json_add_bool(&writer, "coordinating", sg_active_b && sg_moving_b);
+    json_add_uint(&writer, "desks", sg_desks_u8);
+    json_add_uint(&writer, "slot", sg_slot_u8);
+    json_add_uint(&writer, "delay_s", sg_delay_s_u16);
+    json_add_uint(&writer, "announcements", sg_stats.announcements_u32);
+    json_add_uint(&writer, "received", sg_stats.received_u32);
+    json_add_uint(&writer, "invalid", sg_stats.invalid_u32);
+    json_add_uint(&writer, "table_full", sg_stats.table_full_u32);
+    json_object_end(&writer);
+    response_str[json_length(&writer)] = '\0';
+
+    http_send(p_conn, 200, "application/json", response_str);
+}
+
+void sg_put_stagger(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JSON_READER reader;
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    sint32 window_s32 = -1;
+    bool valid_b = true;
+
+    /* {"window": 45}, 0 turns it off */
+    json_reader_init(&reader, p_request->body.p_data, p_request->body.size_u16);
+    valid_b = (json_next(&reader, &key) == JSON_TOKEN_OBJECT_BEGIN);
+    while (valid_b && (json_next(&reader, &key) == JSON_TOKEN_STRING) && (json_next(&reader, &value) != JSON_TOKEN_ERROR))
+    {
+        if (json_token_equals(&key, "window") && (value.type_e == JSON_TOKEN_NUMBER) && (value.number_s32 >= 0) && (value.number_s32 <= (sint32)SG_MAX_WINDOW_S))
+        {
+            window_s32 = value.number_s32;
+        }
+        else if (json_token_equals(&key, "window") || !json_skip(&reader, &value))
+        {
+            valid_b = false;
+        }
+        else
+        {
+            /* Ignore unknown keys */
+        }
+    }
+
+    if (valid_b && (window_s32 >= 0))
+    {
+        sg_set_window((uint16)window_s32);
+        api_store_config();
+        sg_get_stagger(p_conn, p_request);
+    }
+    else
+    {
+        http_send(p_conn, 400, "application/json", "{\"error\":\"expected {\\\"window\\\": 0-300}\"}");
+    }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,33 @@
+#ifndef SG_MAIN_H
+#define SG_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define SG_DEFAULT_PORT 4210U   /* UDP, every desk listens on the same group and port */
+#define SG_MAX_PEERS 64U        /* desks announcing a transition at the same time, more are not taken into account */
+#define SG_MAX_WINDOW_S 300U
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 announcements_u32; /* sent */
+    uint32 received_u32;      /* announcements of other desks */
+    uint32 invalid_u32;       /* datagrams that were not ours or too short */
+    uint32 table_full_u32;    /* announcements dropped because SG_MAX_PEERS desks were already known */
+} SG_STATS;
+
+/*****************************************************************************/
+
+extern void sg_init(const uint16 port_u16, const uint16 window_s_u16);
+extern void sg_set_window(const uint16 window_s_u16); /* seconds the start times are spread over, 0 turns it off */
+extern uint16 sg_get_window();
+extern const SG_STATS *sg_get_stats();
+
+/*****************************************************************************/
+
+#endif
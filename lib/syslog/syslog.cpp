@@ -0,0 +1,355 @@
+#include "syslog.h"
+
+#include <WiFiUdp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "api.h"
+#include "events.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+#include "network.h"
+#include "ntp.h"
+#include "tasks.h"
+
+/*****************************************************************************/
+
+#define SL_HEADER_RESERVE 192U /* "<PRI>1 TIMESTAMP HOSTNAME APP - - [SD] " with the longest hostname */
+#define SL_MAX_HOSTNAME_SIZE 33U
+#define SL_FACILITY_LOCAL0 16U
+
+/*****************************************************************************/
+
+/* Lines are added behind the space reserved for the header, which is put right in front of them when the batch is closed */
+typedef struct
+{
+    uint16 start_u16; /* first byte of the header */
+    uint16 size_u16;  /* from start_u16 */
+    uint16 records_u16;
+    char data_str[SL_DATAGRAM_SIZE];
+} SL_DATAGRAM;
+
+/*****************************************************************************/
+
+const char sl_module_str[] PROGMEM = "Syslog";
+const uint32 SL_MAX_BATCH_AGE_MS_U32 = 20000U; /* a few datagrams per minute at most when idle */
+const uint8 sl_severities[] = {7U, 2U, 3U, 4U, 6U, 7U}; /* RFC 5424 severity of each LOG_LEVEL */
+const char sl_level_chars[] = "-CEWID";
+
+/*****************************************************************************/
+
+WiFiUDP sl_udp;
+IPAddress sl_server_ip;
+uint16 sl_server_port_u16 = 0U; /* 0 while turned off */
+char sl_hostname_str[SL_MAX_HOSTNAME_SIZE];
+sint8 sl_flush_task_s8 = TK_INVALID_TASK;
+SL_STATS sl_stats;
+uint32 sl_lost_records_u32 = 0U; /* since the last datagram, reported in it */
+
+/* Closed datagrams from the head on, the batch being filled right behind them */
+SL_DATAGRAM sl_queue[SL_QUEUE_DEPTH];
+uint8 sl_queue_head_u8 = 0U;
+uint8 sl_queue_count_u8 = 0U;
+SL_DATAGRAM *sl_batch_p = NULL;
+uint8 sl_batch_severity_u8 = 7U;
+uint32 sl_batch_start_ms_u32 = 0U;
+uint32 sl_batch_utc_u32 = 0U;
+
+/*****************************************************************************/
+
+void sl_handle_line(const LOG_LEVEL level_e, const char *p_line, const uint16 size_u16);
+void sl_handle_event(const EVENT *p_event);
+void sl_apply_server(const IPAddress &address, const uint16 port_u16);
+void sl_close_batch();
+bool sl_send_ready();
+void sl_send();
+void sl_get_syslog(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void sl_put_syslog(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+
+/*****************************************************************************/
+
+void sl_init(const char *p_hostname, const char *p_server, const uint16 port_u16)
+{
+    (void)memset(&sl_stats, 0, sizeof(sl_stats));
+    (void)snprintf(sl_hostname_str, sizeof(sl_hostname_str), "%s", p_hostname);
+
+    sl_flush_task_s8 = tk_add_oneshot("Syslog flush", sl_close_batch);
+    (void)tk_add_io_hook("Syslog", sl_send_ready, sl_send);
+    log_set_sink(sl_handle_line);
+
+    (void)http_on(HTTP_METHOD_GET, "/api/syslog", sl_get_syslog);
+    (void)http_on(HTTP_METHOD_PUT, "/api/syslog", sl_put_syslog);
+
+    /* The stored server replaces this one once the config is applied */
+    (void)ev_subscribe(EV_CONFIG_CHANGED, sl_handle_event);
+    (void)sl_set_server(p_server, port_u16);
+}
+
+bool sl_set_server(const char *p_server, const uint16 port_u16)
+{
+    IPAddress address;
+
+    /* Only addresses, a DNS lookup would block the loop */
+    if ((NULL == p_server) || (p_server[0] == '\0'))
+    {
+        sl_apply_server(IPAddress(), 0U);
+    }
+    else if (address.fromString(p_server) && ((uint32)address != 0U) && (port_u16 != 0U))
+    {
+        sl_apply_server(address, port_u16);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void sl_get_server(uint8 *p_server_vu8, uint16 *p_port_u16)
+{
+    for (uint8 i = 0U; i < 4U; ++i)
+    {
+        p_server_vu8[i] = (sl_server_port_u16 != 0U) ? sl_server_ip[i] : 0U;
+    }
+    *p_port_u16 = sl_server_port_u16;
+}
+
+const SL_STATS *sl_get_stats()
+{
+    return &sl_stats;
+}
+
+/*****************************************************************************/
+
+void sl_handle_event(const EVENT *p_event)
+{
+    const uint8 *p_server_vu8 = p_event->data.p_config->syslog_server_vu8;
+    const IPAddress address(p_server_vu8[0], p_server_vu8[1], p_server_vu8[2], p_server_vu8[3]);
+
+    sl_apply_server(address, ((uint32)address != 0U) ? p_event->data.p_config->syslog_port_u16 : 0U);
+}
+
+void sl_apply_server(const IPAddress &address, const uint16 port_u16)
+{
+    /* Every config change comes through here, only log actual changes */
+    if ((port_u16 == sl_server_port_u16) && ((port_u16 == 0U) || ((uint32)address == (uint32)sl_server_ip)))
+    {
+        return;
+    }
+
+    sl_server_ip = address;
+    sl_server_port_u16 = port_u16;
+    if (port_u16 != 0U)
+    {
+        log_msg(LOG_LEVEL_INFO, sl_module_str, "Sending log to %u.%u.%u.%u:%u.", address[0], address[1], address[2], address[3], (unsigned)port_u16);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_INFO, sl_module_str, "Log shipping turned off.");
+    }
+}
+
+void sl_handle_line(const LOG_LEVEL level_e, const char *p_line, const uint16 size_u16)
+{
+    const uint32 now_ms_u32 = millis();
+    const uint8 level_u8 = min((uint8)level_e, (uint8)LOG_LEVEL_DEBUG);
+    char prefix_str[16];
+    uint16 prefix_u16;
+    uint16 line_u16;
+
+    if (sl_server_port_u16 == 0U)
+    {
+        return;
+    }
+
+    if ((NULL != sl_batch_p) && ((sl_batch_p->size_u16 + sizeof(prefix_str) + size_u16 + 1U) > (SL_DATAGRAM_SIZE - SL_HEADER_RESERVE)))
+    {
+        /* Full, this line starts the next one */
+        sl_close_batch();
+    }
+
+    if (NULL == sl_batch_p)
+    {
+        if (sl_queue_count_u8 >= (SL_QUEUE_DEPTH - 1U))
+        {
+            /* Nowhere to put it until a datagram went out */
+            sl_lost_records_u32 += 1U;
+            sl_stats.dropped_records_u32 += 1U;
+            return;
+        }
+
+        sl_batch_p = &sl_queue[(sl_queue_head_u8 + sl_queue_count_u8) % SL_QUEUE_DEPTH];
+        sl_batch_p->size_u16 = 0U;
+        sl_batch_p->records_u16 = 0U;
+        sl_batch_start_ms_u32 = now_ms_u32;
+        sl_batch_utc_u32 = ntp_get_utc_time();
+        sl_batch_severity_u8 = 7U;
+        tk_schedule(sl_flush_task_s8, SL_MAX_BATCH_AGE_MS_U32);
+    }
+
+    /* Milliseconds since the batch timestamp and the level in front of every line */
+    prefix_u16 = (uint16)snprintf(prefix_str, sizeof(prefix_str), "%s+%u %c ", (sl_batch_p->records_u16 > 0U) ? "\n" : "",
+                                  (unsigned)(now_ms_u32 - sl_batch_start_ms_u32), sl_level_chars[level_u8]);
+    prefix_u16 = min(prefix_u16, (uint16)(sizeof(prefix_str) - 1U));
+
+    /* A line that is too long for a whole datagram gets cut */
+    char *p_end = &sl_batch_p->data_str[SL_HEADER_RESERVE + sl_batch_p->size_u16];
+    line_u16 = min(size_u16, (uint16)(SL_DATAGRAM_SIZE - SL_HEADER_RESERVE - sl_batch_p->size_u16 - prefix_u16));
+    (void)memcpy(p_end, prefix_str, prefix_u16);
+    (void)memcpy(&p_end[prefix_u16], p_line, line_u16);
+    sl_batch_p->size_u16 += prefix_u16 + line_u16;
+
+    sl_batch_p->records_u16 += 1U;
+    sl_batch_severity_u8 = min(sl_batch_severity_u8, sl_severities[level_u8]);
+}
+
+void sl_close_batch()
+{
+    char header_str[SL_HEADER_RESERVE];
+    char timestamp_str[24];
+    time_t utc;
+    tm utc_time;
+    int header_i;
+
+    tk_cancel(sl_flush_task_s8);
+    if (NULL == sl_batch_p)
+    {
+        return;
+    }
+
+    if (sl_batch_utc_u32 != 0U)
+    {
+        utc = (time_t)sl_batch_utc_u32;
+        gmtime_r(&utc, &utc_time);
+        (void)strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%dT%H:%M:%SZ", &utc_time);
+    }
+    else
+    {
+        /* No time yet, the NILVALUE */
+        (void)strcpy(timestamp_str, "-");
+    }
+
+    /* Sequence numbers let the receiver count lost datagrams, "lost" says how many lines never made it into one */
+    sl_stats.sequence_u32 = (sl_stats.sequence_u32 < 0x7fffffffUL) ? (sl_stats.sequence_u32 + 1U) : 1U;
+    header_i = snprintf(header_str, sizeof(header_str), "<%u>1 %s %s flexidesk - - [meta sequenceId=\"%u\"][batch@32473 records=\"%u\" lost=\"%u\"] ",
+                        (unsigned)((SL_FACILITY_LOCAL0 * 8U) + sl_batch_severity_u8), timestamp_str, sl_hostname_str,
+                        (unsigned)sl_stats.sequence_u32, (unsigned)sl_batch_p->records_u16, (unsigned)sl_lost_records_u32);
+    header_i = min(header_i, (int)(sizeof(header_str) - 1U));
+    sl_lost_records_u32 = 0U;
+
+    sl_batch_p->start_u16 = SL_HEADER_RESERVE - (uint16)header_i;
+    (void)memcpy(&sl_batch_p->data_str[sl_batch_p->start_u16], header_str, header_i);
+    sl_batch_p->size_u16 += (uint16)header_i;
+
+    sl_queue_count_u8 += 1U;
+    sl_batch_p = NULL;
+}
+
+bool sl_send_ready()
+{
+    return (sl_queue_count_u8 > 0U) && nw_is_link_up();
+}
+
+void sl_send()
+{
+    const SL_DATAGRAM *p_datagram = &sl_queue[sl_queue_head_u8];
+    bool sent_b;
+
+    /* UDP only ever queues the packet in the stack, this does not wait for the network */
+    sent_b = (sl_udp.beginPacket(sl_server_ip, sl_server_port_u16) != 0) &&
+             (sl_udp.write((const uint8 *)&p_datagram->data_str[p_datagram->start_u16], p_datagram->size_u16) == p_datagram->size_u16) &&
+             (sl_udp.endPacket() != 0);
+
+    if (sent_b)
+    {
+        sl_stats.datagrams_u32 += 1U;
+        sl_stats.records_u32 += p_datagram->records_u16;
+    }
+    else
+    {
+        /* Not retried, it would only hold up the datagrams behind it */
+        sl_stats.dropped_records_u32 += p_datagram->records_u16;
+    }
+
+    sl_queue_head_u8 = (sl_queue_head_u8 + 1U) % SL_QUEUE_DEPTH;
+    sl_queue_count_u8 -= 1U;
+}
+
+/*****************************************************************************/
+
+void sl_get_syslog(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    char response_str[192];
+    JSON_WRITER writer;
+    char server_str[16];
+
+    (void)snprintf(server_str, sizeof(server_str), "%u.%u.%u.%u", sl_server_ip[0], sl_server_ip[1], sl_server_ip[2], sl_server_ip[3]);
+
+    json_init(&writer, response_str, sizeof(response_str) - 1U);
+    json_object_begin(&writer, NULL);
+    json_add_string(&writer, "server", (sl_server_port_u16 != 0U) ? server_str : "");
+    json_add_uint(&writer, "port", sl_server_port_u16);
+    json_add_uint(&writer, "datagrams", sl_stats.datagrams_u32);
+    json_add_uint(&writer, "records", sl_stats.records_u32);
+    json_add_uint(&writer, "dropped", sl_stats.dropped_records_u32);
+    json_add_uint(&writer, "sequence", sl_stats.sequence_u32);
+    json_object_end(&writer);
+    response_str[json_length(&writer)] = '\0';
+
+    http_send(p_conn, 200, "application/json", response_str);
+}
+
+void sl_put_syslog(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JSON_READER reader;
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    char server_str[16] = "";
+    uint16 port_u16 = (sl_server_port_u16 != 0U) ? sl_server_port_u16 : SL_DEFAULT_PORT;
+    bool valid_b = true;
+
+    /* {"server": "192.168.1.10", "port": 514}, an empty server turns it off, keys left out stay as they are */
+    if (sl_server_port_u16 != 0U)
+    {
+        (void)snprintf(server_str, sizeof(server_str), "%u.%u.%u.%u", sl_server_ip[0], sl_server_ip[1], sl_server_ip[2], sl_server_ip[3]);
+    }
+    json_reader_init(&reader, p_request->body.p_data, p_request->body.size_u16);
+    valid_b = (json_next(&reader, &key) == JSON_TOKEN_OBJECT_BEGIN);
+    while (valid_b && (json_next(&reader, &key) == JSON_TOKEN_STRING) && (json_next(&reader, &value) != JSON_TOKEN_ERROR))
+    {
+        if (json_token_equals(&key, "server") && (value.type_e == JSON_TOKEN_STRING) && (value.size_u16 < sizeof(server_str)))
+        {
+            (void)memcpy(server_str, value.p_data, value.size_u16);
+            server_str[value.size_u16] = '\0';
+        }
+        else if (json_token_equals(&key, "port") && (value.type_e == JSON_TOKEN_NUMBER) && (value.number_s32 > 0) && (value.number_s32 <= 0xffff))
+        {
+            port_u16 = (uint16)value.number_s32;
+        }
+        else if (json_token_equals(&key, "server") || json_token_equals(&key, "port"))
+        {
+            valid_b = false;
+        }
+        else if (!json_skip(&reader, &value))
+        {
+            valid_b = false;
+        }
+        else
+        {
+            /* Ignore unknown keys */
+        }
+    }
+
+    if (valid_b && sl_set_server(server_str, port_u16))
+    {
+        api_store_config();
+        sl_get_syslog(p_conn, p_request);
+    }
+    else
+    {
+        http_send(p_conn, 400, "application/json", "{\"error\":\"expected {\\\"server\\\": \\\"a.b.c.d\\\", \\\"port\\\": 514}\"}");
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef SL_MAIN_H
+#define SL_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define SL_DATAGRAM_SIZE 1024U /* header plus batched lines, below the MTU */
+#define SL_QUEUE_DEPTH 3U      /* the batch being filled and the datagrams waiting to be sent */
+#define SL_DEFAULT_PORT 514U
+
+/*****************************************************************************/
+
+typedef struct
+{
+    uint32 datagrams_u32;       /* handed to the network */
+    uint32 records_u32;         /* log lines in them */
+    uint32 dropped_records_u32; /* queue was full or sending failed */
+    uint32 sequence_u32;        /* sequenceId of the last datagram, gaps mean loss */
+} SL_STATS;
+
+/*****************************************************************************/
+
+extern void sl_init(const char *p_hostname, const char *p_server, const uint16 port_u16);
+extern bool sl_set_server(const char *p_server, const uint16 port_u16); /* IPv4 address, empty to turn it off */
+extern void sl_get_server(uint8 *p_server_vu8, uint16 *p_port_u16);     /* 0.0.0.0 and 0 while turned off */
+extern const SL_STATS *sl_get_stats();
+
+/*****************************************************************************/
+
+#endif
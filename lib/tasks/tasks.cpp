@@ -0,0 +1,419 @@
+#include "tasks.h"
+
+#include <string.h>
+
+#include "log.h"
+#include "memory.h"
+#include "trace.h"
+
+/*****************************************************************************/
+
+#define TK_HEAP_NONE 0xffU
+
+/* Same as the core's CONT_STACKGUARD, so ESP.getFreeContStack() still sees painted words as free */
+#define TK_STACK_PAINT 0xfeefeffeUL
+#define TK_STACK_MARGIN 64U /* left alone below the frame of tk_stack_pointer() */
+
+/* Bounds how long I/O hooks go unpolled, host fleets of hundreds of instances raise it to stay off the CPU */
+#ifndef TK_MAX_IDLE_MS
+#define TK_MAX_IDLE_MS 2U
+#endif
+
+/*****************************************************************************/
+
+typedef enum
+{
+    TK_KIND_PERIODIC = 0,
+    TK_KIND_ONESHOT,
+    TK_KIND_IO_HOOK
+} TK_KIND;
+
+typedef struct
+{
+    TK_KIND kind_e;
+    fn_task p_task;
+    fn_io_ready p_ready;
+    uint32 period_ms_u32;
+    uint32 deadline_ms_u32;
+    uint8 heap_pos_u8; /* position in the deadline heap, TK_HEAP_NONE if not armed */
+    TK_STATS stats;
+} TK_TASK;
+
+/*****************************************************************************/
+
+const uint32 TK_MAX_IDLE_MS_U32 = TK_MAX_IDLE_MS;
+const uint32 TK_STATS_PERIOD_MS_U32 = 60U * 1000U;
+const char tk_module_str[] PROGMEM = "Tasks";
+const uint32 tk_histogram_bounds_us[TK_HISTOGRAM_BUCKETS] = {10U, 50U, 100U, 500U, 1000U, 5000U, 10000U, 50000U};
+
+/*****************************************************************************/
+
+TK_TASK tk_tasks[TK_MAX_TASKS];
+uint8 tk_num_tasks_u8 = 0U;
+
+/* Binary min-heap of task indices, ordered by deadline */
+uint8 tk_heap_vu8[TK_MAX_TASKS];
+uint8 tk_heap_size_u8 = 0U;
+
+TK_LOOP_STATS tk_loop_stats = {0};
+uint32 tk_cycles_per_us_u32 = 80U;
+
+/* Painted stack window, only what a task dirtied is painted again before the next one */
+uintptr_t tk_stack_top_u = 0U;
+uintptr_t tk_stack_dirty_u = 0U;
+
+/*****************************************************************************/
+
+sint8 tk_add(const char *p_name, const TK_KIND kind_e, fn_task p_task, fn_io_ready p_ready, const uint32 period_ms_u32);
+void tk_execute(const uint8 task_u8, const uint32 now_ms_u32);
+uintptr_t tk_stack_pointer() __attribute__((noinline));
+
+bool tk_deadline_before(const uint8 a_u8, const uint8 b_u8);
+void tk_heap_swap(const uint8 pos_a_u8, const uint8 pos_b_u8);
+void tk_heap_sift_up(uint8 pos_u8);
+void tk_heap_sift_down(uint8 pos_u8);
+void tk_heap_insert(const uint8 task_u8);
+void tk_heap_remove(const uint8 task_u8);
+
+/*****************************************************************************/
+
+void tk_init()
+{
+    (void)memset(tk_tasks, 0, sizeof(tk_tasks));
+    tk_num_tasks_u8 = 0U;
+    tk_heap_size_u8 = 0U;
+    (void)memset(&tk_loop_stats, 0, sizeof(TK_LOOP_STATS));
+
+    /* Timing uses the cycle counter, reading it is a single instruction */
+    tk_cycles_per_us_u32 = ESP.getCpuFreqMHz();
+
+    (void)tk_add_periodic("Stats", tk_log_stats, TK_STATS_PERIOD_MS_U32);
+}
+
+void tk_run()
+{
+    uint32 now_ms_u32 = millis();
+    uint32 idle_ms_u32 = TK_MAX_IDLE_MS_U32;
+    bool busy_b = false;
+    uint8 budget_u8 = tk_num_tasks_u8;
+    const uint32 start_cycles_u32 = ESP.getCycleCount();
+    uint32 pass_us_u32;
+
+    /* Everything that is due, earliest deadline first - bounded so that I/O hooks are never starved */
+    while ((budget_u8-- > 0U) && (tk_heap_size_u8 > 0U) && ((sint32)(now_ms_u32 - tk_tasks[tk_heap_vu8[0U]].deadline_ms_u32) >= 0))
+    {
+        tk_execute(tk_heap_vu8[0U], now_ms_u32);
+        now_ms_u32 = millis();
+        busy_b = true;
+    }
+
+    /* I/O hooks only run when their source has something for us */
+    for (uint8 i = 0U; i < tk_num_tasks_u8; ++i)
+    {
+        if ((tk_tasks[i].kind_e == TK_KIND_IO_HOOK) && tk_tasks[i].p_ready())
+        {
+            tk_execute(i, now_ms_u32);
+            busy_b = true;
+        }
+    }
+
+    if (busy_b)
+    {
+        pass_us_u32 = (ESP.getCycleCount() - start_cycles_u32) / tk_cycles_per_us_u32;
+        TR_INSTANT(TR_TRACK_RUNTIME, "Loop pass", min(pass_us_u32, (uint32)0xffffU));
+        tk_loop_stats.passes_u32 += 1U;
+        tk_loop_stats.max_pass_us_u32 = max(tk_loop_stats.max_pass_us_u32, pass_us_u32);
+    }
+    else
+    {
+        /* Nothing to do right now - hand the time to the system instead of spinning */
+        if (tk_heap_size_u8 > 0U)
+        {
+            const sint32 until_next_s32 = (sint32)(tk_tasks[tk_heap_vu8[0U]].deadline_ms_u32 - millis());
+            idle_ms_u32 = (until_next_s32 <= 0) ? 0U : min((uint32)until_next_s32, TK_MAX_IDLE_MS_U32);
+        }
+
+        if (idle_ms_u32 > 0U)
+        {
+            delay(idle_ms_u32);
+        }
+        else
+        {
+            yield();
+        }
+    }
+}
+
+sint8 tk_add_periodic(const char *p_name, fn_task p_task, const uint32 period_ms_u32)
+{
+    const sint8 task_s8 = tk_add(p_name, TK_KIND_PERIODIC, p_task, NULL, max(period_ms_u32, (uint32)1U));
+
+    /* Periodic tasks run for the first time right away */
+    tk_schedule(task_s8, 0U);
+
+    return task_s8;
+}
+
+sint8 tk_add_oneshot(const char *p_name, fn_task p_task)
+{
+    return tk_add(p_name, TK_KIND_ONESHOT, p_task, NULL, 0U);
+}
+
+sint8 tk_add_io_hook(const char *p_name, fn_io_ready p_ready, fn_task p_task)
+{
+    return (NULL != p_ready) ? tk_add(p_name, TK_KIND_IO_HOOK, p_task, p_ready, 0U) : TK_INVALID_TASK;
+}
+
+void tk_schedule(const sint8 task_s8, const uint32 delay_ms_u32)
+{
+    TK_TASK *p_task;
+
+    if ((task_s8 >= 0) && ((uint8)task_s8 < tk_num_tasks_u8) && (tk_tasks[task_s8].kind_e != TK_KIND_IO_HOOK))
+    {
+        p_task = &tk_tasks[task_s8];
+
+        tk_heap_remove((uint8)task_s8);
+        p_task->deadline_ms_u32 = millis() + delay_ms_u32;
+        tk_heap_insert((uint8)task_s8);
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, tk_module_str, "Cannot schedule task %i.", (int)task_s8);
+    }
+}
+
+void tk_cancel(const sint8 task_s8)
+{
+    if ((task_s8 >= 0) && ((uint8)task_s8 < tk_num_tasks_u8))
+    {
+        tk_heap_remove((uint8)task_s8);
+    }
+    else
+    {
+        /* Nothing to cancel */
+    }
+}
+
+uint8 tk_get_num_tasks()
+{
+    return tk_num_tasks_u8;
+}
+
+const TK_STATS *tk_get_stats(const sint8 task_s8)
+{
+    return ((task_s8 >= 0) && ((uint8)task_s8 < tk_num_tasks_u8)) ? &(tk_tasks[task_s8].stats) : NULL;
+}
+
+const TK_LOOP_STATS *tk_get_loop_stats()
+{
+    return &tk_loop_stats;
+}
+
+void tk_log_stats()
+{
+    for (uint8 i = 0U; i < tk_num_tasks_u8; ++i)
+    {
+        const TK_STATS *p_stats = &(tk_tasks[i].stats);
+
+        log_msg(LOG_LEVEL_DEBUG, tk_module_str, "%s: %u runs, %u overruns, max lateness %u ms, max runtime %u us, total runtime %u ms, max stack %u bytes, %u allocations.",
+                p_stats->p_name, p_stats->runs_u32, p_stats->overruns_u32,
+                p_stats->max_lateness_ms_u32, p_stats->max_runtime_us_u32, (uint32)(p_stats->total_runtime_us_u64 / 1000U),
+                p_stats->stack_max_u16, p_stats->allocations_u32);
+    }
+}
+
+/*****************************************************************************/
+
+sint8 tk_add(const char *p_name, const TK_KIND kind_e, fn_task p_task, fn_io_ready p_ready, const uint32 period_ms_u32)
+{
+    sint8 task_s8 = TK_INVALID_TASK;
+    TK_TASK *p_new;
+
+    if ((NULL != p_task) && (tk_num_tasks_u8 < TK_MAX_TASKS))
+    {
+        task_s8 = (sint8)tk_num_tasks_u8++;
+
+        p_new = &tk_tasks[task_s8];
+        (void)memset(p_new, 0, sizeof(TK_TASK));
+        p_new->kind_e = kind_e;
+        p_new->p_task = p_task;
+        p_new->p_ready = p_ready;
+        p_new->period_ms_u32 = period_ms_u32;
+        p_new->heap_pos_u8 = TK_HEAP_NONE;
+        p_new->stats.p_name = p_name;
+    }
+    else
+    {
+        log_msg(LOG_LEVEL_ERROR, tk_module_str, "Cannot add task '%s'.", p_name);
+    }
+
+    return task_s8;
+}
+
+uintptr_t tk_stack_pointer()
+{
+    /* Our frame lies below the caller's, nothing under it is in use once we return */
+    return (uintptr_t)__builtin_frame_address(0);
+}
+
+void tk_execute(const uint8 task_u8, const uint32 now_ms_u32)
+{
+    TK_TASK *p_task = &tk_tasks[task_u8];
+    uint32 start_cycles_u32;
+    uint32 runtime_us_u32;
+    uint32 lateness_ms_u32 = 0U;
+    uint32 allocations_u32;
+    uint8 bucket_u8 = 0U;
+    volatile uint32 *p_word;
+    const uintptr_t top_u = (tk_stack_pointer() - TK_STACK_MARGIN) & ~(uintptr_t)(sizeof(uint32) - 1U);
+    const uintptr_t bottom_u = top_u - TK_STACK_WINDOW;
+
+    if (p_task->kind_e != TK_KIND_IO_HOOK)
+    {
+        lateness_ms_u32 = now_ms_u32 - p_task->deadline_ms_u32;
+        p_task->stats.max_lateness_ms_u32 = max(p_task->stats.max_lateness_ms_u32, lateness_ms_u32);
+
+        /* Take it off the heap first, the task itself may want to reschedule */
+        tk_heap_remove(task_u8);
+        if (p_task->kind_e == TK_KIND_PERIODIC)
+        {
+            if (lateness_ms_u32 >= p_task->period_ms_u32)
+            {
+                /* Missed at least one whole period, do not try to catch up */
+                p_task->stats.overruns_u32 += 1U;
+                p_task->deadline_ms_u32 = now_ms_u32 + p_task->period_ms_u32;
+            }
+            else
+            {
+                p_task->deadline_ms_u32 += p_task->period_ms_u32;
+            }
+            tk_heap_insert(task_u8);
+        }
+        else
+        {
+            /* One-shot tasks stay registered but disarmed */
+        }
+    }
+
+    /* Nothing below our frame is in use, the task's frames will be. Done inline, a
+     * function call would paint over its own frame. */
+    if (top_u != tk_stack_top_u)
+    {
+        tk_stack_top_u = top_u;
+        tk_stack_dirty_u = bottom_u;
+    }
+    for (p_word = (volatile uint32 *)tk_stack_dirty_u; (uintptr_t)p_word < top_u; ++p_word)
+    {
+        *p_word = TK_STACK_PAINT;
+    }
+
+    TR_BEGIN(TR_TRACK_RUNTIME, p_task->stats.p_name);
+    allocations_u32 = mm_get_allocations();
+    start_cycles_u32 = ESP.getCycleCount();
+    p_task->p_task();
+    runtime_us_u32 = (ESP.getCycleCount() - start_cycles_u32) / tk_cycles_per_us_u32;
+    p_task->stats.allocations_u32 += mm_get_allocations() - allocations_u32;
+    TR_END(TR_TRACK_RUNTIME, p_task->stats.p_name);
+
+    /* Deepest word that is no longer painted, interrupts that hit the task count as well */
+    for (p_word = (volatile uint32 *)bottom_u; ((uintptr_t)p_word < top_u) && (*p_word == TK_STACK_PAINT); ++p_word)
+    {
+    }
+    tk_stack_dirty_u = (uintptr_t)p_word;
+    p_task->stats.stack_max_u16 = max(p_task->stats.stack_max_u16, (uint16)(top_u + TK_STACK_MARGIN - tk_stack_dirty_u));
+
+    while ((bucket_u8 < TK_HISTOGRAM_BUCKETS) && (runtime_us_u32 > tk_histogram_bounds_us[bucket_u8]))
+    {
+        bucket_u8++;
+    }
+    p_task->stats.runtime_histogram_vu32[bucket_u8] += 1U;
+
+    p_task->stats.runs_u32 += 1U;
+    p_task->stats.total_runtime_us_u64 += runtime_us_u32;
+    p_task->stats.max_runtime_us_u32 = max(p_task->stats.max_runtime_us_u32, runtime_us_u32);
+    if ((p_task->kind_e == TK_KIND_PERIODIC) && (runtime_us_u32 >= (p_task->period_ms_u32 * 1000U)))
+    {
+        p_task->stats.overruns_u32 += 1U;
+    }
+}
+
+bool tk_deadline_before(const uint8 a_u8, const uint8 b_u8)
+{
+    return ((sint32)(tk_tasks[a_u8].deadline_ms_u32 - tk_tasks[b_u8].deadline_ms_u32) < 0);
+}
+
+void tk_heap_swap(const uint8 pos_a_u8, const uint8 pos_b_u8)
+{
+    const uint8 task_a_u8 = tk_heap_vu8[pos_a_u8];
+
+    tk_heap_vu8[pos_a_u8] = tk_heap_vu8[pos_b_u8];
+    tk_heap_vu8[pos_b_u8] = task_a_u8;
+    tk_tasks[tk_heap_vu8[pos_a_u8]].heap_pos_u8 = pos_a_u8;
+    tk_tasks[tk_heap_vu8[pos_b_u8]].heap_pos_u8 = pos_b_u8;
+}
+
+void tk_heap_sift_up(uint8 pos_u8)
+{
+    while ((pos_u8 > 0U) && tk_deadline_before(tk_heap_vu8[pos_u8], tk_heap_vu8[(pos_u8 - 1U) / 2U]))
+    {
+        tk_heap_swap(pos_u8, (pos_u8 - 1U) / 2U);
+        pos_u8 = (pos_u8 - 1U) / 2U;
+    }
+}
+
+void tk_heap_sift_down(uint8 pos_u8)
+{
+    uint8 smallest_u8;
+    uint8 child_u8;
+
+    for (;;)
+    {
+        smallest_u8 = pos_u8;
+        for (child_u8 = (2U * pos_u8) + 1U; child_u8 <= ((2U * pos_u8) + 2U); ++child_u8)
+        {
+            if ((child_u8 < tk_heap_size_u8) && tk_deadline_before(tk_heap_vu8[child_u8], tk_heap_vu8[smallest_u8]))
+            {
+                smallest_u8 = child_u8;
+            }
+        }
+
+        if (smallest_u8 == pos_u8)
+        {
+            break;
+        }
+
+        tk_heap_swap(pos_u8, smallest_u8);
+        pos_u8 = smallest_u8;
+    }
+}
+
+void tk_heap_insert(const uint8 task_u8)
+{
+    tk_heap_vu8[tk_heap_size_u8] = task_u8;
+    tk_tasks[task_u8].heap_pos_u8 = tk_heap_size_u8;
+    tk_heap_size_u8 += 1U;
+    tk_heap_sift_up(tk_heap_size_u8 - 1U);
+}
+
+void tk_heap_remove(const uint8 task_u8)
+{
+    const uint8 pos_u8 = tk_tasks[task_u8].heap_pos_u8;
+
+    if (pos_u8 != TK_HEAP_NONE)
+    {
+        tk_heap_size_u8 -= 1U;
+        if (pos_u8 != tk_heap_size_u8)
+        {
+            tk_heap_swap(pos_u8, tk_heap_size_u8);
+            tk_heap_sift_down(pos_u8);
+            tk_heap_sift_up(pos_u8);
+        }
+        tk_tasks[task_u8].heap_pos_u8 = TK_HEAP_NONE;
+    }
+    else
+    {
+        /* Not armed */
+    }
+}
+
+/*****************************************************************************/
@@ -0,0 +1,59 @@
+#ifndef TK_MAIN_H
+#define TK_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#define TK_MAX_TASKS 24U
+#define TK_INVALID_TASK (-1)
+#define TK_HISTOGRAM_BUCKETS 8U /* plus one for everything above the last bound */
+#define TK_STACK_WINDOW 2048U   /* painted below the runtime's frame to measure the stack use of tasks */
+
+/*****************************************************************************/
+
+typedef void (*fn_task)(void);
+typedef bool (*fn_io_ready)(void);
+
+typedef struct
+{
+    const char *p_name;
+    uint32 runs_u32;
+    uint32 overruns_u32;      /* missed a whole period or ran longer than it */
+    uint32 max_lateness_ms_u32;
+    uint32 max_runtime_us_u32;
+    uint64 total_runtime_us_u64; /* 32 bits would wrap after 71 minutes */
+    uint32 runtime_histogram_vu32[TK_HISTOGRAM_BUCKETS + 1U]; /* runs per bucket, not cumulative */
+    uint32 allocations_u32;   /* heap allocations made while running, see mm_get_allocations() */
+    uint16 stack_max_u16;     /* deepest stack use of a run in bytes, TK_STACK_WINDOW if it went further */
+} TK_STATS;
+
+typedef struct
+{
+    uint32 passes_u32;     /* tk_run() calls that had something to do */
+    uint32 max_pass_us_u32; /* longest of them, i.e. the worst delay any I/O hook saw */
+} TK_LOOP_STATS;
+
+/*****************************************************************************/
+
+extern void tk_init();
+extern void tk_run(); /* one pass of the runtime, call from loop() */
+
+extern sint8 tk_add_periodic(const char *p_name, fn_task p_task, const uint32 period_ms_u32);
+extern sint8 tk_add_oneshot(const char *p_name, fn_task p_task); /* disarmed until tk_schedule() */
+extern sint8 tk_add_io_hook(const char *p_name, fn_io_ready p_ready, fn_task p_task);
+
+extern void tk_schedule(const sint8 task_s8, const uint32 delay_ms_u32);
+extern void tk_cancel(const sint8 task_s8);
+
+extern uint8 tk_get_num_tasks();
+extern const TK_STATS *tk_get_stats(const sint8 task_s8);
+extern const TK_LOOP_STATS *tk_get_loop_stats();
+extern const uint32 tk_histogram_bounds_us[TK_HISTOGRAM_BUCKETS];
+extern void tk_log_stats();
+
+/*****************************************************************************/
+
+#endif
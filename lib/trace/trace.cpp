@@ -0,0 +1,265 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "http.h"
+#include "json.h"
+#include "log.h"
+
+/*****************************************************************************/
+
+#define TR_STEP_HEADER 0U
+#define TR_STEP_FIRST_EVENT 1U
+
+/*****************************************************************************/
+
+const char tr_module_str[] PROGMEM = "Trace";
+const char *tr_track_names[TR_NUM_TRACKS] = {"", "Runtime", "Desk", "HTTP", "Scheduler"};
+
+/*****************************************************************************/
+
+bool tr_enabled_b = false;
+
+TR_EVENT tr_events[TR_MAX_EVENTS];
+uint16 tr_head_u16 = 0U; /* next slot to write */
+uint16 tr_count_u16 = 0U;
+uint32 tr_cycles_per_us_u32 = 80U;
+
+/* Only one export at a time, recording pauses while it runs so the ring stays put */
+HTTP_CONN *tr_export_conn_p = NULL;
+bool tr_export_resume_b = false;
+uint32 tr_export_last_cycles_u32 = 0U;
+uint64 tr_export_elapsed_cycles_u64 = 0U;
+uint8 tr_export_depth_vu8[TR_NUM_TRACKS]; /* open spans per track */
+
+/*****************************************************************************/
+
+void tr_get_trace(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void tr_put_trace(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void tr_handle_export_done(HTTP_CONN *p_conn);
+bool tr_produce(HTTP_CONN *p_conn);
+int tr_render_event(const TR_EVENT *p_event, char *p_buffer, const uint16 size_u16);
+
+/*****************************************************************************/
+
+void tr_init()
+{
+    (void)memset(tr_events, 0, sizeof(tr_events));
+    tr_cycles_per_us_u32 = ESP.getCpuFreqMHz();
+
+    (void)http_on(HTTP_METHOD_GET, "/api/trace", tr_get_trace);
+    (void)http_on(HTTP_METHOD_PUT, "/api/trace", tr_put_trace);
+}
+
+void tr_set_enabled(const bool enabled_b)
+{
+    if (enabled_b && !tr_enabled_b)
+    {
+        tr_head_u16 = 0U;
+        tr_count_u16 = 0U;
+    }
+    tr_enabled_b = enabled_b;
+
+    log_msg(LOG_LEVEL_INFO, tr_module_str, "Tracing %s.", enabled_b ? "enabled" : "disabled");
+}
+
+void tr_record(const uint8 phase_u8, const uint8 track_u8, const char *p_name, const uint16 arg_u16)
+{
+    TR_EVENT *p_event = &tr_events[tr_head_u16];
+
+    p_event->cycles_u32 = ESP.getCycleCount();
+    p_event->p_name = p_name;
+    p_event->arg_u16 = arg_u16;
+    p_event->phase_u8 = phase_u8;
+    p_event->track_u8 = track_u8;
+
+    /* Oldest events get overwritten */
+    tr_head_u16 = (tr_head_u16 + 1U) & (TR_MAX_EVENTS - 1U);
+    tr_count_u16 += (tr_count_u16 < TR_MAX_EVENTS) ? 1U : 0U;
+}
+
+/*****************************************************************************/
+
+void tr_get_trace(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    if (NULL != tr_export_conn_p)
+    {
+        http_send(p_conn, 503, "text/plain", "Trace export already running");
+        return;
+    }
+
+    tr_export_conn_p = p_conn;
+    tr_export_resume_b = tr_enabled_b;
+    tr_enabled_b = false;
+
+    http_begin_response(p_conn, 200, "application/json", HTTP_LENGTH_CHUNKED, "Content-Disposition: attachment; filename=\"trace.json\"\r\n");
+    http_set_producer(p_conn, tr_produce);
+    http_set_done_handler(p_conn, tr_handle_export_done);
+}
+
+void tr_put_trace(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    JSON_READER reader;
+    JSON_TOKEN key;
+    JSON_TOKEN value;
+    bool found_b = false;
+    bool enabled_b = false;
+
+    /* {"enabled": true}, the export pauses recording and would be confused by a restart */
+    json_reader_init(&reader, p_request->body.p_data, p_request->body.size_u16);
+    if (json_next(&reader, &key) == JSON_TOKEN_OBJECT_BEGIN)
+    {
+        while ((json_next(&reader, &key) == JSON_TOKEN_STRING) && (json_next(&reader, &value) != JSON_TOKEN_ERROR))
+        {
+            if (json_token_equals(&key, "enabled") && ((value.type_e == JSON_TOKEN_TRUE) || (value.type_e == JSON_TOKEN_FALSE)))
+            {
+                found_b = true;
+                enabled_b = (value.type_e == JSON_TOKEN_TRUE);
+            }
+            else if (!json_skip(&reader, &value))
+            {
+                break;
+            }
+            else
+            {
+                /* Ignore unknown keys */
+            }
+        }
+    }
+
+    if (NULL != tr_export_conn_p)
+    {
+        http_send(p_conn, 503, "application/json", "{\"error\":\"trace export running\"}");
+    }
+    else if (found_b)
+    {
+        tr_set_enabled(enabled_b);
+        http_send(p_conn, 200, "application/json", tr_enabled_b ? "{\"enabled\":true}" : "{\"enabled\":false}");
+    }
+    else
+    {
+        http_send(p_conn, 400, "application/json", "{\"error\":\"expected {\\\"enabled\\\": true|false}\"}");
+    }
+}
+
+void tr_handle_export_done(HTTP_CONN *p_conn)
+{
+    if (p_conn == tr_export_conn_p)
+    {
+        tr_export_conn_p = NULL;
+        tr_enabled_b = tr_enabled_b || tr_export_resume_b;
+    }
+}
+
+bool tr_produce(HTTP_CONN *p_conn)
+{
+    uint32 *p_step_u32 = http_producer_state(p_conn);
+    const uint16 oldest_u16 = (tr_head_u16 - tr_count_u16) & (TR_MAX_EVENTS - 1U);
+    const uint32 close_step_u32 = TR_STEP_FIRST_EVENT + tr_count_u16;
+    const uint32 footer_step_u32 = close_step_u32 + (TR_NUM_TRACKS - TR_TRACK_RUNTIME);
+    TR_EVENT event;
+    uint16 size_u16;
+    uint16 used_u16 = 0U;
+    char *p_buffer = http_tx_reserve(p_conn, &size_u16);
+    int line_i;
+
+    while (*p_step_u32 <= footer_step_u32)
+    {
+        event.phase_u8 = 0U;
+        if (*p_step_u32 == TR_STEP_HEADER)
+        {
+            /* Track names first, the viewer shows them instead of the numbers */
+            line_i = snprintf(&p_buffer[used_u16], size_u16 - used_u16, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+            for (uint8 i = TR_TRACK_RUNTIME; (i < TR_NUM_TRACKS) && (line_i >= 0) && (line_i < (int)(size_u16 - used_u16)); ++i)
+            {
+                line_i += snprintf(&p_buffer[used_u16 + line_i], size_u16 - used_u16 - line_i,
+                                   "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                                   (i == TR_TRACK_RUNTIME) ? "" : ",", (unsigned)i, tr_track_names[i]);
+            }
+            tr_export_last_cycles_u32 = tr_events[oldest_u16].cycles_u32;
+            tr_export_elapsed_cycles_u64 = 0U;
+            (void)memset(tr_export_depth_vu8, 0, sizeof(tr_export_depth_vu8));
+        }
+        else if (*p_step_u32 < close_step_u32)
+        {
+            event = tr_events[(oldest_u16 + *p_step_u32 - TR_STEP_FIRST_EVENT) & (TR_MAX_EVENTS - 1U)];
+            if ((event.phase_u8 == 'E') && (tr_export_depth_vu8[event.track_u8] == 0U))
+            {
+                /* Its begin has already been overwritten */
+                event.phase_u8 = 0U;
+                line_i = 0;
+            }
+            else
+            {
+                line_i = tr_render_event(&event, &p_buffer[used_u16], size_u16 - used_u16);
+            }
+        }
+        else if (*p_step_u32 < footer_step_u32)
+        {
+            /* Spans still open, e.g. the task serving this export, end where the trace ends */
+            event.track_u8 = (uint8)(*p_step_u32 - close_step_u32 + TR_TRACK_RUNTIME);
+            if (tr_export_depth_vu8[event.track_u8] > 0U)
+            {
+                event.cycles_u32 = tr_export_last_cycles_u32;
+                event.p_name = "";
+                event.arg_u16 = 0U;
+                event.phase_u8 = 'E';
+                line_i = tr_render_event(&event, &p_buffer[used_u16], size_u16 - used_u16);
+            }
+            else
+            {
+                line_i = 0;
+            }
+        }
+        else
+        {
+            line_i = snprintf(&p_buffer[used_u16], size_u16 - used_u16, "]}\n");
+        }
+
+        if ((line_i < 0) || (line_i >= (int)(size_u16 - used_u16)))
+        {
+            break;
+        }
+
+        used_u16 += (uint16)line_i;
+        if (event.phase_u8 == 'B')
+        {
+            tr_export_depth_vu8[event.track_u8] += (tr_export_depth_vu8[event.track_u8] < 0xffU) ? 1U : 0U;
+        }
+        else if (event.phase_u8 == 'E')
+        {
+            tr_export_depth_vu8[event.track_u8] -= 1U;
+        }
+        else
+        {
+            /* Nothing to keep track of */
+        }
+
+        /* Closing steps stay on their track until all of its spans are closed */
+        if ((*p_step_u32 < close_step_u32) || (*p_step_u32 >= footer_step_u32) || (tr_export_depth_vu8[event.track_u8] == 0U))
+        {
+            *p_step_u32 += 1U;
+        }
+    }
+
+    http_tx_commit(p_conn, used_u16);
+
+    return *p_step_u32 > footer_step_u32;
+}
+
+int tr_render_event(const TR_EVENT *p_event, char *p_buffer, const uint16 size_u16)
+{
+    uint64 elapsed_us_u64;
+    uint32 fraction_u32;
+
+    /* The cycle counter wraps within a minute, but the runtime's own spans never leave gaps that long */
+    tr_export_elapsed_cycles_u64 += p_event->cycles_u32 - tr_export_last_cycles_u32;
+    tr_export_last_cycles_u32 = p_event->cycles_u32;
+    elapsed_us_u64 = tr_export_elapsed_cycles_u64 / tr_cycles_per_us_u32;
+    fraction_u32 = (uint32)(((tr_export_elapsed_cycles_u64 % tr_cycles_per_us_u32) * 1000U) / tr_cycles_per_us_u32);
+
+    return snprintf(p_buffer, size_u16, ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu.%03u,\"pid\":1,\"tid\":%u%s,\"args\":{\"arg\":%u}}",
+                    p_event->p_name, (char)p_event->phase_u8, (unsigned long)elapsed_us_u64, (unsigned)fraction_u32,
+                    (unsigned)p_event->track_u8, (p_event->phase_u8 == 'i') ? ",\"s\":\"t\"" : "", (unsigned)p_event->arg_u16);
+}
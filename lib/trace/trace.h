@@ -0,0 +1,58 @@
+#ifndef TR_MAIN_H
+#define TR_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+
+/*****************************************************************************/
+
+#ifndef TR_MAX_EVENTS
+#define TR_MAX_EVENTS 256U /* power of two, 12 bytes each */
+#endif
+
+/*****************************************************************************/
+
+/* Shown as separate threads in the trace viewer */
+typedef enum
+{
+    TR_TRACK_RUNTIME = 1,
+    TR_TRACK_DESK,
+    TR_TRACK_HTTP,
+    TR_TRACK_SCHEDULER,
+    TR_NUM_TRACKS
+} TR_TRACK;
+
+typedef struct
+{
+    uint32 cycles_u32;  /* cycle counter, turned into microseconds on export */
+    const char *p_name; /* must be a string literal or otherwise live forever */
+    uint16 arg_u16;
+    uint8 phase_u8;     /* 'B'egin, 'E'nd or 'i'nstant */
+    uint8 track_u8;
+} TR_EVENT;
+
+/*****************************************************************************/
+
+/* Recording is a flag test while disabled, and compiled out completely with DISABLE_TRACE */
+#ifndef DISABLE_TRACE
+#define TR_BEGIN(track, name) do { if (tr_enabled_b) { tr_record('B', (track), (name), 0U); } } while (0)
+#define TR_END(track, name) do { if (tr_enabled_b) { tr_record('E', (track), (name), 0U); } } while (0)
+#define TR_INSTANT(track, name, arg) do { if (tr_enabled_b) { tr_record('i', (track), (name), (uint16)(arg)); } } while (0)
+#else
+#define TR_BEGIN(track, name) do { } while (0)
+#define TR_END(track, name) do { } while (0)
+#define TR_INSTANT(track, name, arg) do { } while (0)
+#endif
+
+/*****************************************************************************/
+
+extern bool tr_enabled_b;
+
+extern void tr_init();
+extern void tr_set_enabled(const bool enabled_b); /* enabling starts a new trace */
+extern void tr_record(const uint8 phase_u8, const uint8 track_u8, const char *p_name, const uint16 arg_u16);
+
+/*****************************************************************************/
+
+#endif
@@ -1,87 +1,243 @@
 #include "webserver.h"
 
-#include <ESP8266WebServer.h>
+#include <string.h>
+
+#include "events.h"
+#include "http.h"
 #include "log.h"
 
 /*****************************************************************************/
 
-ESP8266WebServer ws_instance;
-fn_height_provider ws_height_provider_fn = NULL;
+#define WS_STATUS_SIZE 96U
+
+/*****************************************************************************/
+
+/* One file of the web UI, gzipped in flash */
+typedef struct
+{
+    const char *p_path;
+    const char *p_content_type;
+    const uint8 *p_data;
+    uint32 size_u32;
+    const char *p_etag; /* quoted */
+    const char *p_headers;
+} WS_ASSET;
+
+/* Generated from ui/ by tools/embed_ui.py during the build */
+#include "ws_assets.h"
+
+/*****************************************************************************/
+
+const char ws_module_str[] PROGMEM = "WebServer";
+
+/*****************************************************************************/
+
 fn_command_receiver ws_command_receiver_fn = NULL;
-fn_time_provider ws_time_provider_fn = NULL;
+uint16 ws_height_u16 = 0U;
+DC_STATE ws_desk_state_e = DC_STATE_UNKNOWN;
+const DATETIME *ws_time_p = NULL;
+uint16 ws_server_port_u16 = 0U;
+bool ws_link_up_b = false;
+
+/* Pre-rendered answer to GET /, only redone when something shown in it changed.
+ * Two buffers so that a response still being sent is not rewritten right away. */
+char ws_status_vc[2][WS_STATUS_SIZE];
+uint16 ws_status_size_u16 = 0U;
+uint8 ws_status_index_u8 = 0U;
+char ws_status_headers_str[48];
+bool ws_status_dirty_b = true;
 
 /*****************************************************************************/
 
-void handleRoot();
-void handleStand();
-void handleNotFound();
+void ws_handle_event(const EVENT *p_event);
+void ws_set_link_state(const bool link_up_b);
+void ws_render_status();
+bool ws_etag_matches(const HTTP_REQUEST *p_request, const char *p_etag, const uint16 size_u16);
+void handleAsset(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void handleStatus(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void handleStand(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
+void handleNotFound(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request);
 
 /*****************************************************************************/
 
-void ws_init(const uint16 server_port_u16,
-             fn_height_provider height_provider,
-             fn_command_receiver command_receiver,
-             fn_time_provider time_provider)
+void ws_init(const uint16 server_port_u16, fn_command_receiver command_receiver)
 {
     /* Store function pointers */
-    ws_height_provider_fn = height_provider;
     ws_command_receiver_fn = command_receiver;
-    ws_time_provider_fn = time_provider;
-
-    /* Initialize server */
-    ws_instance.begin(server_port_u16);
+    ws_server_port_u16 = server_port_u16;
 
-    ws_instance.on("/", handleRoot);        // Call the 'handleRoot' function when a client requests URI "/"
-    ws_instance.on("/stand", handleStand);  // Call the 'handleRoot' function when a client requests URI "/"
-    ws_instance.onNotFound(handleNotFound); // When a client requests an unknown URI (i.e. something other than "/"), call function "handleNotFound"
+    /* Keep track of what we serve instead of asking for it on every request */
+    (void)ev_subscribe(EV_HEIGHT_CHANGED, ws_handle_event);
+    (void)ev_subscribe(EV_DESK_STATE_CHANGED, ws_handle_event);
+    (void)ev_subscribe(EV_SECOND_TICK, ws_handle_event);
+    (void)ev_subscribe(EV_LINK_CHANGED, ws_handle_event);
 
-    ws_instance.begin(); // Actually start the server
-    log_msg(LOG_LEVEL_INFO, "WebServer", "HTTP server started on port %i.", server_port_u16);
+    /* Register handlers, the server itself is started once we have a link */
+    http_init();
+    for (uint8 i = 0U; i < (sizeof(ws_assets) / sizeof(ws_assets[0])); ++i)
+    {
+        (void)http_on(HTTP_METHOD_GET, ws_assets[i].p_path, handleAsset);
+    }
+    (void)http_on(HTTP_METHOD_GET, "/", handleStatus);
+    (void)http_on(HTTP_METHOD_ANY, "/stand", handleStand);
+    http_on_not_found(handleNotFound);
 }
 
-void ws_loop()
+void ws_handle_event(const EVENT *p_event)
 {
-    ws_instance.handleClient(); // Listen for HTTP requests from clients
+    switch (p_event->type_e)
+    {
+    case EV_HEIGHT_CHANGED:
+    {
+        ws_height_u16 = p_event->data.height_u16;
+        ws_status_dirty_b = true;
+        break;
+    }
+    case EV_DESK_STATE_CHANGED:
+    {
+        ws_desk_state_e = p_event->data.desk_state_e;
+        ws_status_dirty_b = true;
+        break;
+    }
+    case EV_SECOND_TICK:
+    {
+        ws_time_p = p_event->data.p_time;
+        ws_status_dirty_b = true;
+        break;
+    }
+    case EV_LINK_CHANGED:
+    {
+        ws_set_link_state(p_event->data.link_up_b);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
 }
 
-/*****************************************************************************/
+void ws_set_link_state(const bool link_up_b)
+{
+    if (link_up_b && !ws_link_up_b)
+    {
+        http_begin(ws_server_port_u16);
+        log_msg(LOG_LEVEL_INFO, ws_module_str, "HTTP server started on port %i.", ws_server_port_u16);
+    }
+    else if (!link_up_b && ws_link_up_b)
+    {
+        http_end();
+        log_msg(LOG_LEVEL_INFO, ws_module_str, "HTTP server stopped.");
+    }
+    else
+    {
+        /* Nothing changed */
+    }
+
+    ws_link_up_b = link_up_b;
+}
 
-void handleRoot()
+void ws_render_status()
 {
-    uint16 height_u16;
-    const DATETIME *p_time;
+    const DATETIME *p_time = ws_time_p;
+    const char *p_state_str;
+    char *p_status;
+    int size_i;
 
-    if ((NULL != ws_height_provider_fn) && (NULL != ws_time_provider_fn))
-    {
-        height_u16 = ws_height_provider_fn();
-        p_time = ws_time_provider_fn();
+    /* Render into the buffer that was not served last */
+    ws_status_index_u8 ^= 1U;
+    p_status = ws_status_vc[ws_status_index_u8];
 
-        if (height_u16 > 0U)
+    if (NULL != p_time)
+    {
+        if (ws_height_u16 > 0U)
         {
-            char str[256]; /* XXX */
-            sprintf(str, "Height: %i cm\nTime: %i:%i:%i\nDate: %i/%i/%i", (int)height_u16, p_time->time.hour_u8, p_time->time.minute_u8, p_time->time.second_u8, p_time->date.year_u16, p_time->date.month_u8, p_time->date.day_u8);
-            ws_instance.send(200, "text/plain", str); // Send HTTP status 200 (Ok) and send some text to the browser/client
+            p_state_str = (ws_desk_state_e == DC_STATE_STANDING) ? "standing" : ((ws_desk_state_e == DC_STATE_SITTING) ? "sitting" : "unknown");
+            size_i = snprintf(p_status, WS_STATUS_SIZE, "Height: %i mm\nState: %s\nTime: %i:%i:%i\nDate: %i/%i/%i", (int)ws_height_u16, p_state_str, p_time->time.hour_u8, p_time->time.minute_u8, p_time->time.second_u8, p_time->date.year_u16, p_time->date.month_u8, p_time->date.day_u8);
         }
         else
         {
-            ws_instance.send(200, "text/plain", "No valid height reading :(");
+            size_i = snprintf(p_status, WS_STATUS_SIZE, "No valid height reading :(");
         }
     }
     else
     {
-        ws_instance.send(200, "text/plain", "No height provider registered!"); // Send HTTP status 200 (Ok) and send some text to the browser/client
+        size_i = snprintf(p_status, WS_STATUS_SIZE, "No time received yet!");
     }
+    ws_status_size_u16 = (uint16)min(size_i, (int)(WS_STATUS_SIZE - 1U));
+
+    /* Content based tag, so it also stays valid across reboots */
+    (void)snprintf(ws_status_headers_str, sizeof(ws_status_headers_str), "ETag: \"%08x\"\r\nCache-Control: no-cache\r\n",
+                   (unsigned)crc32_update(0U, (const uint8 *)p_status, ws_status_size_u16));
+
+    ws_status_dirty_b = false;
 }
 
-void handleNotFound()
+bool ws_etag_matches(const HTTP_REQUEST *p_request, const char *p_etag, const uint16 size_u16)
 {
-    ws_instance.send(404, "text/plain", "404: Not found"); // Send HTTP status 404 (Not Found) when there's no handler for the URI in the request
+    return http_slice_equals(&(p_request->if_none_match), "*") ||
+           ((p_request->if_none_match.size_u16 >= size_u16) &&
+            (memmem(p_request->if_none_match.p_data, p_request->if_none_match.size_u16, p_etag, size_u16) != NULL));
 }
 
-void handleStand()
+/*****************************************************************************/
+
+void handleAsset(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    const WS_ASSET *p_asset = NULL;
+
+    for (uint8 i = 0U; (i < (sizeof(ws_assets) / sizeof(ws_assets[0]))) && (NULL == p_asset); ++i)
+    {
+        if (http_slice_equals(&(p_request->path), ws_assets[i].p_path))
+        {
+            p_asset = &ws_assets[i];
+        }
+    }
+
+    if (NULL == p_asset)
+    {
+        handleNotFound(p_conn, p_request);
+    }
+    else if (ws_etag_matches(p_request, p_asset->p_etag, (uint16)strlen(p_asset->p_etag)))
+    {
+        http_begin_response(p_conn, 304, p_asset->p_content_type, 0U, p_asset->p_headers);
+    }
+    else
+    {
+        /* Streamed from flash as the connection takes it, every browser accepts gzip */
+        http_send_static(p_conn, 200, p_asset->p_content_type, p_asset->p_data, p_asset->size_u32, p_asset->p_headers);
+    }
+}
+
+void handleStatus(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    if (ws_status_dirty_b)
+    {
+        ws_render_status();
+    }
+
+    /* The quoted tag after "ETag: " */
+    if (ws_etag_matches(p_request, &ws_status_headers_str[6], 10U))
+    {
+        http_begin_response(p_conn, 304, "text/plain", 0U, ws_status_headers_str);
+    }
+    else
+    {
+        http_send_static(p_conn, 200, "text/plain", ws_status_vc[ws_status_index_u8], ws_status_size_u16, ws_status_headers_str);
+    }
+}
+
+void handleNotFound(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
+{
+    http_send(p_conn, 404, "text/plain", "404: Not found");
+}
+
+void handleStand(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request)
 {
     if (NULL != ws_command_receiver_fn)
     {
         ws_command_receiver_fn(DC_CMD_UP);
     }
+
+    http_send(p_conn, 200, "text/plain", "OK");
 }
@@ -7,11 +7,7 @@
 
 /*****************************************************************************/
 
-extern void ws_init(const uint16 server_port_u16,
-                    fn_height_provider height_provider,
-                    fn_command_receiver command_receiver,
-                    fn_time_provider time_provider);
-extern void ws_loop();
+extern void ws_init(const uint16 server_port_u16, fn_command_receiver command_receiver);
 
 /*****************************************************************************/
 
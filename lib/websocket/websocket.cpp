@@ -0,0 +1,354 @@
+#include "websocket.h"
+
+#include <string.h>
+
+#include "log.h"
+
+/*****************************************************************************/
+
+typedef struct
+{
+    HTTP_CONN *p_conn; /* NULL if the slot is free */
+    fn_wsk_receiver p_receiver;
+    fn_http_done p_closed;
+} WSK_SESSION;
+
+/*****************************************************************************/
+
+const char wsk_module_str[] PROGMEM = "WebSocket";
+const char *wsk_guid_str = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"; /* RFC 6455 */
+
+/*****************************************************************************/
+
+WSK_SESSION wsk_sessions[WSK_MAX_SESSIONS];
+
+/*****************************************************************************/
+
+uint16 wsk_receive(HTTP_CONN *p_conn, const uint8 *p_data, const uint16 size_u16);
+void wsk_handle_closed(HTTP_CONN *p_conn);
+WSK_SESSION *wsk_find_session(const HTTP_CONN *p_conn);
+
+void wsk_sha1(const uint8 *p_data, const uint32 size_u32, uint8 digest_vu8[20]);
+void wsk_sha1_block(uint32 state_vu32[5], const uint8 *p_block);
+void wsk_base64(const uint8 *p_data, const uint8 size_u8, char *p_out);
+
+/*****************************************************************************/
+
+bool wsk_accept(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request, fn_wsk_receiver p_receiver, fn_http_producer p_producer, fn_http_done p_closed)
+{
+    WSK_SESSION *p_session = wsk_find_session(NULL);
+    uint8 key_vu8[64];
+    uint8 digest_vu8[20];
+    char headers_str[64];
+    const uint16 guid_size_u16 = (uint16)strlen(wsk_guid_str);
+
+    if ((p_request->websocket_key.size_u16 == 0U) || ((p_request->websocket_key.size_u16 + guid_size_u16) > sizeof(key_vu8)))
+    {
+        http_send(p_conn, 400, "text/plain", "WebSocket handshake expected");
+        return false;
+    }
+
+    if (NULL == p_session)
+    {
+        http_send(p_conn, 503, "text/plain", "Too many WebSocket sessions");
+        return false;
+    }
+
+    /* Sec-WebSocket-Accept: base64(sha1(key + GUID)) */
+    (void)memcpy(key_vu8, p_request->websocket_key.p_data, p_request->websocket_key.size_u16);
+    (void)memcpy(&key_vu8[p_request->websocket_key.size_u16], wsk_guid_str, guid_size_u16);
+    wsk_sha1(key_vu8, p_request->websocket_key.size_u16 + guid_size_u16, digest_vu8);
+    (void)strcpy(headers_str, "Sec-WebSocket-Accept: ");
+    wsk_base64(digest_vu8, sizeof(digest_vu8), &headers_str[strlen(headers_str)]);
+    (void)strcat(headers_str, "\r\n");
+
+    p_session->p_conn = p_conn;
+    p_session->p_receiver = p_receiver;
+    p_session->p_closed = p_closed;
+
+    http_upgrade(p_conn, headers_str, wsk_receive, p_producer);
+    http_set_done_handler(p_conn, wsk_handle_closed);
+
+    return true;
+}
+
+bool wsk_send(HTTP_CONN *p_conn, const WSK_OPCODE opcode_e, const uint8 *p_data, const uint16 size_u16)
+{
+    uint8 header_vu8[4];
+    uint16 header_size_u16 = 2U;
+    bool sent_b = false;
+
+    /* Server frames are never masked */
+    header_vu8[0] = 0x80U | (uint8)opcode_e;
+    if (size_u16 < 126U)
+    {
+        header_vu8[1] = (uint8)size_u16;
+    }
+    else
+    {
+        header_vu8[1] = 126U;
+        header_vu8[2] = (uint8)(size_u16 >> 8);
+        header_vu8[3] = (uint8)size_u16;
+        header_size_u16 = 4U;
+    }
+
+    if (http_tx_free(p_conn) >= (header_size_u16 + size_u16))
+    {
+        (void)http_write(p_conn, header_vu8, header_size_u16);
+        (void)http_write(p_conn, p_data, size_u16);
+        sent_b = true;
+    }
+
+    return sent_b;
+}
+
+void wsk_close(HTTP_CONN *p_conn, const uint16 status_u16)
+{
+    const uint8 payload_vu8[2] = {(uint8)(status_u16 >> 8), (uint8)status_u16};
+
+    (void)wsk_send(p_conn, WSK_OPCODE_CLOSE, payload_vu8, sizeof(payload_vu8));
+    http_shutdown(p_conn);
+}
+
+/*****************************************************************************/
+
+uint16 wsk_receive(HTTP_CONN *p_conn, const uint8 *p_data, const uint16 size_u16)
+{
+    WSK_SESSION *p_session = wsk_find_session(p_conn);
+    uint16 consumed_u16 = 0U;
+
+    /* Handle every complete frame in the buffer, partial ones wait for more data */
+    while ((NULL != p_session) && ((uint16)(size_u16 - consumed_u16) >= 2U))
+    {
+        const uint16 remaining_u16 = size_u16 - consumed_u16;
+        uint8 *p_frame = (uint8 *)&p_data[consumed_u16];
+        const bool fin_b = (p_frame[0] & 0x80U) != 0U;
+        const WSK_OPCODE opcode_e = (WSK_OPCODE)(p_frame[0] & 0x0fU);
+        const bool masked_b = (p_frame[1] & 0x80U) != 0U;
+        uint32 payload_size_u32 = p_frame[1] & 0x7fU;
+        uint16 header_size_u16 = 2U;
+        uint8 *p_payload;
+
+        if (payload_size_u32 == 126U)
+        {
+            if (remaining_u16 < 4U)
+            {
+                break;
+            }
+            payload_size_u32 = ((uint32)p_frame[2] << 8) | p_frame[3];
+            header_size_u16 = 4U;
+        }
+        else if (payload_size_u32 == 127U)
+        {
+            /* Would never fit into the receive buffer anyway */
+            payload_size_u32 = HTTP_RX_BUFFER_SIZE;
+        }
+        else
+        {
+            /* Short length */
+        }
+        header_size_u16 += masked_b ? 4U : 0U;
+
+        if (!masked_b || !fin_b || (opcode_e == WSK_OPCODE_CONTINUATION) || ((header_size_u16 + payload_size_u32) > HTTP_RX_BUFFER_SIZE))
+        {
+            /* Clients must mask, and we do not reassemble fragments */
+            log_msg(LOG_LEVEL_WARNING, wsk_module_str, "Unsupported frame, closing.");
+            wsk_close(p_conn, 1003U);
+            return size_u16;
+        }
+
+        if (remaining_u16 < (header_size_u16 + payload_size_u32))
+        {
+            break;
+        }
+
+        /* Unmask in place */
+        p_payload = &p_frame[header_size_u16];
+        for (uint16 i = 0U; i < payload_size_u32; ++i)
+        {
+            p_payload[i] ^= p_frame[header_size_u16 - 4U + (i & 3U)];
+        }
+        consumed_u16 += header_size_u16 + (uint16)payload_size_u32;
+
+        switch (opcode_e)
+        {
+        case WSK_OPCODE_TEXT:
+        case WSK_OPCODE_BINARY:
+        {
+            p_session->p_receiver(p_conn, opcode_e, p_payload, (uint16)payload_size_u32);
+            break;
+        }
+        case WSK_OPCODE_PING:
+        {
+            (void)wsk_send(p_conn, WSK_OPCODE_PONG, p_payload, (uint16)payload_size_u32);
+            break;
+        }
+        case WSK_OPCODE_CLOSE:
+        {
+            wsk_close(p_conn, 1000U);
+            return size_u16;
+        }
+        default:
+        {
+            /* Pongs and reserved opcodes */
+            break;
+        }
+        }
+
+        /* Receiver might have closed the session */
+        p_session = wsk_find_session(p_conn);
+    }
+
+    return consumed_u16;
+}
+
+void wsk_handle_closed(HTTP_CONN *p_conn)
+{
+    WSK_SESSION *p_session = wsk_find_session(p_conn);
+    fn_http_done p_closed;
+
+    if (NULL != p_session)
+    {
+        p_closed = p_session->p_closed;
+        p_session->p_conn = NULL;
+
+        if (NULL != p_closed)
+        {
+            p_closed(p_conn);
+        }
+    }
+}
+
+WSK_SESSION *wsk_find_session(const HTTP_CONN *p_conn)
+{
+    WSK_SESSION *p_session = NULL;
+
+    for (uint8 i = 0U; (i < WSK_MAX_SESSIONS) && (NULL == p_session); ++i)
+    {
+        if (wsk_sessions[i].p_conn == p_conn)
+        {
+            p_session = &wsk_sessions[i];
+        }
+    }
+
+    return p_session;
+}
+
+/*****************************************************************************/
+
+void wsk_sha1(const uint8 *p_data, const uint32 size_u32, uint8 digest_vu8[20])
+{
+    uint32 state_vu32[5] = {0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL, 0xc3d2e1f0UL};
+    uint8 block_vu8[64];
+    uint32 pos_u32 = 0U;
+    uint32 rest_u32;
+    const uint64 bits_u64 = (uint64)size_u32 * 8U;
+
+    for (; (pos_u32 + 64U) <= size_u32; pos_u32 += 64U)
+    {
+        wsk_sha1_block(state_vu32, &p_data[pos_u32]);
+    }
+
+    /* Padding: 0x80, zeros, length in bits */
+    rest_u32 = size_u32 - pos_u32;
+    (void)memset(block_vu8, 0, sizeof(block_vu8));
+    (void)memcpy(block_vu8, &p_data[pos_u32], rest_u32);
+    block_vu8[rest_u32] = 0x80U;
+    if (rest_u32 >= 56U)
+    {
+        wsk_sha1_block(state_vu32, block_vu8);
+        (void)memset(block_vu8, 0, sizeof(block_vu8));
+    }
+    for (uint8 i = 0U; i < 8U; ++i)
+    {
+        block_vu8[63U - i] = (uint8)(bits_u64 >> (8U * i));
+    }
+    wsk_sha1_block(state_vu32, block_vu8);
+
+    for (uint8 i = 0U; i < 20U; ++i)
+    {
+        digest_vu8[i] = (uint8)(state_vu32[i / 4U] >> (24U - (8U * (i % 4U))));
+    }
+}
+
+void wsk_sha1_block(uint32 state_vu32[5], const uint8 *p_block)
+{
+    uint32 w_vu32[16];
+    uint32 a = state_vu32[0];
+    uint32 b = state_vu32[1];
+    uint32 c = state_vu32[2];
+    uint32 d = state_vu32[3];
+    uint32 e = state_vu32[4];
+    uint32 f;
+    uint32 k;
+    uint32 temp;
+
+    for (uint8 i = 0U; i < 16U; ++i)
+    {
+        w_vu32[i] = ((uint32)p_block[4U * i] << 24) | ((uint32)p_block[(4U * i) + 1U] << 16) |
+                    ((uint32)p_block[(4U * i) + 2U] << 8) | (uint32)p_block[(4U * i) + 3U];
+    }
+
+    /* Message schedule kept in a 16 word ring */
+    for (uint8 i = 0U; i < 80U; ++i)
+    {
+        if (i >= 16U)
+        {
+            temp = w_vu32[(i + 13U) & 15U] ^ w_vu32[(i + 8U) & 15U] ^ w_vu32[(i + 2U) & 15U] ^ w_vu32[i & 15U];
+            w_vu32[i & 15U] = (temp << 1) | (temp >> 31);
+        }
+
+        if (i < 20U)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999UL;
+        }
+        else if (i < 40U)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1UL;
+        }
+        else if (i < 60U)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdcUL;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6UL;
+        }
+
+        temp = ((a << 5) | (a >> 27)) + f + e + k + w_vu32[i & 15U];
+        e = d;
+        d = c;
+        c = (b << 30) | (b >> 2);
+        b = a;
+        a = temp;
+    }
+
+    state_vu32[0] += a;
+    state_vu32[1] += b;
+    state_vu32[2] += c;
+    state_vu32[3] += d;
+    state_vu32[4] += e;
+}
+
+void wsk_base64(const uint8 *p_data, const uint8 size_u8, char *p_out)
+{
+    const char *p_alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32 group_u32;
+
+    for (uint8 i = 0U; i < size_u8; i += 3U)
+    {
+        group_u32 = (uint32)p_data[i] << 16;
+        group_u32 |= ((i + 1U) < size_u8) ? ((uint32)p_data[i + 1U] << 8) : 0U;
+        group_u32 |= ((i + 2U) < size_u8) ? (uint32)p_data[i + 2U] : 0U;
+
+        *p_out++ = p_alphabet[(group_u32 >> 18) & 0x3fU];
+        *p_out++ = p_alphabet[(group_u32 >> 12) & 0x3fU];
+        *p_out++ = ((i + 1U) < size_u8) ? p_alphabet[(group_u32 >> 6) & 0x3fU] : '=';
+        *p_out++ = ((i + 2U) < size_u8) ? p_alphabet[group_u32 & 0x3fU] : '=';
+    }
+    *p_out = '\0';
+}
@@ -0,0 +1,39 @@
+#ifndef WSK_MAIN_H
+#define WSK_MAIN_H
+
+/*****************************************************************************/
+
+#include "core.h"
+#include "http.h"
+
+/*****************************************************************************/
+
+#define WSK_MAX_SESSIONS 2U
+
+/*****************************************************************************/
+
+typedef enum
+{
+    WSK_OPCODE_CONTINUATION = 0x0,
+    WSK_OPCODE_TEXT = 0x1,
+    WSK_OPCODE_BINARY = 0x2,
+    WSK_OPCODE_CLOSE = 0x8,
+    WSK_OPCODE_PING = 0x9,
+    WSK_OPCODE_PONG = 0xa
+} WSK_OPCODE;
+
+/* Called for every complete text or binary message, control frames are handled here */
+typedef void (*fn_wsk_receiver)(HTTP_CONN *p_conn, const WSK_OPCODE opcode_e, const uint8 *p_data, const uint16 size_u16);
+
+/*****************************************************************************/
+
+/* Completes the handshake from within an HTTP handler, answers 400/503 itself if that is not possible */
+extern bool wsk_accept(HTTP_CONN *p_conn, const HTTP_REQUEST *p_request, fn_wsk_receiver p_receiver, fn_http_producer p_producer, fn_http_done p_closed);
+
+/* Queues one unfragmented message, false if it does not fit into the transmit buffer right now */
+extern bool wsk_send(HTTP_CONN *p_conn, const WSK_OPCODE opcode_e, const uint8 *p_data, const uint16 size_u16);
+extern void wsk_close(HTTP_CONN *p_conn, const uint16 status_u16);
+
+/*****************************************************************************/
+
+#endif
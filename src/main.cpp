@@ -1,8 +1,21 @@
 #include <ESP8266WiFi.h>
-#include <WiFiClient.h>
-#include <ESP8266mDNS.h>
 
+#include "tasks.h"
+#include "events.h"
+#include "network.h"
+#include "config.h"
 #include "webserver.h"
+#include "api.h"
+#include "sse.h"
+#include "jog.h"
+#include "metrics.h"
+#include "trace.h"
+#include "syslog.h"
+#include "history.h"
+#include "fleet.h"
+#include "mqtt.h"
+#include "stagger.h"
+#include "memory.h"
 #include "deskcontrol.h"
 #include "scheduler.h"
 #include "ntp.h"
@@ -12,10 +25,18 @@
 
 const unsigned long SERIAL_BAUDRATE = 115200;
 const unsigned int WEBSERVER_PORT = 8080;
+const uint16 FLEET_PORT = FP_DEFAULT_PORT; /* UDP status and commands, see lib/fleet/fleet_protocol.h */
 const char *NTP_SERVER = "pool.ntp.org";
 const int NTP_TIME_DIFF = 2 * 3600;
-const char *wifi_mod_str = "WiFi";
+const char *MDNS_HOSTNAME = "esp8266";
+const char *SYSLOG_SERVER = ""; /* IPv4 address of a syslog server, can also be set with PUT /api/syslog */
+const uint16 SYSLOG_PORT = SL_DEFAULT_PORT;
+const char *MQTT_BROKER = ""; /* IPv4 address of an MQTT broker, can also be set with PUT /api/mqtt */
+const uint16 MQTT_PORT = MQ_DEFAULT_PORT;
+const uint16 STAGGER_WINDOW_S = 0U; /* spread scheduled moves of nearby desks over this many seconds, can also be set with PUT /api/stagger */
+const uint16 STAGGER_PORT = SG_DEFAULT_PORT;
 const LOG_LEVEL LOGLEVEL = LOG_LEVEL::LOG_LEVEL_INFO;
+const uint32 LED_TOGGLE_PERIOD_MS = 500U;
 
 /* Settings likely to be modified by a user */
 
@@ -24,71 +45,74 @@ const char* WIFI_PASS = "put-your-wifi-password-here";
 
 /*****************************************************************************/
 
-void init_wifi(const char *ssid, const char *password);
-void set_default_config();
-void set_test_config();
-void led_loop();
+void set_default_config(SYSTEM_CONFIG *p_config);
+void set_test_config(SYSTEM_CONFIG *p_config);
+void apply_config(const SYSTEM_CONFIG *p_config);
+void led_toggle();
+int web_command(const DC_COMMAND cmd_e);
+int scheduler_command(const DC_COMMAND cmd_e);
 
 /*****************************************************************************/
 
 void setup(void)
 {
-  /* Setup serial communication to computer using Arduino-Log */
+  SYSTEM_CONFIG config;
+
+  /* Setup serial communication to computer, messages are queued and written out by a task */
   Serial.begin(SERIAL_BAUDRATE);
   log_set_global_level(LOGLEVEL);
 
-  /* Initialize wifi and NTP */
-  init_wifi(WIFI_SSID, WIFI_PASS);
-  ntp_init(NTP_SERVER, NTP_TIME_DIFF);
+  /* Modules register their tasks with the runtime during init */
+  tk_init();
+  log_init();
+  ev_init();
+  mm_init();
+
+  /* Start connecting in the background, modules do not need to wait for it */
+  nw_init(WIFI_SSID, WIFI_PASS, MDNS_HOSTNAME);
+  nw_set_service("flexidesk", WEBSERVER_PORT);
 
   /* Initialize modules */
-  ws_init(WEBSERVER_PORT, dc_get_current_height, dc_send_cmd, ntp_get_current_time);
+  ntp_init(NTP_SERVER, NTP_TIME_DIFF);
+  ws_init(WEBSERVER_PORT, web_command);
+  api_init(web_command);
+  sse_init();
+  jog_init();
+  mt_init();
+  tr_init();
+  sl_init(MDNS_HOSTNAME, SYSLOG_SERVER, SYSLOG_PORT);
   dc_init();
   sc_init();
-  sc_set_time_provider(ntp_get_current_time);
-  sc_set_desk_command_receiver(dc_send_cmd);
-  sc_set_desk_state_provider(dc_get_current_state);
-
-  /* Set our default config for now */
-  set_default_config();
+  sc_set_desk_command_receiver(scheduler_command);
+  hs_init();
+  fp_init(FLEET_PORT, web_command, nw_get_instance_name(), WEBSERVER_PORT);
+  mq_init(nw_get_instance_name(), MQTT_BROKER, MQTT_PORT, web_command);
+  sg_init(STAGGER_PORT, STAGGER_WINDOW_S);
+
+  /* Restore the stored config over the defaults, which fill in what an older one does not have */
+  cfg_init();
+  set_default_config(&config);
+  (void)cfg_load(&config);
+  apply_config(&config);
 
   /* LED for status notification */
   pinMode(LED_BUILTIN, OUTPUT);
+  (void)tk_add_periodic("LED", led_toggle, LED_TOGGLE_PERIOD_MS);
 }
 
 void loop(void)
 {
-  ntp_loop();
-  dc_loop();
-  ws_loop();
-  sc_loop();
-  led_loop();
+  tk_run();
 }
 
 /*****************************************************************************/
 
-void init_wifi(const char *ssid, const char *password)
+void set_default_config(SYSTEM_CONFIG *p_config)
 {
-  log_msg(LOG_LEVEL::LOG_LEVEL_INFO, wifi_mod_str, "Connecting to WiFi.");
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED)
-  {
-    delay(250);
-  }
+  SYSTEM_CONFIG config = {0};
+  IPAddress syslog_server;
+  IPAddress mqtt_broker;
 
-  log_msg(LOG_LEVEL::LOG_LEVEL_INFO, wifi_mod_str, "Connected with IP %i.%i.%i.%i", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
-  if (MDNS.begin("esp8266"))
-  {
-    log_msg(LOG_LEVEL_INFO, "WebServer", "mDNS responder started.");
-  }
-  else
-  {
-    log_msg(LOG_LEVEL_ERROR, "WebServer", "Error setting up MDNS responder.");
-  }
-}
-
-void set_default_config()
-{
   /* Day configs */
   const DAY_CONFIG weekday_config = {
       .start_time = {.hour_u8 = 9U, .minute_u8 = 0U, .second_u8 = 0U}, /* start at 9am */
@@ -99,22 +123,53 @@ void set_default_config()
   const DAY_CONFIG weekend_config = {0}; /* just disabled */
 
   /* Sitting/standing positions - in millimeter! */
-  dc_set_params(1150U, 750U, 50U);
+  config.height_standing_u16 = 1150U;
+  config.height_sitting_u16 = 750U;
+  config.height_tolerance_u16 = 50U;
+
+  /* Scheduler tolerances */
+  config.transition_time_tolerance_u16 = 1U * 60U; /* 1 minute */
+  config.command_send_time_tolerance_u16 = 30U;    /* 30 seconds */
 
   /* Set for all weekdays */
-  sc_set_day_config(MONDAY, &weekday_config);
-  sc_set_day_config(TUESDAY, &weekday_config);
-  sc_set_day_config(WEDNESDAY, &weekday_config);
-  sc_set_day_config(THURSDAY, &weekday_config);
-  sc_set_day_config(FRIDAY, &weekday_config);
+  config.day_configs[MONDAY] = weekday_config;
+  config.day_configs[TUESDAY] = weekday_config;
+  config.day_configs[WEDNESDAY] = weekday_config;
+  config.day_configs[THURSDAY] = weekday_config;
+  config.day_configs[FRIDAY] = weekday_config;
 
   /* Set disabled for weekend */
-  sc_set_day_config(SATURDAY, &weekend_config);
-  sc_set_day_config(SUNDAY, &weekend_config);
+  config.day_configs[SATURDAY] = weekend_config;
+  config.day_configs[SUNDAY] = weekend_config;
+
+  /* Log shipping as configured above, off unless SYSLOG_SERVER is an address */
+  if (syslog_server.fromString(SYSLOG_SERVER))
+  {
+    for (uint8 i = 0U; i < 4U; ++i)
+    {
+      config.syslog_server_vu8[i] = syslog_server[i];
+    }
+    config.syslog_port_u16 = SYSLOG_PORT;
+  }
+
+  /* The same for MQTT */
+  if (mqtt_broker.fromString(MQTT_BROKER))
+  {
+    for (uint8 i = 0U; i < 4U; ++i)
+    {
+      config.mqtt_broker_vu8[i] = mqtt_broker[i];
+    }
+    config.mqtt_port_u16 = MQTT_PORT;
+  }
+  config.stagger_window_s_u16 = STAGGER_WINDOW_S;
+
+  *p_config = config;
 }
 
-void set_test_config()
+void set_test_config(SYSTEM_CONFIG *p_config)
 {
+  SYSTEM_CONFIG config;
+
   /* Day configs */
   const DAY_CONFIG test_config = {
       .start_time = {.hour_u8 = 0U, .minute_u8 = 0U, .second_u8 = 0U},
@@ -123,25 +178,45 @@ void set_test_config()
       .duration_u16 = 1 * 60U,
       .enabled = 1};
 
-  /* Sitting/standing positions - in millimeter! */
-  dc_set_params(1150U, 750U, 50U);
+  /* Heights, tolerances and the rest as in the default config */
+  set_default_config(&config);
 
   /* Set same test config for every day */
-  sc_set_day_config(MONDAY, &test_config);
-  sc_set_day_config(TUESDAY, &test_config);
-  sc_set_day_config(WEDNESDAY, &test_config);
-  sc_set_day_config(THURSDAY, &test_config);
-  sc_set_day_config(FRIDAY, &test_config);
-  sc_set_day_config(SATURDAY, &test_config);
-  sc_set_day_config(SUNDAY, &test_config);
+  for (uint8 day_u8 = 0U; day_u8 < NUM_WEEKDAYS; ++day_u8)
+  {
+    config.day_configs[day_u8] = test_config;
+  }
+
+  *p_config = config;
+}
+
+void apply_config(const SYSTEM_CONFIG *p_config)
+{
+  EVENT event;
+
+  /* Desk control, scheduler, syslog, MQTT and stagger pick their parts from the event */
+  event.type_e = EV_CONFIG_CHANGED;
+  event.data.p_config = p_config;
+  ev_publish(&event);
 }
 
-void led_loop()
+void led_toggle()
 {
   static uint8 led_state_u8 = LOW;
 
-  /* Toggle state every x milliseconds */
-  ONCE_EVERY_MS(500);
   led_state_u8 = (led_state_u8 == HIGH) ? LOW : HIGH;
   digitalWrite(LED_BUILTIN, led_state_u8);
 }
+
+/* The history tells moves apart by who sent the command */
+int web_command(const DC_COMMAND cmd_e)
+{
+  hs_note_trigger(HS_TRIGGER_WEB);
+  return dc_send_cmd(cmd_e);
+}
+
+int scheduler_command(const DC_COMMAND cmd_e)
+{
+  hs_note_trigger(HS_TRIGGER_SCHEDULER);
+  return dc_send_cmd(cmd_e);
+}
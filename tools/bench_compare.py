@@ -0,0 +1,58 @@
+"""
+Compares two runs of the native benchmarks (one JSON object per line, see bench/main.cpp)
+and fails if any result got slower than the allowed ratio:
+
+    .pio/build/native/program > current.json
+    python3 tools/bench_compare.py baseline.json current.json [-t 1.25]
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith("{"):
+                result = json.loads(line)
+                results[(result["suite"], result["name"])] = result["ns_per_op"]
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("-t", "--threshold", type=float, default=1.25, help="current/baseline ratio that counts as a regression")
+    parser.add_argument("-m", "--min-ns", type=float, default=1.0, help="results faster than this are too noisy to compare")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = []
+
+    for key in sorted(current):
+        before = baseline.get(key)
+        after = current[key]
+        if before is None:
+            print(f"{key[0]:<12} {key[1]:<28} {'':>10} {after:>10.2f}  new")
+            continue
+
+        ratio = after / before if before > 0.0 else 1.0
+        regressed = (ratio > args.threshold) and (max(before, after) >= args.min_ns)
+        print(f"{key[0]:<12} {key[1]:<28} {before:>10.2f} {after:>10.2f}  {ratio:5.2f}x{'  REGRESSION' if regressed else ''}")
+        if regressed:
+            regressions.append({"suite": key[0], "name": key[1], "baseline_ns": before, "current_ns": after, "ratio": round(ratio, 3)})
+
+    for key in sorted(set(baseline) - set(current)):
+        print(f"{key[0]:<12} {key[1]:<28} {baseline[key]:>10.2f} {'':>10}  missing")
+
+    print(json.dumps({"compared": len(set(baseline) & set(current)), "regressions": regressions}))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,100 @@
+"""
+Turns the web UI in ui/ into gzip-compressed PROGMEM arrays for the webserver module.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:tools/embed_ui.py) and writes
+ws_assets.h into the build directory, or standalone for other builds:
+
+    python3 tools/embed_ui.py <output directory>
+
+References like {{app.js}} in the HTML are replaced with a path carrying the content tag
+of that asset, which lets everything but the page itself be cached forever.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+UI_DIR = "ui"
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+CACHE_PAGE = "no-cache"                              # revalidated every time, a 304 if unchanged
+CACHE_ASSET = "public, max-age=31536000, immutable"  # URL changes with the content
+
+
+def minify(text):
+    # Indentation and blank lines only, good enough for the hand-written sources
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip()) + "\n"
+
+
+def compress(data):
+    # mtime=0 keeps the output and with it the tag reproducible
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def tag(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static const uint8 %s[] PROGMEM = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def build(project_dir, out_dir):
+    ui_dir = os.path.join(project_dir, UI_DIR)
+    assets = {}
+
+    # Everything but the page first, the page refers to their tags
+    names = sorted(n for n in os.listdir(ui_dir) if os.path.splitext(n)[1] in CONTENT_TYPES)
+    names.sort(key=lambda n: n == "index.html")
+    for name in names:
+        with open(os.path.join(ui_dir, name), encoding="utf-8") as f:
+            text = minify(f.read())
+        text = re.sub(r"\{\{([\w.]+)\}\}", lambda m: "/%s?v=%s" % (m.group(1), assets[m.group(1)]["tag"]), text)
+        data = compress(text.encode("utf-8"))
+        assets[name] = {"data": data, "tag": tag(data), "raw_size": len(text)}
+
+    out = ["/* Generated by tools/embed_ui.py from ui/, do not edit */\n",
+           "#ifndef WS_ASSETS_H\n#define WS_ASSETS_H\n\n"]
+    rows = []
+    for i, name in enumerate(names):
+        asset = assets[name]
+        page = name == "index.html"
+        out.append("/* %s: %u bytes, %u gzipped */\n" % (name, asset["raw_size"], len(asset["data"])))
+        out.append(c_array("ws_asset_%u_vu8" % i, asset["data"]))
+        headers = "Content-Encoding: gzip\\r\\nVary: Accept-Encoding\\r\\nETag: \\\"%s\\\"\\r\\nCache-Control: %s\\r\\n" % (
+            asset["tag"], CACHE_PAGE if page else CACHE_ASSET)
+        # The page has its own path, / stays the plain text status that pollers rely on
+        rows.append('    {"/%s", "%s", ws_asset_%u_vu8, sizeof(ws_asset_%u_vu8), "\\"%s\\"", "%s"},' % (
+            "ui" if page else name, CONTENT_TYPES[os.path.splitext(name)[1]], i, i, asset["tag"], headers))
+    out.append("\nstatic const WS_ASSET ws_assets[] = {\n%s\n};\n\n#endif\n" % "\n".join(rows))
+
+    os.makedirs(out_dir, exist_ok=True)
+    path = os.path.join(out_dir, "ws_assets.h")
+    content = "".join(out)
+    # Only touch the header if something changed, saves a rebuild
+    if not os.path.exists(path) or open(path, encoding="utf-8").read() != content:
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(content)
+
+    for name in names:
+        print("embed_ui: %-10s %5u -> %5u bytes" % (name, assets[name]["raw_size"], len(assets[name]["data"])))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "ui")  # noqa: F821
+    build(env.subst("$PROJECT_DIR"), out_dir)  # noqa: F821
+    env.Append(CPPPATH=[out_dir])  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if len(sys.argv) != 2:
+            sys.exit("usage: embed_ui.py <output directory>")
+        build(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."), sys.argv[1])
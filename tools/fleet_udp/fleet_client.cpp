@@ -0,0 +1,279 @@
+#include "fleet_client.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+#define FC_RECEIVE_BUFFER_SIZE (4 * 1024 * 1024) /* a few hundred answers arrive at once */
+
+/*****************************************************************************/
+
+/* Indexed like DC_COMMAND, DC_STATE and SCHEDULER_STATE in the firmware */
+static const char *fc_command_names[] = {"invalid", "wakeup", "up", "down", "m", "preset1", "preset2", "preset3", "preset4"};
+static const char *fc_desk_state_names[] = {"unknown", "standing", "sitting"};
+static const char *fc_scheduler_state_names[] = {"inactive", "sit_to_stand", "stand_to_sit", "sitting", "standing"};
+
+/*****************************************************************************/
+
+uint64_t fc_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+int fc_open()
+{
+    const int one_i = 1;
+    const int buffer_i = FC_RECEIVE_BUFFER_SIZE;
+    const int fd_i = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd_i >= 0)
+    {
+        (void)setsockopt(fd_i, SOL_SOCKET, SO_BROADCAST, &one_i, sizeof(one_i));
+        /* The forced variant goes past rmem_max but needs privileges */
+        if (setsockopt(fd_i, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_i, sizeof(buffer_i)) != 0)
+        {
+            (void)setsockopt(fd_i, SOL_SOCKET, SO_RCVBUF, &buffer_i, sizeof(buffer_i));
+        }
+        (void)fcntl(fd_i, F_SETFL, fcntl(fd_i, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    return fd_i;
+}
+
+bool fc_add_targets(const char *p_spec, std::vector<struct sockaddr_in> *p_targets)
+{
+    const char *p_colon = strrchr(p_spec, ':');
+    struct addrinfo hints;
+    struct addrinfo *p_result = NULL;
+    struct sockaddr_in addr;
+    unsigned long first_ul;
+    unsigned long last_ul;
+    char *p_end;
+    std::string host;
+
+    if (NULL == p_colon)
+    {
+        return false;
+    }
+
+    host.assign(p_spec, (size_t)(p_colon - p_spec));
+    first_ul = strtoul(p_colon + 1, &p_end, 10);
+    last_ul = (*p_end == '-') ? strtoul(p_end + 1, NULL, 10) : first_ul;
+
+    (void)memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if ((first_ul == 0U) || (last_ul < first_ul) || (last_ul > 65535U) || (getaddrinfo(host.c_str(), NULL, &hints, &p_result) != 0))
+    {
+        return false;
+    }
+
+    addr = *(const struct sockaddr_in *)p_result->ai_addr;
+    freeaddrinfo(p_result);
+    for (unsigned long port_ul = first_ul; port_ul <= last_ul; ++port_ul)
+    {
+        addr.sin_port = htons((uint16_t)port_ul);
+        p_targets->push_back(addr);
+    }
+
+    return true;
+}
+
+bool fc_send(const int fd_i, const struct sockaddr_in *p_to, const uint8_t type_u8, const uint32_t request_id_u32, const uint8_t command_u8)
+{
+    FP_COMMAND datagram;
+    const size_t size = (type_u8 == FP_MSG_COMMAND) ? sizeof(FP_COMMAND) : sizeof(FP_HEADER);
+    struct pollfd pfd;
+
+    (void)memset(&datagram, 0, sizeof(datagram));
+    datagram.header.magic_u16 = FP_MAGIC;
+    datagram.header.version_u8 = FP_VERSION;
+    datagram.header.type_u8 = type_u8;
+    datagram.header.request_id_u32 = request_id_u32;
+    datagram.command_u8 = command_u8;
+
+    /* A full send buffer only happens in bursts to hundreds of desks, it drains within microseconds */
+    for (int attempt_i = 0; attempt_i < 100; ++attempt_i)
+    {
+        if (sendto(fd_i, &datagram, size, 0, (const struct sockaddr *)p_to, sizeof(*p_to)) == (ssize_t)size)
+        {
+            return true;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ENOBUFS))
+        {
+            return false;
+        }
+
+        pfd.fd = fd_i;
+        pfd.events = POLLOUT;
+        (void)poll(&pfd, 1, 1);
+    }
+
+    return false;
+}
+
+bool fc_receive(const int fd_i, FC_REPLY *p_reply, const int timeout_ms)
+{
+    const uint64_t deadline_ns_u64 = fc_now_ns() + ((uint64_t)timeout_ms * 1000000ULL);
+    uint8_t buffer_vu8[1500];
+    socklen_t size = sizeof(p_reply->from);
+    const FP_HEADER *p_header = (const FP_HEADER *)buffer_vu8;
+    struct pollfd pfd;
+    uint64_t now_ns_u64;
+    ssize_t read_i;
+
+    for (;;)
+    {
+        size = sizeof(p_reply->from);
+        read_i = recvfrom(fd_i, buffer_vu8, sizeof(buffer_vu8), 0, (struct sockaddr *)&(p_reply->from), &size);
+        if (read_i < 0)
+        {
+            now_ns_u64 = fc_now_ns();
+            if (((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) || (now_ns_u64 >= deadline_ns_u64))
+            {
+                return false;
+            }
+
+            pfd.fd = fd_i;
+            pfd.events = POLLIN;
+            (void)poll(&pfd, 1, (int)((deadline_ns_u64 - now_ns_u64 + 999999ULL) / 1000000ULL));
+            continue;
+        }
+
+        if ((read_i < (ssize_t)sizeof(FP_HEADER)) || (p_header->magic_u16 != FP_MAGIC) || (p_header->version_u8 != FP_VERSION))
+        {
+            /* Not ours, maybe our own broadcast */
+            continue;
+        }
+
+        p_reply->type_u8 = p_header->type_u8;
+        p_reply->request_id_u32 = p_header->request_id_u32;
+        if (((p_header->type_u8 == FP_MSG_STATUS) && (read_i >= (ssize_t)sizeof(FP_STATUS))) ||
+            ((p_header->type_u8 == FP_MSG_ANNOUNCE) && (read_i >= (ssize_t)sizeof(FP_ANNOUNCE))))
+        {
+            (void)memcpy(&(p_reply->status), buffer_vu8, sizeof(FP_STATUS));
+            if (p_header->type_u8 == FP_MSG_ANNOUNCE)
+            {
+                const FP_ANNOUNCE *p_announce = (const FP_ANNOUNCE *)buffer_vu8;
+
+                p_reply->http_port_u16 = p_announce->http_port_u16;
+                (void)memcpy(p_reply->name_str, p_announce->name_str, FP_NAME_SIZE);
+                p_reply->name_str[FP_NAME_SIZE] = '\0';
+            }
+            return true;
+        }
+        if ((p_header->type_u8 == FP_MSG_COMMAND_ACK) && (read_i >= (ssize_t)sizeof(FP_COMMAND_ACK)))
+        {
+            (void)memcpy(&(p_reply->ack), buffer_vu8, sizeof(FP_COMMAND_ACK));
+            return true;
+        }
+
+        /* Requests of other clients on the broadcast address */
+    }
+}
+
+uint32_t fc_sweep(const int fd_i, const std::vector<struct sockaddr_in> &targets, const uint8_t type_u8, const uint32_t request_id_u32,
+                  const uint8_t command_u8, const uint32_t expected_u32, const int timeout_ms, std::vector<FC_REPLY> *p_replies)
+{
+    const uint64_t deadline_ns_u64 = fc_now_ns() + ((uint64_t)timeout_ms * 1000000ULL);
+    uint32_t received_u32 = 0U;
+    uint64_t now_ns_u64;
+    FC_REPLY reply;
+
+    for (const struct sockaddr_in &target : targets)
+    {
+        (void)fc_send(fd_i, &target, type_u8, request_id_u32, command_u8);
+    }
+
+    while (((expected_u32 == 0U) || (received_u32 < expected_u32)) && ((now_ns_u64 = fc_now_ns()) < deadline_ns_u64))
+    {
+        if (fc_receive(fd_i, &reply, (int)((deadline_ns_u64 - now_ns_u64 + 999999ULL) / 1000000ULL)) &&
+            (reply.request_id_u32 == request_id_u32))
+        {
+            received_u32 += 1U;
+            if (NULL != p_replies)
+            {
+                p_replies->push_back(reply);
+            }
+        }
+    }
+
+    return received_u32;
+}
+
+bool fc_command(const int fd_i, const struct sockaddr_in *p_to, const uint8_t command_u8, const uint32_t request_id_u32,
+                const int attempts_i, const int timeout_ms, FC_REPLY *p_ack)
+{
+    for (int attempt_i = 0; attempt_i < attempts_i; ++attempt_i)
+    {
+        const uint64_t deadline_ns_u64 = fc_now_ns() + ((uint64_t)timeout_ms * 1000000ULL);
+        uint64_t now_ns_u64;
+
+        (void)fc_send(fd_i, p_to, FP_MSG_COMMAND, request_id_u32, command_u8);
+        while ((now_ns_u64 = fc_now_ns()) < deadline_ns_u64)
+        {
+            if (fc_receive(fd_i, p_ack, (int)((deadline_ns_u64 - now_ns_u64 + 999999ULL) / 1000000ULL)) &&
+                (p_ack->type_u8 == FP_MSG_COMMAND_ACK) && (p_ack->request_id_u32 == request_id_u32) &&
+                (p_ack->from.sin_addr.s_addr == p_to->sin_addr.s_addr) && (p_ack->from.sin_port == p_to->sin_port))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*****************************************************************************/
+
+const char *fc_command_name(const uint8_t command_u8)
+{
+    return (command_u8 < (sizeof(fc_command_names) / sizeof(fc_command_names[0]))) ? fc_command_names[command_u8] : "unknown";
+}
+
+uint8_t fc_command_from_name(const char *p_name)
+{
+    for (uint8_t i = 1U; i < (sizeof(fc_command_names) / sizeof(fc_command_names[0])); ++i)
+    {
+        if (strcasecmp(p_name, fc_command_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    /* Like /api/command, the desk has the target heights stored in presets 3 and 4 */
+    if (strcasecmp(p_name, "standing") == 0)
+    {
+        return 7U;
+    }
+    if (strcasecmp(p_name, "sitting") == 0)
+    {
+        return 8U;
+    }
+
+    return 0U;
+}
+
+const char *fc_desk_state_name(const uint8_t state_u8)
+{
+    return (state_u8 < (sizeof(fc_desk_state_names) / sizeof(fc_desk_state_names[0]))) ? fc_desk_state_names[state_u8] : "unknown";
+}
+
+const char *fc_scheduler_state_name(const uint8_t state_u8)
+{
+    return (state_u8 < (sizeof(fc_scheduler_state_names) / sizeof(fc_scheduler_state_names[0]))) ? fc_scheduler_state_names[state_u8] : "unknown";
+}
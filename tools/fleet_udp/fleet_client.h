@@ -0,0 +1,60 @@
+#ifndef FC_MAIN_H
+#define FC_MAIN_H
+
+/*
+ * Host side of the UDP fleet protocol in lib/fleet/fleet_protocol.h. Plain functions on one
+ * non-blocking UDP socket, no threads: requests go out to any number of desks at once and the
+ * answers are told apart by their request id.
+ */
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fleet_protocol.h"
+
+/*****************************************************************************/
+
+typedef struct
+{
+    struct sockaddr_in from;
+    uint8_t type_u8;         /* FP_MSG_STATUS, FP_MSG_ANNOUNCE or FP_MSG_COMMAND_ACK */
+    uint32_t request_id_u32;
+    FP_STATUS status;        /* status and announce */
+    FP_COMMAND_ACK ack;      /* command ack */
+    uint16_t http_port_u16;  /* announce */
+    char name_str[FP_NAME_SIZE + 1U];
+} FC_REPLY;
+
+/*****************************************************************************/
+
+/* Socket that may send to broadcast addresses, -1 on failure */
+extern int fc_open();
+
+/* Appends host:port or host:first-last, false if it cannot be resolved */
+extern bool fc_add_targets(const char *p_spec, std::vector<struct sockaddr_in> *p_targets);
+
+extern bool fc_send(const int fd_i, const struct sockaddr_in *p_to, const uint8_t type_u8, const uint32_t request_id_u32, const uint8_t command_u8);
+
+/* Waits up to timeout_ms for the next valid answer, whatever request it belongs to */
+extern bool fc_receive(const int fd_i, FC_REPLY *p_reply, const int timeout_ms);
+
+/* Sends the same request to every target and collects the answers with its id until expected_u32
+ * of them arrived or the time is up, 0 waits for the whole time (broadcasts). Returns how many arrived. */
+extern uint32_t fc_sweep(const int fd_i, const std::vector<struct sockaddr_in> &targets, const uint8_t type_u8, const uint32_t request_id_u32,
+                         const uint8_t command_u8, const uint32_t expected_u32, const int timeout_ms, std::vector<FC_REPLY> *p_replies);
+
+/* Repeats the command with the same request id until it is acknowledged, the desk carries it out once */
+extern bool fc_command(const int fd_i, const struct sockaddr_in *p_to, const uint8_t command_u8, const uint32_t request_id_u32,
+                       const int attempts_i, const int timeout_ms, FC_REPLY *p_ack);
+
+extern const char *fc_command_name(const uint8_t command_u8);
+extern uint8_t fc_command_from_name(const char *p_name); /* 0 if unknown */
+extern const char *fc_desk_state_name(const uint8_t state_u8);
+extern const char *fc_scheduler_state_name(const uint8_t state_u8);
+
+extern uint64_t fc_now_ns();
+
+/*****************************************************************************/
+
+#endif
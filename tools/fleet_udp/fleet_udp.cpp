@@ -0,0 +1,239 @@
+/*
+ * Command line client and benchmark for the UDP fleet protocol, built on fleet_client.h.
+ *
+ * Targets are host:port or host:first-last, a broadcast address finds every desk behind it:
+ *
+ *   fleet_udp discover -t 192.168.1.255:8080     names, addresses and status of every desk
+ *   fleet_udp status -t host:port...             status of the given desks
+ *   fleet_udp command -c standing -t host:port...
+ *   fleet_udp bench -t host:first-last [-d seconds]
+ *
+ * The benchmark sweeps the status of all targets back to back, each sweep being one request
+ * to every desk at once and waiting for all answers, then checks that repeated commands are
+ * carried out only once. It prints one JSON line like the benchmarks in bench/.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "fleet_client.h"
+
+/*****************************************************************************/
+
+#define FU_TIMEOUT_MS 1000
+
+/*****************************************************************************/
+
+static uint32_t fu_next_id_u32 = 1U;
+
+/*****************************************************************************/
+
+static void fu_print_reply(const FC_REPLY *p_reply)
+{
+    const FP_STATUS *p_status = &(p_reply->status);
+    char age_str[16];
+
+    if (p_status->sync_age_s_u32 == FP_NEVER_SYNCED)
+    {
+        (void)strcpy(age_str, "never");
+    }
+    else
+    {
+        (void)snprintf(age_str, sizeof(age_str), "%us", p_status->sync_age_s_u32);
+    }
+
+    printf("%s:%u", inet_ntoa(p_reply->from.sin_addr), ntohs(p_reply->from.sin_port));
+    if (p_reply->type_u8 == FP_MSG_ANNOUNCE)
+    {
+        printf(" %s http:%u", p_reply->name_str, p_reply->http_port_u16);
+    }
+    printf(" height %u %s, schedule %s, jog %s, ntp %s, config #%u, up %us\n", p_status->height_mm_u16,
+           fc_desk_state_name(p_status->desk_state_u8), fc_scheduler_state_name(p_status->scheduler_state_u8),
+           (p_status->jog_u8 != 0U) ? fc_command_name(p_status->jog_u8) : "-", age_str, p_status->config_sequence_u32,
+           p_status->uptime_s_u32);
+}
+
+static int fu_query(const int fd_i, const std::vector<struct sockaddr_in> &targets, const uint8_t type_u8, const bool broadcast_b)
+{
+    std::vector<FC_REPLY> replies;
+
+    (void)fc_sweep(fd_i, targets, type_u8, fu_next_id_u32++, 0U, broadcast_b ? 0U : (uint32_t)targets.size(), FU_TIMEOUT_MS, &replies);
+    for (const FC_REPLY &reply : replies)
+    {
+        fu_print_reply(&reply);
+    }
+    fprintf(stderr, "%zu answers\n", replies.size());
+
+    return (broadcast_b || (replies.size() == targets.size())) ? 0 : 1;
+}
+
+static int fu_command(const int fd_i, const std::vector<struct sockaddr_in> &targets, const uint8_t command_u8)
+{
+    FC_REPLY ack;
+    int failed_i = 0;
+
+    for (const struct sockaddr_in &target : targets)
+    {
+        const bool acked_b = fc_command(fd_i, &target, command_u8, fu_next_id_u32++, 3, FU_TIMEOUT_MS / 3, &ack);
+
+        printf("%s:%u %s\n", inet_ntoa(target.sin_addr), ntohs(target.sin_port),
+               !acked_b ? "no answer" : ((ack.ack.result_u8 == FP_RESULT_OK) ? "ok" : ((ack.ack.result_u8 == FP_RESULT_INVALID) ? "invalid" : "failed")));
+        failed_i += (acked_b && (ack.ack.result_u8 == FP_RESULT_OK)) ? 0 : 1;
+    }
+
+    return (failed_i == 0) ? 0 : 1;
+}
+
+static uint32_t fu_percentile_us(std::vector<uint32_t> values, const uint32_t percent_u32)
+{
+    if (values.empty())
+    {
+        return 0U;
+    }
+
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1U, values.size() * percent_u32 / 100U)];
+}
+
+static int fu_bench(const int fd_i, const std::vector<struct sockaddr_in> &targets, const double duration_s)
+{
+    const uint32_t num_u32 = (uint32_t)targets.size();
+    std::vector<uint32_t> sweeps_us;
+    std::vector<uint32_t> single_us;
+    std::vector<FC_REPLY> replies;
+    uint64_t start_ns_u64;
+    uint64_t sweep_ns_u64;
+    uint32_t discovered_u32;
+    uint32_t incomplete_u32 = 0U;
+    uint32_t answers_u32 = 0U;
+    uint32_t acked_u32 = 0U;
+    uint32_t executed_once_u32 = 0U;
+    FC_REPLY ack;
+
+    /* Everyone there, the same as a broadcast on a real network */
+    discovered_u32 = fc_sweep(fd_i, targets, FP_MSG_DISCOVER, fu_next_id_u32++, 0U, num_u32, FU_TIMEOUT_MS * 5, NULL);
+
+    /* Round trip to one desk for comparison */
+    for (int i = 0; i < 200; ++i)
+    {
+        sweep_ns_u64 = fc_now_ns();
+        if (fc_sweep(fd_i, std::vector<struct sockaddr_in>(1U, targets[(size_t)i % targets.size()]), FP_MSG_STATUS_REQUEST, fu_next_id_u32++, 0U, 1U,
+                     FU_TIMEOUT_MS, NULL) == 1U)
+        {
+            single_us.push_back((uint32_t)((fc_now_ns() - sweep_ns_u64) / 1000U));
+        }
+    }
+
+    start_ns_u64 = fc_now_ns();
+    while ((fc_now_ns() - start_ns_u64) < (uint64_t)(duration_s * 1e9))
+    {
+        uint32_t received_u32;
+
+        sweep_ns_u64 = fc_now_ns();
+        received_u32 = fc_sweep(fd_i, targets, FP_MSG_STATUS_REQUEST, fu_next_id_u32++, 0U, num_u32, FU_TIMEOUT_MS, NULL);
+        answers_u32 += received_u32;
+        if (received_u32 == num_u32)
+        {
+            sweeps_us.push_back((uint32_t)((fc_now_ns() - sweep_ns_u64) / 1000U));
+        }
+        else
+        {
+            incomplete_u32 += 1U;
+        }
+    }
+    const double elapsed_s = (double)(fc_now_ns() - start_ns_u64) / 1e9;
+
+    /* Each command goes out twice with the same id, the second one must only be answered */
+    for (const struct sockaddr_in &target : targets)
+    {
+        const uint32_t id_u32 = fu_next_id_u32++;
+
+        if (fc_command(fd_i, &target, 1U, id_u32, 3, FU_TIMEOUT_MS / 3, &ack) && (ack.ack.result_u8 == FP_RESULT_OK))
+        {
+            acked_u32 += 1U;
+            if (fc_command(fd_i, &target, 1U, id_u32, 3, FU_TIMEOUT_MS / 3, &ack) && (ack.ack.duplicate_u8 == 1U))
+            {
+                executed_once_u32 += 1U;
+            }
+        }
+    }
+
+    printf("{\"suite\":\"fleet_udp\",\"desks\":%u,\"discovered\":%u,\"single_p50_us\":%u,\"single_p99_us\":%u,"
+           "\"sweeps\":%zu,\"incomplete_sweeps\":%u,\"sweep_p50_us\":%u,\"sweep_p99_us\":%u,\"sweep_max_us\":%u,"
+           "\"answers_per_s\":%.0f,\"commands_acked\":%u,\"duplicates_detected\":%u}\n",
+           num_u32, discovered_u32, fu_percentile_us(single_us, 50U), fu_percentile_us(single_us, 99U),
+           sweeps_us.size() + incomplete_u32, incomplete_u32, fu_percentile_us(sweeps_us, 50U), fu_percentile_us(sweeps_us, 99U),
+           fu_percentile_us(sweeps_us, 100U), (double)answers_u32 / elapsed_s, acked_u32, executed_once_u32);
+
+    return ((incomplete_u32 == 0U) && (discovered_u32 == num_u32)) ? 0 : 1;
+}
+
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    std::vector<struct sockaddr_in> targets;
+    const char *p_mode = (argc > 1) ? argv[1] : "";
+    uint8_t command_u8 = 0U;
+    double duration_s = 10.0;
+    int opt_i;
+    int fd_i;
+
+    optind = 2;
+    while ((opt_i = getopt(argc, argv, "t:c:d:")) != -1)
+    {
+        switch (opt_i)
+        {
+        case 't':
+            if (!fc_add_targets(optarg, &targets))
+            {
+                fprintf(stderr, "cannot use target %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'c':
+            command_u8 = fc_command_from_name(optarg);
+            break;
+        case 'd':
+            duration_s = atof(optarg);
+            break;
+        default:
+            return 2;
+        }
+    }
+
+    fd_i = fc_open();
+    if (targets.empty() || (fd_i < 0))
+    {
+        fprintf(stderr, "usage: fleet_udp discover|status|command|bench -t host:port[-last]... [-c command] [-d seconds]\n");
+        return 2;
+    }
+    srand48((long)fc_now_ns());
+    fu_next_id_u32 = (uint32_t)lrand48();
+
+    if (strcmp(p_mode, "discover") == 0)
+    {
+        return fu_query(fd_i, targets, FP_MSG_DISCOVER, true);
+    }
+    if (strcmp(p_mode, "status") == 0)
+    {
+        return fu_query(fd_i, targets, FP_MSG_STATUS_REQUEST, false);
+    }
+    if ((strcmp(p_mode, "command") == 0) && (command_u8 != 0U))
+    {
+        return fu_command(fd_i, targets, command_u8);
+    }
+    if (strcmp(p_mode, "bench") == 0)
+    {
+        return fu_bench(fd_i, targets, duration_s);
+    }
+
+    fprintf(stderr, "unknown mode or command\n");
+    return 2;
+}
@@ -0,0 +1,129 @@
+"""
+Benchmarks tools/gateway against a fleet of host firmware instances on localhost. Starts the
+instances on consecutive ports and the gateway with all of them as targets. Then it measures
+fleet-wide fresh status (GET /fleet?fresh=1), cached status and a fleet-wide command, and prints
+one JSON line like the benchmarks in bench/:
+
+    pio run -e host_fleet && make -C tools/gateway
+    python3 tools/gateway/fleet_bench.py [-n 300] [-p 19000] [-d 20]
+"""
+
+import argparse
+import http.client
+import json
+import os
+import subprocess
+import sys
+import time
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return round(values[min(len(values) - 1, len(values) * p // 100)], 2) if values else None
+
+
+def cpu_seconds(pid):
+    # utime and stime, in clock ticks
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def rss_kb(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def request(conn, method, path, body=None):
+    start = time.monotonic()
+    conn.request(method, path, body=body, headers={"Content-Type": "application/json"} if body else {})
+    data = conn.getresponse().read()
+    return (time.monotonic() - start) * 1000.0, json.loads(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-n", "--devices", type=int, default=300)
+    parser.add_argument("-p", "--port", type=int, default=19000, help="port of the first firmware instance")
+    parser.add_argument("-d", "--duration", type=float, default=20.0, help="seconds of fresh status requests")
+    parser.add_argument("-l", "--listen", type=int, default=8090, help="port of the gateway")
+    parser.add_argument("-i", "--interval", type=int, default=1000, help="poll interval of the gateway in ms")
+    parser.add_argument("--firmware", default=".pio/build/host_fleet/program")
+    parser.add_argument("--gateway", default="tools/gateway/gateway")
+    args = parser.parse_args()
+
+    desks = []
+    gateway = None
+    result = {"suite": "gateway", "devices": args.devices, "poll_ms": args.interval}
+
+    try:
+        for i in range(args.devices):
+            env = dict(os.environ, FLEXIDESK_PORT=str(args.port + i))
+            desks.append(subprocess.Popen([args.firmware], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        time.sleep(1.0)
+
+        start = time.monotonic()
+        gateway = subprocess.Popen([args.gateway, "-n", "-l", str(args.listen), "-i", str(args.interval),
+                                    "-t", "127.0.0.1:%d-%d" % (args.port, args.port + args.devices - 1)],
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(0.2)
+        conn = http.client.HTTPConnection("127.0.0.1", args.listen, timeout=10)
+
+        # Everyone connected and polled once
+        online = 0
+        while (online < args.devices) and ((time.monotonic() - start) < 60.0):
+            time.sleep(0.1)
+            online = request(conn, "GET", "/fleet")[1]["online"]
+        result["online"] = online
+        result["connect_s"] = round(time.monotonic() - start, 2)
+
+        cpu_start = cpu_seconds(gateway.pid)
+        measure_start = time.monotonic()
+        fresh = []
+        oldest = []
+        while (time.monotonic() - measure_start) < args.duration:
+            ms, fleet = request(conn, "GET", "/fleet?fresh=1")
+            fresh.append(ms)
+            oldest.append(fleet["oldest_ms"])
+            if fleet["online"] < args.devices:
+                result["dropped_out"] = result.get("dropped_out", 0) + 1
+        elapsed = time.monotonic() - measure_start
+        cpu = cpu_seconds(gateway.pid) - cpu_start
+
+        cached = [request(conn, "GET", "/fleet")[0] for _ in range(20)]
+
+        commands = []
+        succeeded = []
+        for _ in range(5):
+            ms, answer = request(conn, "POST", "/fleet/command", json.dumps({"command": "wakeup"}))
+            commands.append(ms)
+            succeeded.append(answer["succeeded"])
+
+        result.update({
+            "fresh_requests": len(fresh),
+            "fresh_p50_ms": percentile(fresh, 50),
+            "fresh_p99_ms": percentile(fresh, 99),
+            "fresh_max_ms": round(max(fresh), 2),
+            "fresh_oldest_max_ms": max(oldest),
+            "cached_p50_ms": percentile(cached, 50),
+            "command_p50_ms": percentile(commands, 50),
+            "command_max_ms": round(max(commands), 2),
+            "command_succeeded_min": min(succeeded),
+            "gateway_cpu_percent": round(100.0 * cpu / elapsed, 1),
+            "gateway_rss_kb": rss_kb(gateway.pid),
+        })
+    finally:
+        for process in desks + ([gateway] if gateway else []):
+            process.terminate()
+        for process in desks + ([gateway] if gateway else []):
+            process.wait()
+
+    print(json.dumps(result))
+    sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
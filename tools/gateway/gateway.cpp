@@ -0,0 +1,1374 @@
+/*
+ * Fleet gateway for the desk controllers.
+ *
+ * Finds the controllers by DNS-SD (_flexidesk._tcp.local) and/or takes them from the command
+ * line, keeps one keep-alive HTTP connection to each of them and polls /api/status over it,
+ * all in one thread around epoll. Clients get the cached status of the whole fleet and can
+ * send commands and schedules to many desks with one request:
+ *
+ *   GET  /fleet              latest status of every desk, ?fresh=1 polls all of them first
+ *   POST /fleet/command      body goes to /api/command of every desk
+ *   PUT  /fleet/schedule     body goes to /api/schedule of every desk
+ *
+ * ?devices=name,name limits commands and schedules to some desks. Answers are JSON.
+ *
+ *   gateway [-l port] [-i poll ms] [-q query s] [-n] [-t host:port[-last port]]...
+ */
+
+#include <arpa/inet.h>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/*****************************************************************************/
+
+#define GW_MDNS_ADDRESS "224.0.0.251"
+#define GW_MDNS_PORT 5353U
+#define GW_SERVICE "_flexidesk._tcp.local"
+
+#define GW_REQUEST_TIMEOUT_MS 2000U /* a desk that takes longer is reconnected */
+#define GW_OP_TIMEOUT_MS 3000U      /* clients get what is there by then */
+#define GW_BACKOFF_MIN_MS 250U
+#define GW_BACKOFF_MAX_MS 10000U
+#define GW_TICK_MS 10U
+#define GW_MAX_REQUEST_SIZE 65536U
+#define GW_NO_SLOT 0xffffffffU /* releases the hold an operation starts with */
+
+/* What an epoll event belongs to, in the upper half of its data */
+#define GW_KEY(type, index) (((uint64_t)(type) << 32) | (uint64_t)(index))
+#define GW_KEY_TYPE(key) ((uint32_t)((key) >> 32))
+#define GW_KEY_INDEX(key) ((uint32_t)(key))
+
+/*****************************************************************************/
+
+typedef enum
+{
+    GW_SOURCE_LISTEN = 0,
+    GW_SOURCE_MDNS,
+    GW_SOURCE_DEVICE,
+    GW_SOURCE_CLIENT
+} GW_SOURCE;
+
+typedef enum
+{
+    GW_REQ_POLL = 0,
+    GW_REQ_FORWARD
+} GW_REQ_KIND;
+
+/* A client operation waiting for this request, slot is its index in the operation */
+typedef struct
+{
+    uint32_t op_u32;
+    uint32_t slot_u32;
+} GW_WAITER;
+
+typedef struct
+{
+    GW_REQ_KIND kind_e;
+    std::string data; /* the complete request */
+    std::vector<GW_WAITER> waiters;
+    uint64_t sent_ns_u64; /* 0 while it is queued */
+} GW_REQUEST;
+
+typedef enum
+{
+    GW_DEV_WAITING = 0, /* disconnected, retried at retry_ns_u64 */
+    GW_DEV_CONNECTING,
+    GW_DEV_CONNECTED
+} GW_DEV_STATE;
+
+typedef struct
+{
+    std::string name;
+    struct sockaddr_in addr;
+    int fd_i;
+    GW_DEV_STATE state_e;
+    uint64_t retry_ns_u64;
+    uint32_t backoff_ms_u32;
+    std::string tx;
+    std::string rx;
+    std::deque<GW_REQUEST> queue; /* one request at a time, the front one is in flight once sent */
+    std::string status;           /* body of the last /api/status */
+    uint64_t status_ns_u64;       /* when it arrived, 0 if never */
+    uint32_t polls_u32;
+    uint32_t failures_u32;
+} GW_DEVICE;
+
+typedef struct
+{
+    int fd_i; /* -1 if the slot is free */
+    uint32_t generation_u32;
+    std::string rx;
+    std::string tx;
+    bool busy_b; /* an operation answers the current request */
+} GW_CLIENT;
+
+typedef enum
+{
+    GW_OP_STATUS = 0, /* GET /fleet?fresh=1 */
+    GW_OP_FORWARD
+} GW_OP_KIND;
+
+typedef struct
+{
+    GW_OP_KIND kind_e;
+    uint32_t client_u32;
+    uint32_t generation_u32; /* of the client, it may be gone by the time the answer is ready */
+    uint32_t remaining_u32;
+    uint64_t start_ns_u64;
+    uint64_t deadline_ns_u64;
+    std::vector<uint32_t> devices; /* forwards: the device of each slot */
+    std::vector<int> codes;        /* 0 if the desk did not answer */
+    std::vector<std::string> bodies;
+} GW_OP;
+
+typedef struct
+{
+    std::string instance;
+    std::string target;
+    uint16_t port_u16;
+} GW_SRV;
+
+/*****************************************************************************/
+
+static int gw_epoll_fd_i = -1;
+static int gw_listen_fd_i = -1;
+static int gw_mdns_fd_i = -1;
+static uint32_t gw_poll_ms_u32 = 1000U;
+static std::vector<GW_DEVICE> gw_devices;
+static std::vector<GW_CLIENT> gw_clients;
+static std::map<uint32_t, GW_OP> gw_ops;
+static uint32_t gw_next_op_u32 = 1U;
+static uint32_t gw_next_generation_u32 = 1U;
+
+/*****************************************************************************/
+
+static uint64_t gw_now_ns()
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static void gw_set_nonblocking(const int fd_i)
+{
+    (void)fcntl(fd_i, F_SETFL, fcntl(fd_i, F_GETFL) | O_NONBLOCK);
+}
+
+static void gw_watch(const int fd_i, const int op_i, const uint32_t events_u32, const uint64_t key_u64)
+{
+    struct epoll_event event;
+
+    event.events = events_u32;
+    event.data.u64 = key_u64;
+    (void)epoll_ctl(gw_epoll_fd_i, op_i, fd_i, &event);
+}
+
+static void gw_json_escape(std::string *p_out, const std::string &str)
+{
+    char escape_vc[8];
+
+    p_out->push_back('"');
+    for (const unsigned char c : str)
+    {
+        if ((c == '"') || (c == '\\'))
+        {
+            p_out->push_back('\\');
+            p_out->push_back((char)c);
+        }
+        else if (c < 0x20U)
+        {
+            (void)snprintf(escape_vc, sizeof(escape_vc), "\\u%04x", c);
+            p_out->append(escape_vc);
+        }
+        else
+        {
+            p_out->push_back((char)c);
+        }
+    }
+    p_out->push_back('"');
+}
+
+static std::string gw_address_str(const struct sockaddr_in *p_addr)
+{
+    char str[INET_ADDRSTRLEN + 8];
+    char ip_str[INET_ADDRSTRLEN];
+
+    (void)inet_ntop(AF_INET, &(p_addr->sin_addr), ip_str, sizeof(ip_str));
+    (void)snprintf(str, sizeof(str), "%s:%u", ip_str, (unsigned)ntohs(p_addr->sin_port));
+    return str;
+}
+
+/*****************************************************************************/
+
+/* Size of the first complete response in the buffer, 0 if it is incomplete and -1 if it is
+ * malformed. The body comes back decoded. */
+static long gw_parse_response(const std::string &rx, int *p_code_i, std::string *p_body, bool *p_close_b)
+{
+    const size_t header_end = rx.find("\r\n\r\n");
+    size_t pos;
+    size_t line_end;
+    size_t chunk_size;
+    long content_length_l = 0;
+    bool chunked_b = false;
+
+    if (header_end == std::string::npos)
+    {
+        return (rx.size() > GW_MAX_REQUEST_SIZE) ? -1 : 0;
+    }
+    if ((rx.compare(0, 5, "HTTP/") != 0) || ((pos = rx.find(' ')) == std::string::npos) || (pos > header_end))
+    {
+        return -1;
+    }
+
+    *p_code_i = atoi(&rx[pos + 1U]);
+    *p_close_b = false;
+    p_body->clear();
+
+    for (pos = rx.find("\r\n") + 2U; pos < header_end; pos = line_end + 2U)
+    {
+        line_end = rx.find("\r\n", pos);
+
+        const std::string line = rx.substr(pos, line_end - pos);
+
+        if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+        {
+            content_length_l = strtol(line.c_str() + 15, NULL, 10);
+        }
+        else if ((strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0) && (NULL != strcasestr(line.c_str(), "chunked")))
+        {
+            chunked_b = true;
+        }
+        else if ((strncasecmp(line.c_str(), "Connection:", 11) == 0) && (NULL != strcasestr(line.c_str(), "close")))
+        {
+            *p_close_b = true;
+        }
+        else
+        {
+            /* Not needed */
+        }
+    }
+
+    pos = header_end + 4U;
+    if (!chunked_b)
+    {
+        if ((content_length_l < 0) || ((rx.size() - pos) < (size_t)content_length_l))
+        {
+            return (content_length_l < 0) ? -1 : 0;
+        }
+        p_body->assign(rx, pos, (size_t)content_length_l);
+        return (long)(pos + (size_t)content_length_l);
+    }
+
+    /* Chunks until the empty one, no trailers */
+    for (;;)
+    {
+        line_end = rx.find("\r\n", pos);
+        if (line_end == std::string::npos)
+        {
+            return 0;
+        }
+
+        chunk_size = strtoul(&rx[pos], NULL, 16);
+        pos = line_end + 2U;
+        if ((rx.size() - pos) < (chunk_size + 2U))
+        {
+            return 0;
+        }
+        if (chunk_size == 0U)
+        {
+            return (long)(pos + 2U);
+        }
+
+        p_body->append(rx, pos, chunk_size);
+        pos += chunk_size + 2U;
+    }
+}
+
+/*****************************************************************************/
+
+static void gw_send_next(GW_DEVICE *p_device);
+static void gw_device_fail(const uint32_t device_u32, const char *p_reason);
+static void gw_op_deliver(const uint32_t op_u32, const uint32_t slot_u32, const int code_i, const std::string &body);
+
+static void gw_device_flush(const uint32_t device_u32)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    ssize_t written_i = 0;
+
+    while (!p_device->tx.empty() && (written_i >= 0))
+    {
+        written_i = send(p_device->fd_i, p_device->tx.data(), p_device->tx.size(), MSG_NOSIGNAL);
+        if (written_i > 0)
+        {
+            p_device->tx.erase(0, (size_t)written_i);
+        }
+    }
+
+    /* The rest goes once the socket takes it */
+    gw_watch(p_device->fd_i, EPOLL_CTL_MOD, EPOLLIN | (p_device->tx.empty() ? 0U : (uint32_t)EPOLLOUT), GW_KEY(GW_SOURCE_DEVICE, device_u32));
+}
+
+static void gw_device_connect(const uint32_t device_u32)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    const int one_i = 1;
+
+    p_device->fd_i = socket(AF_INET, SOCK_STREAM, 0);
+    (void)setsockopt(p_device->fd_i, IPPROTO_TCP, TCP_NODELAY, &one_i, sizeof(one_i));
+    gw_set_nonblocking(p_device->fd_i);
+
+    p_device->state_e = GW_DEV_CONNECTING;
+    p_device->retry_ns_u64 = gw_now_ns(); /* the connect timeout counts from here */
+    p_device->rx.clear();
+    p_device->tx.clear();
+    if ((connect(p_device->fd_i, (const struct sockaddr *)&(p_device->addr), sizeof(p_device->addr)) != 0) && (errno != EINPROGRESS))
+    {
+        /* Unreachable networks fail right away, retried like any other failure */
+        gw_device_fail(device_u32, strerror(errno));
+        return;
+    }
+    gw_watch(p_device->fd_i, EPOLL_CTL_ADD, EPOLLOUT, GW_KEY(GW_SOURCE_DEVICE, device_u32));
+}
+
+static void gw_device_fail(const uint32_t device_u32, const char *p_reason)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    const bool was_connected_b = (p_device->state_e == GW_DEV_CONNECTED);
+
+    if (was_connected_b)
+    {
+        fprintf(stderr, "%s: %s\n", p_device->name.c_str(), p_reason);
+    }
+
+    if (p_device->fd_i >= 0)
+    {
+        (void)close(p_device->fd_i);
+        p_device->fd_i = -1;
+    }
+
+    p_device->state_e = GW_DEV_WAITING;
+    p_device->failures_u32 += 1U;
+    p_device->backoff_ms_u32 = was_connected_b ? GW_BACKOFF_MIN_MS : std::min(p_device->backoff_ms_u32 * 2U, (uint32_t)GW_BACKOFF_MAX_MS);
+    p_device->retry_ns_u64 = gw_now_ns() + ((uint64_t)p_device->backoff_ms_u32 * 1000000ULL);
+
+    /* Nothing queued survives, whoever waits for it gets no answer from this desk */
+    while (!p_device->queue.empty())
+    {
+        const GW_REQUEST request = p_device->queue.front();
+
+        p_device->queue.pop_front();
+        for (const GW_WAITER &waiter : request.waiters)
+        {
+            gw_op_deliver(waiter.op_u32, waiter.slot_u32, 0, "");
+        }
+    }
+}
+
+static void gw_device_connected(const uint32_t device_u32)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    int error_i = 0;
+    socklen_t size = sizeof(error_i);
+
+    (void)getsockopt(p_device->fd_i, SOL_SOCKET, SO_ERROR, &error_i, &size);
+    if (error_i != 0)
+    {
+        gw_device_fail(device_u32, strerror(error_i));
+        return;
+    }
+
+    fprintf(stderr, "%s: connected to %s\n", p_device->name.c_str(), gw_address_str(&(p_device->addr)).c_str());
+    p_device->state_e = GW_DEV_CONNECTED;
+    p_device->backoff_ms_u32 = GW_BACKOFF_MIN_MS;
+    gw_watch(p_device->fd_i, EPOLL_CTL_MOD, EPOLLIN, GW_KEY(GW_SOURCE_DEVICE, device_u32));
+    gw_send_next(p_device);
+    gw_device_flush(device_u32);
+}
+
+static void gw_device_read(const uint32_t device_u32)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    char buffer_vc[16384];
+    std::string body;
+    ssize_t read_i;
+    long size_l;
+    int code_i;
+    bool close_b;
+
+    while ((read_i = recv(p_device->fd_i, buffer_vc, sizeof(buffer_vc), 0)) > 0)
+    {
+        p_device->rx.append(buffer_vc, (size_t)read_i);
+    }
+    if ((read_i == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        gw_device_fail(device_u32, "connection closed");
+        return;
+    }
+
+    while ((size_l = gw_parse_response(p_device->rx, &code_i, &body, &close_b)) != 0)
+    {
+        if ((size_l < 0) || p_device->queue.empty() || (p_device->queue.front().sent_ns_u64 == 0U))
+        {
+            gw_device_fail(device_u32, "unexpected response");
+            return;
+        }
+
+        const GW_REQUEST request = p_device->queue.front();
+
+        p_device->queue.pop_front();
+        p_device->rx.erase(0, (size_t)size_l);
+        if ((request.kind_e == GW_REQ_POLL) && (code_i == 200))
+        {
+            p_device->status = body;
+            p_device->status_ns_u64 = gw_now_ns();
+            p_device->polls_u32 += 1U;
+        }
+        for (const GW_WAITER &waiter : request.waiters)
+        {
+            gw_op_deliver(waiter.op_u32, waiter.slot_u32, code_i, body);
+        }
+
+        if (close_b)
+        {
+            gw_device_fail(device_u32, "closed by the desk");
+            return;
+        }
+    }
+
+    gw_send_next(p_device);
+    gw_device_flush(device_u32);
+}
+
+static void gw_send_next(GW_DEVICE *p_device)
+{
+    if ((p_device->state_e == GW_DEV_CONNECTED) && !p_device->queue.empty() && (p_device->queue.front().sent_ns_u64 == 0U))
+    {
+        p_device->queue.front().sent_ns_u64 = gw_now_ns();
+        p_device->tx.append(p_device->queue.front().data);
+    }
+}
+
+/* Queues a request for a desk, polls are merged with one that has not gone out yet */
+static void gw_enqueue(const uint32_t device_u32, const GW_REQ_KIND kind_e, const std::string &data, const GW_WAITER *p_waiter)
+{
+    GW_DEVICE *p_device = &gw_devices[device_u32];
+    GW_REQUEST request;
+
+    if ((kind_e == GW_REQ_POLL) && (p_device->queue.size() > 1U) && (p_device->queue.back().kind_e == GW_REQ_POLL))
+    {
+        if (NULL != p_waiter)
+        {
+            p_device->queue.back().waiters.push_back(*p_waiter);
+        }
+        return;
+    }
+
+    request.kind_e = kind_e;
+    request.data = data;
+    request.sent_ns_u64 = 0U;
+    if (NULL != p_waiter)
+    {
+        request.waiters.push_back(*p_waiter);
+    }
+    p_device->queue.push_back(request);
+
+    if (p_device->queue.size() == 1U)
+    {
+        gw_send_next(p_device);
+        gw_device_flush(device_u32);
+    }
+}
+
+static std::string gw_poll_request()
+{
+    return "GET /api/status HTTP/1.1\r\nHost: desk\r\n\r\n";
+}
+
+static uint32_t gw_add_device(const std::string &name, const struct sockaddr_in *p_addr)
+{
+    GW_DEVICE device;
+
+    for (uint32_t i = 0U; i < gw_devices.size(); ++i)
+    {
+        GW_DEVICE *p_device = &gw_devices[i];
+
+        if (p_device->name == name)
+        {
+            /* Moved to another address, e.g. a new DHCP lease */
+            if ((p_device->addr.sin_addr.s_addr != p_addr->sin_addr.s_addr) || (p_device->addr.sin_port != p_addr->sin_port))
+            {
+                p_device->addr = *p_addr;
+                gw_device_fail(i, "address changed");
+                p_device->retry_ns_u64 = 0U;
+            }
+            return i;
+        }
+    }
+
+    device.name = name;
+    device.addr = *p_addr;
+    device.fd_i = -1;
+    device.state_e = GW_DEV_WAITING;
+    device.retry_ns_u64 = 0U;
+    device.backoff_ms_u32 = GW_BACKOFF_MIN_MS;
+    device.status_ns_u64 = 0U;
+    device.polls_u32 = 0U;
+    device.failures_u32 = 0U;
+    gw_devices.push_back(device);
+    fprintf(stderr, "%s: added at %s\n", name.c_str(), gw_address_str(p_addr).c_str());
+
+    return (uint32_t)(gw_devices.size() - 1U);
+}
+
+/*****************************************************************************/
+
+static void gw_client_send(const uint32_t client_u32, const int code_i, const std::string &body);
+static void gw_client_process(const uint32_t client_u32);
+
+static void gw_render_fleet(std::string *p_out)
+{
+    const uint64_t now_ns_u64 = gw_now_ns();
+    uint32_t online_u32 = 0U;
+    uint32_t standing_u32 = 0U;
+    uint32_t sitting_u32 = 0U;
+    uint64_t oldest_ms_u64 = 0U;
+    std::string fleet;
+    char str[96];
+
+    fleet.reserve(gw_devices.size() * 600U);
+    for (const GW_DEVICE &device : gw_devices)
+    {
+        const bool online_b = (device.state_e == GW_DEV_CONNECTED) && (device.status_ns_u64 != 0U);
+        const uint64_t age_ms_u64 = (now_ns_u64 - device.status_ns_u64) / 1000000ULL;
+
+        fleet.append(fleet.empty() ? "{\"name\":" : ",{\"name\":");
+        gw_json_escape(&fleet, device.name);
+        (void)snprintf(str, sizeof(str), ",\"address\":\"%s\",\"online\":%s", gw_address_str(&device.addr).c_str(), online_b ? "true" : "false");
+        fleet.append(str);
+
+        if (device.status_ns_u64 != 0U)
+        {
+            (void)snprintf(str, sizeof(str), ",\"age_ms\":%llu,\"status\":", (unsigned long long)age_ms_u64);
+            fleet.append(str);
+            fleet.append(device.status);
+        }
+        fleet.push_back('}');
+
+        if (online_b)
+        {
+            online_u32 += 1U;
+            oldest_ms_u64 = std::max(oldest_ms_u64, age_ms_u64);
+            standing_u32 += (device.status.find("\"state\":\"standing\"") != std::string::npos) ? 1U : 0U;
+            sitting_u32 += (device.status.find("\"state\":\"sitting\"") != std::string::npos) ? 1U : 0U;
+        }
+    }
+
+    (void)snprintf(str, sizeof(str), "{\"devices\":%zu,\"online\":%u,\"standing\":%u,\"sitting\":%u,\"oldest_ms\":%llu,\"fleet\":[",
+                   gw_devices.size(), online_u32, standing_u32, sitting_u32, (unsigned long long)oldest_ms_u64);
+    p_out->assign(str);
+    p_out->append(fleet);
+    p_out->append("]}");
+}
+
+static void gw_op_finish(const uint32_t op_u32)
+{
+    const GW_OP op = gw_ops[op_u32];
+    std::string body;
+    uint32_t succeeded_u32 = 0U;
+    char str[64];
+
+    gw_ops.erase(op_u32);
+
+    if ((op.client_u32 >= gw_clients.size()) || (gw_clients[op.client_u32].generation_u32 != op.generation_u32))
+    {
+        /* The client is gone */
+        return;
+    }
+
+    if (op.kind_e == GW_OP_STATUS)
+    {
+        gw_render_fleet(&body);
+    }
+    else
+    {
+        body = "{\"results\":[";
+        for (size_t i = 0U; i < op.devices.size(); ++i)
+        {
+            body.append((i == 0U) ? "{\"device\":" : ",{\"device\":");
+            gw_json_escape(&body, gw_devices[op.devices[i]].name);
+            (void)snprintf(str, sizeof(str), ",\"status\":%d,\"body\":", op.codes[i]);
+            body.append(str);
+            if (!op.bodies[i].empty() && ((op.bodies[i][0] == '{') || (op.bodies[i][0] == '[')))
+            {
+                body.append(op.bodies[i]);
+            }
+            else
+            {
+                body.append("null");
+            }
+            body.push_back('}');
+            succeeded_u32 += ((op.codes[i] >= 200) && (op.codes[i] < 300)) ? 1U : 0U;
+        }
+        (void)snprintf(str, sizeof(str), "],\"requested\":%zu,\"succeeded\":%u,\"ms\":%llu}", op.devices.size(), succeeded_u32,
+                       (unsigned long long)((gw_now_ns() - op.start_ns_u64) / 1000000ULL));
+        body.append(str);
+    }
+
+    gw_clients[op.client_u32].busy_b = false;
+    gw_client_send(op.client_u32, 200, body);
+    gw_client_process(op.client_u32);
+}
+
+static void gw_op_deliver(const uint32_t op_u32, const uint32_t slot_u32, const int code_i, const std::string &body)
+{
+    std::map<uint32_t, GW_OP>::iterator it = gw_ops.find(op_u32);
+
+    /* Operations that timed out are gone already */
+    if (it == gw_ops.end())
+    {
+        return;
+    }
+
+    if ((it->second.kind_e == GW_OP_FORWARD) && (slot_u32 != GW_NO_SLOT))
+    {
+        it->second.codes[slot_u32] = code_i;
+        it->second.bodies[slot_u32] = body;
+    }
+
+    it->second.remaining_u32 -= 1U;
+    if (it->second.remaining_u32 == 0U)
+    {
+        gw_op_finish(op_u32);
+    }
+}
+
+static uint32_t gw_op_start(const uint32_t client_u32, const GW_OP_KIND kind_e)
+{
+    const uint32_t op_u32 = gw_next_op_u32++;
+    GW_OP *p_op = &gw_ops[op_u32];
+
+    p_op->kind_e = kind_e;
+    p_op->client_u32 = client_u32;
+    p_op->generation_u32 = gw_clients[client_u32].generation_u32;
+    p_op->remaining_u32 = 1U; /* held until all requests are queued, see GW_NO_SLOT */
+    p_op->start_ns_u64 = gw_now_ns();
+    p_op->deadline_ns_u64 = p_op->start_ns_u64 + ((uint64_t)GW_OP_TIMEOUT_MS * 1000000ULL);
+    gw_clients[client_u32].busy_b = true;
+
+    return op_u32;
+}
+
+/*****************************************************************************/
+
+/* Desks named in ?devices=a,b or all of them */
+static std::vector<uint32_t> gw_select_devices(const std::string &query)
+{
+    std::vector<uint32_t> selected;
+    const size_t start = query.find("devices=");
+    std::string names;
+    std::string name;
+    size_t pos = 0U;
+    size_t end;
+
+    if (start == std::string::npos)
+    {
+        for (uint32_t i = 0U; i < gw_devices.size(); ++i)
+        {
+            selected.push_back(i);
+        }
+        return selected;
+    }
+
+    names = query.substr(start + 8U, query.find('&', start) - (start + 8U));
+    while (pos <= names.size())
+    {
+        end = names.find(',', pos);
+        end = (end == std::string::npos) ? names.size() : end;
+        name = names.substr(pos, end - pos);
+        for (uint32_t i = 0U; i < gw_devices.size(); ++i)
+        {
+            if (gw_devices[i].name == name)
+            {
+                selected.push_back(i);
+            }
+        }
+        pos = end + 1U;
+    }
+
+    return selected;
+}
+
+static void gw_handle_fleet(const uint32_t client_u32, const std::string &query)
+{
+    std::string body;
+    uint32_t op_u32;
+    GW_WAITER waiter;
+
+    if (query.find("fresh=1") == std::string::npos)
+    {
+        gw_render_fleet(&body);
+        gw_client_send(client_u32, 200, body);
+        return;
+    }
+
+    /* Answered once every connected desk sent a status that was asked for after now */
+    op_u32 = gw_op_start(client_u32, GW_OP_STATUS);
+    waiter.op_u32 = op_u32;
+    waiter.slot_u32 = GW_NO_SLOT;
+    for (uint32_t i = 0U; i < gw_devices.size(); ++i)
+    {
+        if (gw_devices[i].state_e == GW_DEV_CONNECTED)
+        {
+            gw_ops[op_u32].remaining_u32 += 1U;
+            gw_enqueue(i, GW_REQ_POLL, gw_poll_request(), &waiter);
+        }
+    }
+    gw_op_deliver(op_u32, GW_NO_SLOT, 0, "");
+}
+
+static void gw_handle_forward(const uint32_t client_u32, const char *p_method, const char *p_path, const std::string &query, const std::string &body)
+{
+    const std::vector<uint32_t> selected = gw_select_devices(query);
+    const uint32_t op_u32 = gw_op_start(client_u32, GW_OP_FORWARD);
+    GW_OP *p_op = &gw_ops[op_u32];
+    char header_vc[256];
+    GW_WAITER waiter;
+
+    (void)snprintf(header_vc, sizeof(header_vc), "%s %s HTTP/1.1\r\nHost: desk\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+                   p_method, p_path, body.size());
+
+    p_op->devices = selected;
+    p_op->codes.assign(selected.size(), 0);
+    p_op->bodies.assign(selected.size(), "");
+    p_op->remaining_u32 += (uint32_t)selected.size();
+    waiter.op_u32 = op_u32;
+    for (uint32_t slot_u32 = 0U; slot_u32 < selected.size(); ++slot_u32)
+    {
+        waiter.slot_u32 = slot_u32;
+        if (gw_devices[selected[slot_u32]].state_e == GW_DEV_CONNECTED)
+        {
+            gw_enqueue(selected[slot_u32], GW_REQ_FORWARD, std::string(header_vc) + body, &waiter);
+        }
+        else
+        {
+            gw_op_deliver(op_u32, slot_u32, 0, "");
+        }
+    }
+    gw_op_deliver(op_u32, GW_NO_SLOT, 0, "");
+}
+
+/*****************************************************************************/
+
+static void gw_client_close(const uint32_t client_u32)
+{
+    GW_CLIENT *p_client = &gw_clients[client_u32];
+
+    (void)close(p_client->fd_i);
+    p_client->fd_i = -1;
+    p_client->generation_u32 = 0U;
+    p_client->rx.clear();
+    p_client->tx.clear();
+    p_client->busy_b = false;
+}
+
+static void gw_client_flush(const uint32_t client_u32)
+{
+    GW_CLIENT *p_client = &gw_clients[client_u32];
+    ssize_t written_i = 0;
+
+    while (!p_client->tx.empty() && (written_i >= 0))
+    {
+        written_i = send(p_client->fd_i, p_client->tx.data(), p_client->tx.size(), MSG_NOSIGNAL);
+        if (written_i > 0)
+        {
+            p_client->tx.erase(0, (size_t)written_i);
+        }
+    }
+    if ((written_i < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+        gw_client_close(client_u32);
+        return;
+    }
+
+    gw_watch(p_client->fd_i, EPOLL_CTL_MOD, EPOLLIN | (p_client->tx.empty() ? 0U : (uint32_t)EPOLLOUT), GW_KEY(GW_SOURCE_CLIENT, client_u32));
+}
+
+static void gw_client_send(const uint32_t client_u32, const int code_i, const std::string &body)
+{
+    GW_CLIENT *p_client = &gw_clients[client_u32];
+    char header_vc[160];
+
+    (void)snprintf(header_vc, sizeof(header_vc), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n", code_i,
+                   (code_i == 200) ? "OK" : ((code_i == 404) ? "Not Found" : "Bad Request"), body.size());
+    p_client->tx.append(header_vc);
+    p_client->tx.append(body);
+    gw_client_flush(client_u32);
+}
+
+/* Handles the requests in the buffer one after the other, waits while an operation answers one */
+static void gw_client_process(const uint32_t client_u32)
+{
+    while ((gw_clients[client_u32].fd_i >= 0) && !gw_clients[client_u32].busy_b)
+    {
+        GW_CLIENT *p_client = &gw_clients[client_u32];
+        const size_t header_end = p_client->rx.find("\r\n\r\n");
+        const char *p_length;
+        size_t content_length = 0U;
+        char method_vc[8];
+        char target_vc[256];
+        std::string path;
+        std::string query;
+        std::string body;
+
+        if (header_end == std::string::npos)
+        {
+            if (p_client->rx.size() > GW_MAX_REQUEST_SIZE)
+            {
+                gw_client_close(client_u32);
+            }
+            return;
+        }
+
+        p_length = strcasestr(p_client->rx.c_str(), "\r\nContent-Length:");
+        if ((NULL != p_length) && ((size_t)(p_length - p_client->rx.c_str()) < header_end))
+        {
+            content_length = strtoul(p_length + 17, NULL, 10);
+        }
+        if ((content_length > GW_MAX_REQUEST_SIZE) || (sscanf(p_client->rx.c_str(), "%7s %255s", method_vc, target_vc) != 2))
+        {
+            gw_client_close(client_u32);
+            return;
+        }
+        if (p_client->rx.size() < (header_end + 4U + content_length))
+        {
+            return;
+        }
+
+        body = p_client->rx.substr(header_end + 4U, content_length);
+        p_client->rx.erase(0, header_end + 4U + content_length);
+        path = target_vc;
+        if (path.find('?') != std::string::npos)
+        {
+            query = path.substr(path.find('?') + 1U);
+            path.erase(path.find('?'));
+        }
+
+        if ((strcmp(method_vc, "GET") == 0) && (path == "/fleet"))
+        {
+            gw_handle_fleet(client_u32, query);
+        }
+        else if ((strcmp(method_vc, "POST") == 0) && (path == "/fleet/command"))
+        {
+            gw_handle_forward(client_u32, "POST", "/api/command", query, body);
+        }
+        else if ((strcmp(method_vc, "PUT") == 0) && (path == "/fleet/schedule"))
+        {
+            gw_handle_forward(client_u32, "PUT", "/api/schedule", query, body);
+        }
+        else
+        {
+            gw_client_send(client_u32, 404, "{\"error\":\"not found\"}");
+        }
+    }
+}
+
+static void gw_client_read(const uint32_t client_u32)
+{
+    GW_CLIENT *p_client = &gw_clients[client_u32];
+    char buffer_vc[4096];
+    ssize_t read_i;
+
+    while ((read_i = recv(p_client->fd_i, buffer_vc, sizeof(buffer_vc), 0)) > 0)
+    {
+        p_client->rx.append(buffer_vc, (size_t)read_i);
+    }
+    if ((read_i == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        gw_client_close(client_u32);
+        return;
+    }
+
+    gw_client_process(client_u32);
+}
+
+static void gw_accept()
+{
+    const int one_i = 1;
+    uint32_t client_u32;
+    int fd_i;
+
+    while ((fd_i = accept(gw_listen_fd_i, NULL, NULL)) >= 0)
+    {
+        (void)setsockopt(fd_i, IPPROTO_TCP, TCP_NODELAY, &one_i, sizeof(one_i));
+        gw_set_nonblocking(fd_i);
+
+        for (client_u32 = 0U; (client_u32 < gw_clients.size()) && (gw_clients[client_u32].fd_i >= 0); ++client_u32)
+        {
+        }
+        if (client_u32 == gw_clients.size())
+        {
+            gw_clients.push_back(GW_CLIENT());
+        }
+
+        gw_clients[client_u32].fd_i = fd_i;
+        gw_clients[client_u32].generation_u32 = gw_next_generation_u32++;
+        gw_clients[client_u32].busy_b = false;
+        gw_watch(fd_i, EPOLL_CTL_ADD, EPOLLIN, GW_KEY(GW_SOURCE_CLIENT, client_u32));
+    }
+}
+
+/*****************************************************************************/
+
+static void gw_dns_put_name(std::string *p_packet, const char *p_name)
+{
+    const char *p_label = p_name;
+    const char *p_dot;
+
+    while (*p_label != '\0')
+    {
+        p_dot = strchr(p_label, '.');
+        p_dot = (NULL != p_dot) ? p_dot : (p_label + strlen(p_label));
+        p_packet->push_back((char)(p_dot - p_label));
+        p_packet->append(p_label, (size_t)(p_dot - p_label));
+        p_label = (*p_dot == '.') ? (p_dot + 1) : p_dot;
+    }
+    p_packet->push_back('\0');
+}
+
+/* Reads a possibly compressed name, returns the position after it or 0 if it is malformed */
+static size_t gw_dns_get_name(const uint8_t *p_packet, const size_t size, size_t pos, std::string *p_name)
+{
+    size_t end = 0U;
+    uint8_t jumps_u8 = 0U;
+
+    p_name->clear();
+    while (pos < size)
+    {
+        const uint8_t length_u8 = p_packet[pos];
+
+        if (length_u8 == 0U)
+        {
+            return (end != 0U) ? end : (pos + 1U);
+        }
+        if ((length_u8 & 0xc0U) == 0xc0U)
+        {
+            if (((pos + 1U) >= size) || (++jumps_u8 > 16U))
+            {
+                return 0U;
+            }
+            end = (end != 0U) ? end : (pos + 2U);
+            pos = ((size_t)(length_u8 & 0x3fU) << 8) | p_packet[pos + 1U];
+            continue;
+        }
+        if ((pos + 1U + length_u8) > size)
+        {
+            return 0U;
+        }
+
+        if (!p_name->empty())
+        {
+            p_name->push_back('.');
+        }
+        p_name->append((const char *)&p_packet[pos + 1U], length_u8);
+        pos += 1U + length_u8;
+    }
+
+    return 0U;
+}
+
+/* A name that is taken by a desk online elsewhere gets the address appended, both are kept */
+static void gw_add_discovered(const std::string &name, const struct sockaddr_in *p_addr)
+{
+    for (const GW_DEVICE &device : gw_devices)
+    {
+        if ((device.name == name) && (device.state_e == GW_DEV_CONNECTED) &&
+            ((device.addr.sin_addr.s_addr != p_addr->sin_addr.s_addr) || (device.addr.sin_port != p_addr->sin_port)))
+        {
+            (void)gw_add_device(name + "@" + gw_address_str(p_addr), p_addr);
+            return;
+        }
+    }
+
+    (void)gw_add_device(name, p_addr);
+}
+
+static void gw_mdns_query()
+{
+    struct sockaddr_in addr;
+    std::string packet("\0\0\0\0\0\1\0\0\0\0\0\0", 12U);
+
+    /* PTR question with the unicast-response bit, answers come straight back to our port */
+    gw_dns_put_name(&packet, GW_SERVICE);
+    packet.append("\0\x0c\x80\x01", 4U);
+
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(GW_MDNS_PORT);
+    (void)inet_pton(AF_INET, GW_MDNS_ADDRESS, &addr.sin_addr);
+    (void)sendto(gw_mdns_fd_i, packet.data(), packet.size(), 0, (const struct sockaddr *)&addr, sizeof(addr));
+}
+
+static void gw_mdns_read()
+{
+    uint8_t packet_vu8[1500];
+    struct sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    ssize_t size_i;
+
+    while ((size_i = recvfrom(gw_mdns_fd_i, packet_vu8, sizeof(packet_vu8), 0, (struct sockaddr *)&from, &from_size)) > 0)
+    {
+        const size_t size = (size_t)size_i;
+        std::vector<std::string> instances;
+        std::vector<GW_SRV> services;
+        std::map<std::string, in_addr_t> hosts;
+        std::string name;
+        std::string data;
+        size_t pos = 12U;
+        uint16_t records_u16;
+        bool valid_b = (size >= 12U) && ((packet_vu8[2] & 0x80U) != 0U);
+
+        /* Skip the questions, then go through answers, authority and additional records */
+        for (uint16_t i = 0U; valid_b && (i < (uint16_t)((packet_vu8[4] << 8) | packet_vu8[5])); ++i)
+        {
+            pos = gw_dns_get_name(packet_vu8, size, pos, &name) + 4U;
+            valid_b = (pos > 4U) && (pos <= size);
+        }
+
+        records_u16 = (uint16_t)(((packet_vu8[6] << 8) | packet_vu8[7]) + ((packet_vu8[8] << 8) | packet_vu8[9]) + ((packet_vu8[10] << 8) | packet_vu8[11]));
+        for (uint16_t i = 0U; valid_b && (i < records_u16); ++i)
+        {
+            uint16_t type_u16;
+            uint16_t length_u16;
+
+            pos = gw_dns_get_name(packet_vu8, size, pos, &name);
+            valid_b = (pos != 0U) && ((pos + 10U) <= size);
+            if (!valid_b)
+            {
+                break;
+            }
+
+            type_u16 = (uint16_t)((packet_vu8[pos] << 8) | packet_vu8[pos + 1U]);
+            length_u16 = (uint16_t)((packet_vu8[pos + 8U] << 8) | packet_vu8[pos + 9U]);
+            pos += 10U;
+            valid_b = (pos + length_u16) <= size;
+
+            if (valid_b && (type_u16 == 12U) && (strcasecmp(name.c_str(), GW_SERVICE) == 0) &&
+                (gw_dns_get_name(packet_vu8, size, pos, &data) != 0U))
+            {
+                instances.push_back(data);
+            }
+            else if (valid_b && (type_u16 == 33U) && (length_u16 > 6U))
+            {
+                GW_SRV srv;
+
+                srv.instance = name;
+                srv.port_u16 = (uint16_t)((packet_vu8[pos + 4U] << 8) | packet_vu8[pos + 5U]);
+                if (gw_dns_get_name(packet_vu8, size, pos + 6U, &(srv.target)) != 0U)
+                {
+                    services.push_back(srv);
+                }
+            }
+            else if (valid_b && (type_u16 == 1U) && (length_u16 == 4U))
+            {
+                in_addr_t address;
+
+                (void)memcpy(&address, &packet_vu8[pos], 4U);
+                hosts[name] = address;
+            }
+            else
+            {
+                /* TXT and whatever else is in there */
+            }
+            pos += length_u16;
+        }
+
+        /* Desks are named after their instance, reached where SRV and A records point to */
+        for (const std::string &instance : instances)
+        {
+            for (const GW_SRV &srv : services)
+            {
+                if ((strcasecmp(srv.instance.c_str(), instance.c_str()) == 0) && (instance.size() > strlen(GW_SERVICE)))
+                {
+                    struct sockaddr_in addr = from;
+
+                    addr.sin_port = htons(srv.port_u16);
+                    if (hosts.count(srv.target) != 0U)
+                    {
+                        addr.sin_addr.s_addr = hosts[srv.target];
+                    }
+                    gw_add_discovered(instance.substr(0U, instance.size() - strlen(GW_SERVICE) - 1U), &addr);
+                }
+            }
+        }
+        from_size = sizeof(from);
+    }
+}
+
+static void gw_mdns_init()
+{
+    const int one_i = 1;
+    const unsigned char ttl_u8 = 255U;
+
+    gw_mdns_fd_i = socket(AF_INET, SOCK_DGRAM, 0);
+    (void)setsockopt(gw_mdns_fd_i, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_u8, sizeof(ttl_u8));
+    (void)setsockopt(gw_mdns_fd_i, IPPROTO_IP, IP_MULTICAST_LOOP, &one_i, sizeof(one_i));
+    gw_set_nonblocking(gw_mdns_fd_i);
+    gw_watch(gw_mdns_fd_i, EPOLL_CTL_ADD, EPOLLIN, GW_KEY(GW_SOURCE_MDNS, 0U));
+}
+
+/*****************************************************************************/
+
+/* host:port or host:first-last, every port one desk */
+static bool gw_add_targets(const char *p_target)
+{
+    const char *p_colon = strrchr(p_target, ':');
+    struct addrinfo hints;
+    struct addrinfo *p_result = NULL;
+    struct sockaddr_in addr;
+    unsigned long first_ul;
+    unsigned long last_ul;
+    char *p_end;
+    std::string host;
+
+    if (NULL == p_colon)
+    {
+        return false;
+    }
+
+    host.assign(p_target, (size_t)(p_colon - p_target));
+    first_ul = strtoul(p_colon + 1, &p_end, 10);
+    last_ul = (*p_end == '-') ? strtoul(p_end + 1, NULL, 10) : first_ul;
+
+    (void)memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((first_ul == 0U) || (last_ul < first_ul) || (last_ul > 65535U) || (getaddrinfo(host.c_str(), NULL, &hints, &p_result) != 0))
+    {
+        return false;
+    }
+
+    addr = *(const struct sockaddr_in *)p_result->ai_addr;
+    freeaddrinfo(p_result);
+    for (unsigned long port_ul = first_ul; port_ul <= last_ul; ++port_ul)
+    {
+        addr.sin_port = htons((uint16_t)port_ul);
+        (void)gw_add_device(gw_address_str(&addr), &addr);
+    }
+
+    return true;
+}
+
+static void gw_timers(const uint64_t now_ns_u64, uint64_t *p_next_poll_ns_u64)
+{
+    const bool poll_b = (now_ns_u64 >= *p_next_poll_ns_u64);
+    std::vector<uint32_t> expired;
+
+    if (poll_b)
+    {
+        *p_next_poll_ns_u64 += (uint64_t)gw_poll_ms_u32 * 1000000ULL;
+        *p_next_poll_ns_u64 = std::max(*p_next_poll_ns_u64, now_ns_u64);
+    }
+
+    for (uint32_t i = 0U; i < gw_devices.size(); ++i)
+    {
+        GW_DEVICE *p_device = &gw_devices[i];
+
+        if ((p_device->state_e == GW_DEV_WAITING) && (now_ns_u64 >= p_device->retry_ns_u64))
+        {
+            gw_device_connect(i);
+        }
+        else if ((p_device->state_e == GW_DEV_CONNECTING) && (now_ns_u64 >= (p_device->retry_ns_u64 + ((uint64_t)GW_REQUEST_TIMEOUT_MS * 1000000ULL))))
+        {
+            gw_device_fail(i, "connect timeout");
+        }
+        else if ((p_device->state_e == GW_DEV_CONNECTED) && !p_device->queue.empty() && (p_device->queue.front().sent_ns_u64 != 0U) &&
+                 (now_ns_u64 >= (p_device->queue.front().sent_ns_u64 + ((uint64_t)GW_REQUEST_TIMEOUT_MS * 1000000ULL))))
+        {
+            gw_device_fail(i, "request timeout");
+        }
+        else if ((p_device->state_e == GW_DEV_CONNECTED) && poll_b && p_device->queue.empty())
+        {
+            /* Busy desks are skipped, whatever they are doing ends with the next poll */
+            gw_enqueue(i, GW_REQ_POLL, gw_poll_request(), NULL);
+        }
+        else
+        {
+            /* Nothing due */
+        }
+    }
+
+    for (const std::pair<const uint32_t, GW_OP> &op : gw_ops)
+    {
+        if (now_ns_u64 >= op.second.deadline_ns_u64)
+        {
+            expired.push_back(op.first);
+        }
+    }
+    for (const uint32_t op_u32 : expired)
+    {
+        gw_op_finish(op_u32);
+    }
+}
+
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const int one_i = 1;
+    int listen_port_i = 8090;
+    uint32_t query_s_u32 = 30U;
+    bool mdns_b = true;
+    int opt_i;
+    struct sockaddr_in addr;
+    struct epoll_event events[256];
+    uint64_t next_poll_ns_u64;
+    uint64_t next_query_ns_u64;
+    uint64_t last_timers_ns_u64 = 0U;
+
+    (void)signal(SIGPIPE, SIG_IGN);
+    gw_epoll_fd_i = epoll_create1(0);
+
+    while ((opt_i = getopt(argc, argv, "l:i:q:nt:")) != -1)
+    {
+        switch (opt_i)
+        {
+        case 'l':
+            listen_port_i = atoi(optarg);
+            break;
+        case 'i':
+            gw_poll_ms_u32 = (uint32_t)std::max(atoi(optarg), 10);
+            break;
+        case 'q':
+            query_s_u32 = (uint32_t)std::max(atoi(optarg), 1);
+            break;
+        case 'n':
+            mdns_b = false;
+            break;
+        case 't':
+            if (!gw_add_targets(optarg))
+            {
+                fprintf(stderr, "invalid target '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-l port] [-i poll ms] [-q query s] [-n] [-t host:port[-last port]]...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    gw_listen_fd_i = socket(AF_INET, SOCK_STREAM, 0);
+    (void)setsockopt(gw_listen_fd_i, SOL_SOCKET, SO_REUSEADDR, &one_i, sizeof(one_i));
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)listen_port_i);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if ((bind(gw_listen_fd_i, (const struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(gw_listen_fd_i, 64) != 0))
+    {
+        perror("listen");
+        return 1;
+    }
+    gw_set_nonblocking(gw_listen_fd_i);
+    gw_watch(gw_listen_fd_i, EPOLL_CTL_ADD, EPOLLIN, GW_KEY(GW_SOURCE_LISTEN, 0U));
+
+    if (mdns_b)
+    {
+        gw_mdns_init();
+    }
+
+    fprintf(stderr, "listening on port %d, %zu desks given, mDNS %s\n", listen_port_i, gw_devices.size(), mdns_b ? "on" : "off");
+
+    next_poll_ns_u64 = gw_now_ns();
+    next_query_ns_u64 = next_poll_ns_u64;
+    for (;;)
+    {
+        const int num_events_i = epoll_wait(gw_epoll_fd_i, events, 256, GW_TICK_MS);
+        uint64_t now_ns_u64;
+
+        for (int e = 0; e < num_events_i; ++e)
+        {
+            const uint64_t key_u64 = events[e].data.u64;
+            const uint32_t index_u32 = GW_KEY_INDEX(key_u64);
+
+            switch (GW_KEY_TYPE(key_u64))
+            {
+            case GW_SOURCE_LISTEN:
+                gw_accept();
+                break;
+            case GW_SOURCE_MDNS:
+                gw_mdns_read();
+                break;
+            case GW_SOURCE_DEVICE:
+                if (gw_devices[index_u32].state_e == GW_DEV_CONNECTING)
+                {
+                    gw_device_connected(index_u32);
+                }
+                else if (gw_devices[index_u32].state_e == GW_DEV_CONNECTED)
+                {
+                    if ((events[e].events & EPOLLOUT) != 0U)
+                    {
+                        gw_device_flush(index_u32);
+                    }
+                    if ((events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0U)
+                    {
+                        gw_device_read(index_u32);
+                    }
+                }
+                else
+                {
+                    /* Stale event of a closed connection */
+                }
+                break;
+            case GW_SOURCE_CLIENT:
+                if (gw_clients[index_u32].fd_i >= 0)
+                {
+                    if ((events[e].events & EPOLLOUT) != 0U)
+                    {
+                        gw_client_flush(index_u32);
+                    }
+                    if ((gw_clients[index_u32].fd_i >= 0) && ((events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0U))
+                    {
+                        gw_client_read(index_u32);
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        /* Taken after the events, requests sent while handling them must not look older than now */
+        now_ns_u64 = gw_now_ns();
+        if (mdns_b && (now_ns_u64 >= next_query_ns_u64))
+        {
+            gw_mdns_query();
+            next_query_ns_u64 = now_ns_u64 + ((uint64_t)query_s_u32 * 1000000000ULL);
+        }
+
+        if ((now_ns_u64 - last_timers_ns_u64) >= ((uint64_t)GW_TICK_MS * 1000000ULL))
+        {
+            last_timers_ns_u64 = now_ns_u64;
+            gw_timers(now_ns_u64, &next_poll_ns_u64);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Closed-loop HTTP load generator for the host build of the firmware.
+ *
+ * Keeps a number of keep-alive connections busy with the same request and
+ * reports throughput and latency percentiles as one JSON line, the same way
+ * the benchmarks in bench/ do.
+ *
+ *   http_load [-h host] [-p port] [-c connections] [-d seconds] [-u path]
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/*****************************************************************************/
+
+typedef struct
+{
+    int fd_i;
+    uint64_t sent_ns_u64;
+    char rx_vc[4096];
+    size_t rx_size;
+} LOAD_CONN;
+
+/*****************************************************************************/
+
+static uint64_t load_now_ns()
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static int load_connect(const struct sockaddr_in *p_addr)
+{
+    const int one_i = 1;
+    int fd_i = socket(AF_INET, SOCK_STREAM, 0);
+
+    if ((fd_i < 0) || (connect(fd_i, (const struct sockaddr *)p_addr, sizeof(*p_addr)) != 0))
+    {
+        perror("connect");
+        exit(1);
+    }
+
+    (void)setsockopt(fd_i, IPPROTO_TCP, TCP_NODELAY, &one_i, sizeof(one_i));
+    (void)fcntl(fd_i, F_SETFL, fcntl(fd_i, F_GETFL) | O_NONBLOCK);
+
+    return fd_i;
+}
+
+/* Returns the size of the first complete response in the buffer, 0 if there is none yet */
+static size_t load_response_size(const LOAD_CONN *p_conn)
+{
+    const char *p_end = (const char *)memmem(p_conn->rx_vc, p_conn->rx_size, "\r\n\r\n", 4U);
+    const char *p_length;
+    const char *p_last_chunk;
+    size_t size = 0U;
+
+    if (NULL == p_end)
+    {
+        /* Headers incomplete */
+    }
+    else if (NULL != memmem(p_conn->rx_vc, p_end - p_conn->rx_vc, "Transfer-Encoding: chunked", 26U))
+    {
+        /* Good enough for the bodies the firmware produces */
+        p_last_chunk = (const char *)memmem(p_end + 2, p_conn->rx_size - (size_t)(p_end + 2 - p_conn->rx_vc), "\r\n0\r\n\r\n", 7U);
+        size = (NULL != p_last_chunk) ? (size_t)(p_last_chunk + 7 - p_conn->rx_vc) : 0U;
+    }
+    else
+    {
+        p_length = (const char *)memmem(p_conn->rx_vc, p_end - p_conn->rx_vc, "Content-Length:", 15U);
+        size = (size_t)(p_end - p_conn->rx_vc) + 4U + ((NULL != p_length) ? strtoul(p_length + 15, NULL, 10) : 0U);
+        size = (size <= p_conn->rx_size) ? size : 0U;
+    }
+
+    return size;
+}
+
+static void load_send(LOAD_CONN *p_conn, const char *p_request, const size_t size)
+{
+    p_conn->sent_ns_u64 = load_now_ns();
+    if (write(p_conn->fd_i, p_request, size) != (ssize_t)size)
+    {
+        perror("write");
+        exit(1);
+    }
+}
+
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *p_host = "127.0.0.1";
+    const char *p_path = "/";
+    int port_i = 8080;
+    int num_conns_i = 4;
+    int duration_s_i = 5;
+    int opt_i;
+    char request_vc[256];
+    size_t request_size;
+    struct sockaddr_in addr;
+    struct epoll_event events[64];
+    std::vector<LOAD_CONN> conns;
+    std::vector<uint32_t> latencies_us;
+    uint64_t start_ns_u64;
+    uint64_t end_ns_u64;
+    uint64_t elapsed_ns_u64;
+    int epoll_fd_i;
+
+    while ((opt_i = getopt(argc, argv, "h:p:c:d:u:")) != -1)
+    {
+        switch (opt_i)
+        {
+        case 'h':
+            p_host = optarg;
+            break;
+        case 'p':
+            port_i = atoi(optarg);
+            break;
+        case 'c':
+            num_conns_i = atoi(optarg);
+            break;
+        case 'd':
+            duration_s_i = atoi(optarg);
+            break;
+        case 'u':
+            p_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c connections] [-d seconds] [-u path]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    request_size = (size_t)snprintf(request_vc, sizeof(request_vc), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", p_path, p_host);
+
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port_i);
+    if (inet_pton(AF_INET, p_host, &addr.sin_addr) != 1)
+    {
+        fprintf(stderr, "invalid host address '%s'\n", p_host);
+        return 1;
+    }
+
+    epoll_fd_i = epoll_create1(0);
+    conns.resize((size_t)num_conns_i);
+    for (int i = 0; i < num_conns_i; ++i)
+    {
+        struct epoll_event event;
+
+        conns[i].fd_i = load_connect(&addr);
+        conns[i].rx_size = 0U;
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+        (void)epoll_ctl(epoll_fd_i, EPOLL_CTL_ADD, conns[i].fd_i, &event);
+    }
+
+    start_ns_u64 = load_now_ns();
+    end_ns_u64 = start_ns_u64 + ((uint64_t)duration_s_i * 1000000000ULL);
+    for (int i = 0; i < num_conns_i; ++i)
+    {
+        load_send(&conns[i], request_vc, request_size);
+    }
+
+    while (load_now_ns() < end_ns_u64)
+    {
+        const int num_events_i = epoll_wait(epoll_fd_i, events, 64, 100);
+
+        for (int e = 0; e < num_events_i; ++e)
+        {
+            LOAD_CONN *p_conn = &conns[events[e].data.u32];
+            const ssize_t read_i = read(p_conn->fd_i, &(p_conn->rx_vc[p_conn->rx_size]), sizeof(p_conn->rx_vc) - p_conn->rx_size);
+            size_t response_size;
+
+            if (read_i <= 0)
+            {
+                if ((read_i < 0) && (errno == EAGAIN))
+                {
+                    continue;
+                }
+                fprintf(stderr, "connection closed by server\n");
+                return 1;
+            }
+
+            p_conn->rx_size += (size_t)read_i;
+            response_size = load_response_size(p_conn);
+            if (response_size > 0U)
+            {
+                latencies_us.push_back((uint32_t)((load_now_ns() - p_conn->sent_ns_u64) / 1000U));
+                (void)memmove(p_conn->rx_vc, &(p_conn->rx_vc[response_size]), p_conn->rx_size - response_size);
+                p_conn->rx_size -= response_size;
+                load_send(p_conn, request_vc, request_size);
+            }
+        }
+    }
+    elapsed_ns_u64 = load_now_ns() - start_ns_u64;
+
+    if (latencies_us.empty())
+    {
+        fprintf(stderr, "no responses\n");
+        return 1;
+    }
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    printf("{\"suite\":\"http_load\",\"path\":\"%s\",\"connections\":%d,\"requests\":%zu,\"req_per_s\":%.1f,"
+           "\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u}\n",
+           p_path, num_conns_i, latencies_us.size(), (double)latencies_us.size() * 1e9 / (double)elapsed_ns_u64,
+           latencies_us[latencies_us.size() * 50U / 100U], latencies_us[latencies_us.size() * 90U / 100U],
+           latencies_us[latencies_us.size() * 99U / 100U], latencies_us.back());
+
+    for (int i = 0; i < num_conns_i; ++i)
+    {
+        (void)close(conns[i].fd_i);
+    }
+    (void)close(epoll_fd_i);
+
+    return 0;
+}
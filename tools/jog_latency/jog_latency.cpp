@@ -0,0 +1,328 @@
+/*
+ * End-to-end jog latency against the host build of the firmware and its desk emulator.
+ *
+ * Opens the /api/jog WebSocket and repeatedly holds UP or DOWN for a while, measuring
+ * the time from the jog start until the telemetry shows the desk moving, and from the
+ * stop until it shows the last height change. Finally lets the dead-man timeout stop a
+ * jog that is never refreshed. Reports one JSON line, the same way the benchmarks do.
+ *
+ *   jog_latency [-h host] [-p port] [-n jogs] [-t hold ms]
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/*****************************************************************************/
+
+#define JOG_MSG_START 0x01U
+#define JOG_MSG_STOP 0x02U
+#define JOG_MSG_TELEMETRY 0x81U
+
+#define JOG_REFRESH_MS 200U  /* well within the dead-man timeout */
+#define JOG_SETTLE_MS 500U   /* no height change for this long means it stopped */
+
+typedef struct
+{
+    uint16_t height_u16;
+    uint8_t state_u8;
+    uint8_t jog_u8;
+} JOG_TELEMETRY;
+
+/*****************************************************************************/
+
+static int jog_fd_i = -1;
+static uint8_t jog_rx_vu8[1024];
+static size_t jog_rx_size = 0U;
+static JOG_TELEMETRY jog_last = {0};
+
+/*****************************************************************************/
+
+static uint64_t jog_now_us()
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000ULL) + ((uint64_t)ts.tv_nsec / 1000U);
+}
+
+static void jog_fail(const char *p_what)
+{
+    fprintf(stderr, "%s\n", p_what);
+    exit(1);
+}
+
+static void jog_write(const void *p_data, const size_t size)
+{
+    if (write(jog_fd_i, p_data, size) != (ssize_t)size)
+    {
+        perror("write");
+        exit(1);
+    }
+}
+
+static void jog_send(const uint8_t *p_payload, const uint8_t size_u8)
+{
+    const uint8_t mask_vu8[4] = {0x12, 0x34, 0x56, 0x78};
+    uint8_t frame_vu8[16];
+
+    /* Clients always mask */
+    frame_vu8[0] = 0x82U;
+    frame_vu8[1] = 0x80U | size_u8;
+    memcpy(&frame_vu8[2], mask_vu8, 4U);
+    for (uint8_t i = 0U; i < size_u8; ++i)
+    {
+        frame_vu8[6U + i] = p_payload[i] ^ mask_vu8[i & 3U];
+    }
+    jog_write(frame_vu8, 6U + size_u8);
+}
+
+static void jog_send_start(const uint8_t direction_u8)
+{
+    const uint8_t message_vu8[2] = {JOG_MSG_START, direction_u8};
+
+    jog_send(message_vu8, sizeof(message_vu8));
+}
+
+static void jog_send_stop()
+{
+    const uint8_t message_vu8[1] = {JOG_MSG_STOP};
+
+    jog_send(message_vu8, sizeof(message_vu8));
+}
+
+/* Waits until the given time for the next telemetry message, false on timeout */
+static bool jog_receive(const uint64_t deadline_us_u64)
+{
+    for (;;)
+    {
+        /* Server frames are unmasked and short */
+        while ((jog_rx_size >= 2U) && (jog_rx_size >= (2U + (jog_rx_vu8[1] & 0x7fU))))
+        {
+            const size_t frame_size = 2U + (jog_rx_vu8[1] & 0x7fU);
+            const bool telemetry_b = ((jog_rx_vu8[0] & 0x0fU) == 0x2U) && (frame_size >= 7U) && (jog_rx_vu8[2] == JOG_MSG_TELEMETRY);
+
+            if (telemetry_b)
+            {
+                jog_last.height_u16 = (uint16_t)(jog_rx_vu8[3] | (jog_rx_vu8[4] << 8));
+                jog_last.state_u8 = jog_rx_vu8[5];
+                jog_last.jog_u8 = jog_rx_vu8[6];
+            }
+            memmove(jog_rx_vu8, &jog_rx_vu8[frame_size], jog_rx_size - frame_size);
+            jog_rx_size -= frame_size;
+
+            if (telemetry_b)
+            {
+                return true;
+            }
+        }
+
+        const uint64_t now_us_u64 = jog_now_us();
+        struct pollfd pfd = {jog_fd_i, POLLIN, 0};
+        ssize_t read_i;
+
+        if (now_us_u64 >= deadline_us_u64)
+        {
+            return false;
+        }
+        if (poll(&pfd, 1, (int)((deadline_us_u64 - now_us_u64 + 999U) / 1000U)) <= 0)
+        {
+            continue;
+        }
+
+        read_i = read(jog_fd_i, &jog_rx_vu8[jog_rx_size], sizeof(jog_rx_vu8) - jog_rx_size);
+        if (read_i <= 0)
+        {
+            jog_fail("connection closed by server");
+        }
+        jog_rx_size += (size_t)read_i;
+    }
+}
+
+static void jog_connect(const char *p_host, const int port_i)
+{
+    const int one_i = 1;
+    const char *p_expected_accept = "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"; /* RFC 6455 example key */
+    struct sockaddr_in addr;
+    char request_vc[256];
+    char *p_end = NULL;
+    ssize_t read_i;
+
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port_i);
+    if (inet_pton(AF_INET, p_host, &addr.sin_addr) != 1)
+    {
+        jog_fail("invalid host address");
+    }
+
+    jog_fd_i = socket(AF_INET, SOCK_STREAM, 0);
+    if ((jog_fd_i < 0) || (connect(jog_fd_i, (const struct sockaddr *)&addr, sizeof(addr)) != 0))
+    {
+        perror("connect");
+        exit(1);
+    }
+    (void)setsockopt(jog_fd_i, IPPROTO_TCP, TCP_NODELAY, &one_i, sizeof(one_i));
+
+    (void)snprintf(request_vc, sizeof(request_vc),
+                   "GET /api/jog HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                   p_host);
+    jog_write(request_vc, strlen(request_vc));
+
+    while (NULL == p_end)
+    {
+        read_i = read(jog_fd_i, &jog_rx_vu8[jog_rx_size], sizeof(jog_rx_vu8) - jog_rx_size - 1U);
+        if (read_i <= 0)
+        {
+            jog_fail("connection closed during the handshake");
+        }
+        jog_rx_size += (size_t)read_i;
+        jog_rx_vu8[jog_rx_size] = '\0';
+        p_end = strstr((char *)jog_rx_vu8, "\r\n\r\n");
+    }
+
+    if ((strncmp((char *)jog_rx_vu8, "HTTP/1.1 101", 12U) != 0) || (NULL == strstr((char *)jog_rx_vu8, p_expected_accept)))
+    {
+        fprintf(stderr, "%s", (char *)jog_rx_vu8);
+        jog_fail("handshake failed");
+    }
+
+    /* Frames may already follow the headers */
+    jog_rx_size -= (size_t)(p_end + 4 - (char *)jog_rx_vu8);
+    memmove(jog_rx_vu8, p_end + 4, jog_rx_size);
+}
+
+/* Keeps receiving for as long as the height changes, returns the time of the last change */
+static uint64_t jog_wait_settled()
+{
+    uint64_t last_change_us_u64 = jog_now_us();
+    uint16_t height_u16 = jog_last.height_u16;
+
+    while (jog_receive(last_change_us_u64 + (JOG_SETTLE_MS * 1000U)))
+    {
+        if (jog_last.height_u16 != height_u16)
+        {
+            height_u16 = jog_last.height_u16;
+            last_change_us_u64 = jog_now_us();
+        }
+    }
+
+    return last_change_us_u64;
+}
+
+static uint32_t jog_percentile(std::vector<uint32_t> values, const uint32_t percent_u32)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1U, values.size() * percent_u32 / 100U)];
+}
+
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *p_host = "127.0.0.1";
+    int port_i = 8080;
+    int num_jogs_i = 10;
+    int hold_ms_i = 300;
+    int opt_i;
+    std::vector<uint32_t> start_us;
+    std::vector<uint32_t> stop_us;
+    uint64_t t0_us_u64;
+    uint64_t refresh_us_u64;
+    uint64_t deadman_us_u64;
+    uint16_t height_u16;
+
+    while ((opt_i = getopt(argc, argv, "h:p:n:t:")) != -1)
+    {
+        switch (opt_i)
+        {
+        case 'h':
+            p_host = optarg;
+            break;
+        case 'p':
+            port_i = atoi(optarg);
+            break;
+        case 'n':
+            num_jogs_i = atoi(optarg);
+            break;
+        case 't':
+            hold_ms_i = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-n jogs] [-t hold ms]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    jog_connect(p_host, port_i);
+
+    /* The firmware wakes the desk up by itself, wait until it knows the height */
+    t0_us_u64 = jog_now_us();
+    while ((jog_last.height_u16 == 0U) && jog_receive(t0_us_u64 + 5000000U))
+    {
+    }
+    if (jog_last.height_u16 == 0U)
+    {
+        jog_fail("no height from the desk");
+    }
+    (void)jog_wait_settled();
+
+    for (int i = 0; i < num_jogs_i; ++i)
+    {
+        /* Alternate, so the desk stays where it is */
+        height_u16 = jog_last.height_u16;
+        t0_us_u64 = jog_now_us();
+        refresh_us_u64 = t0_us_u64;
+        jog_send_start(((i % 2) == 0) ? 1U : 2U);
+
+        while (jog_last.height_u16 == height_u16)
+        {
+            if (!jog_receive(t0_us_u64 + 2000000U))
+            {
+                jog_fail("desk did not move");
+            }
+        }
+        start_us.push_back((uint32_t)(jog_now_us() - t0_us_u64));
+
+        /* Hold like a finger on the button would */
+        while (jog_now_us() < (t0_us_u64 + ((uint64_t)hold_ms_i * 1000U)))
+        {
+            if (jog_now_us() >= (refresh_us_u64 + (JOG_REFRESH_MS * 1000U)))
+            {
+                refresh_us_u64 = jog_now_us();
+                jog_send_start(((i % 2) == 0) ? 1U : 2U);
+            }
+            (void)jog_receive(std::min(refresh_us_u64 + (JOG_REFRESH_MS * 1000U), t0_us_u64 + ((uint64_t)hold_ms_i * 1000U)));
+        }
+
+        t0_us_u64 = jog_now_us();
+        jog_send_stop();
+        stop_us.push_back((uint32_t)(std::max(jog_wait_settled(), t0_us_u64) - t0_us_u64));
+    }
+
+    /* Never refreshed: the firmware has to stop it on its own */
+    t0_us_u64 = jog_now_us();
+    jog_send_start(1U);
+    deadman_us_u64 = jog_wait_settled() - t0_us_u64;
+    jog_send_stop();
+
+    printf("{\"suite\":\"jog_latency\",\"jogs\":%d,\"hold_ms\":%d,\"start_p50_us\":%u,\"start_max_us\":%u,"
+           "\"stop_p50_us\":%u,\"stop_max_us\":%u,\"deadman_stop_us\":%u}\n",
+           num_jogs_i, hold_ms_i, jog_percentile(start_us, 50U), jog_percentile(start_us, 100U),
+           jog_percentile(stop_us, 50U), jog_percentile(stop_us, 100U), (uint32_t)deadman_us_u64);
+
+    (void)close(jog_fd_i);
+
+    return 0;
+}
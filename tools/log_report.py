@@ -0,0 +1,89 @@
+"""
+Reports how much RAM the logging front end in lib/log saves per module.
+
+On the ESP8266 string literals end up in .rodata, which is loaded into RAM. The log_msg() and
+log_buffer() macros put their messages into flash with PSTR() instead, module tags are PROGMEM
+arrays, and calls above LOG_MIN_LEVEL are not compiled at all. The numbers are taken from the
+sources, not from the linked image.
+
+Runs as a PlatformIO post script (extra_scripts = post:tools/log_report.py) with the
+LOG_MIN_LEVEL of the environment, or standalone:
+
+    python3 tools/log_report.py [LOG_LEVEL_INFO]
+"""
+
+import glob
+import os
+import re
+import sys
+
+LEVELS = ["LOG_LEVEL_SILENT", "LOG_LEVEL_CRITICAL", "LOG_LEVEL_ERROR", "LOG_LEVEL_WARNING", "LOG_LEVEL_INFO", "LOG_LEVEL_DEBUG"]
+POINTER_SIZE = 4
+
+CALL_RE = re.compile(r"\blog_(?:msg|buffer)\s*\(\s*(LOG_LEVEL_\w+)\s*,\s*(\w+)\s*,\s*((?:\"(?:[^\"\\]|\\.)*\"\s*)+)")
+TAG_RE = re.compile(r"\bconst\s+char\s+(\w+_module_str)\s*\[\]\s*PROGMEM\s*=\s*\"((?:[^\"\\]|\\.)*)\"")
+LITERAL_RE = re.compile(r"\"((?:[^\"\\]|\\.)*)\"")
+
+
+def literal_size(text):
+    # Escapes count as the one byte they turn into, plus the terminator
+    return len(re.sub(r"\\(x[0-9a-fA-F]+|[0-7]{1,3}|.)", "_", text)) + 1
+
+
+def scan(project_dir):
+    modules = {}
+    sources = glob.glob(os.path.join(project_dir, "lib", "*", "*.cpp")) + glob.glob(os.path.join(project_dir, "src", "*.cpp"))
+
+    for path in sorted(sources):
+        with open(path, encoding="utf-8") as f:
+            text = f.read()
+        if "log.h" not in text or path.endswith(os.path.join("log", "log.cpp")):
+            continue
+
+        module = modules.setdefault(os.path.basename(os.path.dirname(path)), {"calls": [], "tags": 0})
+        for match in TAG_RE.finditer(text):
+            # Used to be a pointer in RAM to a literal in RAM
+            module["tags"] += literal_size(match.group(2)) + POINTER_SIZE
+        for match in CALL_RE.finditer(text):
+            message = "".join(LITERAL_RE.findall(match.group(3)))
+            module["calls"].append((LEVELS.index(match.group(1)), literal_size(message)))
+
+    return modules
+
+
+def report(project_dir, min_level):
+    limit = LEVELS.index(min_level)
+    modules = scan(project_dir)
+    totals = [0, 0, 0, 0, 0]
+
+    print("log_report: LOG_MIN_LEVEL=%s, strings that no longer take RAM (bytes)" % min_level)
+    print("log_report: %-12s %5s %8s %8s %8s %8s" % ("module", "calls", "removed", "to flash", "tags", "saved"))
+    for name in sorted(modules):
+        calls = modules[name]["calls"]
+        if not calls and not modules[name]["tags"]:
+            continue
+        removed = [size for level, size in calls if level > limit]
+        kept = [size for level, size in calls if level <= limit]
+        row = [len(calls), len(removed), sum(kept), modules[name]["tags"], sum(removed) + sum(kept) + modules[name]["tags"]]
+        totals = [a + b for a, b in zip(totals, row)]
+        print("log_report: %-12s %5u %8u %8u %8u %8u" % tuple([name] + row))
+    print("log_report: %-12s %5u %8u %8u %8u %8u" % tuple(["total"] + totals))
+
+
+def min_level_of(defines):
+    for define in defines:
+        if isinstance(define, (list, tuple)) and (len(define) == 2) and (define[0] == "LOG_MIN_LEVEL"):
+            return str(define[1])
+        if define == "DISABLE_LOGGING":
+            return "LOG_LEVEL_SILENT"
+    return "LOG_LEVEL_DEBUG"
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    report(env.subst("$PROJECT_DIR"), min_level_of(env.get("CPPDEFINES", [])))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if (len(sys.argv) > 2) or ((len(sys.argv) == 2) and (sys.argv[1] not in LEVELS)):
+            sys.exit("usage: log_report.py [%s]" % "|".join(LEVELS))
+        report(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."), sys.argv[1] if len(sys.argv) == 2 else "LOG_LEVEL_DEBUG")
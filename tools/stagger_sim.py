@@ -0,0 +1,155 @@
+"""
+Simulates a floor of desks on one host to see how many move at the same time when a scheduled
+transition comes up. Starts host firmware instances on consecutive ports, gives all of them the
+same schedule with a sit-to-stand transition shortly after, sets the stagger window and polls
+every desk over the UDP fleet protocol until all are standing. Without a window all desks start
+together. Prints one JSON line per run:
+
+    pio run -e host_fleet
+    python3 tools/stagger_sim.py [-n 40] [-w 0 45] [-p 19000]
+"""
+
+import argparse
+import http.client
+import json
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+FP_MAGIC = 0x4446
+FP_VERSION = 1
+FP_MSG_STATUS_REQUEST = 1
+FP_MSG_STATUS = 2
+FP_STATUS = struct.Struct("<HBBIHBBBBIII")
+DC_STATE_STANDING = 1
+POLL_S = 0.25
+
+
+def http_request(port, method, path, body=None):
+    conn = http.client.HTTPConnection("127.0.0.1", port, timeout=5)
+    conn.request(method, path, body=json.dumps(body) if body is not None else None,
+                 headers={"Content-Type": "application/json"} if body is not None else {})
+    response = conn.getresponse()
+    data = response.read()
+    conn.close()
+    if response.status != 200:
+        raise RuntimeError("%s %s on port %d: %d %s" % (method, path, port, response.status, data))
+    return json.loads(data)
+
+
+def poll(sock, ports, request_id):
+    """Height and desk state of every desk that answers within the poll interval"""
+    for port in ports:
+        sock.sendto(struct.pack("<HBBI", FP_MAGIC, FP_VERSION, FP_MSG_STATUS_REQUEST, request_id), ("127.0.0.1", port))
+
+    status = {}
+    deadline = time.monotonic() + POLL_S
+    while (len(status) < len(ports)) and (time.monotonic() < deadline):
+        sock.settimeout(max(0.001, deadline - time.monotonic()))
+        try:
+            data, address = sock.recvfrom(64)
+        except socket.timeout:
+            break
+        if len(data) >= FP_STATUS.size:
+            fields = FP_STATUS.unpack_from(data)
+            if (fields[0] == FP_MAGIC) and (fields[2] == FP_MSG_STATUS) and (fields[3] == request_id):
+                status[address[1]] = (fields[4], fields[5])
+    return status
+
+
+def run(args, window):
+    ports = [args.port + i for i in range(args.desks)]
+    desks = []
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    result = {"suite": "stagger", "desks": args.desks, "window_s": window}
+
+    try:
+        for port in ports:
+            env = dict(os.environ, FLEXIDESK_PORT=str(port))
+            desks.append(subprocess.Popen([args.firmware], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+        time.sleep(1.5)
+
+        # The transition far enough out for every desk to hear the others first, on the firmware's clock
+        now = http_request(ports[0], "GET", "/api/status")["time"]
+        hour, minute, second = (int(x) for x in now.split(":"))
+        start = hour * 3600 + minute * 60 + second + args.lead_in
+        if start + 600 >= 86400:
+            raise RuntimeError("too close to midnight, the schedule would not fit into today")
+        day = {"enabled": True, "start": "%02d:%02d:%02d" % (start // 3600, (start // 60) % 60, start % 60),
+               "end": "%02d:%02d:%02d" % ((start + 600) // 3600, ((start + 600) // 60) % 60, (start + 600) % 60),
+               "interval": 3600, "duration": 1800}
+        schedule = {"transition_tolerance": 90, "days": [dict(day, day=d) for d in range(7)]}
+        for port in ports:
+            http_request(port, "PUT", "/api/schedule", schedule)
+            http_request(port, "PUT", "/api/stagger", {"window": window})
+        transition = time.monotonic() + start - (hour * 3600 + minute * 60 + second)
+
+        # Moving means the height changed within the last two polls, the display does not change every frame
+        previous = {}
+        changed = {}
+        started = {}
+        peak = 0
+        samples = []
+        request_id = 1
+        standing_at = None
+        while time.monotonic() < transition + window + args.timeout:
+            request_id += 1
+            status = poll(sock, ports, request_id)
+            now = time.monotonic()
+            moving = 0
+            for port, (height, state) in status.items():
+                if (port in previous) and (previous[port] != height):
+                    changed[port] = now
+                    started.setdefault(port, now - transition)
+                previous[port] = height
+                if (now - changed.get(port, -1e9)) <= (2.5 * POLL_S):
+                    moving += 1
+            peak = max(peak, moving)
+            if moving > 0:
+                samples.append(moving)
+            standing = sum(1 for _, state in status.values() if state == DC_STATE_STANDING)
+            if (standing == args.desks) and (standing_at is None):
+                standing_at = now - transition
+                if now > transition + 1.0:
+                    break
+            time.sleep(max(0.0, POLL_S - (time.monotonic() - now)))
+
+        starts = sorted(started.values())
+        result["peak_concurrent"] = peak
+        result["mean_concurrent"] = round(sum(samples) / len(samples), 2) if samples else 0
+        result["first_start_s"] = round(starts[0], 1) if starts else None
+        result["last_start_s"] = round(starts[-1], 1) if starts else None
+        result["all_standing_s"] = round(standing_at, 1) if standing_at is not None else None
+        result["moved"] = len(started)
+        result["stagger"] = http_request(ports[-1], "GET", "/api/stagger")
+    finally:
+        for desk in desks:
+            desk.terminate()
+        for desk in desks:
+            desk.wait()
+        sock.close()
+
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-n", "--desks", type=int, default=40)
+    parser.add_argument("-w", "--window", type=int, nargs="+", default=[0, 45], help="stagger windows in s, one run each, 0 is off")
+    parser.add_argument("-p", "--port", type=int, default=19000, help="port of the first firmware instance")
+    parser.add_argument("--lead-in", type=int, default=40, help="seconds until the scheduled transition")
+    parser.add_argument("--timeout", type=float, default=40.0, help="seconds after the window until giving up")
+    parser.add_argument("--firmware", default=".pio/build/host_fleet/program")
+    args = parser.parse_args()
+
+    for window in args.window:
+        print(json.dumps(run(args, window)))
+        sys.stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,77 @@
+"""
+Receives the batched syslog datagrams of lib/syslog, prints the log lines and checks the
+sequence numbers for lost datagrams. Ends after the given number of seconds (or Ctrl-C)
+with a JSON summary:
+
+    python3 tools/syslog_listen.py [-p 5514] [-d 60] [-q]
+"""
+
+import argparse
+import json
+import re
+import socket
+import sys
+import time
+
+HEADER_RE = re.compile(rb"^<(\d+)>1 (\S+) (\S+) (\S+) \S+ \S+ \[meta sequenceId=\"(\d+)\"\]\[batch@32473 records=\"(\d+)\" lost=\"(\d+)\"\] ")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-p", "--port", type=int, default=5514)
+    parser.add_argument("-d", "--duration", type=float, default=0.0, help="seconds, 0 runs until interrupted")
+    parser.add_argument("-q", "--quiet", action="store_true", help="only print the summary")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", args.port))
+    sock.settimeout(0.2)
+
+    summary = {"datagrams": 0, "records": 0, "lost_datagrams": 0, "lost_records": 0, "malformed": 0, "bytes": 0}
+    last_sequence = {}
+    start = time.monotonic()
+
+    try:
+        while (args.duration <= 0.0) or ((time.monotonic() - start) < args.duration):
+            try:
+                data, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+
+            match = HEADER_RE.match(data)
+            if match is None:
+                summary["malformed"] += 1
+                continue
+
+            host = match.group(3).decode()
+            sequence = int(match.group(5))
+            lines = data[match.end():].decode(errors="replace").split("\n")
+
+            # Sequence numbers are per device and restart at 1 when it reboots
+            if (host in last_sequence) and (sequence > last_sequence[host] + 1):
+                summary["lost_datagrams"] += sequence - last_sequence[host] - 1
+            last_sequence[host] = sequence
+
+            summary["datagrams"] += 1
+            summary["records"] += len(lines)
+            summary["bytes"] += len(data)
+            summary["lost_records"] += int(match.group(7))
+            if int(match.group(6)) != len(lines):
+                summary["malformed"] += 1
+
+            if not args.quiet:
+                for line in lines:
+                    print("%s %s #%u %s" % (match.group(2).decode(), host, sequence, line))
+    except KeyboardInterrupt:
+        pass
+
+    elapsed = time.monotonic() - start
+    summary["seconds"] = round(elapsed, 1)
+    summary["datagrams_per_minute"] = round(summary["datagrams"] * 60.0 / elapsed, 2) if elapsed > 0 else 0.0
+    summary["records_per_datagram"] = round(summary["records"] / summary["datagrams"], 2) if summary["datagrams"] else 0.0
+    print(json.dumps(summary))
+    sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+'use strict';
+const $ = (s) => document.querySelector(s);
+const days = ['Sun', 'Mon', 'Tue', 'Wed', 'Thu', 'Fri', 'Sat'];
+
+function show(text) {
+  $('#message').textContent = text || '';
+}
+
+function request(method, path, body) {
+  return fetch(path, {method: method, body: body && JSON.stringify(body)})
+    .then((r) => r.json().then((j) => {
+      if (!r.ok) throw new Error(j.error || r.status);
+      return j;
+    }));
+}
+
+function update(height, state) {
+  if (height !== undefined) $('#height').textContent = height ? (height / 10).toFixed(1) + ' cm' : '-- cm';
+  if (state !== undefined) $('#state').textContent = state;
+}
+
+/* Live height and state */
+const events = new EventSource('/api/events');
+events.addEventListener('height', (e) => update(JSON.parse(e.data).height));
+events.addEventListener('state', (e) => update(undefined, JSON.parse(e.data).state));
+
+/* Hold-to-move over the jog socket, refreshed well within the dead-man timeout */
+let socket = null;
+let jogTimer = null;
+
+function jogStart(button) {
+  const dir = Number(button.dataset.dir);
+  const send = () => socket && socket.readyState === 1 && socket.send(new Uint8Array([1, dir]));
+  if (!socket || socket.readyState > 1) {
+    socket = new WebSocket('ws://' + location.host + '/api/jog');
+    socket.binaryType = 'arraybuffer';
+    socket.onopen = send;
+  }
+  button.classList.add('active');
+  send();
+  clearInterval(jogTimer);
+  jogTimer = setInterval(send, 200);
+}
+
+function jogStop() {
+  clearInterval(jogTimer);
+  jogTimer = null;
+  document.querySelectorAll('.jog').forEach((b) => b.classList.remove('active'));
+  if (socket && socket.readyState === 1) socket.send(new Uint8Array([2]));
+}
+
+document.querySelectorAll('.jog').forEach((b) => {
+  b.addEventListener('pointerdown', (e) => { e.preventDefault(); jogStart(b); });
+  ['pointerup', 'pointerleave', 'pointercancel'].forEach((t) => b.addEventListener(t, jogStop));
+});
+
+document.querySelectorAll('[data-target]').forEach((b) => b.addEventListener('click', () => {
+  request('POST', '/api/command', {target: b.dataset.target}).then(() => show(), (e) => show(e.message));
+}));
+
+/* Config forms */
+function loadDesk() {
+  return request('GET', '/api/desk').then((desk) => {
+    for (const k in desk) $('#desk [name=' + k + ']').value = desk[k];
+  });
+}
+
+/* Only changed days are sent, all seven together would not fit into the request buffer next to the browser's headers */
+let scheduleSaved = [];
+
+function readSchedule() {
+  return Array.from(document.querySelectorAll('#schedule tbody tr')).map((row) => {
+    const v = (n) => row.querySelector('[name=' + n + ']');
+    return JSON.stringify({
+      day: Number(row.dataset.day), enabled: v('enabled').checked, start: v('start').value, end: v('end').value,
+      interval: Number(v('interval').value) * 60, duration: Number(v('duration').value) * 60
+    });
+  });
+}
+
+function loadSchedule() {
+  return request('GET', '/api/schedule').then((schedule) => {
+    $('#schedule tbody').innerHTML = schedule.days.map((d) =>
+      '<tr data-day="' + d.day + '"><td>' + days[d.day] + '</td>' +
+      '<td><input name="enabled" type="checkbox"' + (d.enabled ? ' checked' : '') + '></td>' +
+      '<td><input name="start" type="time" value="' + d.start.slice(0, 5) + '"></td>' +
+      '<td><input name="end" type="time" value="' + d.end.slice(0, 5) + '"></td>' +
+      '<td><input name="interval" type="number" min="1" value="' + d.interval / 60 + '"></td>' +
+      '<td><input name="duration" type="number" min="1" value="' + d.duration / 60 + '"></td></tr>').join('');
+    scheduleSaved = readSchedule();
+  });
+}
+
+$('#desk').addEventListener('submit', (e) => {
+  e.preventDefault();
+  const desk = {};
+  new FormData(e.target).forEach((v, k) => desk[k] = Number(v));
+  request('PUT', '/api/desk', desk).then(() => show('Saved'), (err) => show(err.message));
+});
+
+$('#schedule').addEventListener('submit', (e) => {
+  e.preventDefault();
+  const current = readSchedule();
+  const changed = current.filter((d, i) => d !== scheduleSaved[i]).map((d) => JSON.parse(d));
+  request('PUT', '/api/schedule', {days: changed}).then(() => { scheduleSaved = current; show('Saved'); }, (err) => show(err.message));
+});
+
+loadDesk().then(loadSchedule).catch((e) => show(e.message));